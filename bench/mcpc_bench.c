@@ -0,0 +1,1160 @@
+// Load generator for mcpc: spawns the server, replays a JSONL corpus of
+// requests over its stdin/stdout, a Unix socket or streamable HTTP, and
+// reports throughput, latency percentiles and the server's peak RSS as JSON.
+// POSIX only.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // pipe2, memmem
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "cJSON.h"
+#include "mcp_shm_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_DEFAULT_REQUESTS 10000
+#define BENCH_DEFAULT_TIMEOUT_MS 10000
+#define BENCH_DEFAULT_TOLERANCE 10.0
+#define BENCH_READ_SIZE 65536
+#define BENCH_UNANSWERED UINT64_MAX
+
+// Exit codes: usage errors match mcpc's own
+#define BENCH_EXIT_FAILED 1
+#define BENCH_EXIT_USAGE 2
+#define BENCH_EXIT_REGRESSION 3
+
+typedef enum bench_transport {
+    BENCH_STDIO,
+    BENCH_UNIX,
+    BENCH_SHM,
+    BENCH_HTTP
+} bench_transport;
+
+typedef struct bench_entry {
+    const char* method;  // Interned in bench.methods, for the per-method breakdown
+    size_t method_index;
+    char* body;          // The message without its id, printed unformatted
+    bool notification;   // Sent without an id: nothing comes back
+} bench_entry;
+
+typedef struct bench_options {
+    const char* corpus;
+    long requests;
+    long warmup;
+    int concurrency;
+    double rate;         // Requests per second, 0 sends as fast as the window allows
+    int timeout_ms;      // How long to wait for replies after the last request
+    bench_transport transport;
+    const char* address; // Socket path or [host:]port
+    const char* output;
+    const char* baseline;
+    double tolerance;    // Percent
+    const char* log;     // Where the server's stderr goes
+    char** command;      // Server to spawn, NULL to use a running one
+} bench_options;
+
+typedef struct bench {
+    bench_options options;
+    bench_entry* entries;
+    size_t entry_count;
+    const char** methods;
+    size_t method_count;
+    long total;           // warmup + requests
+
+    // Per ticket (the n-th message sent, id n + 1 on the wire)
+    uint64_t* sent;       // When it was sent, or was due when a rate is set
+    uint64_t* latency;    // BENCH_UNANSWERED until its reply arrives
+    bool* failed;         // The reply carried an error
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    long in_flight;
+    long next_ticket;     // HTTP connections take tickets from here
+    bool closed;          // The server went away
+    uint64_t start;
+    uint64_t last_reply;
+
+    pid_t server;
+    struct rusage usage;
+    bool has_usage;
+} bench;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static void bench_sleep_until(uint64_t due) {
+    struct timespec until = { (time_t)(due / 1000000000ull), (long)(due % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+// Stamps ticket `ticket` as sent, waiting for its slot in the schedule first
+static uint64_t bench_stamp(bench* b, long ticket) {
+    uint64_t stamp;
+    if (b->options.rate > 0) {
+        // Open loop: latency counts from when the request was due, so a
+        // stalled server is not hidden by requests that were sent late
+        stamp = b->start + (uint64_t)((double)ticket * 1e9 / b->options.rate);
+        bench_sleep_until(stamp);
+    } else {
+        stamp = bench_now_ns();
+    }
+    pthread_mutex_lock(&b->lock);
+    b->sent[ticket] = stamp;
+    pthread_mutex_unlock(&b->lock);
+    return stamp;
+}
+
+static void bench_record(bench* b, long ticket, bool failed) {
+    uint64_t now = bench_now_ns();
+    pthread_mutex_lock(&b->lock);
+    if (ticket >= 0 && ticket < b->total && b->latency[ticket] == BENCH_UNANSWERED) {
+        b->latency[ticket] = now - b->sent[ticket];
+        b->failed[ticket] = failed;
+        b->last_reply = now;
+        b->in_flight--;
+        pthread_cond_broadcast(&b->cond);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void bench_close(bench* b) {
+    pthread_mutex_lock(&b->lock);
+    b->closed = true;
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static int bench_write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+// Renders ticket `ticket` of entry `entry` into `out` (at least strlen(body) + 32 bytes)
+static size_t bench_render(const bench_entry* entry, long ticket, char* out) {
+    if (entry->notification) {
+        size_t length = strlen(entry->body);
+        memcpy(out, entry->body, length + 1);
+        return length;
+    }
+    // The body is an object with at least a method: splice the id in after '{'
+    return (size_t)sprintf(out, "{\"id\":%ld,%s", ticket + 1, entry->body + 1);
+}
+
+// Ticket of a reply, -1 if it is not one of ours; sets *failed for error replies
+static long bench_reply_ticket(const char* text, size_t length, bool* failed) {
+    cJSON* json = cJSON_ParseWithLength(text, length);
+    if (json == NULL) {
+        // Tools that printf() to stdout can leave a partial line in front of a reply
+        const char* brace = memchr(text, '{', length);
+        if (brace == NULL || brace == text) {
+            return -1;
+        }
+        json = cJSON_ParseWithLength(brace, length - (size_t)(brace - text));
+        if (json == NULL) {
+            return -1;
+        }
+    }
+    const cJSON* id = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, "id") : NULL;
+    long ticket = cJSON_IsNumber(id) ? (long)id->valuedouble - 1 : -1;
+    *failed = cJSON_GetObjectItemCaseSensitive(json, "error") != NULL;
+    cJSON_Delete(json);
+    return ticket;
+}
+
+// --- stdio and Unix sockets: one stream, up to `concurrency` requests in flight ---
+
+typedef struct bench_stream {
+    bench* b;
+    int in;   // Replies, one JSON message per line
+    int out;  // Requests
+} bench_stream;
+
+static void* bench_stream_reader(void* arg) {
+    bench_stream* stream = (bench_stream*)arg;
+    size_t capacity = BENCH_READ_SIZE;
+    size_t length = 0;
+    char* buffer = (char*)malloc(capacity);
+    while (buffer != NULL) {
+        if (length == capacity) {
+            char* grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL) {
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(stream->in, buffer + length, capacity - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        size_t scanned = length;
+        length += (size_t)n;
+        size_t line_start = 0;
+        for (char* newline; (newline = (char*)memchr(buffer + scanned, '\n', length - scanned)) != NULL;) {
+            size_t line_end = (size_t)(newline - buffer);
+            bool failed = false;
+            long ticket = bench_reply_ticket(buffer + line_start, line_end - line_start, &failed);
+            if (ticket >= 0) {
+                bench_record(stream->b, ticket, failed);
+            }
+            line_start = scanned = line_end + 1;
+        }
+        memmove(buffer, buffer + line_start, length - line_start);
+        length -= line_start;
+    }
+    free(buffer);
+    bench_close(stream->b);
+    return NULL;
+}
+
+// Sends every ticket through `send`, keeping up to `concurrency` requests in flight
+static int bench_send_all(bench* b, int (*send)(void* context, char* message, size_t length), void* context) {
+    size_t longest = 0;
+    for (size_t i = 0; i < b->entry_count; ++i) {
+        size_t length = strlen(b->entries[i].body);
+        longest = length > longest ? length : longest;
+    }
+    char* message = (char*)malloc(longest + 32);
+    int ret = message != NULL ? 0 : -1;
+    b->start = bench_now_ns();
+    for (long ticket = 0; ret == 0 && ticket < b->total; ++ticket) {
+        const bench_entry* entry = &b->entries[ticket % (long)b->entry_count];
+        pthread_mutex_lock(&b->lock);
+        while (b->in_flight >= b->options.concurrency && !b->closed) {
+            pthread_cond_wait(&b->cond, &b->lock);
+        }
+        bool closed = b->closed;
+        if (!entry->notification) {
+            b->in_flight++;
+        }
+        pthread_mutex_unlock(&b->lock);
+        if (closed) {
+            fprintf(stderr, "The server closed the connection after %ld requests\n", ticket);
+            ret = -1;
+            break;
+        }
+        bench_stamp(b, ticket);
+        size_t length = bench_render(entry, ticket, message);
+        if (send(context, message, length) != 0) {
+            fprintf(stderr, "Failed to send request %ld: %s\n", ticket, strerror(errno));
+            ret = -1;
+        }
+    }
+    free(message);
+    return ret;
+}
+
+// Waits for the stragglers, up to --timeout-ms
+static void bench_wait_replies(bench* b) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += b->options.timeout_ms / 1000;
+    deadline.tv_nsec += (long)(b->options.timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&b->lock);
+    while (b->in_flight > 0 && !b->closed) {
+        if (pthread_cond_timedwait(&b->cond, &b->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Writes one line; the buffer has room for the newline
+static int bench_stream_send(void* context, char* message, size_t length) {
+    bench_stream* stream = (bench_stream*)context;
+    message[length++] = '\n';
+    return bench_write_all(stream->out, message, length);
+}
+
+static int bench_run_stream(bench* b, int in, int out) {
+    bench_stream stream = { b, in, out };
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, bench_stream_reader, &stream) != 0) {
+        fprintf(stderr, "Failed to start the reply reader\n");
+        return -1;
+    }
+    int ret = bench_send_all(b, bench_stream_send, &stream);
+    // Let the server see end of input once the replies are in
+    bench_wait_replies(b);
+    if (in == out) {
+        shutdown(out, SHUT_RDWR);
+    } else {
+        close(out);
+    }
+    pthread_join(reader, NULL);
+    return ret;
+}
+
+#ifdef __linux__
+
+// --- shared memory: the rings of mcpc --shm, parsed in place ---
+
+typedef struct bench_shm {
+    bench* b;
+    mcp_shm_channel channel;
+    volatile long done;  // Set once the sender stopped waiting for replies
+} bench_shm;
+
+// Records every reply in the ring; returns -1 on a corrupt ring
+static int bench_shm_drain(bench_shm* shm, char** partial, size_t* partial_length, size_t* partial_capacity) {
+    mcp_shm_channel* channel = &shm->channel;
+    mcp_shm_ring* ring = &channel->header->replies;
+    const char* bytes;
+    size_t length;
+    uint32_t kind;
+    size_t consumed;
+    int ret;
+    while ((ret = mcp_shm_ring_peek(ring, channel->replies, channel->ring_size, &bytes, &length, &kind, &consumed)) > 0) {
+        if (kind == MCP_SHM_RECORD_PART || *partial_length > 0) {
+            if (*partial_length + length > *partial_capacity) {
+                size_t capacity = (*partial_length + length) * 2;
+                char* grown = (char*)realloc(*partial, capacity);
+                if (grown == NULL) {
+                    return -1;
+                }
+                *partial = grown;
+                *partial_capacity = capacity;
+            }
+            memcpy(*partial + *partial_length, bytes, length);
+            *partial_length += length;
+        }
+        if (kind != MCP_SHM_RECORD_PART) {
+            bool failed = false;
+            long ticket = *partial_length > 0 ? bench_reply_ticket(*partial, *partial_length, &failed)
+                                              : bench_reply_ticket(bytes, length, &failed);
+            *partial_length = 0;
+            if (ticket >= 0) {
+                bench_record(shm->b, ticket, failed);
+            }
+        }
+        mcp_shm_ring_release(ring, consumed);
+        mcp_shm_wake(&ring->producer_waiting, channel->server_wake);
+    }
+    return ret;
+}
+
+// The only thread sleeping on client_wake, so no wake-up meant for it goes elsewhere
+static void* bench_shm_reader(void* arg) {
+    bench_shm* shm = (bench_shm*)arg;
+    mcp_shm_ring* ring = &shm->channel.header->replies;
+    char* partial = NULL;
+    size_t partial_length = 0;
+    size_t partial_capacity = 0;
+    while (!__atomic_load_n(&shm->done, __ATOMIC_SEQ_CST)) {
+        if (bench_shm_drain(shm, &partial, &partial_length, &partial_capacity) < 0) {
+            fprintf(stderr, "Failed to read the replies\n");
+            break;
+        }
+        mcp_shm_sleep_on(&ring->consumer_waiting);
+        if (!mcp_shm_ring_empty(ring)) {
+            continue;
+        }
+        if (mcp_shm_wait(&shm->channel, 100) < 0) {
+            break;
+        }
+    }
+    free(partial);
+    bench_close(shm->b);
+    return NULL;
+}
+
+// Copies one message in; a full ring is waited out by polling, the reader owns the eventfd
+static int bench_shm_send(void* context, char* message, size_t length) {
+    bench_shm* shm = (bench_shm*)context;
+    mcp_shm_channel* channel = &shm->channel;
+    mcp_shm_ring* ring = &channel->header->requests;
+    size_t sent = 0;
+    while (!mcp_shm_ring_send(ring, channel->requests, channel->ring_size, message, length, &sent)) {
+        mcp_shm_wake(&ring->consumer_waiting, channel->server_wake);
+        usleep(50);
+    }
+    mcp_shm_wake(&ring->consumer_waiting, channel->server_wake);
+    return 0;
+}
+
+static int bench_run_shm(bench* b) {
+    bench_shm shm;
+    memset(&shm, 0, sizeof(shm));
+    shm.b = b;
+    // Retry while a spawned server starts up
+    uint64_t give_up = bench_now_ns() + (uint64_t)b->options.timeout_ms * 1000000ull;
+    while (mcp_shm_connect(b->options.address, &shm.channel) != 0) {
+        if (bench_now_ns() > give_up || (b->server > 0 && waitpid(b->server, NULL, WNOHANG) != 0)) {
+            fprintf(stderr, "Failed to connect to %s: %s\n", b->options.address, strerror(errno));
+            return -1;
+        }
+        usleep(10000);
+    }
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, bench_shm_reader, &shm) != 0) {
+        fprintf(stderr, "Failed to start the reply reader\n");
+        mcp_shm_channel_close(&shm.channel);
+        return -1;
+    }
+    int ret = bench_send_all(b, bench_shm_send, &shm);
+    bench_wait_replies(b);
+    __atomic_store_n(&shm.done, 1, __ATOMIC_SEQ_CST);
+    pthread_join(reader, NULL);
+    mcp_shm_channel_close(&shm.channel);
+    return ret;
+}
+
+#else /* !__linux__ */
+
+static int bench_run_shm(bench* b) {
+    (void)b;
+    fprintf(stderr, "The shared-memory transport is only available on Linux\n");
+    return -1;
+}
+
+#endif /* __linux__ */
+
+// --- streamable HTTP: `concurrency` keep-alive connections, one request each ---
+
+typedef struct bench_http_conn {
+    bench* b;
+    int fd;
+    char session[128];  // Mcp-Session-Id from the initialize reply
+    char* buffer;
+    size_t capacity;
+    size_t length;
+    const char* host;
+    int ret;
+} bench_http_conn;
+
+static int bench_http_connect(const char* address, const char** host_out) {
+    static char host[256];
+    const char* colon = strrchr(address, ':');
+    const char* port = colon != NULL ? colon + 1 : address;
+    size_t host_length = colon != NULL ? (size_t)(colon - address) : 0;
+    if (host_length == 0) {
+        snprintf(host, sizeof(host), "127.0.0.1");
+    } else if (address[0] == '[' && host_length >= 2 && address[host_length - 1] == ']') {
+        snprintf(host, sizeof(host), "%.*s", (int)(host_length - 2), address + 1);
+    } else {
+        snprintf(host, sizeof(host), "%.*s", (int)host_length, address);
+    }
+    *host_out = host;
+
+    struct addrinfo hints;
+    struct addrinfo* found = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &found) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* ai = found; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(found);
+    if (fd >= 0) {
+        // Requests wait for their reply, so Nagle would only add delayed-ACK stalls
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+// POSTs `body` and reads the reply; returns the HTTP status, -1 on failure.
+// *reply points into the connection buffer until the next exchange.
+static int bench_http_exchange(bench_http_conn* conn, const char* body, size_t body_length,
+                               const char** reply, size_t* reply_length) {
+    char header[512];
+    int header_length = snprintf(header, sizeof(header),
+                                 "POST /mcp HTTP/1.1\r\n"
+                                 "Host: %s\r\n"
+                                 "Content-Type: application/json\r\n"
+                                 "Accept: application/json\r\n"
+                                 "Content-Length: %zu\r\n"
+                                 "%s%s%s"
+                                 "\r\n",
+                                 conn->host, body_length,
+                                 conn->session[0] ? "Mcp-Session-Id: " : "", conn->session, conn->session[0] ? "\r\n" : "");
+    if (header_length < 0 || (size_t)header_length >= sizeof(header)) {
+        return -1;
+    }
+    // One segment per request, like a real client; a short write finishes piecewise
+    struct iovec parts[2] = { { header, (size_t)header_length }, { (void*)body, body_length } };
+    ssize_t written = writev(conn->fd, parts, 2);
+    size_t head_written = written < 0 ? 0 : (size_t)written < parts[0].iov_len ? (size_t)written : parts[0].iov_len;
+    size_t body_written = written < 0 ? 0 : (size_t)written - head_written;
+    if (bench_write_all(conn->fd, header + head_written, (size_t)header_length - head_written) != 0 ||
+        bench_write_all(conn->fd, body + body_written, body_length - body_written) != 0) {
+        return -1;
+    }
+
+    conn->length = 0;
+    size_t head_end = 0;
+    size_t content_length = 0;
+    int status = -1;
+    for (;;) {
+        if (head_end != 0 && conn->length >= head_end + content_length) {
+            break;
+        }
+        if (conn->length == conn->capacity) {
+            char* grown = (char*)realloc(conn->buffer, conn->capacity * 2);
+            if (grown == NULL) {
+                return -1;
+            }
+            conn->buffer = grown;
+            conn->capacity *= 2;
+        }
+        ssize_t n = read(conn->fd, conn->buffer + conn->length, conn->capacity - conn->length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        conn->length += (size_t)n;
+        if (head_end != 0) {
+            continue;
+        }
+        char* end = memmem(conn->buffer, conn->length, "\r\n\r\n", 4);
+        if (end == NULL) {
+            continue;
+        }
+        head_end = (size_t)(end - conn->buffer) + 4;
+        *end = '\0';
+        if (sscanf(conn->buffer, "HTTP/1.1 %d", &status) != 1) {
+            return -1;
+        }
+        for (char* line = strstr(conn->buffer, "\r\n"); line != NULL; line = strstr(line, "\r\n")) {
+            line += 2;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                content_length = (size_t)strtoul(line + 15, NULL, 10);
+            } else if (strncasecmp(line, "Mcp-Session-Id:", 15) == 0) {
+                sscanf(line + 15, " %127[^\r\n ]", conn->session);
+            }
+        }
+    }
+    *reply = conn->buffer + head_end;
+    *reply_length = content_length;
+    return status;
+}
+
+// Opens the session with the corpus' first initialize request, unmeasured
+static int bench_http_handshake(bench_http_conn* conn) {
+    bench* b = conn->b;
+    char* message = NULL;
+    for (size_t i = 0; i < b->entry_count; ++i) {
+        const bench_entry* entry = &b->entries[i];
+        bool initialize = strcmp(entry->method, "initialize") == 0;
+        if (!initialize && strcmp(entry->method, "notifications/initialized") != 0) {
+            continue;
+        }
+        if (initialize && conn->session[0]) {
+            continue;
+        }
+        free(message);
+        message = (char*)malloc(strlen(entry->body) + 32);
+        if (message == NULL) {
+            return -1;
+        }
+        size_t length = bench_render(entry, -1, message);
+        const char* reply;
+        size_t reply_length;
+        if (bench_http_exchange(conn, message, length, &reply, &reply_length) < 0) {
+            free(message);
+            return -1;
+        }
+    }
+    free(message);
+    return 0;
+}
+
+static void* bench_http_worker(void* arg) {
+    bench_http_conn* conn = (bench_http_conn*)arg;
+    bench* b = conn->b;
+    char* message = NULL;
+    size_t message_capacity = 0;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        long ticket = b->closed ? b->total : b->next_ticket++;
+        pthread_mutex_unlock(&b->lock);
+        if (ticket >= b->total) {
+            break;
+        }
+        const bench_entry* entry = &b->entries[ticket % (long)b->entry_count];
+        size_t needed = strlen(entry->body) + 32;
+        if (needed > message_capacity) {
+            free(message);
+            message = (char*)malloc(needed);
+            message_capacity = message != NULL ? needed : 0;
+            if (message == NULL) {
+                conn->ret = -1;
+                break;
+            }
+        }
+        size_t length = bench_render(entry, ticket, message);
+        if (!entry->notification) {
+            pthread_mutex_lock(&b->lock);
+            b->in_flight++;
+            pthread_mutex_unlock(&b->lock);
+        }
+        bench_stamp(b, ticket);
+        const char* reply;
+        size_t reply_length;
+        int status = bench_http_exchange(conn, message, length, &reply, &reply_length);
+        if (status < 0) {
+            fprintf(stderr, "HTTP exchange failed for request %ld\n", ticket);
+            conn->ret = -1;
+            bench_close(b);
+            break;
+        }
+        if (!entry->notification) {
+            bool failed = true;
+            long answered = status == 200 ? bench_reply_ticket(reply, reply_length, &failed) : -1;
+            bench_record(b, ticket, status != 200 || answered != ticket || failed);
+        }
+    }
+    free(message);
+    return NULL;
+}
+
+static int bench_run_http(bench* b) {
+    int count = b->options.concurrency;
+    bench_http_conn* conns = (bench_http_conn*)calloc((size_t)count, sizeof(bench_http_conn));
+    pthread_t* threads = (pthread_t*)calloc((size_t)count, sizeof(pthread_t));
+    int ret = conns != NULL && threads != NULL ? 0 : -1;
+    int opened = 0;
+    for (; ret == 0 && opened < count; ++opened) {
+        bench_http_conn* conn = &conns[opened];
+        conn->b = b;
+        conn->capacity = BENCH_READ_SIZE;
+        conn->buffer = (char*)malloc(conn->capacity);
+        conn->fd = bench_http_connect(b->options.address, &conn->host);
+        if (conn->buffer == NULL || conn->fd < 0 || bench_http_handshake(conn) != 0) {
+            fprintf(stderr, "Failed to open HTTP connection %d to %s\n", opened, b->options.address);
+            ret = -1;
+        }
+    }
+    int started = 0;
+    b->start = bench_now_ns();
+    for (; ret == 0 && started < count; ++started) {
+        if (pthread_create(&threads[started], NULL, bench_http_worker, &conns[started]) != 0) {
+            fprintf(stderr, "Failed to start HTTP connection thread\n");
+            bench_close(b);
+            ret = -1;
+        }
+    }
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        ret = conns[i].ret != 0 ? -1 : ret;
+    }
+    for (int i = 0; conns != NULL && i < opened; ++i) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+        free(conns[i].buffer);
+    }
+    free(conns);
+    free(threads);
+    return ret;
+}
+
+// --- server process ---
+
+static int bench_spawn(bench* b, int* to_server, int* from_server) {
+    int in[2] = { -1, -1 };
+    int out[2] = { -1, -1 };
+    bool stdio = b->options.transport == BENCH_STDIO;
+    if (stdio && (pipe2(in, O_CLOEXEC) != 0 || pipe2(out, O_CLOEXEC) != 0)) {
+        fprintf(stderr, "Failed to create pipes: %s\n", strerror(errno));
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        int log = open(b->options.log, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (log >= 0) {
+            dup2(log, STDERR_FILENO);
+        }
+        if (stdio) {
+            dup2(in[0], STDIN_FILENO);
+            dup2(out[1], STDOUT_FILENO);
+        }
+        execvp(b->options.command[0], b->options.command);
+        fprintf(stderr, "Failed to run %s: %s\n", b->options.command[0], strerror(errno));
+        _exit(127);
+    }
+    b->server = pid;
+    if (stdio) {
+        close(in[0]);
+        close(out[1]);
+        *to_server = in[1];
+        *from_server = out[0];
+    }
+    return 0;
+}
+
+// Connects to the socket transport, retrying while a spawned server starts up
+static int bench_connect(bench* b) {
+    uint64_t give_up = bench_now_ns() + (uint64_t)b->options.timeout_ms * 1000000ull;
+    for (;;) {
+        int fd = -1;
+        if (b->options.transport == BENCH_UNIX) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", b->options.address);
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        } else {
+            const char* host;
+            fd = bench_http_connect(b->options.address, &host);
+        }
+        if (fd >= 0 || bench_now_ns() > give_up || (b->server > 0 && waitpid(b->server, NULL, WNOHANG) != 0)) {
+            return fd;
+        }
+        usleep(10000);
+    }
+}
+
+// Stops the server and collects its resource usage
+static void bench_reap(bench* b) {
+    if (b->server <= 0) {
+        return;
+    }
+    if (b->options.transport != BENCH_STDIO) {
+        kill(b->server, SIGTERM);
+    }
+    int status;
+    while (wait4(b->server, &status, 0, &b->usage) < 0) {
+        if (errno != EINTR) {
+            return;
+        }
+    }
+    b->has_usage = true;
+}
+
+// --- corpus and report ---
+
+static size_t bench_intern(bench* b, const char* method) {
+    for (size_t i = 0; i < b->method_count; ++i) {
+        if (strcmp(b->methods[i], method) == 0) {
+            return i;
+        }
+    }
+    b->methods[b->method_count] = strdup(method);
+    return b->method_count++;
+}
+
+static int bench_load(bench* b) {
+    FILE* file = fopen(b->options.corpus, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open corpus %s: %s\n", b->options.corpus, strerror(errno));
+        return -1;
+    }
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t allocated = 0;
+    long number = 0;
+    int ret = 0;
+    for (ssize_t length; ret == 0 && (length = getline(&line, &capacity, file)) >= 0;) {
+        ++number;
+        size_t start = strspn(line, " \t\r\n");
+        if (line[start] == '\0') {
+            continue;
+        }
+        cJSON* json = cJSON_Parse(line);
+        const cJSON* method = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, "method") : NULL;
+        if (!cJSON_IsString(method)) {
+            fprintf(stderr, "%s:%ld: expected a JSON-RPC request object\n", b->options.corpus, number);
+            cJSON_Delete(json);
+            ret = -1;
+            break;
+        }
+        if (b->entry_count == allocated) {
+            allocated = allocated != 0 ? allocated * 2 : 16;
+            bench_entry* entries = (bench_entry*)realloc(b->entries, allocated * sizeof(bench_entry));
+            const char** methods = (const char**)realloc(b->methods, allocated * sizeof(const char*));
+            b->entries = entries != NULL ? entries : b->entries;
+            b->methods = methods != NULL ? methods : b->methods;
+            if (entries == NULL || methods == NULL) {
+                cJSON_Delete(json);
+                ret = -1;
+                break;
+            }
+        }
+        bench_entry* entry = &b->entries[b->entry_count++];
+        entry->notification = cJSON_GetObjectItemCaseSensitive(json, "id") == NULL;
+        entry->method_index = bench_intern(b, method->valuestring);
+        entry->method = b->methods[entry->method_index];
+        cJSON_Delete(cJSON_DetachItemFromObjectCaseSensitive(json, "id"));
+        entry->body = cJSON_PrintUnformatted(json);
+        cJSON_Delete(json);
+    }
+    free(line);
+    fclose(file);
+    if (ret == 0 && b->entry_count == 0) {
+        fprintf(stderr, "Corpus %s has no requests\n", b->options.corpus);
+        ret = -1;
+    }
+    return ret;
+}
+
+static int bench_compare(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest-rank percentile of sorted `values`
+static uint64_t bench_percentile(const uint64_t* values, size_t count, double p) {
+    size_t rank = (size_t)ceil(p * (double)count);
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+// Summarizes the answered tickets from `warmup` on whose method is `method`
+// (SIZE_MAX for all); returns how many there were
+static size_t bench_summarize(const bench* b, size_t method, uint64_t* scratch, cJSON* out) {
+    size_t count = 0;
+    size_t errors = 0;
+    uint64_t sum = 0;
+    for (long ticket = b->options.warmup; ticket < b->total; ++ticket) {
+        const bench_entry* entry = &b->entries[ticket % (long)b->entry_count];
+        if (entry->notification || b->latency[ticket] == BENCH_UNANSWERED ||
+            (method != SIZE_MAX && entry->method_index != method)) {
+            continue;
+        }
+        scratch[count++] = b->latency[ticket];
+        sum += b->latency[ticket];
+        errors += b->failed[ticket];
+    }
+    cJSON_AddNumberToObject(out, "count", (double)count);
+    cJSON_AddNumberToObject(out, "errors", (double)errors);
+    if (count == 0) {
+        return 0;
+    }
+    qsort(scratch, count, sizeof(uint64_t), bench_compare);
+    cJSON* latency = cJSON_AddObjectToObject(out, "latency_ns");
+    cJSON_AddNumberToObject(latency, "mean", (double)(sum / count));
+    cJSON_AddNumberToObject(latency, "p50", (double)bench_percentile(scratch, count, 0.50));
+    cJSON_AddNumberToObject(latency, "p90", (double)bench_percentile(scratch, count, 0.90));
+    cJSON_AddNumberToObject(latency, "p99", (double)bench_percentile(scratch, count, 0.99));
+    cJSON_AddNumberToObject(latency, "p999", (double)bench_percentile(scratch, count, 0.999));
+    cJSON_AddNumberToObject(latency, "max", (double)scratch[count - 1]);
+    return count;
+}
+
+static double bench_number(const cJSON* json, const char* path0, const char* path1) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(json, path0);
+    if (path1 != NULL) {
+        item = cJSON_GetObjectItemCaseSensitive(item, path1);
+    }
+    return cJSON_IsNumber(item) ? item->valuedouble : -1;
+}
+
+// Flags throughput drops and p99 rises beyond the tolerance against a saved report
+static int bench_check_baseline(const bench* b, cJSON* report) {
+    FILE* file = fopen(b->options.baseline, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open baseline %s: %s\n", b->options.baseline, strerror(errno));
+        return -1;
+    }
+    char* text = NULL;
+    size_t capacity = 0;
+    ssize_t length = getdelim(&text, &capacity, '\0', file);
+    fclose(file);
+    cJSON* baseline = length > 0 ? cJSON_ParseWithLength(text, (size_t)length) : NULL;
+    free(text);
+    if (baseline == NULL) {
+        fprintf(stderr, "Baseline %s is not a report\n", b->options.baseline);
+        return -1;
+    }
+
+    double allowance = b->options.tolerance / 100.0;
+    cJSON* regressions = cJSON_AddArrayToObject(report, "regressions");
+    double then = bench_number(baseline, "requests_per_sec", NULL);
+    double now = bench_number(report, "requests_per_sec", NULL);
+    char message[256];
+    if (then > 0 && now < then * (1.0 - allowance)) {
+        snprintf(message, sizeof(message), "requests_per_sec %.0f < %.0f", now, then);
+        cJSON_AddItemToArray(regressions, cJSON_CreateString(message));
+    }
+    static const char* const percentiles[] = { "p50", "p99", "p999" };
+    const cJSON* then_latency = cJSON_GetObjectItemCaseSensitive(baseline, "latency_ns");
+    const cJSON* now_latency = cJSON_GetObjectItemCaseSensitive(report, "latency_ns");
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i) {
+        then = bench_number(then_latency, percentiles[i], NULL);
+        now = bench_number(now_latency, percentiles[i], NULL);
+        if (then > 0 && now > then * (1.0 + allowance)) {
+            snprintf(message, sizeof(message), "latency_ns.%s %.0f > %.0f", percentiles[i], now, then);
+            cJSON_AddItemToArray(regressions, cJSON_CreateString(message));
+        }
+    }
+    cJSON_Delete(baseline);
+    return cJSON_GetArraySize(regressions) > 0 ? 1 : 0;
+}
+
+static cJSON* bench_report(const bench* b) {
+    static const char* const transports[] = { "stdio", "unix", "shm", "http" };
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddStringToObject(report, "transport", transports[b->options.transport]);
+    cJSON_AddStringToObject(report, "corpus", b->options.corpus);
+    cJSON_AddNumberToObject(report, "concurrency", b->options.concurrency);
+    cJSON_AddNumberToObject(report, "rate", b->options.rate);
+    cJSON_AddNumberToObject(report, "warmup", (double)b->options.warmup);
+
+    long sent = 0;
+    long notifications = 0;
+    long unanswered = 0;
+    for (long ticket = b->options.warmup; ticket < b->total; ++ticket) {
+        const bench_entry* entry = &b->entries[ticket % (long)b->entry_count];
+        if (b->sent[ticket] == 0) {
+            continue;
+        }
+        sent++;
+        notifications += entry->notification;
+        unanswered += !entry->notification && b->latency[ticket] == BENCH_UNANSWERED;
+    }
+    cJSON_AddNumberToObject(report, "sent", (double)sent);
+    cJSON_AddNumberToObject(report, "notifications", (double)notifications);
+    cJSON_AddNumberToObject(report, "unanswered", (double)unanswered);
+
+    uint64_t* scratch = (uint64_t*)malloc((size_t)b->total * sizeof(uint64_t));
+    if (scratch == NULL) {
+        return report;
+    }
+    // Throughput over the measured window: first measured send to last reply
+    size_t answered = bench_summarize(b, SIZE_MAX, scratch, report);
+    uint64_t window_start = b->options.warmup < b->total && b->sent[b->options.warmup] != 0 ? b->sent[b->options.warmup] : b->start;
+    double seconds = b->last_reply > window_start ? (double)(b->last_reply - window_start) / 1e9 : 0;
+    cJSON_AddNumberToObject(report, "duration_s", seconds);
+    cJSON_AddNumberToObject(report, "requests_per_sec", seconds > 0 ? (double)answered / seconds : 0);
+
+    cJSON* methods = cJSON_AddObjectToObject(report, "methods");
+    for (size_t i = 0; i < b->method_count; ++i) {
+        cJSON* method = cJSON_CreateObject();
+        if (bench_summarize(b, i, scratch, method) > 0) {
+            cJSON_AddItemToObject(methods, b->methods[i], method);
+        } else {
+            cJSON_Delete(method);
+        }
+    }
+    free(scratch);
+
+    if (b->has_usage) {
+        // Linux reports ru_maxrss in kilobytes
+        cJSON_AddNumberToObject(report, "peak_rss_kb", (double)b->usage.ru_maxrss);
+    } else {
+        cJSON_AddNullToObject(report, "peak_rss_kb");
+    }
+    return report;
+}
+
+static int usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [options] [-- server command...]\n"
+            "  --corpus file          JSONL requests, replayed in a loop (default bench/corpus.jsonl)\n"
+            "  --requests n           messages to measure (default %d)\n"
+            "  --warmup n             messages sent first and left out of the report (default 0)\n"
+            "  --concurrency n        requests in flight; HTTP opens one connection each (default 1)\n"
+            "  --rate r               requests per second, open loop (default 0: as fast as replies come)\n"
+            "  --unix path            talk to the server's Unix socket instead of its stdin/stdout\n"
+            "  --shm path             talk through the shared-memory rings of mcpc --shm path\n"
+            "  --http [host:]port     talk streamable HTTP instead\n"
+            "  --timeout-ms n         wait for replies and for the server to listen (default %d)\n"
+            "  --output file          write the JSON report there instead of stdout\n"
+            "  --baseline file        compare with a saved report, exit %d on a regression\n"
+            "  --tolerance percent    allowed drop in throughput or rise in latency (default %.0f)\n"
+            "  --log file             the server's stderr (default /dev/null)\n"
+            "the server command is required for stdio; for sockets it is started and\n"
+            "stopped around the run, or omitted to load a server that is already up\n",
+            program, BENCH_DEFAULT_REQUESTS, BENCH_DEFAULT_TIMEOUT_MS, BENCH_EXIT_REGRESSION, BENCH_DEFAULT_TOLERANCE);
+    return BENCH_EXIT_USAGE;
+}
+
+static int bench_parse_options(bench_options* options, int argc, char** argv) {
+    options->corpus = "bench/corpus.jsonl";
+    options->requests = BENCH_DEFAULT_REQUESTS;
+    options->warmup = 0;
+    options->concurrency = 1;
+    options->rate = 0;
+    options->timeout_ms = BENCH_DEFAULT_TIMEOUT_MS;
+    options->transport = BENCH_STDIO;
+    options->tolerance = BENCH_DEFAULT_TOLERANCE;
+    options->log = "/dev/null";
+    for (int i = 1; i < argc; ++i) {
+        const char* flag = argv[i];
+        if (strcmp(flag, "--") == 0) {
+            options->command = i + 1 < argc ? argv + i + 1 : NULL;
+            break;
+        }
+        if (i + 1 >= argc) {
+            return -1;
+        }
+        const char* value = argv[++i];
+        if (strcmp(flag, "--corpus") == 0) {
+            options->corpus = value;
+        } else if (strcmp(flag, "--requests") == 0) {
+            options->requests = atol(value);
+        } else if (strcmp(flag, "--warmup") == 0) {
+            options->warmup = atol(value);
+        } else if (strcmp(flag, "--concurrency") == 0) {
+            options->concurrency = atoi(value);
+        } else if (strcmp(flag, "--rate") == 0) {
+            options->rate = atof(value);
+        } else if (strcmp(flag, "--unix") == 0) {
+            options->transport = BENCH_UNIX;
+            options->address = value;
+        } else if (strcmp(flag, "--shm") == 0) {
+            options->transport = BENCH_SHM;
+            options->address = value;
+        } else if (strcmp(flag, "--http") == 0) {
+            options->transport = BENCH_HTTP;
+            options->address = value;
+        } else if (strcmp(flag, "--timeout-ms") == 0) {
+            options->timeout_ms = atoi(value);
+        } else if (strcmp(flag, "--output") == 0) {
+            options->output = value;
+        } else if (strcmp(flag, "--baseline") == 0) {
+            options->baseline = value;
+        } else if (strcmp(flag, "--tolerance") == 0) {
+            options->tolerance = atof(value);
+        } else if (strcmp(flag, "--log") == 0) {
+            options->log = value;
+        } else {
+            return -1;
+        }
+    }
+    if (options->requests <= 0 || options->warmup < 0 || options->concurrency <= 0 || options->rate < 0 ||
+        options->timeout_ms < 0 || (options->transport == BENCH_STDIO && options->command == NULL)) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bench b;
+    memset(&b, 0, sizeof(b));
+    if (bench_parse_options(&b.options, argc, argv) != 0) {
+        return usage(argv[0]);
+    }
+    if (bench_load(&b) != 0) {
+        return BENCH_EXIT_FAILED;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    b.total = b.options.warmup + b.options.requests;
+    b.sent = (uint64_t*)calloc((size_t)b.total, sizeof(uint64_t));
+    b.latency = (uint64_t*)malloc((size_t)b.total * sizeof(uint64_t));
+    b.failed = (bool*)calloc((size_t)b.total, sizeof(bool));
+    if (b.sent == NULL || b.latency == NULL || b.failed == NULL) {
+        fprintf(stderr, "Out of memory for %ld requests\n", b.total);
+        return BENCH_EXIT_FAILED;
+    }
+    for (long i = 0; i < b.total; ++i) {
+        b.latency[i] = BENCH_UNANSWERED;
+    }
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    int to_server = -1;
+    int from_server = -1;
+    if (b.options.command != NULL && bench_spawn(&b, &to_server, &from_server) != 0) {
+        return BENCH_EXIT_FAILED;
+    }
+    int ret;
+    if (b.options.transport == BENCH_STDIO) {
+        ret = bench_run_stream(&b, from_server, to_server);
+        close(from_server);
+    } else if (b.options.transport == BENCH_UNIX) {
+        int fd = bench_connect(&b);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to connect to %s\n", b.options.address);
+            ret = -1;
+        } else {
+            ret = bench_run_stream(&b, fd, fd);
+            close(fd);
+        }
+    } else if (b.options.transport == BENCH_SHM) {
+        ret = bench_run_shm(&b);
+    } else {
+        // Wait until the spawned server listens; connections are opened per worker
+        int fd = bench_connect(&b);
+        if (fd >= 0) {
+            close(fd);
+        }
+        ret = bench_run_http(&b);
+    }
+    bench_reap(&b);
+
+    cJSON* report = bench_report(&b);
+    int regression = b.options.baseline != NULL ? bench_check_baseline(&b, report) : 0;
+    char* text = cJSON_Print(report);
+    cJSON_Delete(report);
+    FILE* out = b.options.output != NULL ? fopen(b.options.output, "w") : stdout;
+    if (out == NULL || text == NULL) {
+        fprintf(stderr, "Failed to write the report to %s\n", b.options.output);
+        ret = -1;
+    } else {
+        fprintf(out, "%s\n", text);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    cJSON_free(text);
+
+    if (ret != 0 || regression < 0) {
+        return BENCH_EXIT_FAILED;
+    }
+    return regression > 0 ? BENCH_EXIT_REGRESSION : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
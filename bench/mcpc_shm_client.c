@@ -0,0 +1,220 @@
+// Test client of mcpc's shared-memory transport (mcpc --shm path): sends the
+// JSON-RPC messages read from stdin, one per line, and prints every reply on
+// its own line. Once stdin ends it waits for the replies of all requests
+// (messages with an id) and exits; 1 when some never came. Linux only.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cJSON.h"
+#include "mcp_shm_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CLIENT_DEFAULT_TIMEOUT_MS 10000
+#define CLIENT_READ_SIZE 65536
+
+typedef struct client {
+    mcp_shm_channel channel;
+    char* reply;           // A reply arriving in pieces
+    size_t reply_length;
+    size_t reply_capacity;
+    long expected;         // Requests sent
+    long answered;         // Replies received for them
+} client;
+
+// Whether the message is answered: a request, or a batch holding one
+static bool client_expects_reply(const char* message, size_t length) {
+    cJSON* json = cJSON_ParseWithLength(message, length);
+    bool expected = false;
+    if (cJSON_IsArray(json)) {
+        for (const cJSON* item = json->child; item != NULL && !expected; item = item->next) {
+            expected = cJSON_GetObjectItemCaseSensitive(item, "id") != NULL;
+        }
+    } else {
+        expected = cJSON_GetObjectItemCaseSensitive(json, "id") != NULL;
+    }
+    cJSON_Delete(json);
+    return expected;
+}
+
+static void client_print(client* c, const char* message, size_t length) {
+    cJSON* json = cJSON_ParseWithLength(message, length);
+    // Notifications the server pushes have no id and answer nothing
+    if (cJSON_IsArray(json) || cJSON_GetObjectItemCaseSensitive(json, "id") != NULL) {
+        c->answered++;
+    }
+    cJSON_Delete(json);
+    fwrite(message, 1, length, stdout);
+    fputc('\n', stdout);
+}
+
+// Prints every reply in the ring; returns -1 on a corrupt ring or out of memory
+static int client_drain(client* c) {
+    mcp_shm_channel* channel = &c->channel;
+    mcp_shm_ring* ring = &channel->header->replies;
+    const char* bytes;
+    size_t length;
+    uint32_t kind;
+    size_t consumed;
+    int ret;
+    while ((ret = mcp_shm_ring_peek(ring, channel->replies, channel->ring_size, &bytes, &length, &kind, &consumed)) > 0) {
+        if (kind == MCP_SHM_RECORD_PART || c->reply_length > 0) {
+            if (c->reply_length + length > c->reply_capacity) {
+                size_t capacity = (c->reply_length + length) * 2;
+                char* grown = (char*)realloc(c->reply, capacity);
+                if (grown == NULL) {
+                    return -1;
+                }
+                c->reply = grown;
+                c->reply_capacity = capacity;
+            }
+            memcpy(c->reply + c->reply_length, bytes, length);
+            c->reply_length += length;
+            if (kind != MCP_SHM_RECORD_PART) {
+                client_print(c, c->reply, c->reply_length);
+                c->reply_length = 0;
+            }
+        } else {
+            client_print(c, bytes, length);
+        }
+        mcp_shm_ring_release(ring, consumed);
+        // The server may be holding replies back until there is room
+        mcp_shm_wake(&ring->producer_waiting, channel->server_wake);
+    }
+    fflush(stdout);
+    return ret;
+}
+
+// Sends one message, printing replies while the request ring is full
+static int client_send(client* c, const char* message, size_t length) {
+    mcp_shm_channel* channel = &c->channel;
+    mcp_shm_ring* ring = &channel->header->requests;
+    size_t sent = 0;
+    while (!mcp_shm_ring_send(ring, channel->requests, channel->ring_size, message, length, &sent)) {
+        // Full: the server wakes us once it took some, unless it did so meanwhile
+        mcp_shm_wake(&ring->consumer_waiting, channel->server_wake);
+        mcp_shm_sleep_on(&ring->producer_waiting);
+        if (client_drain(c) < 0 || mcp_shm_wait(channel, 100) < 0) {
+            return -1;
+        }
+    }
+    if (client_expects_reply(message, length)) {
+        c->expected++;
+    }
+    mcp_shm_wake(&ring->consumer_waiting, channel->server_wake);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int timeout_ms = CLIENT_DEFAULT_TIMEOUT_MS;
+    if (argc == 4 && strcmp(argv[2], "--timeout-ms") == 0) {
+        timeout_ms = atoi(argv[3]);
+    } else if (argc != 2) {
+        fprintf(stderr, "usage: %s path [--timeout-ms n]   (default %d)\n", argv[0], CLIENT_DEFAULT_TIMEOUT_MS);
+        return 2;
+    }
+    client c;
+    memset(&c, 0, sizeof(c));
+    if (mcp_shm_connect(argv[1], &c.channel) != 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    size_t capacity = CLIENT_READ_SIZE;
+    size_t length = 0;
+    char* input = (char*)malloc(capacity);
+    bool input_open = input != NULL;
+    int ret = input != NULL ? 0 : -1;
+    mcp_shm_ring* replies = &c.channel.header->replies;
+    while (ret == 0 && (input_open || c.answered < c.expected)) {
+        if (client_drain(&c) < 0) {
+            fprintf(stderr, "Failed to read the replies\n");
+            ret = -1;
+            break;
+        }
+        if (!input_open && c.answered >= c.expected) {
+            break;
+        }
+        // About to sleep: the server wakes us with its next reply, unless it sent one meanwhile
+        mcp_shm_sleep_on(&replies->consumer_waiting);
+        if (!mcp_shm_ring_empty(replies)) {
+            continue;
+        }
+        struct pollfd fds[3] = {
+            { c.channel.client_wake, POLLIN, 0 },
+            { c.channel.control, POLLIN, 0 },
+            { input_open ? STDIN_FILENO : -1, POLLIN, 0 },
+        };
+        int n = poll(fds, 3, input_open ? -1 : timeout_ms);
+        if (n < 0 && errno != EINTR) {
+            ret = -1;
+        } else if (n == 0) {
+            fprintf(stderr, "Timed out with %ld of %ld requests unanswered\n", c.expected - c.answered, c.expected);
+            ret = -1;
+        } else if (fds[1].revents != 0) {
+            client_drain(&c);
+            fprintf(stderr, "The server closed the connection\n");
+            ret = -1;
+        }
+        if (n > 0 && (fds[0].revents & POLLIN)) {
+            uint64_t count;
+            ssize_t ignored = read(c.channel.client_wake, &count, sizeof(count));
+            (void)ignored;
+        }
+        if (ret != 0 || n <= 0 || fds[2].revents == 0) {
+            continue;
+        }
+
+        if (length == capacity) {
+            char* grown = (char*)realloc(input, capacity * 2);
+            if (grown == NULL) {
+                ret = -1;
+                break;
+            }
+            input = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(STDIN_FILENO, input + length, capacity - length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            // A last message without a trailing newline still counts
+            input_open = false;
+            if (length > 0) {
+                ret = client_send(&c, input, length);
+                length = 0;
+            }
+            continue;
+        }
+        length += (size_t)got;
+        size_t start = 0;
+        for (char* newline; ret == 0 && (newline = (char*)memchr(input + start, '\n', length - start)) != NULL;) {
+            size_t end = (size_t)(newline - input);
+            if (end > start) {
+                ret = client_send(&c, input + start, end - start);
+            }
+            start = end + 1;
+        }
+        memmove(input, input + start, length - start);
+        length -= start;
+    }
+    free(input);
+    free(c.reply);
+    mcp_shm_channel_close(&c.channel);
+    return ret == 0 ? 0 : 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -18,10 +18,14 @@
 #include <sstream>
 #include <memory>
 #include <vector>
+#include <iterator>
 #include <map>
 #include <set>
 #include <string> // Added for std::string
 #include <iostream>
+#include <climits>
+#include <algorithm>
+#include <functional>
 
 using namespace clang;
 using namespace clang::ast_matchers;
@@ -53,6 +57,23 @@ static cl::opt<std::string> BridgeOutputDir(
     cl::init("."), // Default to current directory
     cl::cat(MyToolCategory));
 
+// Optional: microbenchmark of every parse_<struct> and handle_<function>
+static cl::opt<std::string> MicrobenchOutputFilename(
+    "m",
+    cl::desc("Also generate a microbenchmark program (C code, see mcp_microbench.h) into this file"),
+    cl::value_desc("filename"),
+    cl::init(""),
+    cl::cat(MyToolCategory));
+
+// Optional: source files whose tools are built as loadable modules (see mcp_module.h)
+static cl::list<std::string> ModuleBases(
+    "module",
+    cl::desc("Build the tools of this source file base (e.g. file for src/mcp_server/file.c) as a loadable module: "
+             "they are left out of the static bridge and tool list, and <base>_module.c exports them"),
+    cl::value_desc("base"),
+    cl::ZeroOrMore,
+    cl::cat(MyToolCategory));
+
 
 // --- Persistent Data Structures (AST Independent) ---
 // NEW: Store information without relying on live AST nodes
@@ -163,6 +184,11 @@ struct PersistentFunctionDefinition {
     std::vector<PersistentParameterInfo> parameters;
     std::string sourceFileBase; // Base name of the source file (e.g., "my_functions")
     std::set<std::string> requiredIncludes; // Headers needed by this function's handler/includes
+    bool isAsync = false; // EXPORT_ASYNC_AS: takes (mcp_call*, mcp_cancel_token*) ahead of `parameters`
+    bool isStream = false; // EXPORT_STREAM_AS: takes an mcp_stream* ahead of `parameters` and writes its result there
+    unsigned timeoutMs = 0; // TIMEOUT_MS annotation, 0 for none
+    bool isPure = false; // PURE annotation: results depend on the arguments only and are cached
+    bool isSingleFlight = false; // SINGLE_FLIGHT annotation, or PURE: identical concurrent calls run once
 };
 
 // --- Global Persistent Storage ---
@@ -175,6 +201,16 @@ std::set<std::string> g_processedFileBases;
 // Store all unique includes needed for the final signature file
 std::set<std::string> g_allRequiredIncludesForSig;
 
+// Index of a tool in bridge_tool_names, which lists g_persistentFunctions in map order
+unsigned toolIndex(const std::string& exportName) {
+    return (unsigned)std::distance(g_persistentFunctions.begin(), g_persistentFunctions.find(exportName));
+}
+
+// Whether the definitions of a source file base go into a loadable module (--module)
+bool isModuleBase(const std::string& baseName) {
+    return std::find(ModuleBases.begin(), ModuleBases.end(), baseName) != ModuleBases.end();
+}
+
 // --- Annotation Parser (Task 1.2 - Unchanged conceptually) ---
 std::string getAnnotationValue(const clang::Decl* D, const std::string& annotationPrefix) {
     if (!D || !D->hasAttrs()) {
@@ -201,6 +237,12 @@ std::string getExportName(const clang::NamedDecl* D) {
     std::string exportName= "";
     if(D->hasAttr<AnnotateAttr>()) {
         exportName= getAnnotationValue(D, "EXPORT_AS=");
+        if(exportName.empty()) {
+            exportName = getAnnotationValue(D, "EXPORT_ASYNC_AS=");
+        }
+        if(exportName.empty()) {
+            exportName = getAnnotationValue(D, "EXPORT_STREAM_AS=");
+        }
         if(exportName.empty()) {
             exportName = D->getNameAsString();
         }
@@ -587,6 +629,15 @@ public:
                 funcDef.exportName = exportName;
                 funcDef.originalName = FD->getNameAsString();
                 funcDef.description = getAnnotationValue(FD, "DESCRIPTION=");
+                std::string timeout = getAnnotationValue(FD, "TIMEOUT_MS=");
+                if (!timeout.empty()) {
+                    unsigned long long value = 0;
+                    if (StringRef(timeout).trim().getAsInteger(10, value) || value == 0 || value > UINT_MAX) {
+                        errs() << "Warning: Ignoring invalid TIMEOUT_MS '" << timeout << "' on " << FD->getNameAsString() << "\n";
+                    } else {
+                        funcDef.timeoutMs = (unsigned)value;
+                    }
+                }
                 funcDef.returnTypeName = qualTypeToString(FD->getReturnType());
                 errs() << "Function " << funcDef.originalName << " Return type: " << funcDef.returnTypeName << "\n";
                 funcDef.sourceFileBase = sourceFileBase;
@@ -594,7 +645,40 @@ public:
                 // Add the definition file itself to includes for signature file
                  g_allRequiredIncludesForSig.insert(funcDef.requiredIncludes.begin(), funcDef.requiredIncludes.end());
 
-                for (unsigned i = 0; i < FD->getNumParams(); ++i) {
+                // Async functions lead with the completion handle and the cancellation token,
+                // which the runtime supplies; only the remaining parameters come from the client
+                unsigned firstParam = 0;
+                funcDef.isAsync = !getAnnotationValue(FD, "EXPORT_ASYNC_AS=").empty();
+                if (funcDef.isAsync) {
+                    if (FD->getNumParams() < 2 ||
+                        !StringRef(qualTypeToString(FD->getParamDecl(0)->getType())).contains("mcp_call") ||
+                        !StringRef(qualTypeToString(FD->getParamDecl(1)->getType())).contains("mcp_cancel_token") ||
+                        funcDef.returnTypeName != "void") {
+                        errs() << "Error: Async function " << funcDef.originalName << " must be declared as void " << funcDef.originalName << "(mcp_call*, mcp_cancel_token*, ...). Skipping.\n";
+                        return;
+                    }
+                    firstParam = 2;
+                }
+                // Streaming functions lead with the stream their result is written to
+                funcDef.isStream = !getAnnotationValue(FD, "EXPORT_STREAM_AS=").empty();
+                if (funcDef.isStream) {
+                    if (FD->getNumParams() < 1 ||
+                        !StringRef(qualTypeToString(FD->getParamDecl(0)->getType())).contains("mcp_stream") ||
+                        funcDef.returnTypeName != "void") {
+                        errs() << "Error: Streaming function " << funcDef.originalName << " must be declared as void " << funcDef.originalName << "(mcp_stream*, ...). Skipping.\n";
+                        return;
+                    }
+                    firstParam = 1;
+                }
+                funcDef.isPure = !getAnnotationValue(FD, "PURE=").empty();
+                funcDef.isSingleFlight = funcDef.isPure || !getAnnotationValue(FD, "SINGLE_FLIGHT=").empty();
+                if (funcDef.isSingleFlight && (funcDef.isAsync || funcDef.isStream)) {
+                    // Their result is sent by mcp_call_complete() or the stream, after the dispatcher could store or share it
+                    errs() << "Warning: Ignoring PURE/SINGLE_FLIGHT on " << (funcDef.isAsync ? "async" : "streaming") << " function " << funcDef.originalName << "\n";
+                    funcDef.isPure = false;
+                    funcDef.isSingleFlight = false;
+                }
+                for (unsigned i = firstParam; i < FD->getNumParams(); ++i) {
                     const ParmVarDecl *PVD = FD->getParamDecl(i);
                     PersistentParameterInfo paramInfo;
                     paramInfo.name = PVD->getNameAsString();
@@ -694,14 +778,14 @@ void generateEnumParser(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Persiste
         cOS << "        }\n";
     }
     cOS << "        else {\n";
-    cOS << "            fprintf(stderr, \"Error: Unknown string value '%s' for enum " << enumDef.exportName << "\\n\", str);\n";
+    cOS << "            mcp_log_error(\"Unknown string value '%s' for enum " << enumDef.exportName << "\", str);\n";
     cOS << "            return (" << enumDef.originalName << ")0; // Default/error value\n";
     cOS << "        }\n";
     cOS << "    } else if (cJSON_IsNumber(json)) {\n";
     cOS << "        // Allow number input, assuming it corresponds to the enum value\n";
     cOS << "        return (" << enumDef.originalName << ")json->valueint;\n";
     cOS << "    } else {\n";
-    cOS << "         fprintf(stderr, \"Error: Unexpected JSON type for enum " << enumDef.exportName << "\\n\");\n";
+    cOS << "         mcp_log_error(\"Unexpected JSON type for enum " << enumDef.exportName << "\");\n";
     cOS << "        return (" << enumDef.originalName << ")0; // Default/error value\n";
     cOS << "    }\n";
     cOS << "}\n\n";
@@ -746,9 +830,9 @@ void generateFieldParserLogic(raw_fd_ostream &cOS, const PersistentFieldInfo& fi
                          cOS << "            struct " << structCType << "* temp_" << field.name << " = " << parserFunc << "(" << field.name << "_json);\n";
                          cOS << "            if (temp_" << field.name << ") {\n";
                          cOS << "                " << cVar << " = *temp_" << field.name << "; // Copy value\n";
-                         cOS << "                free(temp_" << field.name << "); // Free temporary allocated struct\n";
+                         cOS << "                mcp_free(temp_" << field.name << "); // Free temporary allocated struct\n";
                          cOS << "            } else {\n";
-                         cOS << "                fprintf(stderr, \"Warning: Failed to parse struct value for field '" << field.name << "'\\n\");\n";
+                         cOS << "                mcp_log_warn(\"Failed to parse struct value for field '" << field.name << "'\");\n";
                           cOS << "                // Initialize " << cVar << " safely (e.g., memset or default init)\n";
                           cOS << "                memset(&(" << cVar << "), 0, sizeof(" << cVar << "));\n";
                          cOS << "            }\n";
@@ -777,8 +861,8 @@ void generateFieldParserLogic(raw_fd_ostream &cOS, const PersistentFieldInfo& fi
          bool isArray = StringRef(field.typeName).contains('[');
           cOS << "            if (cJSON_IsString(" << field.name << "_json)) {\n";
           if (isPointer) {
-               cOS << "                " << cVar << " = _strdup(" << field.name << "_json->valuestring);\n";
-               cOS << "                // TODO: Remember to free this string (" << field.name << ") later!\n";
+               cOS << "                " << cVar << " = mcp_strdup(" << field.name << "_json->valuestring);\n";
+               cOS << "                // Lives in the request arena, reclaimed with the request\n";
           } else if (isArray) {
                 cOS << "                strncpy(" << cVar << ", " << field.name << "_json->valuestring, sizeof(" << cVar << ") - 1);\n";
                 cOS << "                " << cVar << "[sizeof(" << cVar << ") - 1] = '\\0'; // Ensure null termination\n";
@@ -788,7 +872,7 @@ void generateFieldParserLogic(raw_fd_ostream &cOS, const PersistentFieldInfo& fi
                cOS << "                }\n";
           }
           cOS << "            } else {\n";
-          cOS << "                 fprintf(stderr, \"Warning: Expected string for field '" << field.name << "' but got different type.\\n\");\n";
+          cOS << "                 mcp_log_warn(\"Expected string for field '" << field.name << "' but got different type.\");\n";
           cOS << "            }\n";
      } else if (schema.type == "integer") {
           cOS << "            if (cJSON_IsNumber(" << field.name << "_json)) {\n";
@@ -805,7 +889,7 @@ void generateFieldParserLogic(raw_fd_ostream &cOS, const PersistentFieldInfo& fi
      } else if (schema.type == "array") {
          cOS << "            // TODO: Implement array parsing for field '" << field.name << "'\n";
           // Needs to know element type, allocate array, loop through cJSON array, parse elements recursively
-         cOS << "            fprintf(stderr, \"Warning: Array parsing for field '" << field.name << "' not implemented yet.\\n\");\n";
+         cOS << "            mcp_log_warn(\"Array parsing for field '" << field.name << "' not implemented yet.\");\n";
      } else if (schema.type == "object") {
           cOS << "            // Warning: Cannot parse generic 'object' type for field '" << field.name << "'. Needs specific type or $ref.\n";
      } else {
@@ -842,8 +926,8 @@ void generateStructParser(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Persis
     // Make static inline if only used within this file's handlers? Or keep extern? Let's keep extern for now.
     cOS << (needsStructKeyword ? "struct " : "") << structCType << "* " << funcName << "(cJSON *json) {\n";
     cOS << "    if (!json || !cJSON_IsObject(json)) return NULL;\n";
-    cOS << "    " << (needsStructKeyword ? "struct " : "") << structCType << "* obj = (" << (needsStructKeyword ? "struct " : "") << structCType << "*)malloc(sizeof(" << (needsStructKeyword ? "struct " : "") << structCType << "));\n";
-    cOS << "    if (!obj) { perror(\"malloc failed for " << structCType << "\"); return NULL; }\n";
+    cOS << "    " << (needsStructKeyword ? "struct " : "") << structCType << "* obj = (" << (needsStructKeyword ? "struct " : "") << structCType << "*)mcp_malloc(sizeof(" << (needsStructKeyword ? "struct " : "") << structCType << "));\n";
+    cOS << "    if (!obj) { perror(\"mcp_malloc failed for " << structCType << "\"); return NULL; }\n";
     cOS << "    memset(obj, 0, sizeof(" << (needsStructKeyword ? "struct " : "") << structCType << ")); // Initialize memory\n\n";
 
     for (const auto& field : structDef.fields) {
@@ -866,13 +950,22 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
     cOS << "// Handler for function " << funcDef.exportName << " (calls " << funcDef.originalName << ")\n";
     cOS << "cJSON* handle_" << handlerFuncName << "(cJSON *params) {\n";
     cOS << "    cJSON* result_json = NULL;\n";
-    cOS << "    if (!params || !cJSON_IsObject(params)) {\n";
-    cOS << "        fprintf(stderr, \"Error: Invalid parameters object for function " << funcDef.exportName << "\\n\");\n";
-    cOS << "        return NULL; // TODO: Return JSON error object?\n";
-    cOS << "    }\n\n";
+    // Phase timings for the tool's histograms, see mcp_stats.h
+    const std::string statsTool = std::to_string(toolIndex(funcDef.exportName)) + "u";
+    cOS << "    uint64_t stats_mark = mcp_stats_begin(" << statsTool << ");\n";
+    // Spans for the request timeline, see mcp_trace.h
+    cOS << "    uint64_t trace_handle = mcp_trace_begin();\n";
+    cOS << "    uint64_t trace_span = 0;\n";
+    if (funcDef.isAsync) {
+        cOS << "    mcp_call* call = NULL;\n";
+    }
+    if (funcDef.isStream) {
+        cOS << "    mcp_stream* stream = NULL;\n";
+    }
+    bool hasReturn = funcDef.returnTypeName != "void";
 
-    cOS << "    // --- Declare and Parse Parameters --- \n";
-    std::vector<std::string> allocated_params; // Track params needing free()
+    // Every variable END reads is set before the first goto END
+    cOS << "    // --- Declare Parameters --- \n";
     for (const auto& param : funcDef.parameters) {
         cOS << "    " << param.typeName << " p_" << param.name << "; // Might need initialization\n";
         // Initialize pointers to NULL, others often to 0 via memset later or explicit init
@@ -882,6 +975,19 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
             // For non-pointers, zero-init might be good practice depending on type
              cOS << "    memset(&p_" << param.name << ", 0, sizeof(p_" << param.name << "));\n";
         }
+    }
+    if (hasReturn && !funcDef.isAsync && !funcDef.isStream) {
+        cOS << "    " << funcDef.returnTypeName << " return_value;\n";
+        cOS << "    memset(&return_value, 0, sizeof(return_value));\n";
+    }
+    cOS << "    if (!params || !cJSON_IsObject(params)) {\n";
+    cOS << "        mcp_log_error(\"Invalid parameters object for function " << funcDef.exportName << "\");\n";
+    cOS << "        goto END; // TODO: Return JSON error object?\n";
+    cOS << "    }\n\n";
+
+    cOS << "    // --- Parse Parameters --- \n";
+    std::vector<std::string> allocated_params; // Track params needing free()
+    for (const auto& param : funcDef.parameters) {
         // Generate parsing logic for this parameter
         PersistentFieldInfo tempFieldInfo; // Adapt field parsing logic for parameters
         tempFieldInfo.name = param.name;
@@ -911,22 +1017,26 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
                  errs() << "isEnumRef: " << isEnumRef << "\n";
                  errs() << "param.typeName: " << param.typeName << "\n";
                   if (isStructRef && StringRef(param.typeName).contains('*')) { // Pointer to struct
+                      cOS << "            trace_span = mcp_trace_begin();\n";
                       cOS << "            " << cVar << " = parse_" << referencedExportName << "(p_json);//" << referencedExportName << "\n";
+                      cOS << "            mcp_trace_end(\"parse_" << referencedExportName << "\", trace_span);\n";
                       allocated_params.push_back(cVar); // Mark for freeing
                   } else if (isEnumRef) { // Enum (passed by value)
+                       cOS << "            trace_span = mcp_trace_begin();\n";
                        cOS << "            " << cVar << " = parse_" << referencedExportName << "(p_json);\n";
+                       cOS << "            mcp_trace_end(\"parse_" << referencedExportName << "\", trace_span);\n";
                   } else {
-                     cOS << "            fprintf(stderr, \"Warning: Unsupported $ref type or pass-by-value struct for parameter '" << param.name << "'\\n\");\n";
+                     cOS << "            mcp_log_warn(\"Unsupported $ref type or pass-by-value struct for parameter '" << param.name << "'\");\n";
                       // TODO: Handle struct-by-value parameters if needed (parse to temp, copy)
                   }
              } else {
-                 cOS << "             fprintf(stderr, \"Warning: Invalid $ref format '" << schema.ref << "' for parameter '" << param.name << "'\\n\");\n";
+                 cOS << "             mcp_log_warn(\"Invalid $ref format '" << schema.ref << "' for parameter '" << param.name << "'\");\n";
              }
         } else if (schema.type == "string" && StringRef(param.typeName).contains('*')) { // Only handle char* for params easily
              cOS << "            if (cJSON_IsString(p_json)) {\n";
-             cOS << "                " << cVar << " = _strdup(p_json->valuestring);\n";
+             cOS << "                " << cVar << " = mcp_strdup(p_json->valuestring);\n";
              allocated_params.push_back(cVar); // Mark for freeing
-             cOS << "            } else { fprintf(stderr, \"Warning: Expected string for param '" << param.name << "'\\n\"); }\n";
+             cOS << "            } else { mcp_log_warn(\"Expected string for param '" << param.name << "'\"); }\n";
         } else if (schema.type == "integer") {
             cOS << "            if (cJSON_IsNumber(p_json)) { " << cVar << " = (" << param.typeName << ")p_json->valueint; }\n";
         } else if (schema.type == "boolean") {
@@ -936,12 +1046,12 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
         } else if (schema.type == "array") {
              cOS << "            // TODO: Implement array parsing for parameter '" << param.name << "'\n";
         } else {
-             cOS << "            fprintf(stderr, \"Warning: Unsupported type for parameter '" << param.name << "'\\n\");\n";
+             cOS << "            mcp_log_warn(\"Unsupported type for parameter '" << param.name << "'\");\n";
         }
 
         cOS << "        } else {\n";
         // Parameter missing or null. Check if required? (Assume required for now)
-        cOS << "            fprintf(stderr, \"Error: Required parameter '" << param.name << "' missing or null for function " << funcDef.exportName << "\\n\");\n";
+        cOS << "            mcp_log_error(\"Required parameter '" << param.name << "' missing or null for function " << funcDef.exportName << "\");\n";
         // Cleanup already allocated params before returning error
         
         cOS << "            goto END;\n";
@@ -951,10 +1061,89 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
     }
     cOS << "\n";
 
+    cOS << "    mcp_stats_lap(" << statsTool << ", MCP_STATS_PARSE, &stats_mark);\n\n";
+
+    if (funcDef.isAsync) {
+        // The reply comes from mcp_call_complete(); the NULL returned here is not sent
+        cOS << "    // --- Hand the Request to the Async C Function --- \n";
+        cOS << "    call = mcp_call_detach();\n";
+        cOS << "    if (call == NULL) {\n";
+        cOS << "        mcp_log_error(\"Async function " << funcDef.exportName << " called outside of a request\");\n";
+        cOS << "        goto END;\n";
+        cOS << "    }\n";
+        if (!allocated_params.empty()) {
+            // The function may go on using its parameters on another thread until it completes the call
+            cOS << "    {\n";
+            cOS << "        void* kept[] = { ";
+            for (size_t i = 0; i < allocated_params.size(); ++i) {
+                cOS << (i > 0 ? ", " : "") << "(void*)" << allocated_params[i];
+            }
+            cOS << " };\n";
+            cOS << "        if (mcp_call_keep(call, kept, " << allocated_params.size() << ") != 0) {\n";
+            cOS << "            mcp_call_fail(call, MCP_ERROR_INTERNAL, \"Out of memory\");\n";
+            cOS << "            call = NULL;\n";
+            cOS << "            goto END;\n";
+            cOS << "        }\n";
+            cOS << "    }\n";
+        }
+        cOS << "    trace_span = mcp_trace_begin();\n";
+        cOS << "    " << funcDef.originalName << "(call, mcp_call_cancel_token(call)";
+        for (const auto& param : funcDef.parameters) {
+            cOS << ", p_" << param.name;
+        }
+        cOS << ");\n";
+        cOS << "    mcp_trace_end(\"" << funcDef.originalName << "\", trace_span);\n";
+        cOS << "\n";
+        cOS << "END:\n";
+        if (!allocated_params.empty()) {
+            cOS << "    // --- Free Allocated Parameter Memory, unless the Call Keeps It --- \n";
+            cOS << "    if (call == NULL) {\n";
+            for(const auto& alloc_param : allocated_params) {
+               cOS << "        if (" << alloc_param << ") mcp_free(" << alloc_param << ");\n";
+            }
+            cOS << "    }\n";
+        }
+        // Lapped after END so that calls failing before the function are in the histograms too
+        cOS << "    mcp_stats_lap(" << statsTool << ", MCP_STATS_HANDLER, &stats_mark);\n";
+        cOS << "    mcp_trace_end(\"handle_" << handlerFuncName << "\", trace_handle);\n";
+        cOS << "    return " << resultJsonVar << ";\n";
+        cOS << "}\n\n";
+        return;
+    }
+
+    if (funcDef.isStream) {
+        // The reply is written through the stream, chunk by chunk; the NULL returned here is not sent
+        cOS << "    // --- Stream the Result of the C Function --- \n";
+        cOS << "    stream = mcp_stream_open();\n";
+        cOS << "    if (stream == NULL) {\n";
+        cOS << "        mcp_log_error(\"Failed to open the result stream of " << funcDef.exportName << "\");\n";
+        cOS << "        goto END;\n";
+        cOS << "    }\n";
+        cOS << "    trace_span = mcp_trace_begin();\n";
+        cOS << "    " << funcDef.originalName << "(stream";
+        for (const auto& param : funcDef.parameters) {
+            cOS << ", p_" << param.name;
+        }
+        cOS << ");\n";
+        cOS << "    mcp_stream_close(stream);\n";
+        cOS << "    mcp_trace_end(\"" << funcDef.originalName << "\", trace_span);\n";
+        cOS << "\n";
+        cOS << "END:\n";
+        cOS << "    // --- Free Allocated Parameter Memory --- \n";
+        for(const auto& alloc_param : allocated_params) {
+           cOS << "    if (" << alloc_param << ") mcp_free(" << alloc_param << ");\n";
+        }
+        // Lapped after END so that calls failing before the function are in the histograms too
+        cOS << "    mcp_stats_lap(" << statsTool << ", MCP_STATS_HANDLER, &stats_mark);\n";
+        cOS << "    mcp_trace_end(\"handle_" << handlerFuncName << "\", trace_handle);\n";
+        cOS << "    return " << resultJsonVar << ";\n";
+        cOS << "}\n\n";
+        return;
+    }
+
     cOS << "    // --- Call Original C Function --- \n";
-    bool hasReturn = funcDef.returnTypeName != "void";
+    cOS << "    trace_span = mcp_trace_begin();\n";
     if (hasReturn) {
-         cOS << "    " << funcDef.returnTypeName << " return_value;\n";
          cOS << "    return_value = " << funcDef.originalName << "(";
 
     } else {
@@ -963,12 +1152,14 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
     for (size_t p_idx = 0; p_idx < funcDef.parameters.size(); ++p_idx) {
         cOS << (p_idx > 0 ? ", " : "") << "p_" << funcDef.parameters[p_idx].name;
     }
-    cOS << ");\n\n";
+    cOS << ");\n";
+    cOS << "    mcp_trace_end(\"" << funcDef.originalName << "\", trace_span);\n";
+    cOS << "    mcp_stats_lap(" << statsTool << ", MCP_STATS_HANDLER, &stats_mark);\n\n";
     cOS << "    result_json = return_value;\n";
     cOS << "END:\n";
     cOS << "    // --- Free Allocated Parameter Memory --- \n";
     for(const auto& alloc_param : allocated_params) {
-       cOS << "    if (" << alloc_param << ") free(" << alloc_param << ");\n";
+       cOS << "    if (" << alloc_param << ") mcp_free(" << alloc_param << ");\n";
     }
     cOS << "\n";
 
@@ -1014,23 +1205,25 @@ void generateFunctionHandler(raw_fd_ostream &cOS, raw_fd_ostream &hOS, const Per
              if (isStructPtr && !structExportName.empty()) {
                  cOS << "        // TODO: Need a function: cJSON* toJson_" << structExportName << "(" << funcDef.returnTypeName << " data);\n";
                  cOS << "        // " << resultJsonVar << " = toJson_" << structExportName << "(return_value);\n";
-                 cOS << "        fprintf(stderr, \"Warning: C-to-JSON conversion for struct pointer return type '" << funcDef.returnTypeName << "' not implemented.\\n\");\n";
+                 cOS << "        mcp_log_warn(\"C-to-JSON conversion for struct pointer return type '" << funcDef.returnTypeName << "' not implemented.\");\n";
                  cOS << "        " << resultJsonVar << " = cJSON_CreateNull(); // Placeholder\n";
 
              } else {
-                 cOS << "        fprintf(stderr, \"Warning: C-to-JSON conversion for return type '" << funcDef.returnTypeName << "' not implemented.\\n\");\n";
+                 cOS << "        mcp_log_warn(\"C-to-JSON conversion for return type '" << funcDef.returnTypeName << "' not implemented.\");\n";
                  cOS << "        " << resultJsonVar << " = cJSON_CreateNull(); // Placeholder\n";
              }
              cOS << "    }\n";
          }
          else {
-             cOS << "    fprintf(stderr, \"Warning: C-to-JSON conversion for return type '" << funcDef.returnTypeName << "' not implemented.\\n\");\n";
+             cOS << "    mcp_log_warn(\"C-to-JSON conversion for return type '" << funcDef.returnTypeName << "' not implemented.\");\n";
              cOS << "    " << resultJsonVar << " = cJSON_CreateNull(); // Placeholder\n";
          }
 
     } else {
          cOS << "    " << resultJsonVar << " = cJSON_CreateNull(); // Void function returns null\n";
     }
+    cOS << "    mcp_stats_lap(" << statsTool << ", MCP_STATS_SERIALIZE, &stats_mark);\n";
+    cOS << "    mcp_trace_end(\"handle_" << handlerFuncName << "\", trace_handle);\n";
     cOS << "\n    return " << resultJsonVar << ";\n";
     cOS << "}\n\n";
 }
@@ -1112,60 +1305,126 @@ public:
 private:
     // --- Final Generation Logic (Called after all TUs are processed) ---
 
-    // Helper to generate JSON schema C code recursively (for signature file)
-    void generateJsonSchemaCCode(raw_fd_ostream &os, const PersistentJsonSchemaInfo& schemaInfo, const std::string& parentVar, const std::string& keyNameOrIndex, bool isProperty) {
-        std::string schemaVar = parentVar + "_" + keyNameOrIndex + "_schema";
-        // Sanitize keyNameOrIndex if it's numeric (for array items)
-        if (!keyNameOrIndex.empty() && std::isdigit(keyNameOrIndex[0])) {
-            schemaVar = parentVar + "_items_schema"; // Simpler name for array items
-        } else {
-            // Sanitize key name for C variable
-            std::string sanitizedKey = keyNameOrIndex;
-            std::replace(sanitizedKey.begin(), sanitizedKey.end(), '-', '_');
-             std::replace(sanitizedKey.begin(), sanitizedKey.end(), '.', '_');
-            schemaVar = parentVar + "_" + sanitizedKey + "_schema";
-        }
-
-
-        os << "                    cJSON* " << schemaVar << " = cJSON_CreateObject();\n";
-        os << "                    if (" << schemaVar << ") {\n";
+    // JSON string as cJSON prints it; escapeString() escapes the same characters
+    std::string jsonString(const std::string& value) {
+        return "\"" + escapeString(value) + "\"";
+    }
 
+    // Compact JSON text of one parameter or field schema
+    std::string jsonSchemaText(const PersistentJsonSchemaInfo& schemaInfo, const std::string& description) {
+        std::string text = "{";
         if (!schemaInfo.ref.empty()) {
-            os << "                    cJSON_AddStringToObject(" << schemaVar << ", \"$ref\", \"" << schemaInfo.ref << "\");\n";
-            os << "                    cJSON_AddStringToObject(" << schemaVar << ", \"type\", \"object\");\n";
+            text += "\"$ref\":" + jsonString(schemaInfo.ref) + ",\"type\":\"object\"";
         } else if (schemaInfo.type == "array" && schemaInfo.items) {
-            os << "                    cJSON_AddStringToObject(" << schemaVar << ", \"type\", \"array\");\n";
-            // Recursively generate items schema, key is "items"
-            generateJsonSchemaCCode(os, *schemaInfo.items, schemaVar, "items", false);
+            text += "\"type\":\"array\",\"items\":" + jsonSchemaText(*schemaInfo.items, "");
         } else {
-             os << "                    cJSON_AddStringToObject(" << schemaVar << ", \"type\", \"" << schemaInfo.type << "\");\n";
-             // Handle direct enum values if needed (though we prefer $ref)
-             if (schemaInfo.isEnum && schemaInfo.ref.empty() && g_persistentEnums.count(schemaInfo.enumExportName)) {
-                  const auto& enumDef = g_persistentEnums.at(schemaInfo.enumExportName);
-                  os << "                    cJSON* enum_values_inline = cJSON_CreateArray();\n";
-                  os << "                    if(enum_values_inline){\n";
-                   for (const auto& constant : enumDef.constants) {
-                       os << "                    cJSON_AddItemToArray(enum_values_inline, cJSON_CreateString(\"" << constant.name << "\"));\n";
-                   }
-                  os << "                    cJSON_AddItemToObject(" << schemaVar << ", \"enum\", enum_values_inline);\n";
-                  os << "                    }\n";
-             }
+            text += "\"type\":" + jsonString(schemaInfo.type);
+            if (schemaInfo.isEnum && schemaInfo.ref.empty() && g_persistentEnums.count(schemaInfo.enumExportName)) {
+                const auto& enumDef = g_persistentEnums.at(schemaInfo.enumExportName);
+                text += ",\"enum\":[";
+                for (size_t i = 0; i < enumDef.constants.size(); ++i) {
+                    text += (i > 0 ? "," : "") + jsonString(enumDef.constants[i].name);
+                }
+                text += "]";
+            }
+        }
+        if (!description.empty()) {
+            text += ",\"description\":" + jsonString(description);
         }
-        // Add description if available (needs PersistentJsonSchemaInfo to hold it)
-        // if (!schemaInfo.description.empty()) { os << "            cJSON_AddStringToObject(" << schemaVar << ", \"description\", \"" << schemaInfo.description << "\");\n"; }
+        return text + "}";
+    }
 
+    // Compact JSON text of the $defs and tools of the definitions whose source file
+    // base passes `includeBase`: the one serialization of the signatures, which the
+    // runtime sends as it is and parses when it needs a tree
+    std::string generateSignaturesText(const std::function<bool(const std::string&)>& includeBase) {
+        std::string defs;
+        for (const auto& [exportName, enumDef] : g_persistentEnums) {
+            if (!includeBase(enumDef.sourceFileBase)) continue;
+            defs += (defs.empty() ? "" : ",") + jsonString(exportName) + ":{";
+            if (!enumDef.description.empty()) {
+                defs += "\"description\":" + jsonString(enumDef.description) + ",";
+            }
+            defs += "\"type\":" + jsonString(enumDef.schemaInfo.type) + ",\"enum\":[";
+            for (size_t i = 0; i < enumDef.constants.size(); ++i) {
+                defs += (i > 0 ? "," : "") + jsonString(enumDef.constants[i].name);
+            }
+            defs += "]}";
+        }
+        for (const auto& [exportName, structDef] : g_persistentStructs) {
+            if (!includeBase(structDef.sourceFileBase)) continue;
+            defs += (defs.empty() ? "" : ",") + jsonString(exportName) + ":{";
+            if (!structDef.description.empty()) {
+                defs += "\"description\":" + jsonString(structDef.description) + ",";
+            }
+            std::string properties;
+            std::string required;
+            for (const auto& field : structDef.fields) {
+                properties += (properties.empty() ? "" : ",") + jsonString(field.name) + ":" + jsonSchemaText(field.schemaInfo, field.description);
+                if (!StringRef(field.typeName).contains('*')) {
+                    required += (required.empty() ? "" : ",") + jsonString(field.name);
+                }
+            }
+            defs += "\"type\":\"object\",\"properties\":{" + properties + "}";
+            if (!required.empty()) {
+                defs += ",\"required\":[" + required + "]";
+            }
+            defs += "}";
+        }
 
-        // Add the generated schema object to its parent
-        if (isProperty) { // Adding to properties object
-             os << "            cJSON_AddItemToObject(" << parentVar << ", \"" << keyNameOrIndex << "\", " << schemaVar << ");\n";
-        } else if (schemaInfo.type == "array") { // Adding items schema to an array schema
-             os << "            cJSON_AddItemToObject(" << parentVar << ", \"items\", " << schemaVar << ");\n";
-        } else {
-             // Should not happen if called correctly? Adding to defs?
-              os << "           // Adding schema " << schemaVar << " to " << parentVar << " with key " << keyNameOrIndex << "\n";
-               os << "            cJSON_AddItemToObject(" << parentVar << ", \"" << keyNameOrIndex << "\", " << schemaVar << ");\n";
+        std::string tools;
+        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
+            if (!includeBase(funcDef.sourceFileBase)) continue;
+            std::string properties;
+            std::string required;
+            for (const auto& param : funcDef.parameters) {
+                properties += (properties.empty() ? "" : ",") + jsonString(param.name) + ":" + jsonSchemaText(param.schemaInfo, param.description);
+                required += (required.empty() ? "" : ",") + jsonString(param.name);
+            }
+            tools += (tools.empty() ? "" : ",");
+            tools += "{\"name\":" + jsonString(funcDef.exportName) + ",\"description\":" + jsonString(funcDef.description);
+            tools += ",\"inputSchema\":{\"type\":\"object\",\"$schema\":\"http://json-schema.org/draft-07/schema#\"";
+            tools += ",\"properties\":{" + properties + "}";
+            if (!required.empty()) {
+                tools += ",\"required\":[" + required + "]";
+            }
+            tools += ",\"additionalProperties\":false}}";
+        }
+        return "{\"$defs\":{" + defs + "},\"tools\":[" + tools + "]}";
+    }
+
+    // Emits `text` as a C string literal, split over lines short enough for every compiler
+    void emitStringLiteral(raw_fd_ostream &os, const std::string& text) {
+        const size_t lineBytes = 96;
+        if (text.empty()) {
+            os << "    \"\"";
+        }
+        for (size_t start = 0; start < text.size(); start += lineBytes) {
+            os << (start > 0 ? "\n" : "") << "    \"";
+            for (char c : text.substr(start, lineBytes)) {
+                switch (c) {
+                    case '"':  os << "\\\""; break;
+                    case '\\': os << "\\\\"; break;
+                    case '?':  os << "\\?"; break;  // No trigraphs
+                    default:   os << c; break;
+                }
+            }
+            os << "\"";
         }
-         os << "        } // end if (" << schemaVar << ")\n";
+    }
+
+    // Emits the signatures text as `textDeclaration[]`, then `signature`, a function
+    // parsing that text, so the tree and the text can never disagree
+    void generateSignaturesFunction(raw_fd_ostream &os, const std::string& signature, const std::string& textDeclaration,
+                                    const std::string& textName, const std::string& signaturesText) {
+        os << textDeclaration << "[] =\n";
+        emitStringLiteral(os, signaturesText);
+        os << ";\n\n";
+        os << signature << " {\n";
+        os << "    cJSON* root = cJSON_ParseWithLength(" << textName << ", " << signaturesText.size() << ");\n";
+        os << "    if (!root) { mcp_log_error(\"Failed to parse the function signatures\"); }\n";
+        os << "    return root;\n";
+        os << "}\n\n";
     }
 
     // Generates the `get_all_function_signatures_json` function into the signature file
@@ -1175,7 +1434,7 @@ private:
         sigOS << "// Generated on: " << /* TODO: Add timestamp */ "\n";
         sigOS << "#include \"cJSON.h\"\n";
         sigOS << "#include <string.h> // For strcmp\n";
-        sigOS << "#include <stdio.h> // for fprintf, stderr\n";
+        sigOS << "#include \"mcp_log.h\" // mcp_log_error\n";
         sigOS << "#include <stdlib.h> // For malloc, free? (Maybe not needed here)\n\n";
 
         // Include necessary C headers (struct/enum definitions) gathered from all files
@@ -1187,157 +1446,84 @@ private:
 
         sigOS << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
 
-        sigOS << "cJSON* get_all_function_signatures_json() {\n";
-        sigOS << "    cJSON* root = cJSON_CreateObject();\n";
-        sigOS << "    if (!root) { fprintf(stderr, \"Failed to create root JSON object\\n\"); return NULL; }\n\n";
+        // Serialized here once: tools/list copies the text into the reply
+        auto linkedIn = [](const std::string& baseName) { return !isModuleBase(baseName); };
+        std::string signaturesText = generateSignaturesText(linkedIn);
+        generateSignaturesFunction(sigOS, "cJSON* get_all_function_signatures_json()", "const char function_signatures_json_text",
+                                   "function_signatures_json_text", signaturesText);
+        sigOS << "const size_t function_signatures_json_length = " << signaturesText.size() << ";\n\n";
+
+        sigOS << "#ifdef __cplusplus\n} // extern \"C\"\n#endif\n";
+        sigOS.flush();
+    }
 
-        // --- Generate $defs ---
-        sigOS << "    // --- $defs --- \n";
-        sigOS << "    cJSON* defs = cJSON_AddObjectToObject(root, \"$defs\");\n";
-        sigOS << "    if (!defs) { fprintf(stderr, \"Failed to create $defs object\\n\"); cJSON_Delete(root); return NULL; }\n\n";
+    // What a lookup returns for one tool: its handler, or its entry in bridge_tools
+    using LookupResult = std::function<std::string(const PersistentFunctionDefinition&)>;
+
+    // Emits the body of one dispatch branch: every name in `group` has length `len`.
+    // Switches on the character position that splits the group into the most
+    // branches and recurses until one candidate is left, which memcmp confirms.
+    // Distinct names of equal length always differ somewhere, so this terminates.
+    void emitDispatchTree(raw_fd_ostream &os, const std::vector<const PersistentFunctionDefinition*>& group, size_t len, int depth,
+                          const LookupResult& result) {
+        std::string pad(4 * depth, ' ');
+        if (group.size() == 1) {
+            const PersistentFunctionDefinition* funcDef = group.front();
+            os << pad << "return memcmp(name, \"" << funcDef->exportName << "\", " << len << ") == 0 ? " << result(*funcDef) << " : NULL;\n";
+            return;
+        }
 
-        // $defs for Enums
-        for (const auto& [exportName, enumDef] : g_persistentEnums) {
-            sigOS << "    // Definition for enum: " << exportName << "\n";
-            sigOS << "    cJSON* enum_def = cJSON_CreateObject();\n";
-            sigOS << "    {\n";
-            sigOS << "        cJSON* enum_def = cJSON_CreateObject();\n";
-            sigOS << "        if (enum_def) {\n";
-            if (!enumDef.description.empty()) {
-                sigOS << "            cJSON_AddStringToObject(enum_def, \"description\", \"" << escapeString(enumDef.description) << "\");\n";
+        size_t bestPos = 0;
+        size_t bestCount = 0;
+        for (size_t pos = 0; pos < len; ++pos) {
+            std::set<unsigned char> chars;
+            for (const PersistentFunctionDefinition* funcDef : group) {
+                chars.insert((unsigned char)funcDef->exportName[pos]);
             }
-            // Use the stored schema info for the enum type itself
-            sigOS << "            cJSON_AddStringToObject(enum_def, \"type\", \"" << enumDef.schemaInfo.type << "\");\n";
-             // Add enum values (as strings)
-            sigOS << "            cJSON* enum_values = cJSON_CreateArray();\n";
-            sigOS << "            if (enum_values) {\n";
-            for (const auto& constant : enumDef.constants) {
-                sigOS << "                cJSON_AddItemToArray(enum_values, cJSON_CreateString(\"" << constant.name << "\"));\n";
+            if (chars.size() > bestCount) {
+                bestCount = chars.size();
+                bestPos = pos;
             }
-            sigOS << "                cJSON_AddItemToObject(enum_def, \"enum\", enum_values);\n";
-            sigOS << "            }\n";
-            sigOS << "            cJSON_AddItemToObject(defs, \"" << exportName << "\", enum_def);\n";
-            sigOS << "        } // end if enum_def\n";
-            sigOS << "    }\n\n";
         }
-        sigOS << "    cJSON* field_schema_obj = NULL;\n";
-        // $defs for Structs
-        for (const auto& [exportName, structDef] : g_persistentStructs) {
-            sigOS << "    // Definition for struct: " << exportName << "\n";
-            sigOS << "    {\n";
-            sigOS << "        cJSON* struct_def = cJSON_CreateObject();\n";
-            sigOS << "        if (struct_def) {\n";
-            if (!structDef.description.empty()) {
-                sigOS << "            cJSON_AddStringToObject(struct_def, \"description\", \"" << escapeString(structDef.description) << "\");\n";
-            }
-            sigOS << "            cJSON_AddStringToObject(struct_def, \"type\", \"object\");\n";
-            sigOS << "            cJSON* properties = cJSON_CreateObject();\n";
-            sigOS << "            cJSON* required_props = cJSON_CreateArray();\n";
-            sigOS << "            if (properties && required_props) {\n";
 
-            for (const auto& field : structDef.fields) {
-                sigOS << "                // Field: " << field.name << "\n";
-                // Generate the schema C code for this field
-                generateJsonSchemaCCode(sigOS, field.schemaInfo, "properties", field.name, true);
-                // Add description at the field level within generateJsonSchemaCCode if needed
-
-                 // Assume all struct fields are required unless they are pointers? Refine later.
-                 if (!StringRef(field.typeName).contains('*')) {
-                      sigOS << "                cJSON_AddItemToArray(required_props, cJSON_CreateString(\"" << field.name << "\"));\n";
-                 }
-
-                 // Add field description to the generated schema object if possible
-                 // Find the generated object and add description
-                 sigOS << "                field_schema_obj = cJSON_GetObjectItem(properties, \"" << field.name << "\");\n";
-                 sigOS << "                if (field_schema_obj && !cJSON_HasObjectItem(field_schema_obj, \"description\") && !" << std::string(field.description.empty() ? "true" : "false") << ") {\n";
-                 sigOS << "                     cJSON_AddStringToObject(field_schema_obj, \"description\", \"" << escapeString(field.description) << "\");\n";
-                 sigOS << "                }\n";
-
-            }
-            sigOS << "                cJSON_AddItemToObject(struct_def, \"properties\", properties);\n";
-             // Only add required array if it's not empty
-            sigOS << "                if(cJSON_GetArraySize(required_props) > 0) {\n";
-            sigOS << "                    cJSON_AddItemToObject(struct_def, \"required\", required_props);\n";
-            sigOS << "                } else {\n";
-            sigOS << "                    cJSON_Delete(required_props); // Clean up empty array\n";
-            sigOS << "                }\n";
-            sigOS << "            } else { /* Handle properties/required alloc failure */ \n";
-             sigOS << "                if (properties) cJSON_Delete(properties);\n";
-             sigOS << "                if (required_props) cJSON_Delete(required_props);\n";
-             sigOS << "            }\n"; // end if properties && required
-            sigOS << "            cJSON_AddItemToObject(defs, \"" << exportName << "\", struct_def);\n";
-            sigOS << "        } // end if struct_def\n";
-            sigOS << "    }\n\n";
+        std::map<unsigned char, std::vector<const PersistentFunctionDefinition*>> branches;
+        for (const PersistentFunctionDefinition* funcDef : group) {
+            branches[(unsigned char)funcDef->exportName[bestPos]].push_back(funcDef);
         }
+        os << pad << "switch ((unsigned char)name[" << bestPos << "]) {\n";
+        for (const auto& [c, branch] : branches) {
+            os << pad << "case " << (unsigned)c << ":";
+            if (c >= 0x20 && c < 0x7f && c != '*' && c != '/') os << " /* '" << (char)c << "' */";
+            os << " {\n";
+            emitDispatchTree(os, branch, len, depth + 1, result);
+            os << pad << "}\n";
+        }
+        os << pad << "default:\n";
+        os << pad << "    return NULL;\n";
+        os << pad << "}\n";
+    }
 
-
-        // --- Generate tools ---
-        sigOS << "    // --- tools --- \n";
-        sigOS << "    cJSON* tools = cJSON_AddArrayToObject(root, \"tools\");\n";
-        sigOS << "    if (!tools) { fprintf(stderr, \"Failed to create tools array\\n\"); cJSON_Delete(root); return NULL; }\n\n";
-
+    // Emits `declaration(const char* name, size_t len)`, returning `result` of the
+    // tools whose source file base passes `includeBase` and NULL for any other name
+    void emitLookupFunction(raw_fd_ostream &os, const std::string& declaration,
+                            const std::function<bool(const std::string&)>& includeBase, const LookupResult& result) {
+        std::map<size_t, std::vector<const PersistentFunctionDefinition*>> byLength;
         for (const auto& [exportName, funcDef] : g_persistentFunctions) {
-            sigOS << "    // Tool for function: " << funcDef.exportName << "\n";
-            sigOS << "    {\n";
-            sigOS << "        cJSON* tool = cJSON_CreateObject();\n";
-            sigOS << "        if (tool) {\n";
-            sigOS << "            cJSON_AddStringToObject(tool, \"name\", \"" << funcDef.exportName << "\");\n";
-            sigOS << "            cJSON_AddStringToObject(tool, \"description\", \"" << escapeString(funcDef.description) << "\");\n";
-
-            sigOS << "            cJSON* inputSchema = cJSON_CreateObject();\n";
-            sigOS << "            if (inputSchema) {\n";
-            sigOS << "                cJSON_AddStringToObject(inputSchema, \"type\", \"object\");\n";
-            sigOS << "                cJSON_AddStringToObject(inputSchema, \"$schema\", \"http://json-schema.org/draft-07/schema#\");\n";
-            sigOS << "                cJSON* properties = cJSON_CreateObject();\n";
-            sigOS << "                cJSON* required = cJSON_CreateArray();\n";
-            sigOS << "                if (properties && required) {\n";
-            sigOS << "                cJSON* param_schema_obj = NULL;\n";
-            for (const auto& param : funcDef.parameters) {
-                 sigOS << "                    // Parameter: " << param.name << "\n";
-                 // Generate schema C code for the parameter
-                 generateJsonSchemaCCode(sigOS, param.schemaInfo, "properties", param.name, true);
-
-                  // Assume required unless default value specified (TODO)
-                 sigOS << "                    cJSON_AddItemToArray(required, cJSON_CreateString(\"" << param.name << "\"));\n";
-
-                   // Add param description to the generated schema object
-                   sigOS << "                    param_schema_obj = cJSON_GetObjectItem(properties, \"" << param.name << "\");\n";
-                   sigOS << "                    if (param_schema_obj && !cJSON_HasObjectItem(param_schema_obj, \"description\") && !" << std::string(param.description.empty() ? "true" : "false") << ") {\n";
-                   sigOS << "                         cJSON_AddStringToObject(param_schema_obj, \"description\", \"" << escapeString(param.description) << "\");\n";
-                   sigOS << "                    }\n";
-                 // TODO: Add default value if available
-            }
-            sigOS << "                    cJSON_AddItemToObject(inputSchema, \"properties\", properties);\n";
-             // Only add required array if not empty
-            sigOS << "                if (cJSON_GetArraySize(required) > 0) {\n";
-            sigOS << "                    cJSON_AddItemToObject(inputSchema, \"required\", required);\n";
-            sigOS << "                } else {\n";
-            sigOS << "                    cJSON_Delete(required);\n";
-            sigOS << "                }\n";
-            sigOS << "                } else { /* Handle properties/required alloc failure */ \n";
-             sigOS << "                   if (properties) cJSON_Delete(properties);\n";
-             sigOS << "                   if (required) cJSON_Delete(required);\n";
-             sigOS << "                   cJSON_Delete(inputSchema); inputSchema = NULL;\n";
-             sigOS << "               }\n"; // end if properties && required
-
-             sigOS << "                if (inputSchema) {\n"; // Check again before adding
-             sigOS << "                    cJSON_AddFalseToObject(inputSchema, \"additionalProperties\");\n";
-             sigOS << "                    cJSON_AddItemToObject(tool, \"inputSchema\", inputSchema);\n";
-             sigOS << "                }\n";
-            sigOS << "            } // end if inputSchema\n";
-
-            sigOS << "            if (inputSchema) { // Only add tool if input schema was successful\n";
-            sigOS << "               cJSON_AddItemToArray(tools, tool);\n";
-            sigOS << "            } else { cJSON_Delete(tool); } // Clean up tool if schema failed\n";
-            sigOS << "        } // end if tool\n";
-            sigOS << "    }\n\n";
+            if (!includeBase(funcDef.sourceFileBase)) continue;
+            byLength[funcDef.exportName.size()].push_back(&funcDef);
         }
-
-        sigOS << "    return root;\n";
-        sigOS << "}\n\n";
-
-        sigOS << "#ifdef __cplusplus\n} // extern \"C\"\n#endif\n";
-        sigOS.flush();
+        os << declaration << "(const char* name, size_t len) {\n";
+        os << "    (void)name;\n";
+        os << "    switch (len) {\n";
+        for (const auto& [len, group] : byLength) {
+            os << "    case " << len << ": {\n";
+            emitDispatchTree(os, group, len, 2, result);
+            os << "    }\n";
+        }
+        os << "    default:\n";
+        os << "        return NULL;\n";
+        os << "    }\n";
+        os << "}\n\n";
     }
 
     // Generates the main bridge dispatcher function into the bridge file
@@ -1346,8 +1532,11 @@ private:
         bridgeOS << "// Main Bridge Dispatcher Code (Auto-generated - Do not modify)\n";
          bridgeOS << "// Generated on: " << /* TODO: Add timestamp */ "\n";
         bridgeOS << "#include \"cJSON.h\"\n";
-        bridgeOS << "#include <string.h> // For strcmp\n";
-        bridgeOS << "#include <stdio.h>  // For fprintf, stderr\n";
+        bridgeOS << "#include \"mcp_stats.h\" // bridge_tool_names\n";
+        bridgeOS << "#include \"generated_func.h\" // bridge_tool_info\n";
+        bridgeOS << "#include <string.h> // For memcmp, strlen, strcmp\n";
+        bridgeOS << "#include \"mcp_log.h\" // mcp_log_error\n";
+        bridgeOS << "#include \"mcp_module.h\" // mcp_module_lookup\n";
         bridgeOS << "#include <stdlib.h> // For free (maybe needed by handlers?)\n\n";
 
         bridgeOS << "// Include generated bridge headers for each processed file base\n";
@@ -1358,10 +1547,39 @@ private:
 
         bridgeOS << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
 
+        // --- Tool Table ---
+        // One entry per tool, indexed as bridge_tool_names, with its handler and the
+        // flags of its annotations; tools of loadable modules have no handler here
+        bridgeOS << "typedef cJSON* (*bridge_handler)(cJSON* params);\n\n";
+        bridgeOS << "const bridge_tool_info bridge_tools[] = {\n";
+        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
+            bridgeOS << "    { " << (isModuleBase(funcDef.sourceFileBase) ? "NULL" : "handle_" + funcDef.originalName)
+                     << ", " << funcDef.timeoutMs << "u"
+                     << ", " << (funcDef.isPure ? "true" : "false")
+                     << ", " << (funcDef.isSingleFlight ? "true" : "false") << " }, // " << funcDef.exportName << "\n";
+        }
+        bridgeOS << "    { NULL, 0u, false, false }\n";
+        bridgeOS << "};\n\n";
+
+        // --- Method Lookup ---
+        // Names are grouped by length, then told apart by their most discriminating
+        // characters, so finding a tool costs a couple of jumps and one memcmp
+        // however many tools are exported.
+        bridgeOS << "// Collision-free method lookup (generated decision tree: length, then characters)\n";
+        emitLookupFunction(bridgeOS, "static const bridge_tool_info* bridge_lookup",
+                           [](const std::string&) { return true; },
+                           [](const PersistentFunctionDefinition& funcDef) {
+                               return "&bridge_tools[" + std::to_string(toolIndex(funcDef.exportName)) + "]";
+                           });
+
+        bridgeOS << "const bridge_tool_info* bridge_tool(const char* name) {\n";
+        bridgeOS << "    return bridge_lookup(name, strlen(name));\n";
+        bridgeOS << "}\n\n";
+
         bridgeOS << "// --- Main Bridge Function --- \n";
         bridgeOS << "cJSON* bridge(cJSON* input_json) {\n";
         bridgeOS << "    if (!input_json) {\n";
-        bridgeOS << "        fprintf(stderr, \"Error: Bridge input JSON is NULL\\n\");\n";
+        bridgeOS << "        mcp_log_error(\"Bridge input JSON is NULL\");\n";
         bridgeOS << "        return NULL;\n";
         bridgeOS << "    }\n\n";
 
@@ -1369,13 +1587,13 @@ private:
         bridgeOS << "    cJSON* params_item = cJSON_GetObjectItemCaseSensitive(input_json, \"params\");\n\n";
 
         bridgeOS << "    if (!method_item || !cJSON_IsString(method_item) || !method_item->valuestring) {\n";
-        bridgeOS << "        fprintf(stderr, \"Error: Invalid or missing 'method' string in input JSON\\n\");\n";
+        bridgeOS << "        mcp_log_error(\"Invalid or missing 'method' string in input JSON\");\n";
         bridgeOS << "        // TODO: Return error JSON\n";
         bridgeOS << "        return NULL;\n";
         bridgeOS << "    }\n";
          // Params are optional for some functions, but should be object if present
          bridgeOS << "    if (params_item && !cJSON_IsObject(params_item)) {\n";
-         bridgeOS << "        fprintf(stderr, \"Error: 'params' field exists but is not a JSON object\\n\");\n";
+         bridgeOS << "        mcp_log_error(\"'params' field exists but is not a JSON object\");\n";
          bridgeOS << "        // TODO: Return error JSON\n";
          bridgeOS << "        return NULL;\n";
          bridgeOS << "    }\n";
@@ -1388,16 +1606,16 @@ private:
         bridgeOS << "    cJSON* result = NULL;\n\n";
 
         // --- Function Dispatch ---
-        bridgeOS << "    bool handled = false;\n";
-        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
-             bridgeOS << "    if (!handled && strcmp(func_name, \"" << funcDef.exportName << "\") == 0) {\n";
-             bridgeOS << "        result = handle_" << funcDef.originalName << "(params_obj);\n";
-             bridgeOS << "        handled = true;\n";
-             bridgeOS << "    }\n";
-        }
-
-        bridgeOS << "    if (!handled) {\n";
-        bridgeOS << "        fprintf(stderr, \"Error: Unknown function method '%s' called\\n\", func_name);\n";
+        bridgeOS << "    const bridge_tool_info* tool = bridge_lookup(func_name, strlen(func_name));\n";
+        bridgeOS << "    bridge_handler handler = tool != NULL ? tool->handler : NULL;\n";
+        bridgeOS << "    if (handler == NULL) {\n";
+        bridgeOS << "        // Tools built as loadable modules, loaded on their first call\n";
+        bridgeOS << "        handler = mcp_module_lookup(func_name);\n";
+        bridgeOS << "    }\n";
+        bridgeOS << "    if (handler != NULL) {\n";
+        bridgeOS << "        result = handler(params_obj);\n";
+        bridgeOS << "    } else {\n";
+        bridgeOS << "        mcp_log_error(\"Unknown function method '%s' called\", func_name);\n";
         bridgeOS << "        // TODO: Return error JSON\n";
         bridgeOS << "        result = NULL;\n";
         bridgeOS << "    }\n\n";
@@ -1409,10 +1627,145 @@ private:
         bridgeOS << "    return result;\n";
         bridgeOS << "}\n\n";
 
+        // --- Tool names for the statistics, indexed as in the handlers ---
+        bridgeOS << "const char* const bridge_tool_names[] = {\n";
+        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
+            bridgeOS << "    \"" << funcDef.exportName << "\",\n";
+        }
+        bridgeOS << "    NULL\n";
+        bridgeOS << "};\n";
+        bridgeOS << "const unsigned bridge_tool_count = " << g_persistentFunctions.size() << ";\n\n";
+
         bridgeOS << "#ifdef __cplusplus\n} // extern \"C\"\n#endif\n";
         bridgeOS.flush();
     }
 
+    // Generates the entry points of a loadable module (see mcp_module.h): the
+    // signatures of its tools for `mcpc --index-modules`, and their handlers
+    void generateModuleFile(raw_fd_ostream &os, const std::string& baseName) {
+        auto inModule = [baseName](const std::string& base) { return base == baseName; };
+        os << "// Loadable module entry points for " << baseName << " (Auto-generated - Do not modify)\n";
+        os << "#include \"cJSON.h\"\n";
+        os << "#include \"mcp_log.h\" // mcp_log_error\n";
+        os << "#include \"mcp_module.h\" // MCP_MODULE_EXPORT, mcp_module_handler\n";
+        os << "#include <string.h> // For memcmp, strlen\n";
+        os << "#include \"" << baseName << "_bridge.h\"\n\n";
+        os << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+
+        generateSignaturesFunction(os, "MCP_MODULE_EXPORT cJSON* mcpc_module_signatures(void)", "static const char module_signatures_json_text",
+                                   "module_signatures_json_text", generateSignaturesText(inModule));
+
+        os << "// Collision-free method lookup (generated decision tree: length, then characters)\n";
+        emitLookupFunction(os, "static mcp_module_handler module_lookup", inModule,
+                           [](const PersistentFunctionDefinition& funcDef) { return "handle_" + funcDef.originalName; });
+        os << "MCP_MODULE_EXPORT mcp_module_handler mcpc_module_handler(const char* name) {\n";
+        os << "    return module_lookup(name, strlen(name));\n";
+        os << "}\n\n";
+
+        os << "#ifdef __cplusplus\n} // extern \"C\"\n#endif\n";
+        os.flush();
+    }
+
+    // C expression that builds a random JSON value valid for `schema`
+    std::string fixtureExpression(const PersistentJsonSchemaInfo& schema) {
+        std::string referencedExportName;
+        size_t defsPos = schema.ref.find("#/$defs/");
+        if (defsPos != std::string::npos) {
+            referencedExportName = schema.ref.substr(defsPos + strlen("#/$defs/"));
+        }
+        if (g_persistentStructs.count(referencedExportName)) {
+            return "fixture_" + referencedExportName + "(seed)";
+        }
+        if (g_persistentEnums.count(referencedExportName) && !g_persistentEnums.at(referencedExportName).constants.empty()) {
+            return "cJSON_CreateString(enum_" + referencedExportName + "[mcp_microbench_random(seed) % " +
+                   std::to_string(g_persistentEnums.at(referencedExportName).constants.size()) + "u])";
+        }
+        if (schema.type == "string") return "mcp_microbench_string(seed)";
+        if (schema.type == "integer") return "cJSON_CreateNumber((double)(mcp_microbench_random(seed) % 1000u))";
+        if (schema.type == "number") return "cJSON_CreateNumber((double)mcp_microbench_random(seed) / 65536.0)";
+        if (schema.type == "boolean") return "cJSON_CreateBool(mcp_microbench_random(seed) & 1u)";
+        if (schema.type == "array") return "cJSON_CreateArray()"; // Array fields are not parsed yet
+        return "cJSON_CreateObject()";
+    }
+
+    // Generates a program timing each parse_<struct> and handle_<function> on
+    // randomized inputs built from their schemas (see mcp_microbench.h)
+    void generateMicrobenchFile(raw_fd_ostream &os) {
+        os << "// Microbenchmarks of the generated parsers and handlers (Auto-generated - Do not modify)\n";
+        os << "#include \"cJSON.h\"\n";
+        os << "#include \"mcp_microbench.h\"\n";
+        os << "#include <stddef.h>\n\n";
+        for (const std::string& baseName : g_processedFileBases) {
+            os << "#include \"" << baseName << "_bridge.h\"\n";
+        }
+        os << "\n#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+
+        for (const auto& [exportName, enumDef] : g_persistentEnums) {
+            if (enumDef.constants.empty()) continue;
+            os << "static const char* const enum_" << exportName << "[] = {";
+            for (size_t i = 0; i < enumDef.constants.size(); ++i) {
+                os << (i > 0 ? ", " : " ") << "\"" << escapeString(enumDef.constants[i].name) << "\"";
+            }
+            os << " };\n";
+        }
+        os << "\n";
+
+        // Fixtures: structs may nest each other, so declare them all first
+        for (const auto& [exportName, structDef] : g_persistentStructs) {
+            os << "static cJSON* fixture_" << exportName << "(uint32_t* seed);\n";
+        }
+        os << "\n";
+        for (const auto& [exportName, structDef] : g_persistentStructs) {
+            os << "static cJSON* fixture_" << exportName << "(uint32_t* seed) {\n";
+            os << "    cJSON* json = cJSON_CreateObject();\n";
+            for (const auto& field : structDef.fields) {
+                os << "    cJSON_AddItemToObject(json, \"" << field.name << "\", " << fixtureExpression(field.schemaInfo) << ");\n";
+            }
+            os << "    return json;\n";
+            os << "}\n\n";
+            os << "static const void* run_parse_" << exportName << "(cJSON* input) {\n";
+            os << "    return parse_" << exportName << "(input);\n";
+            os << "}\n\n";
+        }
+        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
+            if (funcDef.isAsync || funcDef.isStream) continue; // Their reply needs a running request
+            os << "static cJSON* fixture_params_" << funcDef.originalName << "(uint32_t* seed) {\n";
+            os << "    cJSON* json = cJSON_CreateObject();\n";
+            if (funcDef.parameters.empty()) {
+                os << "    (void)seed;\n";
+            }
+            for (const auto& param : funcDef.parameters) {
+                os << "    cJSON_AddItemToObject(json, \"" << param.name << "\", " << fixtureExpression(param.schemaInfo) << ");\n";
+            }
+            os << "    return json;\n";
+            os << "}\n\n";
+            os << "static const void* run_handle_" << funcDef.originalName << "(cJSON* input) {\n";
+            os << "    return handle_" << funcDef.originalName << "(input);\n";
+            os << "}\n\n";
+        }
+
+        size_t count = 0;
+        os << "static const mcp_microbench_case microbench_cases[] = {\n";
+        for (const auto& [exportName, structDef] : g_persistentStructs) {
+            os << "    { \"parse_" << exportName << "\", fixture_" << exportName << ", run_parse_" << exportName << " },\n";
+            ++count;
+        }
+        for (const auto& [exportName, funcDef] : g_persistentFunctions) {
+            if (funcDef.isAsync || funcDef.isStream) continue;
+            os << "    { \"handle_" << funcDef.originalName << "\", fixture_params_" << funcDef.originalName
+               << ", run_handle_" << funcDef.originalName << " },\n";
+            ++count;
+        }
+        os << "    { NULL, NULL, NULL }\n";
+        os << "};\n\n";
+
+        os << "int main(int argc, char** argv) {\n";
+        os << "    return mcp_microbench_main(argc, argv, microbench_cases, " << count << "u);\n";
+        os << "}\n\n";
+        os << "#ifdef __cplusplus\n} // extern \"C\"\n#endif\n";
+        os.flush();
+    }
+
     // NEW: Generate the per-file bridge C and H files
     void generatePerFileBridgeCode() {
         errs() << "Generating per-file bridge code...\n";
@@ -1430,6 +1783,10 @@ private:
                  *c_streams[baseName] << "// Generated bridge C file for " << baseName << "\n";
                  *c_streams[baseName] << "#include \"" << baseName << "_bridge.h\"\n";
                   *c_streams[baseName] << "#include \"cJSON.h\"\n";
+                  *c_streams[baseName] << "#include \"mcp_arena.h\" // mcp_malloc/mcp_strdup/mcp_free\n";
+                  *c_streams[baseName] << "#include \"mcp_dispatch.h\" // mcp_call_detach for async functions, mcp_stats_*/mcp_trace_* timings\n";
+                  *c_streams[baseName] << "#include \"mcp_stream.h\" // mcp_stream_open/mcp_stream_close for streaming functions\n";
+                  *c_streams[baseName] << "#include \"mcp_log.h\" // mcp_log_warn/mcp_log_error\n";
                   *c_streams[baseName] << "#include <string.h>\n";
                   *c_streams[baseName] << "#include <stdlib.h>\n";
                   *c_streams[baseName] << "#include <stdio.h>\n";
@@ -1452,6 +1809,10 @@ private:
                  *c_streams[baseName] << "// Generated bridge C file for " << baseName << "\n";
                  *c_streams[baseName] << "#include \"" << baseName << "_bridge.h\"\n";
                   *c_streams[baseName] << "#include \"cJSON.h\"\n";
+                  *c_streams[baseName] << "#include \"mcp_arena.h\" // mcp_malloc/mcp_strdup/mcp_free\n";
+                  *c_streams[baseName] << "#include \"mcp_dispatch.h\" // mcp_call_detach for async functions, mcp_stats_*/mcp_trace_* timings\n";
+                  *c_streams[baseName] << "#include \"mcp_stream.h\" // mcp_stream_open/mcp_stream_close for streaming functions\n";
+                  *c_streams[baseName] << "#include \"mcp_log.h\" // mcp_log_warn/mcp_log_error\n";
                   *c_streams[baseName] << "#include <string.h>\n";
                   *c_streams[baseName] << "#include <stdlib.h>\n";
                    *c_streams[baseName] << "#include <stdio.h>\n";
@@ -1483,6 +1844,10 @@ private:
                  *c_streams[baseName] << "// Generated bridge C file for " << baseName << "\n";
                  *c_streams[baseName] << "#include \"" << baseName << "_bridge.h\"\n";
                  *c_streams[baseName] << "#include \"cJSON.h\"\n";
+                 *c_streams[baseName] << "#include \"mcp_arena.h\" // mcp_malloc/mcp_strdup/mcp_free\n";
+                 *c_streams[baseName] << "#include \"mcp_dispatch.h\" // mcp_call_detach for async functions, mcp_stats_*/mcp_trace_* timings\n";
+                 *c_streams[baseName] << "#include \"mcp_stream.h\" // mcp_stream_open/mcp_stream_close for streaming functions\n";
+                 *c_streams[baseName] << "#include \"mcp_log.h\" // mcp_log_warn/mcp_log_error\n";
                  *c_streams[baseName] << "#include <string.h>\n";
                  *c_streams[baseName] << "#include <stdlib.h>\n";
                  *c_streams[baseName] << "#include <stdio.h>\n";
@@ -1493,6 +1858,12 @@ private:
                  }
                  *c_streams[baseName] << "\n// Forward declare original functions needed\n";
                   *c_streams[baseName] << "extern " << funcDef.returnTypeName << " " << funcDef.originalName << "(";
+                    if (funcDef.isAsync) {
+                        *c_streams[baseName] << "mcp_call*, mcp_cancel_token*" << (funcDef.parameters.empty() ? "" : ", ");
+                    }
+                    if (funcDef.isStream) {
+                        *c_streams[baseName] << "mcp_stream*" << (funcDef.parameters.empty() ? "" : ", ");
+                    }
                     for (size_t i = 0; i < funcDef.parameters.size(); ++i) {
                         *c_streams[baseName] << (i > 0 ? ", " : "") << funcDef.parameters[i].typeName; // No names needed for extern decl
                     }
@@ -1563,6 +1934,36 @@ private:
               errs() << "Successfully wrote bridge file: " << BridgeOutputFilename << "\n";
          }
 
+        // 4. Entry points of the source files built as loadable modules
+        for (const std::string& baseName : ModuleBases) {
+            if (!g_processedFileBases.count(baseName)) {
+                errs() << "Warning: --module " << baseName << " matches no processed source file\n";
+                continue;
+            }
+            SmallString<256> modulePath(BridgeOutputDir);
+            sys::path::append(modulePath, baseName + "_module.c");
+            std::error_code EC_module;
+            raw_fd_ostream moduleOS(modulePath, EC_module, llvm::sys::fs::OF_Text);
+            if (EC_module) {
+                errs() << "Error opening module file " << modulePath << ": " << EC_module.message() << "\n";
+            } else {
+                generateModuleFile(moduleOS, baseName);
+                errs() << "Successfully wrote module file: " << modulePath << "\n";
+            }
+        }
+
+        // 5. Optional microbenchmark program (using persistent data)
+        if (!MicrobenchOutputFilename.empty()) {
+            std::error_code EC_bench;
+            raw_fd_ostream benchOS(MicrobenchOutputFilename, EC_bench, llvm::sys::fs::OF_Text);
+            if (EC_bench) {
+                errs() << "Error opening microbenchmark file " << MicrobenchOutputFilename << ": " << EC_bench.message() << "\n";
+            } else {
+                generateMicrobenchFile(benchOS);
+                errs() << "Successfully wrote microbenchmark file: " << MicrobenchOutputFilename << "\n";
+            }
+        }
+
          // Clear persistent data (optional, as program exits soon)
          //g_persistentEnums.clear();
          //g_persistentStructs.clear();
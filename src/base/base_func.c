@@ -5,6 +5,10 @@
 #include "export_macro.h"
 #include "generated_func.h"
 #include "base_func.h"
+#include "mcp_log.h"
+#include "mcp_module.h"
+#include "mcp_resource.h"
+#include "mcp_session.h"
 // Assume EXPORT_AS is defined in a header provided by the mcp-c framework
 // If not, you might need to include the specific header file here.
 // #include "mcp_export.h" // Or similar, depending on the framework
@@ -31,11 +35,15 @@ cJSON* initialize(char* protocolVersion, struct capabilities* capabilities, stru
         return NULL;
     }
 
-    fprintf(stderr, "protocolVersion: %s\n", protocolVersion);
-    fprintf(stderr, "capabilities.roots.listChanged: %d\n", capabilities->roots.listChanged);
-    fprintf(stderr, "capabilities.sampling.maxTokens: %d\n", capabilities->sampling.maxTokens);
-    fprintf(stderr, "clientInfo.name: %s\n", clientInfo->name);
-    fprintf(stderr, "clientInfo.version: %s\n", clientInfo->version);
+    mcp_log_debug("protocolVersion: %s", protocolVersion);
+    mcp_log_debug("capabilities.roots.listChanged: %d", capabilities->roots.listChanged);
+    mcp_log_debug("capabilities.sampling.maxTokens: %d", capabilities->sampling.maxTokens);
+    mcp_log_debug("clientInfo.name: %s", clientInfo->name);
+    mcp_log_debug("clientInfo.version: %s", clientInfo->version);
+
+    // 记录到当前连接的会话, 同一进程内每个客户端各自握手
+    mcp_session_set_client(mcp_session_current(), protocolVersion, clientInfo->name, clientInfo->version,
+                           capabilities->roots.listChanged, capabilities->sampling.maxTokens);
 
     // 添加serverInfo
     cJSON* serverInfo = cJSON_CreateObject();
@@ -46,6 +54,13 @@ cJSON* initialize(char* protocolVersion, struct capabilities* capabilities, stru
     cJSON_AddItemToObject(result, "serverInfo", serverInfo);
     cJSON_AddStringToObject(serverInfo, "name", SERVER_NAME);
     cJSON_AddStringToObject(serverInfo, "version", SERVER_VERSION);
+
+    // 配置了 MCPC_RESOURCE_ROOT 时才提供 resources
+    cJSON* serverCapabilities = cJSON_AddObjectToObject(result, "capabilities");
+    cJSON_AddObjectToObject(serverCapabilities, "tools");
+    if (mcp_resource_enabled()) {
+        cJSON_AddObjectToObject(serverCapabilities, "resources");
+    }
     int i=0;
     return result;
 }
@@ -62,16 +77,40 @@ cJSON* initialize(char* protocolVersion, struct capabilities* capabilities, stru
 EXPORT_AS(notifications, initialized)
 cJSON* initialized_notification() {
     // 这里可以添加初始化完成后的处理逻辑
-    printf("Server initialized successfully\n");
+    mcp_session_set_initialized(mcp_session_current());
+    mcp_log_info("Server initialized successfully");
     cJSON* result = cJSON_CreateObject();
     return result;
 }
 
+// A raw item referring to the text export serialized: printing the reply copies it in one go
+static cJSON* function_signatures_reference(void) {
+    cJSON* item = cJSON_CreateNull();
+    if (item != NULL) {
+        item->type = cJSON_Raw | cJSON_IsReference;
+        item->valuestring = (char*)function_signatures_json_text;
+    }
+    return item;
+}
+
 EXPORT_AS(tools, list)
 cJSON* handle_tools_list() {
-    cJSON* result = get_all_function_signatures_json();
+    if (mcp_module_count() == 0) {
+        return function_signatures_reference();
+    }
+    // Tools of loadable modules are listed from their manifest, without loading them
+    cJSON* result = cJSON_ParseWithLength(function_signatures_json_text, function_signatures_json_length);
+    mcp_module_add_signatures(result);
     return result;
 }
 
+EXPORT_AS(resources, list)
+cJSON* handle_resources_list() {
+    return mcp_resource_list();
+}
 
-
+// Files are written straight from their mapping, in chunks, see mcp_resource.h
+EXPORT_STREAM_AS(resources, read)
+void handle_resources_read(mcp_stream* out, char* uri) {
+    mcp_resource_read(out, uri);
+}
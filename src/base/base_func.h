@@ -3,6 +3,7 @@
 #include <stdbool.h>
 
 #include "export_macro.h"
+#include "mcp_stream.h"
 // --- Server Information (Constants) ---
 #define SERVER_NAME "secure-filesystem-server" // Server name
 #define SERVER_VERSION "0.2.0"                 // Server version
@@ -35,5 +36,7 @@ typedef struct EXPORT initialize_params {
 cJSON* initialize(char* protocolVersion, struct capabilities* capabilities, struct client_info* clientInfo);
 cJSON* initialized_notification();
 cJSON* handle_tools_list();
+cJSON* handle_resources_list();
+void handle_resources_read(mcp_stream* out, char* uri);
 
 #endif
@@ -1,66 +1,346 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "export_macro.h"
 #include "mcp.h"
-#include "generated_func.h"
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_framer.h"
+#include "mcp_log.h"
+#include "mcp_module.h"
+#include "mcp_pool.h"
+#include "mcp_queue.h"
+#include "mcp_resource.h"
+#include "mcp_session.h"
+#include "mcp_stream.h"
+#include "mcp_thread.h"
+#include "mcp_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int mcp_serve() {
-    char buffer[4096] = {0};
-    cJSON *json = NULL;
-    cJSON *id = NULL;
-    cJSON *result = NULL;
-    int ret = 2;
-    
-    // Read data from standard input
-    if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
-        fprintf(stderr, "Error reading from stdin\n");
-        return -1;
+/**
+ * @brief stdio transport state. Workers hand finished replies to the single
+ * writer thread through `replies`, so stdout never interleaves.
+ */
+typedef struct mcp_stdio {
+    mcp_sink sink;
+    mcp_session* session;  // stdio serves exactly one client
+    mcp_pool pool;
+    mcp_queue replies;
+    mcp_writer writer;
+    mcp_stream_gate gate;  // Keeps a streamed reply in one piece on stdout
+    mcp_thread_t deadline_thread;
+    mcp_mutex_t deadline_lock;
+    mcp_cond_t deadline_armed;
+    bool stopping;
+} mcp_stdio;
+
+typedef struct mcp_stdio_reply {
+    cJSON* response;
+    mcp_arena* arena;
+    int tool;  // For the byte count, see mcp_stats_bytes_out()
+    // A piece of a streamed reply instead of `response`
+    char* chunk;
+    size_t length;
+    bool last;
+    struct mcp_stdio_reply* next;  // Held back while a streamed reply is being written
+} mcp_stdio_reply;
+
+static void mcp_stdio_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    mcp_stdio* stdio_ctx = (mcp_stdio*)sink;
+    mcp_stdio_reply* reply = response != NULL ? (mcp_stdio_reply*)calloc(1, sizeof(mcp_stdio_reply)) : NULL;
+    if (reply != NULL) {
+        reply->response = response;
+        reply->arena = arena;
+        reply->tool = mcp_stats_current();
+        if (mcp_queue_push(&stdio_ctx->replies, reply) == 0) {
+            return;
+        }
+        free(reply);
     }
-    
-    // Parse JSON data
-    json = cJSON_Parse(buffer);
-    if (json == NULL) {
-        const char *error_ptr = cJSON_GetErrorPtr();
-        if (error_ptr != NULL) {
-            fprintf(stderr, "JSON parsing error: %s\n", error_ptr);
+    mcp_response_release(response, arena);
+}
+
+// Worker thread: queues the next piece of a streamed reply, waiting while stdout lags behind
+static int mcp_stdio_send_chunk(mcp_sink* sink, char* chunk, size_t length, bool first, bool last) {
+    mcp_stdio* stdio_ctx = (mcp_stdio*)sink;
+    bool queued = false;
+    if (mcp_stream_gate_enter(&stdio_ctx->gate, length, first) == 0) {
+        mcp_stdio_reply* reply = (mcp_stdio_reply*)calloc(1, sizeof(mcp_stdio_reply));
+        if (reply != NULL) {
+            reply->chunk = chunk;
+            reply->length = length;
+            reply->last = last;
+            reply->tool = mcp_stats_current();
+            queued = mcp_queue_push(&stdio_ctx->replies, reply) == 0;
+            if (!queued) {
+                free(reply);
+            }
         }
-        return -1;
+        if (!queued) {
+            mcp_stream_gate_written(&stdio_ctx->gate, length);
+        }
+    }
+    if (!queued) {
+        free(chunk);
     }
+    // The stream holds stdout from its first accepted piece up to its last one
+    if (last || (first && !queued)) {
+        mcp_stream_gate_leave(&stdio_ctx->gate);
+    }
+    return queued ? 0 : -1;
+}
 
-    // Get request ID
-    id = cJSON_GetObjectItemCaseSensitive(json, "id");
-    if (id == NULL || !cJSON_IsNumber(id)) {
-        fprintf(stderr, "Invalid or missing request ID\n");
-        cJSON_Delete(json);
+// Appends one reply, or one piece of a streamed one, to the output buffer
+static void mcp_stdio_encode(mcp_stdio* stdio_ctx, mcp_stdio_reply* reply, size_t* streamed) {
+    size_t length = stdio_ctx->writer.length;
+    uint64_t trace = mcp_trace_begin();
+    if (reply->chunk != NULL) {
+        if (mcp_writer_append(&stdio_ctx->writer, reply->chunk, reply->length) != 0 ||
+            (reply->last && mcp_writer_append(&stdio_ctx->writer, "\n", 1) != 0)) {
+            mcp_log_error("Failed to buffer a streamed response");
+        }
+        *streamed += reply->length;
+        free(reply->chunk);
+    } else if (mcp_writer_append_json(&stdio_ctx->writer, reply->response) != 0) {
+        mcp_log_error("Failed to encode response");
+    }
+    mcp_stats_bytes_out(reply->tool, stdio_ctx->writer.length - length);
+    mcp_trace_end("encode", trace);
+    // Compact JSON is in the reused output buffer, drop the request arena
+    mcp_response_release(reply->response, reply->arena);
+    free(reply);
+}
+
+/**
+ * @brief Writer thread: encodes every reply that is ready into the output
+ * buffer and flushes them with one write(), in completion order. Replies
+ * finishing while a streamed one is half written follow its last piece.
+ */
+static void* mcp_writer_main(void* arg) {
+    mcp_stdio* stdio_ctx = (mcp_stdio*)arg;
+    mcp_stdio_reply* reply = NULL;
+    mcp_stdio_reply* held = NULL;
+    mcp_stdio_reply** held_tail = &held;
+    bool streaming = false;
+    mcp_trace_name_thread("stdout writer");
+
+    while ((reply = (mcp_stdio_reply*)mcp_queue_pop(&stdio_ctx->replies)) != NULL) {
+        size_t streamed = 0;
+        do {
+            if (streaming && reply->chunk == NULL) {
+                *held_tail = reply;
+                held_tail = &reply->next;
+                continue;
+            }
+            if (reply->chunk != NULL) {
+                streaming = !reply->last;
+            }
+            mcp_stdio_encode(stdio_ctx, reply, &streamed);
+            while (!streaming && held != NULL) {
+                mcp_stdio_reply* next = held->next;
+                mcp_stdio_encode(stdio_ctx, held, &streamed);
+                held = next;
+            }
+            if (held == NULL) {
+                held_tail = &held;
+            }
+        } while ((reply = (mcp_stdio_reply*)mcp_queue_try_pop(&stdio_ctx->replies)) != NULL);
+
+        uint64_t trace = mcp_trace_begin();
+        if (mcp_writer_flush(&stdio_ctx->writer) != 0) {
+            mcp_log_error("Error writing to stdout");
+        }
+        mcp_trace_end("write", trace);
+        if (streamed > 0) {
+            mcp_stream_gate_written(&stdio_ctx->gate, streamed);
+        }
+    }
+    return NULL;
+}
+
+static void mcp_deadline_armed(void* arg) {
+    mcp_stdio* stdio_ctx = (mcp_stdio*)arg;
+    mcp_mutex_lock(&stdio_ctx->deadline_lock);
+    mcp_cond_signal(&stdio_ctx->deadline_armed);
+    mcp_mutex_unlock(&stdio_ctx->deadline_lock);
+}
+
+/**
+ * @brief Deadline thread: ticks the deadline wheel while requests with a
+ * timeout are running and sleeps otherwise. stdio has no event loop to do it.
+ */
+static void* mcp_deadline_main(void* arg) {
+    mcp_stdio* stdio_ctx = (mcp_stdio*)arg;
+    mcp_timer_wheel* wheel = mcp_dispatch_deadlines();
+    mcp_trace_name_thread("deadlines");
+    for (;;) {
+        mcp_mutex_lock(&stdio_ctx->deadline_lock);
+        while (!stdio_ctx->stopping && mcp_timer_wheel_count(wheel) == 0) {
+            mcp_cond_wait(&stdio_ctx->deadline_armed, &stdio_ctx->deadline_lock);
+        }
+        bool stopping = stdio_ctx->stopping;
+        mcp_mutex_unlock(&stdio_ctx->deadline_lock);
+        if (stopping) {
+            return NULL;
+        }
+        mcp_sleep_ms(MCP_TIMER_TICK_MS);
+        mcp_timer_wheel_advance(wheel);
+    }
+}
+
+static int mcp_deadline_start(mcp_stdio* stdio_ctx) {
+    stdio_ctx->stopping = false;
+    mcp_mutex_init(&stdio_ctx->deadline_lock);
+    mcp_cond_init(&stdio_ctx->deadline_armed);
+    if (mcp_thread_create(&stdio_ctx->deadline_thread, mcp_deadline_main, stdio_ctx) != 0) {
+        mcp_cond_destroy(&stdio_ctx->deadline_armed);
+        mcp_mutex_destroy(&stdio_ctx->deadline_lock);
         return -1;
     }
+    mcp_timer_wheel_set_driver(mcp_dispatch_deadlines(), mcp_deadline_armed, stdio_ctx);
+    return 0;
+}
+
+static void mcp_deadline_stop(mcp_stdio* stdio_ctx) {
+    mcp_timer_wheel_set_driver(mcp_dispatch_deadlines(), NULL, NULL);
+    mcp_mutex_lock(&stdio_ctx->deadline_lock);
+    stdio_ctx->stopping = true;
+    mcp_cond_signal(&stdio_ctx->deadline_armed);
+    mcp_mutex_unlock(&stdio_ctx->deadline_lock);
+    mcp_thread_join(stdio_ctx->deadline_thread);
+    mcp_cond_destroy(&stdio_ctx->deadline_armed);
+    mcp_mutex_destroy(&stdio_ctx->deadline_lock);
+}
 
-    // Process JSON data here
-    cJSON* response = cJSON_CreateObject();
-    result = bridge(json);
-    if (result != NULL) {
-        if (response != NULL) {
-            // Add result to response
-            cJSON_AddItemToObject(response, "result", result);
+/**
+ * @brief Reader loop: frames newline-delimited JSON-RPC messages from stdin,
+ * parses them in place and queues them for the worker pool, so the next
+ * message is parsed while earlier handlers run. Returns on EOF.
+ */
+static void mcp_read_loop(mcp_stdio* stdio_ctx) {
+    mcp_framer framer;
+    char* message = NULL;
+    size_t length = 0;
+
+    if (mcp_framer_init(&framer, 0, MCP_FRAMER_INITIAL_CAPACITY) != 0) {
+        fprintf(stderr, "Failed to allocate input buffer\n");
+        return;
+    }
+    mcp_trace_name_thread("stdin reader");
+    for (;;) {
+        // The frame span includes any wait for stdin, so idle gaps show up as well
+        uint64_t trace = mcp_trace_begin();
+        if (mcp_framer_next(&framer, &message, &length) != 1) {
+            break;
+        }
+        mcp_trace_end("frame", trace);
+        if (length == 0) {
+            continue; // Skip blank lines between messages
         }
-    }else{
-        cJSON_AddStringToObject(response, "result", cJSON_CreateObject());
-        printf("result is NULL\n");
-    }
-    // Add ID to response
-    cJSON_AddNumberToObject(response, "id", id->valueint);
-    // Add jsonrpc version
-    cJSON_AddStringToObject(response, "jsonrpc", "2.0");
-    printf("%s\n", cJSON_Print(response));
-    // Clean up resources
-    cJSON_Delete(json);
-    cJSON_Delete(response);
-    return ret;
+        // Parse straight into the arena that will also hold the reply
+        mcp_arena* arena = mcp_arena_acquire();
+        mcp_arena* previous = mcp_arena_set_current(arena);
+        trace = mcp_trace_begin();
+        cJSON* json = cJSON_ParseWithLength(message, length);
+        mcp_trace_end("cJSON_Parse", trace);
+        mcp_arena_set_current(previous);
+        if (json == NULL) {
+            const char *error_ptr = cJSON_GetErrorPtr();
+            if (error_ptr != NULL) {
+                mcp_log_warn("JSON parsing error: %.64s", error_ptr);
+            }
+            mcp_arena_release(arena);
+            continue;
+        }
+        // Stop reading stdin while the queue is full; the client's writes block on the pipe
+        mcp_pool_wait_room(&stdio_ctx->pool);
+        if (mcp_dispatch_submit(&stdio_ctx->pool, json, length, arena, &stdio_ctx->sink, stdio_ctx->session) != 0) {
+            mcp_response_release(json, arena);
+            break;
+        }
+    }
+    mcp_framer_destroy(&framer);
+}
+
+int mcp_serve() {
+    mcp_stdio stdio_ctx;
+    mcp_thread_t writer_thread;
+
+    mcp_log_init();
+    mcp_arena_install_hooks();
+    stdio_ctx.sink.send = mcp_stdio_send;
+    stdio_ctx.sink.send_chunk = mcp_stdio_send_chunk;
+    mcp_stream_gate_init(&stdio_ctx.gate);
+    stdio_ctx.session = mcp_session_create();
+    if (stdio_ctx.session == NULL || mcp_writer_init(&stdio_ctx.writer, 1, MCP_WRITER_INITIAL_CAPACITY) != 0) {
+        fprintf(stderr, "Failed to allocate output buffer\n");
+        mcp_session_release(stdio_ctx.session);
+        mcp_stream_gate_destroy(&stdio_ctx.gate);
+        return -1;
+    }
+    if (mcp_queue_init(&stdio_ctx.replies, 64) != 0) {
+        fprintf(stderr, "Failed to allocate reply queue\n");
+        mcp_writer_destroy(&stdio_ctx.writer);
+        mcp_session_release(stdio_ctx.session);
+        mcp_stream_gate_destroy(&stdio_ctx.gate);
+        return -1;
+    }
+    if (mcp_thread_create(&writer_thread, mcp_writer_main, &stdio_ctx) != 0) {
+        fprintf(stderr, "Failed to start writer thread\n");
+        mcp_queue_destroy(&stdio_ctx.replies);
+        mcp_writer_destroy(&stdio_ctx.writer);
+        mcp_session_release(stdio_ctx.session);
+        mcp_stream_gate_destroy(&stdio_ctx.gate);
+        return -1;
+    }
+    if (mcp_pool_init(&stdio_ctx.pool, 0) != 0) {
+        fprintf(stderr, "Failed to start worker pool\n");
+        mcp_queue_close(&stdio_ctx.replies);
+        mcp_thread_join(writer_thread);
+        mcp_queue_destroy(&stdio_ctx.replies);
+        mcp_writer_destroy(&stdio_ctx.writer);
+        mcp_session_release(stdio_ctx.session);
+        mcp_stream_gate_destroy(&stdio_ctx.gate);
+        return -1;
+    }
+    if (mcp_deadline_start(&stdio_ctx) != 0) {
+        fprintf(stderr, "Failed to start deadline thread\n");
+        mcp_pool_shutdown(&stdio_ctx.pool);
+        mcp_queue_close(&stdio_ctx.replies);
+        mcp_thread_join(writer_thread);
+        mcp_queue_destroy(&stdio_ctx.replies);
+        mcp_writer_destroy(&stdio_ctx.writer);
+        mcp_session_release(stdio_ctx.session);
+        mcp_stream_gate_destroy(&stdio_ctx.gate);
+        return -1;
+    }
+    if (mcp_stats_start_dumper() != 0) {
+        fprintf(stderr, "Failed to start statistics dumper, SIGUSR1 is ignored\n");
+    }
+    mcp_trace_init();
+    mcp_module_init();
+    mcp_resource_init();
+
+    // Serve until stdin is closed, then let in-flight requests finish
+    mcp_read_loop(&stdio_ctx);
+    mcp_pool_shutdown(&stdio_ctx.pool);
+    mcp_dispatch_drain_calls(false);
+    mcp_deadline_stop(&stdio_ctx);
+    mcp_queue_close(&stdio_ctx.replies);
+    mcp_thread_join(writer_thread);
+    mcp_stats_stop_dumper();
+    mcp_trace_shutdown();
+    mcp_log_shutdown();
+
+    mcp_queue_destroy(&stdio_ctx.replies);
+    mcp_writer_destroy(&stdio_ctx.writer);
+    mcp_session_release(stdio_ctx.session);
+    mcp_stream_gate_destroy(&stdio_ctx.gate);
+    return 0;
 }
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_arena.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_ARENA_ALIGN 16
+#define MCP_ALIGN_UP(n) (((n) + (MCP_ARENA_ALIGN - 1)) & ~(size_t)(MCP_ARENA_ALIGN - 1))
+
+// Tags written in front of every mcp_malloc() block so mcp_free() knows its origin
+#define MCP_ALLOC_HEAP ((size_t)0x4d435048u)  // "MCPH"
+#define MCP_ALLOC_ARENA ((size_t)0x4d435041u) // "MCPA"
+
+typedef struct mcp_alloc_header {
+    size_t tag;
+    size_t reserved;  // Keeps the payload 16-byte aligned
+} mcp_alloc_header;
+
+typedef struct mcp_arena_chunk {
+    struct mcp_arena_chunk* next;
+    size_t size;
+    volatile long used;
+    char* data;
+} mcp_arena_chunk;
+
+static mcp_mutex_t g_arena_lock = MCP_MUTEX_INITIALIZER;
+static mcp_arena* g_arena_free_list = NULL;
+static size_t g_arena_free_count = 0;
+static MCP_THREAD_LOCAL mcp_arena* t_current_arena = NULL;
+static MCP_THREAD_LOCAL size_t t_allocations = 0;
+static MCP_THREAD_LOCAL size_t t_allocated_bytes = 0;
+
+static mcp_arena_chunk* mcp_arena_chunk_new(size_t min_size) {
+    size_t size = min_size > MCP_ARENA_CHUNK_SIZE ? MCP_ALIGN_UP(min_size) : MCP_ARENA_CHUNK_SIZE;
+    size_t header = MCP_ALIGN_UP(sizeof(mcp_arena_chunk));
+    mcp_arena_chunk* chunk = (mcp_arena_chunk*)malloc(header + size);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->data = (char*)chunk + header;
+    return chunk;
+}
+
+mcp_arena* mcp_arena_acquire(void) {
+    mcp_arena* arena = NULL;
+    mcp_mutex_lock(&g_arena_lock);
+    if (g_arena_free_list != NULL) {
+        arena = g_arena_free_list;
+        g_arena_free_list = arena->next_free;
+        g_arena_free_count--;
+    }
+    mcp_mutex_unlock(&g_arena_lock);
+    if (arena != NULL) {
+        return arena;
+    }
+
+    arena = (mcp_arena*)malloc(sizeof(mcp_arena));
+    if (!arena) {
+        return NULL;
+    }
+    arena->chunks = mcp_arena_chunk_new(MCP_ARENA_CHUNK_SIZE);
+    if (!arena->chunks) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->chunks;
+    arena->next_free = NULL;
+    return arena;
+}
+
+void mcp_arena_release(mcp_arena* arena) {
+    if (arena == NULL) {
+        return;
+    }
+    // Keep only the oldest (standard sized) chunk, drop the overflow chunks
+    mcp_arena_chunk* chunk = arena->chunks;
+    while (chunk->next != NULL) {
+        mcp_arena_chunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    chunk->used = 0;
+    arena->chunks = chunk;
+    arena->current = chunk;
+
+    mcp_mutex_lock(&g_arena_lock);
+    if (g_arena_free_count < MCP_ARENA_POOL_LIMIT) {
+        arena->next_free = g_arena_free_list;
+        g_arena_free_list = arena;
+        g_arena_free_count++;
+        arena = NULL;
+    }
+    mcp_mutex_unlock(&g_arena_lock);
+    if (arena != NULL) {
+        free(arena->chunks);
+        free(arena);
+    }
+}
+
+void* mcp_arena_alloc(mcp_arena* arena, size_t size) {
+    size = MCP_ALIGN_UP(size == 0 ? 1 : size);
+    for (;;) {
+        mcp_arena_chunk* chunk = (mcp_arena_chunk*)mcp_atomic_load_ptr((void* volatile*)&arena->current);
+        long end = mcp_atomic_add(&chunk->used, (long)size);
+        if ((size_t)end <= chunk->size) {
+            return chunk->data + (end - (long)size);
+        }
+
+        // Chunk exhausted: the first thread to get here links a new one
+        mcp_mutex_lock(&g_arena_lock);
+        if (arena->current == chunk) {
+            mcp_arena_chunk* fresh = mcp_arena_chunk_new(size);
+            if (!fresh) {
+                mcp_mutex_unlock(&g_arena_lock);
+                return NULL;
+            }
+            fresh->next = arena->chunks;
+            arena->chunks = fresh;
+            mcp_atomic_store_ptr((void* volatile*)&arena->current, fresh);
+        }
+        mcp_mutex_unlock(&g_arena_lock);
+    }
+}
+
+mcp_arena* mcp_arena_set_current(mcp_arena* arena) {
+    mcp_arena* previous = t_current_arena;
+    t_current_arena = arena;
+    return previous;
+}
+
+mcp_arena* mcp_arena_current(void) {
+    return t_current_arena;
+}
+
+void* mcp_malloc(size_t size) {
+    mcp_alloc_header* header = NULL;
+    t_allocations++;
+    t_allocated_bytes += size;
+    if (t_current_arena != NULL) {
+        header = (mcp_alloc_header*)mcp_arena_alloc(t_current_arena, sizeof(mcp_alloc_header) + size);
+        if (header) header->tag = MCP_ALLOC_ARENA;
+    } else {
+        header = (mcp_alloc_header*)malloc(sizeof(mcp_alloc_header) + size);
+        if (header) header->tag = MCP_ALLOC_HEAP;
+    }
+    return header ? (void*)(header + 1) : NULL;
+}
+
+void mcp_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    mcp_alloc_header* header = (mcp_alloc_header*)ptr - 1;
+    if (header->tag == MCP_ALLOC_HEAP) {
+        header->tag = 0;
+        free(header);
+    }
+    // Arena blocks are reclaimed when the arena is released
+}
+
+char* mcp_strdup(const char* str) {
+    if (str == NULL) {
+        return NULL;
+    }
+    size_t length = strlen(str) + 1;
+    char* copy = (char*)mcp_malloc(length);
+    if (copy) {
+        memcpy(copy, str, length);
+    }
+    return copy;
+}
+
+void mcp_arena_counters(size_t* allocations, size_t* bytes) {
+    *allocations = t_allocations;
+    *bytes = t_allocated_bytes;
+}
+
+void mcp_arena_install_hooks(void) {
+    static int installed = 0;
+    if (installed) {
+        return;
+    }
+    installed = 1;
+    cJSON_Hooks hooks = { mcp_malloc, mcp_free };
+    cJSON_InitHooks(&hooks);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+#ifndef MCP_ARENA_H
+#define MCP_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_ARENA_CHUNK_SIZE (64 * 1024)
+// Released arenas kept for reuse; the rest are freed
+#define MCP_ARENA_POOL_LIMIT 64
+
+struct mcp_arena_chunk;
+
+/**
+ * @brief Per-request bump allocator.
+ *
+ * Everything allocated while handling one message (the parsed request,
+ * generated parse_<struct> results, string parameters, the response tree)
+ * comes from one arena and is dropped in one shot once the reply has been
+ * written. Allocation is lock-free, so the elements of a batch can share
+ * their batch's arena from several workers.
+ */
+typedef struct mcp_arena {
+    struct mcp_arena_chunk* volatile current;
+    struct mcp_arena_chunk* chunks;  // All chunks, newest first
+    struct mcp_arena* next_free;
+} mcp_arena;
+
+/**
+ * @brief Takes an empty arena from the process-wide free list (or creates one).
+ */
+mcp_arena* mcp_arena_acquire(void);
+
+/**
+ * @brief Resets the arena and returns it to the free list. Every pointer
+ * handed out by it becomes invalid.
+ */
+void mcp_arena_release(mcp_arena* arena);
+
+void* mcp_arena_alloc(mcp_arena* arena, size_t size);
+
+/**
+ * @brief Selects the arena used by mcp_malloc() on the calling thread.
+ * Pass NULL to allocate from the heap. Returns the previous arena.
+ */
+mcp_arena* mcp_arena_set_current(mcp_arena* arena);
+mcp_arena* mcp_arena_current(void);
+
+/**
+ * @brief Allocators used by cJSON and by the generated bridge code. They
+ * allocate from the calling thread's current arena when one is set, else
+ * from the heap. mcp_free() accepts either kind (arena memory is simply
+ * left for the reset), from any thread.
+ *
+ * Note: strings returned by cJSON (e.g. cJSON_Print) must be released with
+ * cJSON_free()/mcp_free(), never with free(). Objects that must outlive the
+ * request have to be created with the current arena set to NULL.
+ */
+void* mcp_malloc(size_t size);
+void mcp_free(void* ptr);
+char* mcp_strdup(const char* str);
+
+/**
+ * @brief Running totals of the mcp_malloc() calls made on the calling thread
+ * and the bytes they asked for. Take the difference around a piece of code
+ * to see what it allocates (the generated microbenchmarks do).
+ */
+void mcp_arena_counters(size_t* allocations, size_t* bytes);
+
+/**
+ * @brief Routes all cJSON allocations through mcp_malloc()/mcp_free().
+ * Call once at startup, before any cJSON object is created.
+ */
+void mcp_arena_install_hooks(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_ARENA_H */
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_cache.h"
+#include "mcp_stats.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_CACHE_INITIAL_BUCKETS 64
+
+typedef struct mcp_cache_entry {
+    struct mcp_cache_entry* chain;  // Next entry of the same bucket
+    struct mcp_cache_entry* prev;   // LRU order, most recently used first
+    struct mcp_cache_entry* next;
+    uint64_t hash;
+    uint64_t expires;               // mcp_stats_now_ns() deadline, 0 for never
+    size_t key_length;
+    size_t value_length;
+    size_t size;                    // What the entry counts against the budget
+    int tool;
+    char data[];                    // The key, then the serialized result and its NUL
+} mcp_cache_entry;
+
+typedef struct mcp_cache_shard {
+    mcp_mutex_t lock;
+    mcp_cache_entry** buckets;
+    size_t bucket_count;            // A power of two
+    size_t count;
+    size_t bytes;
+    mcp_cache_entry* head;          // Most recently used
+    mcp_cache_entry* tail;          // Next to evict
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t expirations;
+} mcp_cache_shard;
+
+static mcp_mutex_t g_cache_lock = MCP_MUTEX_INITIALIZER;
+static volatile long g_cache_loaded = 0;
+static mcp_cache_shard g_shards[MCP_CACHE_SHARDS];
+static size_t g_shard_capacity = 0;
+static uint64_t g_ttl_ns = 0;
+
+// Reads the limits once, before the first use
+static void mcp_cache_load(void) {
+    if (mcp_atomic_load(&g_cache_loaded)) {
+        return;
+    }
+    mcp_mutex_lock(&g_cache_lock);
+    if (!g_cache_loaded) {
+        const char* bytes = getenv(MCP_CACHE_BYTES_ENV);
+        const char* ttl = getenv(MCP_CACHE_TTL_ENV);
+        size_t capacity = bytes != NULL && *bytes != '\0' ? (size_t)strtoull(bytes, NULL, 10) : MCP_CACHE_DEFAULT_BYTES;
+        g_shard_capacity = capacity / MCP_CACHE_SHARDS;
+        g_ttl_ns = ttl != NULL ? (uint64_t)strtoull(ttl, NULL, 10) * 1000000ull : 0;
+        for (unsigned i = 0; i < MCP_CACHE_SHARDS; ++i) {
+            mcp_mutex_init(&g_shards[i].lock);
+        }
+        mcp_atomic_store(&g_cache_loaded, 1);
+    }
+    mcp_mutex_unlock(&g_cache_lock);
+}
+
+bool mcp_cache_enabled(void) {
+    mcp_cache_load();
+    return g_shard_capacity != 0;
+}
+
+// --- keys ---
+
+static int mcp_cache_key_reserve(mcp_cache_key* key, size_t extra) {
+    if (key->length + extra <= key->capacity) {
+        return 0;
+    }
+    size_t capacity = key->capacity * 2 > key->length + extra ? key->capacity * 2 : key->length + extra;
+    char* data = (char*)malloc(capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    memcpy(data, key->data, key->length);
+    if (key->data != key->inline_data) {
+        free(key->data);
+    }
+    key->data = data;
+    key->capacity = capacity;
+    return 0;
+}
+
+static int mcp_cache_key_append(mcp_cache_key* key, const void* bytes, size_t length) {
+    if (mcp_cache_key_reserve(key, length) != 0) {
+        return -1;
+    }
+    memcpy(key->data + key->length, bytes, length);
+    key->length += length;
+    return 0;
+}
+
+// A string as its length and bytes, so no two strings can run together
+static int mcp_cache_key_string(mcp_cache_key* key, char tag, const char* text) {
+    size_t length = strlen(text);
+    return mcp_cache_key_append(key, &tag, 1) || mcp_cache_key_append(key, &length, sizeof(length)) ||
+           mcp_cache_key_append(key, text, length);
+}
+
+static int mcp_cache_compare_names(const void* a, const void* b) {
+    return strcmp((*(const cJSON* const*)a)->string, (*(const cJSON* const*)b)->string);
+}
+
+static int mcp_cache_key_value(mcp_cache_key* key, const cJSON* value) {
+    if (cJSON_IsNumber(value)) {
+        double number = value->valuedouble == 0 ? 0 : value->valuedouble;  // -0 and 0 are one value
+        return mcp_cache_key_append(key, "n", 1) || mcp_cache_key_append(key, &number, sizeof(number));
+    }
+    if (cJSON_IsString(value)) {
+        return mcp_cache_key_string(key, 's', value->valuestring);
+    }
+    if (cJSON_IsBool(value)) {
+        return mcp_cache_key_append(key, cJSON_IsTrue(value) ? "t" : "f", 1);
+    }
+    if (cJSON_IsArray(value)) {
+        if (mcp_cache_key_append(key, "[", 1) != 0) {
+            return -1;
+        }
+        for (const cJSON* item = value->child; item != NULL; item = item->next) {
+            if (mcp_cache_key_value(key, item) != 0) {
+                return -1;
+            }
+        }
+        return mcp_cache_key_append(key, "]", 1);
+    }
+    if (cJSON_IsObject(value)) {
+        size_t count = 0;
+        for (const cJSON* item = value->child; item != NULL; item = item->next) {
+            count++;
+        }
+        const cJSON* members_inline[16];
+        const cJSON** members = count <= 16 ? members_inline : (const cJSON**)malloc(count * sizeof(cJSON*));
+        if (members == NULL) {
+            return -1;
+        }
+        count = 0;
+        for (const cJSON* item = value->child; item != NULL; item = item->next) {
+            members[count++] = item;
+        }
+        qsort(members, count, sizeof(cJSON*), mcp_cache_compare_names);
+        int ret = mcp_cache_key_append(key, "{", 1);
+        for (size_t i = 0; ret == 0 && i < count; ++i) {
+            ret = mcp_cache_key_string(key, 'k', members[i]->string) || mcp_cache_key_value(key, members[i]);
+        }
+        if (members != members_inline) {
+            free((void*)members);
+        }
+        return ret != 0 ? -1 : mcp_cache_key_append(key, "}", 1);
+    }
+    return mcp_cache_key_append(key, "z", 1);  // null
+}
+
+int mcp_cache_key_init(mcp_cache_key* key, const char* tool, const cJSON* params) {
+    key->data = key->inline_data;
+    key->length = 0;
+    key->capacity = sizeof(key->inline_data);
+    // Missing params are called with an empty object, so they share its key
+    int ret = mcp_cache_key_string(key, 'm', tool) ||
+              (params != NULL ? mcp_cache_key_value(key, params) : mcp_cache_key_append(key, "{}", 2));
+    if (ret != 0) {
+        mcp_cache_key_free(key);
+        return -1;
+    }
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key->length; ++i) {
+        hash = (hash ^ (unsigned char)key->data[i]) * 1099511628211ull;
+    }
+    key->hash = hash;
+    return 0;
+}
+
+void mcp_cache_key_free(mcp_cache_key* key) {
+    if (key->data != key->inline_data) {
+        free(key->data);
+    }
+    key->data = key->inline_data;
+    key->length = 0;
+}
+
+// --- shards, callers hold the shard lock ---
+
+static mcp_cache_shard* mcp_cache_shard_of(uint64_t hash) {
+    return &g_shards[hash >> (64 - MCP_CACHE_SHARD_BITS)];
+}
+
+static mcp_cache_entry** mcp_cache_slot(mcp_cache_shard* shard, const mcp_cache_key* key) {
+    mcp_cache_entry** slot = &shard->buckets[key->hash & (shard->bucket_count - 1)];
+    while (*slot != NULL && ((*slot)->hash != key->hash || (*slot)->key_length != key->length ||
+                             memcmp((*slot)->data, key->data, key->length) != 0)) {
+        slot = &(*slot)->chain;
+    }
+    return slot;
+}
+
+static void mcp_cache_lru_unlink(mcp_cache_shard* shard, mcp_cache_entry* entry) {
+    *(entry->prev != NULL ? &entry->prev->next : &shard->head) = entry->next;
+    *(entry->next != NULL ? &entry->next->prev : &shard->tail) = entry->prev;
+}
+
+static void mcp_cache_lru_push(mcp_cache_shard* shard, mcp_cache_entry* entry) {
+    entry->prev = NULL;
+    entry->next = shard->head;
+    *(shard->head != NULL ? &shard->head->prev : &shard->tail) = entry;
+    shard->head = entry;
+}
+
+// Takes `entry` out of the shard; the caller frees it once unlocked
+static void mcp_cache_remove(mcp_cache_shard* shard, mcp_cache_entry* entry) {
+    mcp_cache_entry** slot = &shard->buckets[entry->hash & (shard->bucket_count - 1)];
+    while (*slot != entry) {
+        slot = &(*slot)->chain;
+    }
+    *slot = entry->chain;
+    mcp_cache_lru_unlink(shard, entry);
+    shard->count--;
+    shard->bytes -= entry->size;
+}
+
+// Doubles the bucket array once the chains average more than one entry
+static void mcp_cache_grow(mcp_cache_shard* shard) {
+    size_t count = shard->bucket_count != 0 ? shard->bucket_count * 2 : MCP_CACHE_INITIAL_BUCKETS;
+    mcp_cache_entry** buckets = (mcp_cache_entry**)calloc(count, sizeof(mcp_cache_entry*));
+    if (buckets == NULL) {
+        return;
+    }
+    for (mcp_cache_entry* entry = shard->head; entry != NULL; entry = entry->next) {
+        mcp_cache_entry** slot = &buckets[entry->hash & (count - 1)];
+        entry->chain = *slot;
+        *slot = entry;
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+}
+
+cJSON* mcp_cache_get(const mcp_cache_key* key, int* tool) {
+    if (!mcp_cache_enabled()) {
+        return NULL;
+    }
+    mcp_cache_shard* shard = mcp_cache_shard_of(key->hash);
+    mcp_cache_entry* expired = NULL;
+    cJSON* result = NULL;
+    mcp_mutex_lock(&shard->lock);
+    mcp_cache_entry* entry = shard->bucket_count != 0 ? *mcp_cache_slot(shard, key) : NULL;
+    if (entry != NULL && entry->expires != 0 && entry->expires <= mcp_stats_now_ns()) {
+        mcp_cache_remove(shard, entry);
+        shard->expirations++;
+        expired = entry;
+        entry = NULL;
+    }
+    if (entry != NULL) {
+        // The copy goes to the request arena, so the entry may be evicted right after
+        result = cJSON_CreateRaw(entry->data + entry->key_length);
+    }
+    if (result != NULL) {
+        mcp_cache_lru_unlink(shard, entry);
+        mcp_cache_lru_push(shard, entry);
+        *tool = entry->tool;
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    mcp_mutex_unlock(&shard->lock);
+    free(expired);
+    return result;
+}
+
+void mcp_cache_put(const mcp_cache_key* key, const cJSON* result, int tool) {
+    if (!mcp_cache_enabled() || result == NULL) {
+        return;
+    }
+    char* text = cJSON_PrintUnformatted(result);
+    if (text == NULL) {
+        return;
+    }
+    size_t value_length = strlen(text);
+    size_t size = sizeof(mcp_cache_entry) + key->length + value_length + 1;
+    mcp_cache_entry* entry = size <= g_shard_capacity ? (mcp_cache_entry*)malloc(size) : NULL;
+    if (entry == NULL) {
+        cJSON_free(text);
+        return;
+    }
+    entry->hash = key->hash;
+    entry->expires = g_ttl_ns != 0 ? mcp_stats_now_ns() + g_ttl_ns : 0;
+    entry->key_length = key->length;
+    entry->value_length = value_length;
+    entry->size = size;
+    entry->tool = tool;
+    memcpy(entry->data, key->data, key->length);
+    memcpy(entry->data + key->length, text, value_length + 1);
+    cJSON_free(text);
+
+    mcp_cache_shard* shard = mcp_cache_shard_of(key->hash);
+    mcp_cache_entry* dropped = NULL;  // Freed once unlocked, chained through `chain`
+    mcp_mutex_lock(&shard->lock);
+    if (shard->count >= shard->bucket_count) {
+        mcp_cache_grow(shard);
+    }
+    if (shard->bucket_count == 0) {
+        mcp_mutex_unlock(&shard->lock);
+        free(entry);
+        return;
+    }
+    // Another worker may have computed the same call meanwhile: keep the newer copy
+    mcp_cache_entry* existing = *mcp_cache_slot(shard, key);
+    if (existing != NULL) {
+        mcp_cache_remove(shard, existing);
+        existing->chain = dropped;
+        dropped = existing;
+    }
+    while (shard->bytes + size > g_shard_capacity && shard->tail != NULL) {
+        mcp_cache_entry* victim = shard->tail;
+        mcp_cache_remove(shard, victim);
+        victim->chain = dropped;
+        dropped = victim;
+        shard->evictions++;
+    }
+    mcp_cache_entry** slot = &shard->buckets[key->hash & (shard->bucket_count - 1)];
+    entry->chain = *slot;
+    *slot = entry;
+    mcp_cache_lru_push(shard, entry);
+    shard->count++;
+    shard->bytes += size;
+    mcp_mutex_unlock(&shard->lock);
+
+    while (dropped != NULL) {
+        mcp_cache_entry* next = dropped->chain;
+        free(dropped);
+        dropped = next;
+    }
+}
+
+void mcp_cache_clear(void) {
+    mcp_cache_load();
+    for (unsigned i = 0; i < MCP_CACHE_SHARDS; ++i) {
+        mcp_cache_shard* shard = &g_shards[i];
+        mcp_mutex_lock(&shard->lock);
+        mcp_cache_entry* entry = shard->head;
+        shard->head = shard->tail = NULL;
+        if (shard->buckets != NULL) {
+            memset(shard->buckets, 0, shard->bucket_count * sizeof(mcp_cache_entry*));
+        }
+        shard->count = 0;
+        shard->bytes = 0;
+        mcp_mutex_unlock(&shard->lock);
+        while (entry != NULL) {
+            mcp_cache_entry* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+}
+
+cJSON* mcp_cache_report(void) {
+    mcp_cache_load();
+    uint64_t entries = 0, bytes = 0, hits = 0, misses = 0, evictions = 0, expirations = 0;
+    for (unsigned i = 0; i < MCP_CACHE_SHARDS; ++i) {
+        mcp_cache_shard* shard = &g_shards[i];
+        mcp_mutex_lock(&shard->lock);
+        entries += shard->count;
+        bytes += shard->bytes;
+        hits += shard->hits;
+        misses += shard->misses;
+        evictions += shard->evictions;
+        expirations += shard->expirations;
+        mcp_mutex_unlock(&shard->lock);
+    }
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "entries", (double)entries);
+    cJSON_AddNumberToObject(report, "bytes", (double)bytes);
+    cJSON_AddNumberToObject(report, "capacity", (double)(g_shard_capacity * MCP_CACHE_SHARDS));
+    cJSON_AddNumberToObject(report, "ttl_ms", (double)(g_ttl_ns / 1000000ull));
+    cJSON_AddNumberToObject(report, "hits", (double)hits);
+    cJSON_AddNumberToObject(report, "misses", (double)misses);
+    cJSON_AddNumberToObject(report, "evictions", (double)evictions);
+    cJSON_AddNumberToObject(report, "expirations", (double)expirations);
+    return report;
+}
+
+#ifdef __cplusplus
+}
+#endif
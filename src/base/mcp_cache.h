@@ -0,0 +1,79 @@
+#ifndef MCP_CACHE_H
+#define MCP_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes of cached results (keys and bookkeeping included); 0 turns the cache off
+#define MCP_CACHE_BYTES_ENV "MCPC_CACHE_BYTES"
+#define MCP_CACHE_DEFAULT_BYTES (64 * 1024 * 1024)
+// Lifetime of a cached result in milliseconds; 0 keeps it until it is evicted
+#define MCP_CACHE_TTL_ENV "MCPC_CACHE_TTL_MS"
+// Independently locked LRU shards, picked by the top bits of the key hash
+#define MCP_CACHE_SHARD_BITS 4
+#define MCP_CACHE_SHARDS (1u << MCP_CACHE_SHARD_BITS)
+// Keys up to this size are built without a heap allocation
+#define MCP_CACHE_KEY_INLINE 256
+
+/**
+ * @brief Identity of one call of a PURE tool: the tool name and its params
+ * in canonical form (object members sorted by name, numbers by value), so
+ * the same arguments in any order or spacing give the same key.
+ */
+typedef struct mcp_cache_key {
+    char* data;
+    size_t length;
+    size_t capacity;
+    uint64_t hash;
+    char inline_data[MCP_CACHE_KEY_INLINE];
+} mcp_cache_key;
+
+/**
+ * @brief Builds the key of calling `tool` with `params` (NULL for none).
+ * Returns 0, or -1 when out of memory. Free it with mcp_cache_key_free().
+ */
+int mcp_cache_key_init(mcp_cache_key* key, const char* tool, const cJSON* params);
+void mcp_cache_key_free(mcp_cache_key* key);
+
+/**
+ * @brief Whether results are cached at all ($MCPC_CACHE_BYTES is not 0).
+ */
+bool mcp_cache_enabled(void);
+
+/**
+ * @brief Looks up `key`. On a hit returns the serialized result as a raw
+ * cJSON item allocated with the current arena (printed as is, never parsed)
+ * and sets *tool to the statistics id of the tool that produced it.
+ * Returns NULL on a miss or when the entry has outlived its TTL.
+ */
+cJSON* mcp_cache_get(const mcp_cache_key* key, int* tool);
+
+/**
+ * @brief Stores the serialized form of `result` under `key`, evicting the
+ * least recently used entries of the shard to stay within its share of the
+ * budget. Results larger than a shard's share are not cached.
+ */
+void mcp_cache_put(const mcp_cache_key* key, const cJSON* result, int tool);
+
+/**
+ * @brief Drops every entry.
+ */
+void mcp_cache_clear(void);
+
+/**
+ * @brief Sizes and counters of the cache: entries, bytes, capacity, hits,
+ * misses, evictions and expirations, summed over the shards.
+ */
+cJSON* mcp_cache_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_CACHE_H */
@@ -0,0 +1,880 @@
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_cache.h"
+#include "mcp_dispatch.h"
+#include "mcp_flight.h"
+#include "mcp_log.h"
+#include "mcp_thread.h"
+#include "generated_func.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Shared state of one JSON-RPC batch. Elements run as independent
+ * requests; the last one to finish assembles and sends the reply array.
+ */
+typedef struct mcp_batch {
+    cJSON* json;            // The batch array, owned
+    mcp_arena* arena;       // Shared by all elements
+    mcp_sink* sink;
+    mcp_session* session;
+    size_t count;
+    volatile long pending;  // Elements still running
+    cJSON** responses;      // One slot per element, NULL for notifications
+    mcp_request* requests;
+} mcp_batch;
+
+// The request whose handler runs on this thread, for mcp_call_detach()
+static MCP_THREAD_LOCAL mcp_request* t_request = NULL;
+
+// Detached calls not completed yet, for mcp_dispatch_drain_calls()
+static mcp_mutex_t g_calls_lock = MCP_MUTEX_INITIALIZER;
+static mcp_cond_t g_calls_done = MCP_COND_INITIALIZER;
+static long g_calls = 0;
+static volatile long g_cancel_calls = 0;
+
+static mcp_timer_wheel g_deadlines = MCP_TIMER_WHEEL_INITIALIZER;
+
+/**
+ * @brief Runtime deadline overrides. Replaced as a whole on every change so
+ * workers read them without a lock; replaced tables stay allocated, since a
+ * reader may still hold one and changes are rare.
+ */
+typedef struct mcp_timeouts {
+    struct mcp_timeouts* retired;
+    size_t count;
+    bool has_default;
+    unsigned default_ms;
+    struct {
+        char* method;
+        unsigned ms;
+    } entries[];
+} mcp_timeouts;
+
+static mcp_mutex_t g_timeouts_lock = MCP_MUTEX_INITIALIZER;
+static mcp_timeouts* volatile g_timeouts = NULL;
+static volatile long g_timeouts_loaded = 0;
+
+void mcp_response_release(cJSON* response, mcp_arena* arena) {
+    if (arena != NULL) {
+        mcp_arena_release(arena);
+    } else {
+        cJSON_Delete(response);
+    }
+}
+
+cJSON* mcp_error_response(const cJSON* id, int code, const char* message) {
+    cJSON* response = cJSON_CreateObject();
+    if (response == NULL) {
+        return NULL;
+    }
+    cJSON* error = cJSON_AddObjectToObject(response, "error");
+    if (error != NULL) {
+        cJSON_AddNumberToObject(error, "code", code);
+        cJSON_AddStringToObject(error, "message", message);
+    }
+    cJSON_AddItemToObject(response, "id", id != NULL ? cJSON_Duplicate(id, 1) : cJSON_CreateNull());
+    cJSON_AddStringToObject(response, "jsonrpc", "2.0");
+    return response;
+}
+
+static bool mcp_is_cancel(const cJSON* json) {
+    const cJSON* method = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, "method") : NULL;
+    return cJSON_IsString(method) && strcmp(method->valuestring, "notifications/cancelled") == 0;
+}
+
+static bool mcp_is_method(const cJSON* json, const char* name) {
+    const cJSON* method = cJSON_GetObjectItemCaseSensitive(json, "method");
+    return cJSON_IsString(method) && strcmp(method->valuestring, name) == 0;
+}
+
+// Methods the runtime answers itself; they never reach the bridge
+static bool mcp_is_reserved(const cJSON* json) {
+    return mcp_is_method(json, MCP_STATS_METHOD) || mcp_is_method(json, MCP_TRACE_METHOD);
+}
+
+static bool mcp_id_equal(const cJSON* a, const cJSON* b) {
+    if (cJSON_IsNumber(a) && cJSON_IsNumber(b)) {
+        return a->valuedouble == b->valuedouble;
+    }
+    return cJSON_IsString(a) && cJSON_IsString(b) && strcmp(a->valuestring, b->valuestring) == 0;
+}
+
+// Flags the in-flight request of `session` named by params.requestId
+static void mcp_dispatch_cancel(mcp_session* session, const cJSON* json) {
+    const cJSON* params = cJSON_GetObjectItemCaseSensitive(json, "params");
+    const cJSON* target = cJSON_GetObjectItemCaseSensitive(params, "requestId");
+    if (session == NULL || target == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    for (mcp_request* request = session->requests; request != NULL; request = request->next) {
+        if (mcp_id_equal(request->id, target)) {
+            mcp_atomic_store(&request->cancel.cancelled, 1);
+        }
+    }
+    mcp_mutex_unlock(&session->lock);
+}
+
+static void mcp_request_track(mcp_request* request) {
+    mcp_session* session = request->session;
+    if (session == NULL || request->id == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    request->prev = NULL;
+    request->next = session->requests;
+    if (request->next != NULL) {
+        request->next->prev = request;
+    }
+    session->requests = request;
+    mcp_mutex_unlock(&session->lock);
+}
+
+static void mcp_request_untrack(mcp_request* request) {
+    mcp_session* session = request->session;
+    if (session == NULL || request->id == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    if (request->prev != NULL) {
+        request->prev->next = request->next;
+    } else {
+        session->requests = request->next;
+    }
+    if (request->next != NULL) {
+        request->next->prev = request->prev;
+    }
+    mcp_mutex_unlock(&session->lock);
+}
+
+// Wraps a handler result into the response for `id`; takes ownership of `result`
+static cJSON* mcp_result_response(const cJSON* id, cJSON* result) {
+    cJSON* response = cJSON_CreateObject();
+    if (response == NULL) {
+        cJSON_Delete(result);
+        return NULL;
+    }
+    if (result != NULL) {
+        // Add result to response
+        cJSON_AddItemToObject(response, "result", result);
+    } else {
+        cJSON_AddObjectToObject(response, "result");
+        mcp_log_warn("result is NULL");
+    }
+    // Add ID to response
+    cJSON_AddItemToObject(response, "id", cJSON_Duplicate(id, 1));
+    // Add jsonrpc version
+    cJSON_AddStringToObject(response, "jsonrpc", "2.0");
+    return response;
+}
+
+// Runs the call of `flight` again on this worker for one waiter after another,
+// until a run finishes without its token firing, and lands the flight with it.
+// Returns the flight when nobody was left to run it for, NULL once it landed
+static mcp_flight* mcp_flight_rerun(mcp_flight* flight) {
+    mcp_call* call;
+    while ((call = mcp_flight_promote(flight)) != NULL) {
+        mcp_request* leader = t_request;
+        mcp_arena* previous = mcp_arena_set_current(call->arena);
+        mcp_session* previous_session = mcp_session_set_current(call->session);
+        int previous_tool = mcp_stats_current();
+        t_request = call;
+        mcp_stats_set_current(-1);
+        uint64_t trace = mcp_trace_begin();
+        cJSON* result = bridge(call->json);
+        mcp_trace_end("bridge", trace);
+        int tool = mcp_stats_current();
+        bool finished = !mcp_cancel_requested(&call->cancel);
+        if (finished) {
+            mcp_flight_land(flight, result, tool);
+        }
+        call->tool = tool;
+        call->failed = result == NULL;
+        mcp_call_complete(call, result);
+        mcp_stats_set_current(previous_tool);
+        t_request = leader;
+        mcp_session_set_current(previous_session);
+        mcp_arena_set_current(previous);
+        if (finished) {
+            return NULL;
+        }
+    }
+    return flight;
+}
+
+cJSON* mcp_dispatch_message(cJSON* json) {
+    cJSON *id = NULL;
+    cJSON *result = NULL;
+
+    if (!cJSON_IsObject(json)) {
+        return mcp_error_response(NULL, MCP_ERROR_INVALID_REQUEST, "Invalid Request");
+    }
+
+    // Get request ID, notifications carry none and get no reply
+    id = cJSON_GetObjectItemCaseSensitive(json, "id");
+    if (id == NULL) {
+        // Cancellations were already applied by mcp_dispatch_submit()
+        if (!mcp_is_cancel(json) && !mcp_is_reserved(json)) {
+            result = bridge(json);
+            cJSON_Delete(result);
+        }
+        return NULL;
+    }
+    if (!cJSON_IsNumber(id) && !cJSON_IsString(id)) {
+        return mcp_error_response(NULL, MCP_ERROR_INVALID_REQUEST, "Invalid request ID");
+    }
+
+    if (mcp_is_method(json, MCP_STATS_METHOD)) {
+        return mcp_result_response(id, mcp_stats_report());
+    }
+    if (mcp_is_method(json, MCP_TRACE_METHOD)) {
+        return mcp_result_response(id, mcp_trace_control(cJSON_GetObjectItemCaseSensitive(json, "params")));
+    }
+
+    // PURE tools answer the same params with the same result: serve it without the handler,
+    // and let identical calls of them and of SINGLE_FLIGHT tools wait for the one running
+    const cJSON* method = cJSON_GetObjectItemCaseSensitive(json, "method");
+    const bridge_tool_info* info = cJSON_IsString(method) ? bridge_tool(method->valuestring) : NULL;
+    bool pure = info != NULL && info->pure && mcp_cache_enabled();
+    bool shared = info != NULL && info->single_flight && t_request != NULL;
+    mcp_cache_key key;
+    bool keyed = (pure || shared) &&
+                 mcp_cache_key_init(&key, method->valuestring, cJSON_GetObjectItemCaseSensitive(json, "params")) == 0;
+    if (keyed && pure) {
+        int tool = -1;
+        uint64_t lookup = mcp_trace_begin();
+        result = mcp_cache_get(&key, &tool);
+        mcp_trace_end("cache", lookup);
+        if (result != NULL) {
+            mcp_cache_key_free(&key);
+            mcp_stats_set_current(tool);
+            return mcp_result_response(id, result);
+        }
+    }
+    mcp_flight* flight = NULL;
+    if (keyed && shared) {
+        flight = mcp_flight_join(&key);
+        if (flight == NULL && t_request->detached) {
+            // Parked on the identical call in flight, which answers for this one too
+            mcp_cache_key_free(&key);
+            return NULL;
+        }
+    }
+
+    uint64_t trace = mcp_trace_begin();
+    result = bridge(json);
+    mcp_trace_end("bridge", trace);
+    if (flight != NULL && mcp_cancel_requested(&t_request->cancel)) {
+        // Whatever the cancelled leader returned is cut short: the waiters get a run of their own
+        flight = mcp_flight_rerun(flight);
+    }
+    mcp_flight_land(flight, t_request != NULL && t_request->detached ? NULL : result, mcp_stats_current());
+    if (t_request != NULL && t_request->detached) {
+        // An asynchronous handler answers later through mcp_call_complete()
+        if (keyed) {
+            mcp_cache_key_free(&key);
+        }
+        cJSON_Delete(result);
+        return NULL;
+    }
+    if (t_request != NULL && result == NULL) {
+        t_request->failed = true;
+    }
+    if (keyed) {
+        // Failures are not remembered: the next call runs the handler again, and
+        // neither is what a cancelled or timed-out handler returned early
+        if (pure && result != NULL && !(t_request != NULL && mcp_cancel_requested(&t_request->cancel))) {
+            mcp_cache_put(&key, result, mcp_stats_current());
+        }
+        mcp_cache_key_free(&key);
+    }
+    return mcp_result_response(id, result);
+}
+
+// Records one element's reply; the last element sends the batch reply and frees the batch
+static void mcp_batch_complete(mcp_batch* batch, size_t index, cJSON* response) {
+    batch->responses[index] = response;
+    if (mcp_atomic_add(&batch->pending, -1) != 0) {
+        return;
+    }
+
+    mcp_arena* previous = mcp_arena_set_current(batch->arena);
+    cJSON* reply = cJSON_CreateArray();
+    for (size_t i = 0; i < batch->count; ++i) {
+        if (batch->responses[i] == NULL) {
+            continue;
+        }
+        if (reply == NULL || !cJSON_AddItemToArray(reply, batch->responses[i])) {
+            cJSON_Delete(batch->responses[i]);
+        }
+    }
+    mcp_arena_set_current(previous);
+    if (batch->arena == NULL) {
+        cJSON_Delete(batch->json);
+    }
+    // A batch of notifications only gets no reply at all
+    if (reply != NULL && reply->child == NULL) {
+        if (batch->arena == NULL) {
+            cJSON_Delete(reply);
+        }
+        reply = NULL;
+    }
+    batch->sink->send(batch->sink, reply, batch->arena);
+    mcp_session_release(batch->session);
+    free(batch->responses);
+    free(batch->requests);
+    free(batch);
+}
+
+// Records the call in the tool's statistics; running past the deadline counts as an error
+static void mcp_request_count(mcp_request* request, const cJSON* response) {
+    if (request->tool < 0) {
+        return;
+    }
+    bool error = request->failed || request->cancel.cancelled == MCP_CANCEL_DEADLINE ||
+                 (response != NULL && cJSON_GetObjectItemCaseSensitive(response, "error") != NULL);
+    // A batch is received as one message, its elements have no size of their own
+    size_t bytes_in = request->batch == NULL ? request->task.bytes : 0;
+    mcp_stats_call(request->tool, error, mcp_stats_now_ns() - request->started, bytes_in);
+}
+
+// Hands a reply to the sink, which learns the tool it came from for the byte count
+static void mcp_request_send(mcp_request* request, cJSON* response, mcp_arena* arena) {
+    int previous = mcp_stats_current();
+    mcp_stats_set_current(request->tool);
+    request->sink->send(request->sink, response, arena);
+    mcp_stats_set_current(previous);
+}
+
+// Delivers the reply of a finished request and frees it
+static void mcp_request_finish(mcp_request* request, cJSON* response) {
+    mcp_request_untrack(request);
+    mcp_request_count(request, response);
+    if (mcp_atomic_load(&request->answered) == MCP_ANSWERED_DEADLINE) {
+        if (request->batch == NULL) {
+            // The timeout error went out when the deadline passed, and took the sink with it
+            if (request->arena != NULL) {
+                mcp_arena_release(request->arena);
+            } else {
+                cJSON_Delete(request->json);
+            }
+            mcp_session_release(request->session);
+            free(request);
+            return;
+        }
+        // A batch replies once, so its element reports the timeout now that the arena is free
+        mcp_arena* previous = mcp_arena_set_current(request->arena);
+        response = mcp_error_response(request->id, MCP_ERROR_TIMEOUT, "Request timed out");
+        mcp_arena_set_current(previous);
+    }
+    if (response != NULL &&
+        (mcp_atomic_load(&request->cancel.cancelled) == MCP_CANCEL_CLIENT || mcp_atomic_load(&g_cancel_calls) != 0)) {
+        // The client has moved on and expects no reply
+        if (request->arena == NULL) {
+            cJSON_Delete(response);
+        }
+        response = NULL;
+    }
+    if (request->batch != NULL) {
+        // The request belongs to the batch, do not touch it afterwards
+        mcp_batch_complete(request->batch, request->index, response);
+        return;
+    }
+    if (request->arena == NULL) {
+        cJSON_Delete(request->json);
+    }
+    mcp_request_send(request, response, request->arena);
+    mcp_session_release(request->session);
+    free(request);
+}
+
+// Drops one hold; the last holder sends the claimed reply
+static void mcp_request_release(mcp_request* request) {
+    if (mcp_atomic_add(&request->holds, -1) == 0) {
+        mcp_request_finish(request, request->response);
+    }
+}
+
+// The first answer wins: the handler's reply, or the timeout error of its deadline
+static void mcp_request_answer(mcp_request* request, cJSON* response) {
+    if (mcp_atomic_cas(&request->answered, 0, MCP_ANSWERED_HANDLER)) {
+        request->response = response;
+    } else if (request->arena == NULL) {
+        cJSON_Delete(response);
+    }
+    if (request->deadline.fire != NULL && mcp_timer_cancel(&g_deadlines, &request->deadline)) {
+        // Disarmed before it fired, so the deadline's hold is ours to drop
+        mcp_request_release(request);
+    }
+}
+
+// Runs on the thread driving the wheel, possibly while the handler is still busy
+static void mcp_request_expire(mcp_timer* timer) {
+    mcp_request* request = (mcp_request*)((char*)timer - offsetof(mcp_request, deadline));
+    if (mcp_atomic_cas(&request->answered, 0, MCP_ANSWERED_DEADLINE)) {
+        bool cancelled = !mcp_atomic_cas(&request->cancel.cancelled, 0, MCP_CANCEL_DEADLINE) ||
+                         mcp_atomic_load(&g_cancel_calls) != 0;
+        if (request->batch == NULL && !cancelled) {
+            // The handler still owns the arena, so the error is built on the heap and sent right away
+            mcp_arena* previous = mcp_arena_set_current(NULL);
+            cJSON* response = mcp_error_response(request->id, MCP_ERROR_TIMEOUT, "Request timed out");
+            mcp_arena_set_current(previous);
+            // Sent without a tool: the handler has not returned yet to tell which one it is
+            request->sink->send(request->sink, response, NULL);
+        } else if (request->batch == NULL) {
+            request->sink->send(request->sink, NULL, NULL);
+        }
+    }
+    mcp_request_release(request);
+}
+
+static void mcp_request_run(mcp_task* task) {
+    mcp_request* request = (mcp_request*)task;
+    if (mcp_cancel_requested(&request->cancel)) {
+        // Cancelled while still queued, never start it
+        mcp_request_finish(request, NULL);
+        return;
+    }
+    if (request->id != NULL) {
+        const cJSON* method = cJSON_GetObjectItemCaseSensitive(request->json, "method");
+        unsigned timeout_ms = cJSON_IsString(method) ? mcp_dispatch_timeout(method->valuestring) : 0;
+        if (timeout_ms != 0) {
+            request->deadline.fire = mcp_request_expire;
+            mcp_atomic_add(&request->holds, 1);
+            mcp_timer_add(&g_deadlines, &request->deadline, timeout_ms);
+        }
+    }
+    // Everything the handler allocates through cJSON/mcp_malloc lands in the request arena
+    uint64_t trace = mcp_trace_begin();
+    request->started = mcp_stats_now_ns();
+    mcp_stats_set_current(-1);
+    mcp_arena* previous = mcp_arena_set_current(request->arena);
+    mcp_session* previous_session = mcp_session_set_current(request->session);
+    mcp_request* previous_request = t_request;
+    t_request = request;
+    cJSON* response = mcp_dispatch_message(request->json);
+    if (!request->detached) {
+        request->tool = mcp_stats_current();
+    }
+    mcp_stats_set_current(-1);
+    t_request = previous_request;
+    mcp_session_set_current(previous_session);
+    mcp_arena_set_current(previous);
+
+    // A detached call answers through mcp_call_complete(), possibly already done
+    if (!request->detached) {
+        mcp_request_answer(request, response);
+    }
+    mcp_request_release(request);
+    mcp_trace_end("request", trace);
+}
+
+// Fills in what every request needs before it is queued
+static void mcp_request_init(mcp_request* request, cJSON* json, mcp_arena* arena, mcp_sink* sink, mcp_session* session) {
+    request->task.run = mcp_request_run;
+    request->json = json;
+    request->arena = arena;
+    request->sink = sink;
+    request->session = session;
+    request->holds = 1;
+    request->tool = -1;
+    const cJSON* id = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, "id") : NULL;
+    if (cJSON_IsNumber(id) || cJSON_IsString(id)) {
+        request->id = id;
+    }
+}
+
+static bool mcp_has_id(const cJSON* json) {
+    return cJSON_IsObject(json) && cJSON_GetObjectItemCaseSensitive(json, "id") != NULL;
+}
+
+// Sheds a message the pool has no room for: every request in it gets a busy error
+static void mcp_dispatch_reject(cJSON* json, mcp_arena* arena, mcp_sink* sink) {
+    cJSON* reply = NULL;
+    mcp_arena* previous = mcp_arena_set_current(arena);
+    if (cJSON_IsArray(json)) {
+        reply = cJSON_CreateArray();
+        cJSON* element = NULL;
+        cJSON_ArrayForEach(element, json) {
+            if (reply != NULL && mcp_has_id(element)) {
+                cJSON_AddItemToArray(reply, mcp_error_response(cJSON_GetObjectItemCaseSensitive(element, "id"),
+                                                               MCP_ERROR_SERVER_BUSY, "Server busy"));
+            }
+        }
+    } else {
+        reply = mcp_error_response(cJSON_GetObjectItemCaseSensitive(json, "id"), MCP_ERROR_SERVER_BUSY, "Server busy");
+    }
+    mcp_arena_set_current(previous);
+    if (arena == NULL) {
+        cJSON_Delete(json);
+    }
+    sink->send(sink, reply, arena);
+}
+
+static int mcp_dispatch_submit_batch(mcp_pool* pool, cJSON* json, size_t bytes, mcp_arena* arena, mcp_sink* sink,
+                                     mcp_session* session) {
+    size_t count = (size_t)cJSON_GetArraySize(json);
+    if (count == 0) {
+        // An empty batch is answered with a single error
+        mcp_response_release(json, arena);
+        cJSON* response = mcp_error_response(NULL, MCP_ERROR_INVALID_REQUEST, "Invalid Request");
+        if (response != NULL) {
+            sink->send(sink, response, NULL);
+        }
+        return 0;
+    }
+
+    mcp_batch* batch = (mcp_batch*)calloc(1, sizeof(mcp_batch));
+    if (!batch) {
+        return -1;
+    }
+    batch->responses = (cJSON**)calloc(count, sizeof(cJSON*));
+    batch->requests = (mcp_request*)calloc(count, sizeof(mcp_request));
+    if (!batch->responses || !batch->requests) {
+        free(batch->responses);
+        free(batch->requests);
+        free(batch);
+        return -1;
+    }
+    batch->json = json;
+    batch->arena = arena;
+    batch->sink = sink;
+    batch->session = session;
+    batch->count = count;
+    batch->pending = (long)count;
+
+    size_t index = 0;
+    cJSON* element = NULL;
+    cJSON_ArrayForEach(element, json) {
+        mcp_request* request = &batch->requests[index];
+        mcp_request_init(request, element, arena, sink, session);
+        request->task.bytes = index == 0 ? bytes : 0; // The batch is charged once
+        request->pool = pool;
+        request->batch = batch;
+        request->index = index;
+        mcp_request_track(request);
+        index++;
+    }
+    cJSON_ArrayForEach(element, json) {
+        if (mcp_is_cancel(element)) {
+            mcp_dispatch_cancel(session, element);
+        }
+    }
+    // From here on the batch owns `json` and frees itself when the last element completes
+    mcp_session_retain(session);
+    for (size_t i = 0; i < count; ++i) {
+        if (mcp_pool_submit(pool, &batch->requests[i].task) != 0) {
+            mcp_arena* previous = mcp_arena_set_current(arena);
+            cJSON* response = mcp_error_response(NULL, MCP_ERROR_INTERNAL, "Server shutting down");
+            mcp_arena_set_current(previous);
+            mcp_request_untrack(&batch->requests[i]);
+            mcp_batch_complete(batch, i, response);
+        }
+    }
+    return 0;
+}
+
+int mcp_dispatch_submit(mcp_pool* pool, cJSON* json, size_t bytes, mcp_arena* arena, mcp_sink* sink,
+                        mcp_session* session) {
+    if (cJSON_IsArray(json)) {
+        bool has_request = false;
+        cJSON* element = NULL;
+        cJSON_ArrayForEach(element, json) {
+            has_request = has_request || mcp_has_id(element);
+        }
+        if (has_request && !mcp_pool_admits(pool, (size_t)cJSON_GetArraySize(json), bytes)) {
+            mcp_dispatch_reject(json, arena, sink);
+            return 0;
+        }
+        return mcp_dispatch_submit_batch(pool, json, bytes, arena, sink, session);
+    }
+    if (mcp_is_cancel(json)) {
+        // Applied on the transport thread, so it is not queued behind the work it cancels
+        mcp_dispatch_cancel(session, json);
+        if (arena == NULL) {
+            cJSON_Delete(json);
+        }
+        sink->send(sink, NULL, arena);
+        return 0;
+    }
+
+    if (mcp_has_id(json) && !mcp_pool_admits(pool, 1, bytes)) {
+        mcp_dispatch_reject(json, arena, sink);
+        return 0;
+    }
+
+    mcp_request* request = (mcp_request*)calloc(1, sizeof(mcp_request));
+    if (!request) {
+        return -1;
+    }
+    mcp_request_init(request, json, arena, sink, session);
+    request->task.bytes = bytes;
+    request->pool = pool;
+    mcp_session_retain(session);
+    mcp_request_track(request);
+    if (mcp_pool_submit(pool, &request->task) != 0) {
+        mcp_request_untrack(request);
+        mcp_session_release(session);
+        free(request);
+        return -1;
+    }
+    return 0;
+}
+
+bool mcp_cancel_requested(mcp_cancel_token* token) {
+    return token != NULL && (mcp_atomic_load(&token->cancelled) != 0 || mcp_atomic_load(&g_cancel_calls) != 0);
+}
+
+mcp_cancel_token* mcp_cancel_current(void) {
+    return t_request != NULL ? &t_request->cancel : NULL;
+}
+
+mcp_call* mcp_call_detach(void) {
+    mcp_request* request = t_request;
+    if (request == NULL || request->detached) {
+        return NULL;
+    }
+    request->detached = true;
+    // The call may complete before the handler returns, so take the tool now
+    request->tool = mcp_stats_current();
+    mcp_atomic_add(&request->holds, 1);
+    // Off the worker, but not done: admission still counts it
+    mcp_pool_hold(request->pool, request->task.bytes);
+    mcp_mutex_lock(&g_calls_lock);
+    g_calls++;
+    mcp_mutex_unlock(&g_calls_lock);
+    return request;
+}
+
+mcp_cancel_token* mcp_call_cancel_token(mcp_call* call) {
+    return call != NULL ? &call->cancel : NULL;
+}
+
+int mcp_call_keep(mcp_call* call, void* const* blocks, size_t count) {
+    if (call == NULL || count == 0) {
+        return 0;
+    }
+    void** kept = (void**)realloc(call->kept, (call->kept_count + count) * sizeof(void*));
+    if (kept == NULL) {
+        return -1;
+    }
+    memcpy(kept + call->kept_count, blocks, count * sizeof(void*));
+    call->kept = kept;
+    call->kept_count += count;
+    return 0;
+}
+
+// Answers and drops the handle's hold; sends the reply unless the worker is still in bridge()
+static void mcp_call_finish(mcp_call* call, cJSON* response) {
+    // The handler is done with its parameters once it answers
+    for (size_t i = 0; i < call->kept_count; ++i) {
+        mcp_free(call->kept[i]);
+    }
+    free(call->kept);
+    call->kept = NULL;
+    call->kept_count = 0;
+    // Released below, possibly freeing the call
+    mcp_pool* pool = call->pool;
+    size_t bytes = call->task.bytes;
+    mcp_request_answer(call, response);
+    mcp_request_release(call);
+    mcp_pool_settle(pool, bytes);
+    mcp_mutex_lock(&g_calls_lock);
+    if (--g_calls == 0) {
+        mcp_cond_broadcast(&g_calls_done);
+    }
+    mcp_mutex_unlock(&g_calls_lock);
+}
+
+void mcp_call_complete(mcp_call* call, cJSON* result) {
+    if (call == NULL) {
+        cJSON_Delete(result);
+        return;
+    }
+    mcp_arena* own = mcp_arena_current();
+    if (result != NULL && call->arena != NULL && own != call->arena) {
+        // Built elsewhere, the reply must live as long as the call's arena
+        mcp_arena_set_current(call->arena);
+        cJSON* copy = cJSON_Duplicate(result, 1);
+        mcp_arena_set_current(own);
+        cJSON_Delete(result);
+        result = copy;
+    }
+    cJSON* response = NULL;
+    mcp_arena* previous = mcp_arena_set_current(call->arena);
+    if (call->id != NULL) {
+        response = mcp_result_response(call->id, result);
+    } else {
+        cJSON_Delete(result);
+    }
+    mcp_arena_set_current(previous);
+    mcp_call_finish(call, response);
+}
+
+void mcp_call_fail(mcp_call* call, int code, const char* message) {
+    if (call == NULL) {
+        return;
+    }
+    cJSON* response = NULL;
+    mcp_arena* previous = mcp_arena_set_current(call->arena);
+    if (call->id != NULL) {
+        response = mcp_error_response(call->id, code, message);
+    }
+    mcp_arena_set_current(previous);
+    mcp_call_finish(call, response);
+}
+
+bool mcp_call_claim(mcp_call* call) {
+    return call != NULL && mcp_atomic_cas(&call->answered, 0, MCP_ANSWERED_HANDLER);
+}
+
+void mcp_call_sent(mcp_call* call) {
+    if (call != NULL) {
+        // The claimed answer stays empty, so the sink gets no response
+        mcp_call_finish(call, NULL);
+    }
+}
+
+void mcp_dispatch_cancel_session(mcp_session* session) {
+    if (session == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    for (mcp_request* request = session->requests; request != NULL; request = request->next) {
+        mcp_atomic_store(&request->cancel.cancelled, 1);
+    }
+    mcp_mutex_unlock(&session->lock);
+}
+
+void mcp_dispatch_drain_calls(bool cancel) {
+    if (cancel) {
+        mcp_atomic_store(&g_cancel_calls, 1);
+    }
+    mcp_mutex_lock(&g_calls_lock);
+    while (g_calls > 0) {
+        mcp_cond_wait(&g_calls_done, &g_calls_lock);
+    }
+    mcp_mutex_unlock(&g_calls_lock);
+    mcp_atomic_store(&g_cancel_calls, 0);
+}
+
+mcp_timer_wheel* mcp_dispatch_deadlines(void) {
+    return &g_deadlines;
+}
+
+// Copies `base` with `method` set to `timeout_ms`. Caller holds g_timeouts_lock
+static mcp_timeouts* mcp_timeouts_with(mcp_timeouts* base, const char* method, unsigned timeout_ms) {
+    size_t count = base != NULL ? base->count : 0;
+    mcp_timeouts* table = (mcp_timeouts*)calloc(1, sizeof(mcp_timeouts) + (count + 1) * sizeof(table->entries[0]));
+    if (!table) {
+        return NULL;
+    }
+    if (base != NULL) {
+        table->has_default = base->has_default;
+        table->default_ms = base->default_ms;
+        memcpy(table->entries, base->entries, count * sizeof(table->entries[0]));
+    }
+    table->count = count;
+    if (strcmp(method, "*") == 0) {
+        table->has_default = true;
+        table->default_ms = timeout_ms;
+        return table;
+    }
+    size_t i = 0;
+    while (i < table->count && strcmp(table->entries[i].method, method) != 0) {
+        i++;
+    }
+    if (i == table->count) {
+        size_t length = strlen(method) + 1;
+        table->entries[i].method = (char*)malloc(length);
+        if (table->entries[i].method == NULL) {
+            free(table);
+            return NULL;
+        }
+        memcpy(table->entries[i].method, method, length);
+        table->count++;
+    }
+    table->entries[i].ms = timeout_ms;
+    return table;
+}
+
+static void mcp_timeouts_set_locked(const char* method, unsigned timeout_ms) {
+    mcp_timeouts* current = (mcp_timeouts*)mcp_atomic_load_ptr((void* volatile*)&g_timeouts);
+    mcp_timeouts* table = mcp_timeouts_with(current, method, timeout_ms);
+    if (table == NULL) {
+        fprintf(stderr, "Failed to set the timeout of %s\n", method);
+        return;
+    }
+    table->retired = current;
+    mcp_atomic_store_ptr((void* volatile*)&g_timeouts, table);
+}
+
+// Applies $MCPC_TIMEOUTS once, before the first lookup or override
+static void mcp_timeouts_load(void) {
+    if (mcp_atomic_load(&g_timeouts_loaded)) {
+        return;
+    }
+    mcp_mutex_lock(&g_timeouts_lock);
+    if (!g_timeouts_loaded) {
+        const char* env = getenv(MCP_TIMEOUTS_ENV);
+        while (env != NULL && *env != '\0') {
+            const char* end = strchr(env, ',');
+            size_t length = end != NULL ? (size_t)(end - env) : strlen(env);
+            const char* equals = memchr(env, '=', length);
+            char method[256];
+            char* digits_end = NULL;
+            unsigned long ms = 0;
+            if (equals != NULL && equals[1] >= '0' && equals[1] <= '9') {
+                errno = 0;
+                ms = strtoul(equals + 1, &digits_end, 10);
+            }
+            // The whole value must be a number of milliseconds: "5s" is not 5
+            if (digits_end == env + length && errno == 0 && ms <= UINT_MAX &&
+                (size_t)(equals - env) < sizeof(method)) {
+                memcpy(method, env, (size_t)(equals - env));
+                method[equals - env] = '\0';
+                mcp_timeouts_set_locked(method, (unsigned)ms);
+            } else {
+                fprintf(stderr, "Ignoring malformed %s entry: %.*s\n", MCP_TIMEOUTS_ENV, (int)length, env);
+            }
+            env = end != NULL ? end + 1 : NULL;
+        }
+        mcp_atomic_store(&g_timeouts_loaded, 1);
+    }
+    mcp_mutex_unlock(&g_timeouts_lock);
+}
+
+void mcp_dispatch_set_timeout(const char* method, unsigned timeout_ms) {
+    mcp_timeouts_load();
+    mcp_mutex_lock(&g_timeouts_lock);
+    mcp_timeouts_set_locked(method, timeout_ms);
+    mcp_mutex_unlock(&g_timeouts_lock);
+}
+
+unsigned mcp_dispatch_timeout(const char* method) {
+    mcp_timeouts_load();
+    mcp_timeouts* table = (mcp_timeouts*)mcp_atomic_load_ptr((void* volatile*)&g_timeouts);
+    if (table != NULL) {
+        for (size_t i = 0; i < table->count; ++i) {
+            if (strcmp(table->entries[i].method, method) == 0) {
+                return table->entries[i].ms;
+            }
+        }
+    }
+    const bridge_tool_info* info = bridge_tool(method);
+    if (info != NULL && info->timeout_ms != 0) {
+        return info->timeout_ms;
+    }
+    return table != NULL && table->has_default ? table->default_ms : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
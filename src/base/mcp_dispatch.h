@@ -0,0 +1,232 @@
+#ifndef MCP_DISPATCH_H
+#define MCP_DISPATCH_H
+
+#include "cJSON.h"
+#include "mcp_arena.h"
+#include "mcp_pool.h"
+#include "mcp_session.h"
+#include "mcp_stats.h"
+#include "mcp_timer.h"
+#include "mcp_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Destination for finished replies. Each transport provides one; it
+ * must be safe to call from any worker thread.
+ */
+typedef struct mcp_sink {
+    // Called exactly once per submitted message. `response` is NULL when the
+    // message needs no reply (notifications). Takes ownership of `response`
+    // and `arena` (either may be NULL); the sink calls mcp_response_release()
+    // once the response has been encoded, and reports its size with
+    // mcp_stats_bytes_out() for the tool mcp_stats_current() names during send
+    void (*send)(struct mcp_sink* sink, cJSON* response, mcp_arena* arena);
+    // Optional, NULL when the transport takes whole replies only. Hands over
+    // the next piece of a reply an mcp_stream writes, from the thread running
+    // the handler; `last` ends the reply, the transport adds its delimiter.
+    // Pieces of one reply must reach the client without other replies in
+    // between, and the call may block while too many wait to be written.
+    // Takes ownership of `chunk` (malloc'd) and returns -1 once the client is
+    // gone. `send` still follows, with no response, when the call finishes
+    int (*send_chunk)(struct mcp_sink* sink, char* chunk, size_t length, bool first, bool last);
+} mcp_sink;
+
+// JSON-RPC 2.0 error codes
+#define MCP_ERROR_PARSE (-32700)
+#define MCP_ERROR_INVALID_REQUEST (-32600)
+#define MCP_ERROR_METHOD_NOT_FOUND (-32601)
+#define MCP_ERROR_INVALID_PARAMS (-32602)
+#define MCP_ERROR_INTERNAL (-32603)
+// Implementation-defined server errors
+#define MCP_ERROR_SERVER_BUSY (-32000)  // The request queue is at its limits
+#define MCP_ERROR_TIMEOUT (-32001)      // The tool ran past its deadline
+#define MCP_ERROR_RESOURCE_NOT_FOUND (-32002)  // resources/read of a URI the server does not serve
+
+// Per-tool deadlines overriding the TIMEOUT_MS annotations, "tool=ms,..."; "*" sets the default
+#define MCP_TIMEOUTS_ENV "MCPC_TIMEOUTS"
+
+struct mcp_batch;
+
+// Who claimed mcp_request.answered
+#define MCP_ANSWERED_HANDLER 1
+#define MCP_ANSWERED_DEADLINE 2   // Sent its timeout error already, unless it is part of a batch
+
+// Why a token was fired
+#define MCP_CANCEL_CLIENT 1    // notifications/cancelled or a closed connection: no reply
+#define MCP_CANCEL_DEADLINE 2  // The tool's timeout: the client already got a timeout error
+
+/**
+ * @brief Set when the client sends notifications/cancelled for a request,
+ * or when the request runs past its tool's deadline. Handlers poll it with
+ * mcp_cancel_requested() and return early; whatever they return then is
+ * dropped.
+ */
+typedef struct mcp_cancel_token {
+    volatile long cancelled;  // 0 or MCP_CANCEL_*
+} mcp_cancel_token;
+
+/**
+ * @brief One JSON-RPC message travelling from a transport to a worker.
+ * Requests that belong to a batch are owned by it and borrow `json` from
+ * the batch array.
+ */
+typedef struct mcp_request {
+    mcp_task task;
+    mcp_pool* pool;    // Counts the request while it is detached
+    cJSON* json;
+    mcp_arena* arena;  // Holds `json` and everything built while handling it
+    mcp_sink* sink;
+    mcp_session* session;
+    struct mcp_batch* batch;
+    size_t index;
+    const cJSON* id;           // NULL for notifications
+    mcp_cancel_token cancel;
+    mcp_timer deadline;
+    volatile long holds;       // The worker, the handle of a detached call and the armed deadline
+    volatile long answered;    // Claimed by the first reply, MCP_ANSWERED_*
+    bool detached;
+    cJSON* response;           // The claimed reply, sent by the last holder
+    int tool;                  // Index into bridge_tool_names once a generated handler ran, else -1
+    bool failed;               // The handler returned no result
+    uint64_t started;          // mcp_stats_now_ns() at worker pickup
+    void** kept;               // Parameters of a detached call, freed when it finishes
+    size_t kept_count;
+    // In-flight list of the session, guarded by its lock
+    struct mcp_request* prev;
+    struct mcp_request* next;
+} mcp_request;
+
+/**
+ * @brief Completion handle of an asynchronous handler (EXPORT_ASYNC_AS).
+ * It is the request itself and stays valid until it is completed.
+ */
+typedef struct mcp_request mcp_call;
+
+/**
+ * @brief Frees a response: resets its arena in one shot, or walks the tree
+ * with cJSON_Delete() when it was built on the heap.
+ */
+void mcp_response_release(cJSON* response, mcp_arena* arena);
+
+/**
+ * @brief Builds a JSON-RPC error response. `id` is copied; NULL yields
+ * "id": null.
+ */
+cJSON* mcp_error_response(const cJSON* id, int code, const char* message);
+
+/**
+ * @brief Dispatches one parsed message through bridge() and builds the reply.
+ *
+ * @return cJSON* The JSON-RPC response (an error response for values that
+ * are not request objects), or NULL for notifications (no "id"). The caller
+ * owns the returned object.
+ */
+cJSON* mcp_dispatch_message(cJSON* json);
+
+/**
+ * @brief Queues `json` for a worker; its reply is delivered to `sink`.
+ * A batch (top-level array) is split so its elements run concurrently, and
+ * their replies are delivered to `sink` once, as one array.
+ * `arena` is the arena `json` was parsed into (or NULL); the reply is built
+ * in it as well. Takes ownership of both on success; returns -1 if the pool
+ * is closed. `session` (may be NULL) is retained until the message is done
+ * and is the current session while its handlers run.
+ *
+ * `bytes` is the size of the message as received. When the pool does not
+ * admit it, requests are answered right away with MCP_ERROR_SERVER_BUSY
+ * instead of queueing; notifications are always queued, since the client
+ * could not learn that one was dropped.
+ */
+int mcp_dispatch_submit(mcp_pool* pool, cJSON* json, size_t bytes, mcp_arena* arena, mcp_sink* sink,
+                        mcp_session* session);
+
+/**
+ * @brief Whether the client has cancelled the request `token` belongs to.
+ * NULL is never cancelled.
+ */
+bool mcp_cancel_requested(mcp_cancel_token* token);
+
+/**
+ * @brief The token of the request running on the calling thread, or NULL
+ * outside of a request. Lets synchronous handlers stop early as well.
+ */
+mcp_cancel_token* mcp_cancel_current(void);
+
+/**
+ * @brief Takes the request running on the calling thread off the
+ * synchronous path: its reply is no longer built from bridge()'s return
+ * value but from exactly one later mcp_call_complete()/mcp_call_fail().
+ * Called by generated EXPORT_ASYNC_AS handlers before the user function.
+ *
+ * @return NULL outside of a request.
+ */
+mcp_call* mcp_call_detach(void);
+mcp_cancel_token* mcp_call_cancel_token(mcp_call* call);
+
+/**
+ * @brief Hands the parsed parameters of a detached call (mcp_malloc()
+ * blocks) to it, so the handler may go on using them, from any thread,
+ * until it completes the call; they are freed with mcp_free() then. Takes
+ * all of `blocks` or, returning -1 when out of memory, none of them.
+ * Called by generated EXPORT_ASYNC_AS handlers before the user function.
+ */
+int mcp_call_keep(mcp_call* call, void* const* blocks, size_t count);
+
+/**
+ * @brief Finishes a detached call from any thread; the handle, and the
+ * parameters the call kept, are invalid afterwards. Takes ownership of `result` (NULL sends an empty result):
+ * when it was built outside the call's arena, e.g. on a thread of the
+ * tool's own, it is copied into the arena and deleted.
+ */
+void mcp_call_complete(mcp_call* call, cJSON* result);
+void mcp_call_fail(mcp_call* call, int code, const char* message);
+
+/**
+ * @brief For detached calls whose reply the handler writes out itself
+ * (mcp_stream): mcp_call_claim() takes the answer before the first byte goes
+ * out, so the deadline no longer sends one, and is false when the deadline
+ * answered first. mcp_call_sent() then finishes the call without a reply of
+ * its own, as it does for calls whose reply was dropped.
+ */
+bool mcp_call_claim(mcp_call* call);
+void mcp_call_sent(mcp_call* call);
+
+/**
+ * @brief Flags every in-flight request of `session`, for transports whose
+ * client has gone away.
+ */
+void mcp_dispatch_cancel_session(mcp_session* session);
+
+/**
+ * @brief Waits until every detached call has completed. With `cancel` all
+ * their tokens read as cancelled meanwhile, so they stop early and their
+ * replies are dropped. Call after the pool is shut down, while the sinks
+ * can still take replies.
+ */
+void mcp_dispatch_drain_calls(bool cancel);
+
+/**
+ * @brief Overrides the deadline of `method` (0 removes it); "*" sets the
+ * default for tools without one. Takes effect for requests that start
+ * afterwards. The initial values come from TIMEOUT_MS annotations and
+ * $MCPC_TIMEOUTS.
+ */
+void mcp_dispatch_set_timeout(const char* method, unsigned timeout_ms);
+unsigned mcp_dispatch_timeout(const char* method);
+
+/**
+ * @brief The wheel holding the deadlines of running requests. The process
+ * driving it (the socket event loop or the stdio deadline thread) calls
+ * mcp_timer_wheel_advance() every tick while timers are pending. An expired
+ * request is answered with MCP_ERROR_TIMEOUT and its token is fired.
+ */
+mcp_timer_wheel* mcp_dispatch_deadlines(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_DISPATCH_H */
@@ -0,0 +1,183 @@
+#include "mcp_event_loop.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "mcp_uring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_EVENT_BATCH 128
+
+static uint32_t mcp_epoll_events(unsigned events) {
+    uint32_t mask = 0;
+    if (events & MCP_EVENT_READ) mask |= EPOLLIN | EPOLLRDHUP;
+    if (events & MCP_EVENT_WRITE) mask |= EPOLLOUT;
+    return mask;
+}
+
+// Wake handler: clears the eventfd counter, posted tasks are run by the loop itself
+static void mcp_event_loop_on_wake(mcp_event_handler* handler, unsigned events) {
+    uint64_t value;
+    (void)events;
+    while (read(handler->fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+}
+
+int mcp_event_loop_init(mcp_event_loop* loop) {
+    loop->stopping = 0;
+    loop->uring = NULL;
+    loop->poll_fd = -1;
+    loop->wake.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->wake.on_event = mcp_event_loop_on_wake;
+    if (loop->wake.fd < 0 || mcp_queue_init(&loop->posted, 64) != 0) {
+        if (loop->wake.fd >= 0) close(loop->wake.fd);
+        return -1;
+    }
+    loop->uring = mcp_uring_create(loop);
+    if (loop->uring != NULL) {
+        return 0;
+    }
+    loop->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->poll_fd < 0 || mcp_event_loop_add(loop, &loop->wake, MCP_EVENT_READ) != 0) {
+        if (loop->poll_fd >= 0) close(loop->poll_fd);
+        mcp_queue_destroy(&loop->posted);
+        close(loop->wake.fd);
+        return -1;
+    }
+    return 0;
+}
+
+void mcp_event_loop_destroy(mcp_event_loop* loop) {
+    if (loop->uring != NULL) {
+        mcp_uring_destroy(loop->uring);
+        loop->uring = NULL;
+    } else {
+        close(loop->poll_fd);
+    }
+    mcp_queue_destroy(&loop->posted);
+    close(loop->wake.fd);
+    loop->wake.fd = -1;
+    loop->poll_fd = -1;
+}
+
+int mcp_event_loop_add(mcp_event_loop* loop, mcp_event_handler* handler, unsigned events) {
+    if (loop->uring != NULL) {
+        return mcp_uring_add(loop->uring, handler, events);
+    }
+    struct epoll_event ev;
+    ev.events = mcp_epoll_events(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(loop->poll_fd, EPOLL_CTL_ADD, handler->fd, &ev);
+}
+
+int mcp_event_loop_modify(mcp_event_loop* loop, mcp_event_handler* handler, unsigned events) {
+    if (loop->uring != NULL) {
+        return mcp_uring_modify(loop->uring, handler, events);
+    }
+    struct epoll_event ev;
+    ev.events = mcp_epoll_events(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(loop->poll_fd, EPOLL_CTL_MOD, handler->fd, &ev);
+}
+
+void mcp_event_loop_remove(mcp_event_loop* loop, mcp_event_handler* handler) {
+    if (loop->uring != NULL) {
+        mcp_uring_remove(loop->uring, handler, false);
+        return;
+    }
+    epoll_ctl(loop->poll_fd, EPOLL_CTL_DEL, handler->fd, NULL);
+}
+
+void mcp_event_loop_close(mcp_event_loop* loop, mcp_event_handler* handler) {
+    if (loop->uring != NULL) {
+        // The descriptor stays open until a send still in flight is done
+        mcp_uring_remove(loop->uring, handler, true);
+        return;
+    }
+    epoll_ctl(loop->poll_fd, EPOLL_CTL_DEL, handler->fd, NULL);
+    close(handler->fd);
+}
+
+long mcp_event_loop_read(mcp_event_loop* loop, mcp_event_handler* handler, mcp_framer* framer) {
+    if (loop->uring != NULL) {
+        return mcp_uring_read(loop->uring, handler, framer);
+    }
+    return mcp_framer_fill(framer);
+}
+
+long mcp_event_loop_write(mcp_event_loop* loop, mcp_event_handler* handler, mcp_writer* writer) {
+    if (loop->uring != NULL) {
+        return mcp_uring_write(loop->uring, handler, writer);
+    }
+    return mcp_writer_write_some(writer);
+}
+
+static void mcp_event_loop_wakeup(mcp_event_loop* loop) {
+    uint64_t one = 1;
+    // A full counter still leaves the eventfd readable, so a failed write is harmless
+    while (write(loop->wake.fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+int mcp_event_loop_post(mcp_event_loop* loop, mcp_task* task) {
+    if (mcp_queue_push(&loop->posted, task) != 0) {
+        return -1;
+    }
+    mcp_event_loop_wakeup(loop);
+    return 0;
+}
+
+void mcp_event_loop_drain(mcp_event_loop* loop) {
+    mcp_task* task = NULL;
+    while ((task = (mcp_task*)mcp_queue_try_pop(&loop->posted)) != NULL) {
+        task->run(task);
+    }
+}
+
+int mcp_event_loop_run(mcp_event_loop* loop) {
+    struct epoll_event events[MCP_EVENT_BATCH];
+
+    if (loop->uring != NULL) {
+        return mcp_uring_run(loop->uring);
+    }
+    while (!mcp_atomic_load(&loop->stopping)) {
+        int count = epoll_wait(loop->poll_fd, events, MCP_EVENT_BATCH, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return -1;
+        }
+        for (int i = 0; i < count; ++i) {
+            mcp_event_handler* handler = (mcp_event_handler*)events[i].data.ptr;
+            unsigned ready = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) ready |= MCP_EVENT_READ;
+            if (events[i].events & EPOLLOUT) ready |= MCP_EVENT_WRITE;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) ready |= MCP_EVENT_ERROR;
+            handler->on_event(handler, ready);
+        }
+        // Completions posted by workers are handled after the I/O of this round
+        mcp_event_loop_drain(loop);
+    }
+    return 0;
+}
+
+void mcp_event_loop_stop(mcp_event_loop* loop) {
+    mcp_atomic_store(&loop->stopping, 1);
+    mcp_event_loop_wakeup(loop);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,117 @@
+#ifndef MCP_EVENT_LOOP_H
+#define MCP_EVENT_LOOP_H
+
+#include "mcp_framer.h"
+#include "mcp_pool.h"
+#include "mcp_queue.h"
+#include "mcp_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Readiness bits passed to mcp_event_loop_add/modify and to handlers
+#define MCP_EVENT_READ  0x1u
+#define MCP_EVENT_WRITE 0x2u
+#define MCP_EVENT_ERROR 0x4u  // Hang-up or socket error, always reported
+// Only for mcp_event_loop_add: a connected socket whose bytes move through
+// mcp_event_loop_read/write, so the io_uring backend can own its I/O
+#define MCP_EVENT_STREAM 0x8u
+
+/**
+ * @brief A descriptor watched by the loop. Embed it as the first member of a
+ * connection struct and recover the container in `on_event`.
+ */
+typedef struct mcp_event_handler {
+    void (*on_event)(struct mcp_event_handler* handler, unsigned events);
+    int fd;
+    int slot;  // Backend bookkeeping, managed by the loop
+} mcp_event_handler;
+
+struct mcp_uring;
+
+/**
+ * @brief Single-threaded non-blocking reactor: io_uring on Linux kernels that
+ * support multishot receive, epoll otherwise (see mcp_uring.h).
+ *
+ * All socket I/O of a transport happens on the thread running the loop, so
+ * connection state needs no locking. Worker threads hand results back with
+ * mcp_event_loop_post(), which queues a task and wakes the loop through an
+ * eventfd.
+ */
+typedef struct mcp_event_loop {
+    struct mcp_uring* uring;  // io_uring backend, NULL when running on epoll
+    int poll_fd;
+    mcp_event_handler wake;  // eventfd, readable when tasks were posted
+    mcp_queue posted;        // mcp_task* to run on the loop thread
+    volatile long stopping;
+} mcp_event_loop;
+
+int mcp_event_loop_init(mcp_event_loop* loop);
+
+/**
+ * @brief Closes the loop's own descriptors. Tasks still posted are dropped,
+ * call mcp_event_loop_drain() first.
+ */
+void mcp_event_loop_destroy(mcp_event_loop* loop);
+
+/**
+ * @brief Starts watching `handler->fd` for `events`. Returns 0 or -1.
+ */
+int mcp_event_loop_add(mcp_event_loop* loop, mcp_event_handler* handler, unsigned events);
+int mcp_event_loop_modify(mcp_event_loop* loop, mcp_event_handler* handler, unsigned events);
+
+/**
+ * @brief Stops watching the handler. Call it before closing the descriptor.
+ */
+void mcp_event_loop_remove(mcp_event_loop* loop, mcp_event_handler* handler);
+
+/**
+ * @brief Stops watching a stream handler and closes its descriptor. Output
+ * already accepted by mcp_event_loop_write() is still delivered first.
+ */
+void mcp_event_loop_close(mcp_event_loop* loop, mcp_event_handler* handler);
+
+/**
+ * @brief Moves the bytes received on a stream handler into `framer`; the
+ * loop's counterpart of mcp_framer_fill(), with the same return values.
+ */
+long mcp_event_loop_read(mcp_event_loop* loop, mcp_event_handler* handler, mcp_framer* framer);
+
+/**
+ * @brief Sends pending output of a stream handler; the loop's counterpart of
+ * mcp_writer_write_some(), with the same return values. On io_uring the
+ * buffer is handed to the kernel whole and the next call fails with EAGAIN
+ * until that send completes, which is reported as MCP_EVENT_WRITE.
+ */
+long mcp_event_loop_write(mcp_event_loop* loop, mcp_event_handler* handler, mcp_writer* writer);
+
+/**
+ * @brief Runs `task` on the loop thread. Safe to call from any thread.
+ * Returns -1 if the task could not be queued.
+ */
+int mcp_event_loop_post(mcp_event_loop* loop, mcp_task* task);
+
+/**
+ * @brief Dispatches events until mcp_event_loop_stop() is called.
+ * Returns 0 after a stop, -1 on a polling error.
+ */
+int mcp_event_loop_run(mcp_event_loop* loop);
+
+/**
+ * @brief Makes mcp_event_loop_run() return. Safe to call from any thread and
+ * from a signal handler.
+ */
+void mcp_event_loop_stop(mcp_event_loop* loop);
+
+/**
+ * @brief Runs every task posted so far on the calling thread, used during
+ * shutdown once the loop no longer runs.
+ */
+void mcp_event_loop_drain(mcp_event_loop* loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_EVENT_LOOP_H */
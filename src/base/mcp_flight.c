@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_dispatch.h"
+#include "mcp_flight.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mcp_flight {
+    struct mcp_flight* chain;  // Next flight of the same bucket
+    bool listed;               // In the table, so identical calls can join it
+    uint64_t hash;
+    size_t waiter_count;
+    size_t waiter_capacity;
+    mcp_call** waiters;        // Detached requests waiting for the result
+    size_t key_length;
+    char key[];
+};
+
+static mcp_mutex_t g_flights_lock = MCP_MUTEX_INITIALIZER;
+static mcp_flight* g_flights[MCP_FLIGHT_BUCKETS];
+static uint64_t g_flights_run = 0;
+static uint64_t g_flights_joined = 0;
+static uint64_t g_flights_active = 0;
+
+// Caller holds g_flights_lock
+static mcp_flight** mcp_flight_slot(const mcp_cache_key* key) {
+    mcp_flight** slot = &g_flights[key->hash & (MCP_FLIGHT_BUCKETS - 1)];
+    while (*slot != NULL && ((*slot)->hash != key->hash || (*slot)->key_length != key->length ||
+                             memcmp((*slot)->key, key->data, key->length) != 0)) {
+        slot = &(*slot)->chain;
+    }
+    return slot;
+}
+
+// Caller holds g_flights_lock
+static int mcp_flight_park(mcp_flight* flight) {
+    if (flight->waiter_count == flight->waiter_capacity) {
+        size_t capacity = flight->waiter_capacity != 0 ? flight->waiter_capacity * 2 : 4;
+        mcp_call** waiters = (mcp_call**)realloc(flight->waiters, capacity * sizeof(mcp_call*));
+        if (waiters == NULL) {
+            return -1;
+        }
+        flight->waiters = waiters;
+        flight->waiter_capacity = capacity;
+    }
+    mcp_call* call = mcp_call_detach();
+    if (call == NULL) {
+        return -1;
+    }
+    flight->waiters[flight->waiter_count++] = call;
+    return 0;
+}
+
+mcp_flight* mcp_flight_join(const mcp_cache_key* key) {
+    mcp_mutex_lock(&g_flights_lock);
+    mcp_flight** slot = mcp_flight_slot(key);
+    if (*slot != NULL && mcp_flight_park(*slot) == 0) {
+        g_flights_joined++;
+        mcp_mutex_unlock(&g_flights_lock);
+        return NULL;
+    }
+    mcp_flight* flight = (mcp_flight*)malloc(sizeof(mcp_flight) + key->length);
+    if (flight != NULL) {
+        memset(flight, 0, sizeof(mcp_flight));
+        flight->hash = key->hash;
+        flight->key_length = key->length;
+        memcpy(flight->key, key->data, key->length);
+        // A call that could not park runs on its own, unlisted beside the flight it missed
+        flight->listed = *slot == NULL;
+        if (flight->listed) {
+            *slot = flight;
+        }
+        g_flights_run++;
+        g_flights_active++;
+    }
+    mcp_mutex_unlock(&g_flights_lock);
+    // Out of memory: run the call without coalescing, landing a NULL flight is a no-op
+    return flight;
+}
+
+mcp_call* mcp_flight_promote(mcp_flight* flight) {
+    mcp_call* call = NULL;
+    if (flight == NULL) {
+        return NULL;
+    }
+    mcp_mutex_lock(&g_flights_lock);
+    for (size_t i = 0; i < flight->waiter_count; ++i) {
+        if (!mcp_cancel_requested(mcp_call_cancel_token(flight->waiters[i]))) {
+            call = flight->waiters[i];
+            memmove(&flight->waiters[i], &flight->waiters[i + 1], (flight->waiter_count - i - 1) * sizeof(mcp_call*));
+            flight->waiter_count--;
+            g_flights_run++;
+            g_flights_joined--;
+            break;
+        }
+    }
+    mcp_mutex_unlock(&g_flights_lock);
+    return call;
+}
+
+void mcp_flight_land(mcp_flight* flight, const cJSON* result, int tool) {
+    if (flight == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&g_flights_lock);
+    if (flight->listed) {
+        mcp_flight** slot = &g_flights[flight->hash & (MCP_FLIGHT_BUCKETS - 1)];
+        while (*slot != flight) {
+            slot = &(*slot)->chain;
+        }
+        *slot = flight->chain;
+    }
+    g_flights_active--;
+    mcp_mutex_unlock(&g_flights_lock);
+
+    // Serialized once; each waiter gets the text as a raw item in its own arena
+    char* text = flight->waiter_count != 0 && result != NULL ? cJSON_PrintUnformatted(result) : NULL;
+    for (size_t i = 0; i < flight->waiter_count; ++i) {
+        mcp_call* call = flight->waiters[i];
+        call->tool = tool;
+        if (result != NULL && text == NULL) {
+            call->failed = true;
+            mcp_call_fail(call, MCP_ERROR_INTERNAL, "Out of memory");
+            continue;
+        }
+        mcp_arena* previous = mcp_arena_set_current(call->arena);
+        cJSON* copy = text != NULL ? cJSON_CreateRaw(text) : NULL;
+        call->failed = copy == NULL;
+        mcp_call_complete(call, copy);
+        mcp_arena_set_current(previous);
+    }
+    cJSON_free(text);
+    free(flight->waiters);
+    free(flight);
+}
+
+cJSON* mcp_flight_report(void) {
+    mcp_mutex_lock(&g_flights_lock);
+    uint64_t run = g_flights_run, joined = g_flights_joined, active = g_flights_active;
+    mcp_mutex_unlock(&g_flights_lock);
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "runs", (double)run);
+    cJSON_AddNumberToObject(report, "joined", (double)joined);
+    cJSON_AddNumberToObject(report, "in_flight", (double)active);
+    return report;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef MCP_FLIGHT_H
+#define MCP_FLIGHT_H
+
+#include "cJSON.h"
+#include "mcp_cache.h"
+#include "mcp_dispatch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Buckets of the table of calls in flight; a power of two
+#define MCP_FLIGHT_BUCKETS 256
+
+typedef struct mcp_flight mcp_flight;
+
+/**
+ * @brief Joins the call identified by `key` (see mcp_cache_key_init()) for
+ * the request running on the calling thread.
+ *
+ * When an identical call is already running, the request is detached and
+ * parked on it and NULL is returned: the caller returns without a reply,
+ * which comes from mcp_flight_land() of the running call. Otherwise the
+ * request leads a new flight, which the caller runs and then lands.
+ */
+mcp_flight* mcp_flight_join(const mcp_cache_key* key);
+
+/**
+ * @brief Takes the first parked request whose token has not fired off the
+ * flight, for the caller to run the call again on its behalf, because the
+ * run that led the flight was cancelled and its result is not the call's.
+ * The flight stays open meanwhile. NULL when nobody is left waiting for it.
+ */
+mcp_call* mcp_flight_promote(mcp_flight* flight);
+
+/**
+ * @brief Ends a flight: every request parked on it is completed with a
+ * copy of `result` (serialized once, NULL answers them as a failed call
+ * would) and counted against `tool`. Does not take `result`.
+ */
+void mcp_flight_land(mcp_flight* flight, const cJSON* result, int tool);
+
+/**
+ * @brief Counters of coalesced calls: flights run, requests that joined
+ * one instead of running the handler, and flights in the air now.
+ */
+cJSON* mcp_flight_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_FLIGHT_H */
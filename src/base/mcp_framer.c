@@ -0,0 +1,216 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_framer.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define mcp_read(fd, buf, n) _read((fd), (buf), (unsigned int)(n))
+#else
+#include <unistd.h>
+#define mcp_read(fd, buf, n) read((fd), (buf), (n))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MCP_HAVE_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MCP_HAVE_SSE2
+static inline unsigned mcp_ctz(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+const char* mcp_find_newline(const char* data, size_t length) {
+#ifdef MCP_HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    // 每次比较 16 字节, 用 movemask 取出命中位置
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        if (mask != 0) {
+            return data + i + mcp_ctz(mask);
+        }
+    }
+    return (const char*)memchr(data + i, '\n', length - i);
+#else
+    return (const char*)memchr(data, '\n', length);
+#endif
+}
+
+int mcp_framer_init(mcp_framer* framer, int fd, size_t initial_capacity) {
+    if (initial_capacity == 0) {
+        initial_capacity = MCP_FRAMER_INITIAL_CAPACITY;
+    }
+    framer->data = (char*)malloc(initial_capacity);
+    if (!framer->data) {
+        return -1;
+    }
+    framer->capacity = initial_capacity;
+    framer->start = 0;
+    framer->end = 0;
+    framer->scan = 0;
+    framer->fd = fd;
+    framer->eof = false;
+    return 0;
+}
+
+void mcp_framer_destroy(mcp_framer* framer) {
+    free(framer->data);
+    framer->data = NULL;
+    framer->capacity = 0;
+    framer->start = framer->end = framer->scan = 0;
+}
+
+// Makes room at the end of the buffer: slide the unfinished tail to the front,
+// and double the buffer only when the tail itself fills it.
+static int mcp_framer_reserve(mcp_framer* framer) {
+    size_t pending = framer->end - framer->start;
+    if (framer->start > 0 && (framer->end == framer->capacity || framer->start >= framer->capacity / 2)) {
+        memmove(framer->data, framer->data + framer->start, pending);
+        framer->scan -= framer->start;
+        framer->start = 0;
+        framer->end = pending;
+    }
+    if (framer->end == framer->capacity) {
+        size_t new_capacity = framer->capacity * 2;
+        char* data = (char*)realloc(framer->data, new_capacity);
+        if (!data) {
+            return -1;
+        }
+        framer->data = data;
+        framer->capacity = new_capacity;
+    }
+    return 0;
+}
+
+long mcp_framer_fill(mcp_framer* framer) {
+    if (framer->start == framer->end) {
+        // Buffer fully consumed, restart at the front for free
+        framer->start = framer->end = framer->scan = 0;
+    }
+    if (mcp_framer_reserve(framer) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (;;) {
+        long n = (long)mcp_read(framer->fd, framer->data + framer->end, framer->capacity - framer->end);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n > 0) {
+            framer->end += (size_t)n;
+        } else if (n == 0) {
+            framer->eof = true;
+        }
+        return n;
+    }
+}
+
+int mcp_framer_append(mcp_framer* framer, const char* data, size_t length) {
+    if (framer->start == framer->end) {
+        framer->start = framer->end = framer->scan = 0;
+    }
+    if (framer->capacity - framer->end < length) {
+        size_t pending = framer->end - framer->start;
+        if (framer->start > 0) {
+            memmove(framer->data, framer->data + framer->start, pending);
+            framer->scan -= framer->start;
+            framer->start = 0;
+            framer->end = pending;
+        }
+        size_t new_capacity = framer->capacity;
+        while (new_capacity - framer->end < length) {
+            new_capacity *= 2;
+        }
+        if (new_capacity != framer->capacity) {
+            char* grown = (char*)realloc(framer->data, new_capacity);
+            if (!grown) {
+                return -1;
+            }
+            framer->data = grown;
+            framer->capacity = new_capacity;
+        }
+    }
+    memcpy(framer->data + framer->end, data, length);
+    framer->end += length;
+    return 0;
+}
+
+static void mcp_framer_take(mcp_framer* framer, char* newline, char** message, size_t* length) {
+    char* begin = framer->data + framer->start;
+    size_t len = (size_t)(newline - begin);
+    *newline = '\0';
+    if (len > 0 && begin[len - 1] == '\r') {
+        begin[--len] = '\0';
+    }
+    framer->start += (size_t)(newline - begin) + 1;
+    framer->scan = framer->start;
+    *message = begin;
+    *length = len;
+}
+
+bool mcp_framer_pop(mcp_framer* framer, char** message, size_t* length) {
+    if (framer->scan < framer->start) {
+        framer->scan = framer->start;
+    }
+    const char* newline = mcp_find_newline(framer->data + framer->scan, framer->end - framer->scan);
+    if (newline == NULL) {
+        framer->scan = framer->end;
+        return false;
+    }
+    mcp_framer_take(framer, (char*)newline, message, length);
+    return true;
+}
+
+void mcp_framer_consume(mcp_framer* framer, size_t length) {
+    framer->start += length;
+    if (framer->start > framer->end) {
+        framer->start = framer->end;
+    }
+    framer->scan = framer->start;
+}
+
+int mcp_framer_next(mcp_framer* framer, char** message, size_t* length) {
+    for (;;) {
+        if (mcp_framer_pop(framer, message, length)) {
+            return 1;
+        }
+        if (framer->eof) {
+            break;
+        }
+        long n = mcp_framer_fill(framer);
+        if (n < 0) {
+            return -1;
+        }
+    }
+    // Flush a last message that was not terminated by a newline
+    if (framer->end > framer->start) {
+        if (framer->end == framer->capacity && mcp_framer_reserve(framer) != 0) {
+            return -1;
+        }
+        mcp_framer_take(framer, framer->data + framer->end, message, length);
+        framer->end = framer->start;
+        return 1;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
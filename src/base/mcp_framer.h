@@ -0,0 +1,81 @@
+#ifndef MCP_FRAMER_H
+#define MCP_FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_FRAMER_INITIAL_CAPACITY (64 * 1024)
+
+/**
+ * @brief Newline-delimited message framer over a file descriptor.
+ *
+ * Bytes are pulled with large read() calls into one growable buffer.
+ * Consumed bytes are reclaimed by sliding the unfinished tail back to the
+ * front, so a message is always contiguous and can be handed out in place.
+ * There is no size limit on a single message.
+ */
+typedef struct mcp_framer {
+    char* data;
+    size_t capacity;
+    size_t start;   // First byte of the next message
+    size_t end;     // One past the last byte read
+    size_t scan;    // Bytes in [start, scan) are known to contain no newline
+    int fd;
+    bool eof;
+} mcp_framer;
+
+int mcp_framer_init(mcp_framer* framer, int fd, size_t initial_capacity);
+void mcp_framer_destroy(mcp_framer* framer);
+
+/**
+ * @brief Performs one read() into the free space of the buffer.
+ *
+ * @return Number of bytes read, 0 on end of file, -1 on error (errno is kept,
+ * so EAGAIN can be told apart on non-blocking descriptors).
+ */
+long mcp_framer_fill(mcp_framer* framer);
+
+/**
+ * @brief Appends bytes received elsewhere (e.g. by an io_uring completion),
+ * growing the buffer as needed. Returns 0, or -1 when out of memory.
+ */
+int mcp_framer_append(mcp_framer* framer, const char* data, size_t length);
+
+/**
+ * @brief Takes the next complete message out of the buffer without reading.
+ * The newline (and a preceding '\r') is replaced by '\0', so the slice is a
+ * NUL-terminated string. It stays valid until the next fill.
+ *
+ * @return true if a message was returned.
+ */
+bool mcp_framer_pop(mcp_framer* framer, char** message, size_t* length);
+
+/**
+ * @brief Drops `length` bytes from the front of the unread data, for callers
+ * that parse the buffer themselves (e.g. HTTP headers and bodies).
+ */
+void mcp_framer_consume(mcp_framer* framer, size_t length);
+
+/**
+ * @brief Blocking helper: pops the next message, reading as needed. A final
+ * message without a trailing newline is returned at end of file.
+ *
+ * @return 1 if a message was returned, 0 on end of file, -1 on error.
+ */
+int mcp_framer_next(mcp_framer* framer, char** message, size_t* length);
+
+/**
+ * @brief Returns a pointer to the first '\n' in [data, data + length), or
+ * NULL. Uses SSE2 when available.
+ */
+const char* mcp_find_newline(const char* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_FRAMER_H */
@@ -0,0 +1,1137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_http.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_event_loop.h"
+#include "mcp_framer.h"
+#include "mcp_log.h"
+#include "mcp_net.h"
+#include "mcp_session.h"
+#include "mcp_thread.h"
+#include "mcp_timer.h"
+#include "mcp_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_HTTP_SESSION_BUCKETS 256
+
+typedef struct mcp_http_server mcp_http_server;
+typedef struct mcp_http_session mcp_http_session;
+
+typedef enum mcp_http_method {
+    MCP_HTTP_OTHER,
+    MCP_HTTP_GET,
+    MCP_HTTP_POST,
+    MCP_HTTP_DELETE
+} mcp_http_method;
+
+/**
+ * @brief What the header of the connection's current request said.
+ */
+typedef struct mcp_http_request {
+    mcp_http_method method;
+    size_t header_length;   // 0 until the blank line has been seen
+    size_t content_length;
+    bool bad;               // Malformed request line or header
+    bool path_ok;
+    bool keep_alive;
+    bool chunked;
+    bool accept_json;
+    bool accept_sse;
+    bool origin_ok;
+    bool session_id_invalid;
+    char session_id[MCP_HTTP_SESSION_ID_LENGTH + 1];  // "" when absent
+} mcp_http_request;
+
+/**
+ * @brief One client connection. Only the loop thread touches it; a request
+ * handed to the workers keeps it `busy` until the reply is back, which also
+ * keeps pipelined replies in order.
+ */
+typedef struct mcp_http_conn {
+    mcp_event_handler handler;
+    mcp_http_server* server;
+    mcp_framer in;
+    mcp_writer out;
+    mcp_http_request request;
+    size_t header_scan;                // Start of the first header line not yet scanned
+    struct mcp_http_conn** stream_list;  // Session (or broadcast) list of a GET stream
+    struct mcp_http_conn* stream_next;
+    struct mcp_http_conn* prev;
+    struct mcp_http_conn* next;
+    mcp_task release;                  // Frees a closed connection after the current round
+    unsigned events;
+    bool keep_alive;                   // Of the request being answered
+    bool busy;
+    bool streaming;
+    bool close_after_write;
+    bool closed;
+} mcp_http_conn;
+
+struct mcp_http_session {
+    char id[MCP_HTTP_SESSION_ID_LENGTH + 1];
+    mcp_session* state;  // What initialize negotiated, shared with running requests
+    mcp_http_conn* streams;
+    mcp_http_session* next;
+    uint64_t used_ms;    // Last request, for idle expiry
+};
+
+struct mcp_http_server {
+    mcp_transport transport;
+    mcp_net* net;
+    mcp_http_server* next_server;
+    mcp_event_handler listener;
+    mcp_event_handler heartbeat;  // timerfd
+    mcp_sink discard;             // For posts that only carry notifications
+    mcp_writer scratch;           // Body encoding, loop thread only
+    mcp_http_conn* conns;
+    mcp_http_conn* broadcast;     // GET streams opened without a session
+    mcp_http_session* sessions[MCP_HTTP_SESSION_BUCKETS];
+    size_t session_count;
+};
+
+/**
+ * @brief A POST travelling to the workers and back to its connection.
+ */
+typedef struct mcp_http_exchange {
+    mcp_task task;
+    mcp_sink sink;
+    mcp_http_conn* conn;
+    cJSON* response;
+    mcp_arena* arena;
+    int tool;  // For the byte count, see mcp_stats_bytes_out()
+    bool sse;
+    char session_id[MCP_HTTP_SESSION_ID_LENGTH + 1];  // Set when the request created a session
+} mcp_http_exchange;
+
+typedef struct mcp_http_push {
+    mcp_task task;
+    mcp_http_server* server;
+    cJSON* message;
+    bool all;
+    char session_id[MCP_HTTP_SESSION_ID_LENGTH + 1];
+} mcp_http_push;
+
+// Running HTTP servers, for mcp_http_notify(); only changed while no request runs
+static mcp_http_server* g_http_servers = NULL;
+
+static void mcp_http_process(mcp_http_conn* conn);
+static void mcp_http_close(mcp_http_conn* conn);
+
+// --- Sessions ---
+
+static size_t mcp_http_session_bucket(const char* id) {
+    uint32_t hash = 2166136261u;
+    for (; *id; ++id) {
+        hash = (hash ^ (unsigned char)*id) * 16777619u;
+    }
+    return hash % MCP_HTTP_SESSION_BUCKETS;
+}
+
+static mcp_http_session* mcp_http_session_find(mcp_http_server* server, const char* id) {
+    mcp_http_session* session = server->sessions[mcp_http_session_bucket(id)];
+    while (session != NULL && strcmp(session->id, id) != 0) {
+        session = session->next;
+    }
+    return session;
+}
+
+// Unlinks and frees a session, closing its streams and cancelling what it still runs
+static void mcp_http_session_remove(mcp_http_server* server, mcp_http_session* session) {
+    mcp_http_session** link = &server->sessions[mcp_http_session_bucket(session->id)];
+    while (*link != session) {
+        link = &(*link)->next;
+    }
+    *link = session->next;
+    server->session_count--;
+    while (session->streams != NULL) {
+        mcp_http_close(session->streams);
+    }
+    mcp_dispatch_cancel_session(session->state);
+    mcp_session_release(session->state);
+    free(session);
+}
+
+// Ends the sessions idle since before `cutoff`, or with `oldest` the longest
+// idle one only; sessions with an open stream or requests in flight are in
+// use and stay
+static void mcp_http_session_expire(mcp_http_server* server, uint64_t cutoff, bool oldest) {
+    mcp_http_session* victim = NULL;
+    for (size_t i = 0; i < MCP_HTTP_SESSION_BUCKETS; ++i) {
+        mcp_http_session* session = server->sessions[i];
+        while (session != NULL) {
+            mcp_http_session* next = session->next;
+            if (session->streams == NULL && session->used_ms < cutoff && !mcp_session_busy(session->state)) {
+                if (!oldest) {
+                    mcp_http_session_remove(server, session);
+                } else if (victim == NULL || session->used_ms < victim->used_ms) {
+                    victim = session;
+                }
+            }
+            session = next;
+        }
+    }
+    if (victim != NULL) {
+        mcp_http_session_remove(server, victim);
+    }
+}
+
+static mcp_http_session* mcp_http_session_create(mcp_http_server* server) {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char bytes[MCP_HTTP_SESSION_ID_LENGTH / 2];
+    uint64_t now = mcp_timer_now_ms();
+    if (server->session_count >= MCP_HTTP_MAX_SESSIONS) {
+        uint64_t idle = (uint64_t)MCP_HTTP_SESSION_EVICT_SECONDS * 1000;
+        if (now > idle) {
+            mcp_http_session_expire(server, now - idle, true);
+        }
+        if (server->session_count >= MCP_HTTP_MAX_SESSIONS) {
+            mcp_log_warn("%d HTTP sessions are in use, not starting another", MCP_HTTP_MAX_SESSIONS);
+            return NULL;
+        }
+    }
+    mcp_http_session* session = (mcp_http_session*)calloc(1, sizeof(mcp_http_session));
+    if (!session) {
+        return NULL;
+    }
+    session->state = mcp_session_create();
+    if (session->state == NULL || getrandom(bytes, sizeof(bytes), 0) != (ssize_t)sizeof(bytes)) {
+        mcp_session_release(session->state);
+        free(session);
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(bytes); ++i) {
+        session->id[2 * i] = hex[bytes[i] >> 4];
+        session->id[2 * i + 1] = hex[bytes[i] & 0xf];
+    }
+    session->used_ms = now;
+    size_t bucket = mcp_http_session_bucket(session->id);
+    session->next = server->sessions[bucket];
+    server->sessions[bucket] = session;
+    server->session_count++;
+    return session;
+}
+
+// --- Connections ---
+
+static void mcp_http_release_run(mcp_task* task) {
+    mcp_http_conn* conn = (mcp_http_conn*)((char*)task - offsetof(mcp_http_conn, release));
+    mcp_framer_destroy(&conn->in);
+    mcp_writer_destroy(&conn->out);
+    free(conn);
+}
+
+static void mcp_http_stream_unlink(mcp_http_conn* conn) {
+    if (conn->stream_list == NULL) {
+        return;
+    }
+    for (mcp_http_conn** link = conn->stream_list; *link != NULL; link = &(*link)->stream_next) {
+        if (*link == conn) {
+            *link = conn->stream_next;
+            break;
+        }
+    }
+    conn->stream_list = NULL;
+    conn->stream_next = NULL;
+}
+
+/**
+ * @brief Closes the socket at once; the memory is freed after the current
+ * loop round (other events of the round may still point at it), or when the
+ * request still with the workers comes back.
+ */
+static void mcp_http_close(mcp_http_conn* conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = true;
+    mcp_http_server* server = conn->server;
+    mcp_event_loop_close(&server->net->loop, &conn->handler);
+    mcp_http_stream_unlink(conn);
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        server->conns = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    if (!conn->busy) {
+        conn->release.run = mcp_http_release_run;
+        mcp_event_loop_post(&server->net->loop, &conn->release);
+    }
+}
+
+static void mcp_http_update_interest(mcp_http_conn* conn) {
+    if (conn->closed) {
+        return;
+    }
+    unsigned events = conn->busy ? 0 : MCP_EVENT_READ;
+    if (conn->out.length > 0) {
+        events |= MCP_EVENT_WRITE;
+    }
+    if (events != conn->events && mcp_event_loop_modify(&conn->server->net->loop, &conn->handler, events) == 0) {
+        conn->events = events;
+    }
+}
+
+// Writes as much pending output as the socket takes without blocking
+static void mcp_http_flush(mcp_http_conn* conn) {
+    while (conn->out.length > 0) {
+        long n = mcp_event_loop_write(&conn->server->net->loop, &conn->handler, &conn->out);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            mcp_http_close(conn);
+            return;
+        }
+    }
+    if (conn->out.length == 0 && conn->close_after_write) {
+        mcp_http_close(conn);
+        return;
+    }
+    mcp_http_update_interest(conn);
+}
+
+static void mcp_http_respond(mcp_http_conn* conn, int status, const char* reason, const char* content_type,
+                             const char* extra_headers, const char* body, size_t body_length) {
+    char header[512];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %d %s\r\n"
+                          "%s%s%s"
+                          "Content-Length: %zu\r\n"
+                          "%s"
+                          "Connection: %s\r\n\r\n",
+                          status, reason,
+                          content_type ? "Content-Type: " : "", content_type ? content_type : "", content_type ? "\r\n" : "",
+                          body_length,
+                          extra_headers ? extra_headers : "",
+                          conn->keep_alive ? "keep-alive" : "close");
+    if (length < 0 || (size_t)length >= sizeof(header) ||
+        mcp_writer_append(&conn->out, header, (size_t)length) != 0 ||
+        (body_length > 0 && mcp_writer_append(&conn->out, body, body_length) != 0)) {
+        mcp_http_close(conn);
+        return;
+    }
+    if (!conn->keep_alive) {
+        conn->close_after_write = true;
+    }
+    mcp_http_flush(conn);
+}
+
+// HTTP-level failures carry a JSON-RPC error body so clients can show a reason
+static void mcp_http_respond_error(mcp_http_conn* conn, int status, const char* reason, int code, const char* message) {
+    mcp_writer* scratch = &conn->server->scratch;
+    cJSON* error = mcp_error_response(NULL, code, message);
+    scratch->length = 0;
+    if (error == NULL || mcp_writer_append_json(scratch, error) != 0) {
+        scratch->length = 0;
+    }
+    cJSON_Delete(error);
+    mcp_http_respond(conn, status, reason, "application/json", NULL, scratch->data, scratch->length);
+}
+
+// --- Request parsing ---
+
+static bool mcp_http_token_in(const char* value, size_t length, const char* token) {
+    size_t token_length = strlen(token);
+    for (size_t i = 0; i + token_length <= length; ++i) {
+        if (strncasecmp(value + i, token, token_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Browsers send Origin; only local pages may talk to a local server (DNS rebinding)
+static bool mcp_http_origin_is_local(const char* value, size_t length) {
+    static const char* hosts[] = { "localhost", "127.0.0.1", "[::1]" };
+    const char* host = NULL;
+    for (size_t i = 0; i + 3 <= length; ++i) {
+        if (memcmp(value + i, "://", 3) == 0) {
+            host = value + i + 3;
+            break;
+        }
+    }
+    if (host == NULL) {
+        return false;
+    }
+    size_t rest = length - (size_t)(host - value);
+    for (size_t i = 0; i < sizeof(hosts) / sizeof(hosts[0]); ++i) {
+        size_t n = strlen(hosts[i]);
+        if (rest >= n && strncasecmp(host, hosts[i], n) == 0 && (rest == n || host[n] == ':' || host[n] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void mcp_http_parse_request_line(mcp_http_request* request, const char* line, size_t length) {
+    const char* end = line + length;
+    const char* space = (const char*)memchr(line, ' ', length);
+    if (space == NULL) {
+        request->bad = true;
+        return;
+    }
+    size_t method_length = (size_t)(space - line);
+    if (method_length == 3 && memcmp(line, "GET", 3) == 0) {
+        request->method = MCP_HTTP_GET;
+    } else if (method_length == 4 && memcmp(line, "POST", 4) == 0) {
+        request->method = MCP_HTTP_POST;
+    } else if (method_length == 6 && memcmp(line, "DELETE", 6) == 0) {
+        request->method = MCP_HTTP_DELETE;
+    }
+
+    const char* target = space + 1;
+    const char* target_end = (const char*)memchr(target, ' ', (size_t)(end - target));
+    if (target_end == NULL) {
+        request->bad = true;
+        return;
+    }
+    const char* query = (const char*)memchr(target, '?', (size_t)(target_end - target));
+    size_t path_length = (size_t)((query ? query : target_end) - target);
+    request->path_ok = path_length == strlen(MCP_HTTP_PATH) && memcmp(target, MCP_HTTP_PATH, path_length) == 0;
+
+    const char* version = target_end + 1;
+    size_t version_length = (size_t)(end - version);
+    if (version_length == 8 && memcmp(version, "HTTP/1.1", 8) == 0) {
+        request->keep_alive = true;
+    } else if (version_length == 8 && memcmp(version, "HTTP/1.0", 8) == 0) {
+        request->keep_alive = false;
+    } else {
+        request->bad = true;
+    }
+}
+
+static void mcp_http_parse_field(mcp_http_request* request, const char* line, size_t length, bool* has_accept) {
+    const char* colon = (const char*)memchr(line, ':', length);
+    if (colon == NULL) {
+        request->bad = true;
+        return;
+    }
+    size_t name_length = (size_t)(colon - line);
+    const char* value = colon + 1;
+    const char* end = line + length;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    size_t value_length = (size_t)(end - value);
+
+#define MCP_FIELD_IS(name) (name_length == sizeof(name) - 1 && strncasecmp(line, name, name_length) == 0)
+    if (MCP_FIELD_IS("Content-Length")) {
+        size_t content_length = 0;
+        if (value_length == 0 || value_length > 12) {
+            request->bad = true;
+            return;
+        }
+        for (size_t i = 0; i < value_length; ++i) {
+            if (value[i] < '0' || value[i] > '9') {
+                request->bad = true;
+                return;
+            }
+            content_length = content_length * 10 + (size_t)(value[i] - '0');
+        }
+        request->content_length = content_length;
+    } else if (MCP_FIELD_IS("Transfer-Encoding")) {
+        request->chunked = mcp_http_token_in(value, value_length, "chunked");
+    } else if (MCP_FIELD_IS("Connection")) {
+        if (mcp_http_token_in(value, value_length, "close")) {
+            request->keep_alive = false;
+        } else if (mcp_http_token_in(value, value_length, "keep-alive")) {
+            request->keep_alive = true;
+        }
+    } else if (MCP_FIELD_IS("Accept")) {
+        *has_accept = true;
+        request->accept_json |= mcp_http_token_in(value, value_length, "application/json") ||
+                                mcp_http_token_in(value, value_length, "*/*");
+        request->accept_sse |= mcp_http_token_in(value, value_length, "text/event-stream");
+    } else if (MCP_FIELD_IS("Mcp-Session-Id")) {
+        if (value_length == MCP_HTTP_SESSION_ID_LENGTH) {
+            memcpy(request->session_id, value, value_length);
+            request->session_id[value_length] = '\0';
+        } else {
+            request->session_id_invalid = true;
+        }
+    } else if (MCP_FIELD_IS("Origin")) {
+        request->origin_ok = mcp_http_origin_is_local(value, value_length);
+    }
+#undef MCP_FIELD_IS
+}
+
+/**
+ * @brief Looks for the end of the request header and parses it.
+ *
+ * @return 1 when the header is complete, 0 when more bytes are needed,
+ * -1 when the header is too large.
+ */
+static int mcp_http_parse_header(mcp_http_conn* conn) {
+    mcp_http_request* request = &conn->request;
+    for (;;) {
+        const char* data = conn->in.data + conn->in.start;
+        size_t available = conn->in.end - conn->in.start;
+        const char* newline = mcp_find_newline(data + conn->header_scan, available - conn->header_scan);
+        if (newline == NULL) {
+            return available > MCP_HTTP_MAX_HEADER ? -1 : 0;
+        }
+        size_t line_start = conn->header_scan;
+        size_t line_end = (size_t)(newline - data);
+        conn->header_scan = line_end + 1;
+        if (line_end > line_start && data[line_end - 1] == '\r') {
+            line_end--;
+        }
+        if (line_end > line_start) {
+            continue;
+        }
+        if (line_start == 0) {
+            // Tolerate stray blank lines before the request line
+            mcp_framer_consume(&conn->in, conn->header_scan);
+            conn->header_scan = 0;
+            continue;
+        }
+        break;
+    }
+
+    const char* data = conn->in.data + conn->in.start;
+    size_t position = 0;
+    bool first = true;
+    bool has_accept = false;
+    memset(request, 0, sizeof(mcp_http_request));
+    request->header_length = conn->header_scan;
+    request->origin_ok = true;  // Requests without Origin do not come from a browser
+    while (position < request->header_length) {
+        const char* line = data + position;
+        const char* newline = (const char*)memchr(line, '\n', request->header_length - position);
+        size_t length = (size_t)(newline - line);
+        position += length + 1;
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+        if (length == 0) {
+            break;
+        }
+        if (first) {
+            mcp_http_parse_request_line(request, line, length);
+            first = false;
+        } else {
+            mcp_http_parse_field(request, line, length, &has_accept);
+        }
+    }
+    if (!has_accept) {
+        request->accept_json = true;
+    }
+    return 1;
+}
+
+// --- Routing ---
+
+// True when the message contains at least one request, i.e. something that gets a reply
+static bool mcp_http_has_request(const cJSON* json) {
+    if (cJSON_IsArray(json)) {
+        const cJSON* element = NULL;
+        cJSON_ArrayForEach(element, json) {
+            if (!cJSON_IsObject(element) || cJSON_GetObjectItemCaseSensitive(element, "id") != NULL) {
+                return true;
+            }
+        }
+        return cJSON_GetArraySize(json) == 0;
+    }
+    return !cJSON_IsObject(json) || cJSON_GetObjectItemCaseSensitive(json, "id") != NULL;
+}
+
+static bool mcp_http_is_initialize(const cJSON* json) {
+    const cJSON* method = cJSON_IsObject(json) ? cJSON_GetObjectItemCaseSensitive(json, "method") : NULL;
+    return cJSON_IsString(method) && strcmp(method->valuestring, "initialize") == 0;
+}
+
+static void mcp_http_discard_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    (void)sink;
+    mcp_response_release(response, arena);
+}
+
+// Worker thread: hand the reply back to the loop thread that owns the connection
+static void mcp_http_exchange_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    mcp_http_exchange* exchange = (mcp_http_exchange*)((char*)sink - offsetof(mcp_http_exchange, sink));
+    exchange->response = response;
+    exchange->arena = arena;
+    exchange->tool = mcp_stats_current();
+    if (mcp_event_loop_post(&exchange->conn->server->net->loop, &exchange->task) != 0) {
+        mcp_log_error("Failed to hand HTTP reply back to the event loop");
+    }
+}
+
+static void mcp_http_exchange_complete(mcp_task* task) {
+    mcp_http_exchange* exchange = (mcp_http_exchange*)task;
+    mcp_http_conn* conn = exchange->conn;
+    mcp_writer* scratch = &conn->server->scratch;
+    conn->busy = false;
+
+    if (conn->closed) {
+        mcp_response_release(exchange->response, exchange->arena);
+        free(exchange);
+        mcp_http_release_run(&conn->release);
+        return;
+    }
+
+    if (exchange->response == NULL) {
+        // Nothing to reply after all (the request could not be answered)
+        mcp_arena_release(exchange->arena);
+        free(exchange);
+        mcp_http_respond(conn, 202, "Accepted", NULL, NULL, NULL, 0);
+        if (!conn->closed) {
+            mcp_http_process(conn);
+            mcp_http_update_interest(conn);
+        }
+        return;
+    }
+
+    // A client that only accepts SSE gets the reply as one event on this response
+    scratch->length = 0;
+    uint64_t trace = mcp_trace_begin();
+    int encoded = (!exchange->sse || mcp_writer_append(scratch, "event: message\ndata: ", 21) == 0) &&
+                  mcp_writer_append_json(scratch, exchange->response) == 0 &&
+                  (!exchange->sse || mcp_writer_append(scratch, "\n", 1) == 0);
+    mcp_trace_end("encode", trace);
+    mcp_response_release(exchange->response, exchange->arena);
+    if (!encoded) {
+        free(exchange);
+        mcp_http_respond_error(conn, 500, "Internal Server Error", MCP_ERROR_INTERNAL, "Failed to encode response");
+    } else {
+        mcp_stats_bytes_out(exchange->tool, scratch->length);
+        char extra[64] = "";
+        if (exchange->session_id[0] != '\0') {
+            snprintf(extra, sizeof(extra), "Mcp-Session-Id: %s\r\n", exchange->session_id);
+        }
+        mcp_http_respond(conn, 200, "OK", exchange->sse ? "text/event-stream" : "application/json", extra,
+                         scratch->data, scratch->length);
+        free(exchange);
+    }
+    // Answer requests that were pipelined behind this one
+    if (!conn->closed) {
+        mcp_http_process(conn);
+        mcp_http_update_interest(conn);
+    }
+}
+
+static void mcp_http_post(mcp_http_conn* conn, mcp_http_session* session, const char* body) {
+    mcp_http_server* server = conn->server;
+    mcp_http_request* request = &conn->request;
+    if (request->content_length == 0) {
+        mcp_http_respond_error(conn, 400, "Bad Request", MCP_ERROR_INVALID_REQUEST, "Empty body");
+        return;
+    }
+
+    mcp_arena* arena = mcp_arena_acquire();
+    mcp_arena* previous = mcp_arena_set_current(arena);
+    uint64_t trace = mcp_trace_begin();
+    cJSON* json = cJSON_ParseWithLength(body, request->content_length);
+    mcp_trace_end("cJSON_Parse", trace);
+    mcp_arena_set_current(previous);
+    if (json == NULL) {
+        mcp_arena_release(arena);
+        mcp_http_respond_error(conn, 400, "Bad Request", MCP_ERROR_PARSE, "Parse error");
+        return;
+    }
+
+    mcp_session* state = session != NULL ? session->state : NULL;
+    if (!mcp_http_has_request(json)) {
+        // Notifications and client responses: accepted, nothing to wait for
+        if (mcp_dispatch_submit(&server->net->pool, json, request->content_length, arena, &server->discard, state) != 0) {
+            mcp_response_release(json, arena);
+            mcp_http_respond_error(conn, 503, "Service Unavailable", MCP_ERROR_INTERNAL, "Server shutting down");
+            return;
+        }
+        mcp_http_respond(conn, 202, "Accepted", NULL, NULL, NULL, 0);
+        return;
+    }
+
+    mcp_http_exchange* exchange = (mcp_http_exchange*)calloc(1, sizeof(mcp_http_exchange));
+    if (!exchange) {
+        mcp_response_release(json, arena);
+        mcp_http_respond_error(conn, 500, "Internal Server Error", MCP_ERROR_INTERNAL, "Out of memory");
+        return;
+    }
+    exchange->task.run = mcp_http_exchange_complete;
+    exchange->sink.send = mcp_http_exchange_send;
+    exchange->conn = conn;
+    exchange->sse = request->accept_sse && !request->accept_json;
+    if (session == NULL && mcp_http_is_initialize(json)) {
+        mcp_http_session* created = mcp_http_session_create(server);
+        if (created != NULL) {
+            memcpy(exchange->session_id, created->id, sizeof(exchange->session_id));
+            state = created->state;
+        }
+    }
+    conn->busy = true;
+    if (mcp_dispatch_submit(&server->net->pool, json, request->content_length, arena, &exchange->sink, state) != 0) {
+        conn->busy = false;
+        free(exchange);
+        mcp_response_release(json, arena);
+        mcp_http_respond_error(conn, 503, "Service Unavailable", MCP_ERROR_INTERNAL, "Server shutting down");
+    }
+}
+
+// GET: the connection turns into an SSE stream for server-initiated messages
+static void mcp_http_open_stream(mcp_http_conn* conn, mcp_http_session* session) {
+    static const char header[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: keep-alive\r\n\r\n";
+    if (mcp_writer_append(&conn->out, header, sizeof(header) - 1) != 0) {
+        mcp_http_close(conn);
+        return;
+    }
+    conn->streaming = true;
+    conn->stream_list = session != NULL ? &session->streams : &conn->server->broadcast;
+    conn->stream_next = *conn->stream_list;
+    *conn->stream_list = conn;
+    mcp_http_flush(conn);
+}
+
+static void mcp_http_delete_session(mcp_http_conn* conn, mcp_http_session* session) {
+    mcp_http_session_remove(conn->server, session);
+    mcp_http_respond(conn, 200, "OK", NULL, NULL, NULL, 0);
+}
+
+static void mcp_http_route(mcp_http_conn* conn, const char* body) {
+    mcp_http_request* request = &conn->request;
+    mcp_http_session* session = NULL;
+
+    conn->keep_alive = request->keep_alive;
+    if (!request->path_ok) {
+        mcp_http_respond_error(conn, 404, "Not Found", MCP_ERROR_INVALID_REQUEST, "Unknown endpoint, use " MCP_HTTP_PATH);
+        return;
+    }
+    if (!request->origin_ok) {
+        mcp_http_respond_error(conn, 403, "Forbidden", MCP_ERROR_INVALID_REQUEST, "Origin not allowed");
+        return;
+    }
+    if (request->session_id_invalid ||
+        (request->session_id[0] != '\0' && (session = mcp_http_session_find(conn->server, request->session_id)) == NULL)) {
+        mcp_http_respond_error(conn, 404, "Not Found", MCP_ERROR_INVALID_REQUEST, "Session not found");
+        return;
+    }
+    if (session != NULL) {
+        session->used_ms = mcp_timer_now_ms();
+    }
+
+    switch (request->method) {
+    case MCP_HTTP_POST:
+        mcp_http_post(conn, session, body);
+        break;
+    case MCP_HTTP_GET:
+        if (!request->accept_sse) {
+            mcp_http_respond_error(conn, 406, "Not Acceptable", MCP_ERROR_INVALID_REQUEST, "GET requires Accept: text/event-stream");
+        } else {
+            mcp_http_open_stream(conn, session);
+        }
+        break;
+    case MCP_HTTP_DELETE:
+        if (session == NULL) {
+            mcp_http_respond_error(conn, 400, "Bad Request", MCP_ERROR_INVALID_REQUEST, "Missing Mcp-Session-Id");
+        } else {
+            mcp_http_delete_session(conn, session);
+        }
+        break;
+    default:
+        mcp_http_respond(conn, 405, "Method Not Allowed", NULL, "Allow: GET, POST, DELETE\r\n", NULL, 0);
+        break;
+    }
+}
+
+// Handles every complete request in the input buffer, one at a time
+static void mcp_http_process(mcp_http_conn* conn) {
+    while (!conn->closed && !conn->busy && !conn->streaming) {
+        mcp_http_request* request = &conn->request;
+        if (request->header_length == 0) {
+            int ret = mcp_http_parse_header(conn);
+            if (ret == 0) {
+                return;
+            }
+            if (ret < 0) {
+                conn->keep_alive = false;
+                mcp_http_respond_error(conn, 431, "Request Header Fields Too Large", MCP_ERROR_INVALID_REQUEST, "Header too large");
+                return;
+            }
+            // Errors that leave the rest of the stream unparseable also end the connection
+            conn->keep_alive = false;
+            if (request->bad) {
+                mcp_http_respond_error(conn, 400, "Bad Request", MCP_ERROR_INVALID_REQUEST, "Malformed HTTP request");
+                return;
+            }
+            if (request->chunked) {
+                mcp_http_respond_error(conn, 411, "Length Required", MCP_ERROR_INVALID_REQUEST, "Chunked bodies are not supported");
+                return;
+            }
+            if (request->content_length > MCP_HTTP_MAX_BODY) {
+                mcp_http_respond_error(conn, 413, "Content Too Large", MCP_ERROR_INVALID_REQUEST, "Body too large");
+                return;
+            }
+        }
+
+        size_t total = request->header_length + request->content_length;
+        if (conn->in.end - conn->in.start < total) {
+            return;
+        }
+        const char* body = conn->in.data + conn->in.start + request->header_length;
+        mcp_http_route(conn, body);
+        // The body was parsed (copied) already, so the bytes can go
+        mcp_framer_consume(&conn->in, total);
+        request->header_length = 0;
+        conn->header_scan = 0;
+    }
+}
+
+static void mcp_http_conn_on_event(mcp_event_handler* handler, unsigned events) {
+    mcp_http_conn* conn = (mcp_http_conn*)handler;
+    if (conn->closed) {
+        return;
+    }
+    if (events & MCP_EVENT_WRITE) {
+        mcp_http_flush(conn);
+        if (conn->closed) {
+            return;
+        }
+    }
+    if (events & (MCP_EVENT_READ | MCP_EVENT_ERROR)) {
+        long n = mcp_event_loop_read(&conn->server->net->loop, &conn->handler, &conn->in);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            mcp_http_close(conn);
+            return;
+        }
+        if (conn->streaming) {
+            // Nothing is expected from the client on a stream, only its hang-up
+            mcp_framer_consume(&conn->in, conn->in.end - conn->in.start);
+        } else {
+            mcp_http_process(conn);
+        }
+    }
+    mcp_http_update_interest(conn);
+}
+
+static void mcp_http_accept(mcp_event_handler* handler, unsigned events) {
+    mcp_http_server* server = (mcp_http_server*)((char*)handler - offsetof(mcp_http_server, listener));
+    (void)events;
+    for (;;) {
+        int fd = accept4(handler->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        mcp_http_conn* conn = (mcp_http_conn*)calloc(1, sizeof(mcp_http_conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        if (mcp_framer_init(&conn->in, fd, MCP_HTTP_BUFFER_SIZE) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        if (mcp_writer_init(&conn->out, fd, MCP_HTTP_BUFFER_SIZE) != 0) {
+            mcp_framer_destroy(&conn->in);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->handler.fd = fd;
+        conn->handler.on_event = mcp_http_conn_on_event;
+        conn->server = server;
+        conn->keep_alive = true;
+        conn->events = MCP_EVENT_READ;
+        if (mcp_event_loop_add(&server->net->loop, &conn->handler, MCP_EVENT_READ | MCP_EVENT_STREAM) != 0) {
+            mcp_writer_destroy(&conn->out);
+            mcp_framer_destroy(&conn->in);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->next = server->conns;
+        if (server->conns != NULL) {
+            server->conns->prev = conn;
+        }
+        server->conns = conn;
+    }
+}
+
+// --- Server push ---
+
+static void mcp_http_stream_write(mcp_http_conn* conn, const char* data, size_t length) {
+    if (mcp_writer_append(&conn->out, data, length) != 0) {
+        mcp_http_close(conn);
+        return;
+    }
+    mcp_http_flush(conn);
+}
+
+static void mcp_http_push_run(mcp_task* task) {
+    mcp_http_push* push = (mcp_http_push*)task;
+    mcp_http_server* server = push->server;
+    mcp_writer* scratch = &server->scratch;
+
+    scratch->length = 0;
+    if (mcp_writer_append(scratch, "event: message\ndata: ", 21) == 0 &&
+        mcp_writer_append_json(scratch, push->message) == 0 &&
+        mcp_writer_append(scratch, "\n", 1) == 0) {
+        mcp_http_conn* conn = NULL;
+        if (push->all) {
+            conn = server->conns;
+        } else {
+            mcp_http_session* session = mcp_http_session_find(server, push->session_id);
+            conn = session != NULL ? session->streams : NULL;
+        }
+        while (conn != NULL) {
+            // Writing may close (and unlink) the connection, step first
+            mcp_http_conn* next = push->all ? conn->next : conn->stream_next;
+            if (conn->streaming) {
+                mcp_http_stream_write(conn, scratch->data, scratch->length);
+            }
+            conn = next;
+        }
+    }
+    cJSON_Delete(push->message);
+    free(push);
+}
+
+static void mcp_http_heartbeat(mcp_event_handler* handler, unsigned events) {
+    mcp_http_server* server = (mcp_http_server*)((char*)handler - offsetof(mcp_http_server, heartbeat));
+    uint64_t expirations;
+    (void)events;
+    if (read(handler->fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    mcp_http_conn* conn = server->conns;
+    while (conn != NULL) {
+        mcp_http_conn* next = conn->next;
+        if (conn->streaming) {
+            mcp_http_stream_write(conn, ": keep-alive\n\n", 14);
+        }
+        conn = next;
+    }
+    uint64_t now = mcp_timer_now_ms();
+    uint64_t idle = (uint64_t)MCP_HTTP_SESSION_IDLE_SECONDS * 1000;
+    if (now > idle) {
+        mcp_http_session_expire(server, now - idle, false);
+    }
+}
+
+int mcp_http_notify(const char* session_id, cJSON* message) {
+    int ret = -1;
+    for (mcp_http_server* server = g_http_servers; server != NULL; server = server->next_server) {
+        mcp_http_push* push = (mcp_http_push*)calloc(1, sizeof(mcp_http_push));
+        if (push == NULL) {
+            continue;
+        }
+        push->task.run = mcp_http_push_run;
+        push->server = server;
+        // Each server encodes and frees its own copy
+        bool last = server->next_server == NULL;
+        push->message = last ? message : cJSON_Duplicate(message, 1);
+        push->all = session_id == NULL;
+        if (session_id != NULL) {
+            snprintf(push->session_id, sizeof(push->session_id), "%s", session_id);
+        }
+        if (mcp_event_loop_post(&server->net->loop, &push->task) != 0) {
+            if (!last) {
+                cJSON_Delete(push->message);
+            }
+            free(push);
+            continue;
+        }
+        // The loop thread may have run and freed the push already
+        if (last) {
+            return 0;
+        }
+        ret = 0;
+    }
+    cJSON_Delete(message);
+    return ret;
+}
+
+// --- Server lifecycle ---
+
+static int mcp_http_bind(const char* host, int port) {
+    struct addrinfo hints;
+    struct addrinfo* addresses = NULL;
+    char service[16];
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%d", port);
+    int ret = getaddrinfo(host, service, &hints, &addresses);
+    if (ret != 0) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", host, gai_strerror(ret));
+        return -1;
+    }
+    for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, address->ai_addr, address->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot listen on %s:%d: %s\n", host, port, strerror(errno));
+    }
+    return fd;
+}
+
+static int mcp_http_start_heartbeat(mcp_http_server* server) {
+    struct itimerspec interval;
+    memset(&interval, 0, sizeof(interval));
+    interval.it_value.tv_sec = MCP_HTTP_HEARTBEAT_SECONDS;
+    interval.it_interval.tv_sec = MCP_HTTP_HEARTBEAT_SECONDS;
+    server->heartbeat.on_event = mcp_http_heartbeat;
+    server->heartbeat.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (server->heartbeat.fd < 0) {
+        return -1;
+    }
+    if (timerfd_settime(server->heartbeat.fd, 0, &interval, NULL) != 0 ||
+        mcp_event_loop_add(&server->net->loop, &server->heartbeat, MCP_EVENT_READ) != 0) {
+        close(server->heartbeat.fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void mcp_http_stop(mcp_transport* transport) {
+    mcp_http_server* server = (mcp_http_server*)transport;
+    mcp_event_loop_remove(&server->net->loop, &server->listener);
+    close(server->listener.fd);
+    mcp_event_loop_remove(&server->net->loop, &server->heartbeat);
+    close(server->heartbeat.fd);
+}
+
+static void mcp_http_destroy(mcp_transport* transport) {
+    mcp_http_server* server = (mcp_http_server*)transport;
+    for (mcp_http_server** link = &g_http_servers; *link != NULL; link = &(*link)->next_server) {
+        if (*link == server) {
+            *link = server->next_server;
+            break;
+        }
+    }
+    while (server->conns != NULL) {
+        mcp_http_close(server->conns);
+    }
+    // Run the deferred frees before the server goes away
+    mcp_event_loop_drain(&server->net->loop);
+    for (size_t i = 0; i < MCP_HTTP_SESSION_BUCKETS; ++i) {
+        while (server->sessions[i] != NULL) {
+            mcp_http_session* next = server->sessions[i]->next;
+            mcp_session_release(server->sessions[i]->state);
+            free(server->sessions[i]);
+            server->sessions[i] = next;
+        }
+    }
+    mcp_writer_destroy(&server->scratch);
+    free(server);
+}
+
+int mcp_http_listen(mcp_net* net, const char* host, int port) {
+    if (host == NULL) {
+        host = MCP_HTTP_DEFAULT_HOST;
+    }
+    mcp_http_server* server = (mcp_http_server*)calloc(1, sizeof(mcp_http_server));
+    if (!server) {
+        return -1;
+    }
+    server->net = net;
+    server->transport.stop = mcp_http_stop;
+    server->transport.destroy = mcp_http_destroy;
+    server->discard.send = mcp_http_discard_send;
+    server->listener.on_event = mcp_http_accept;
+    server->listener.fd = mcp_http_bind(host, port);
+    if (server->listener.fd < 0) {
+        free(server);
+        return -1;
+    }
+    if (mcp_writer_init(&server->scratch, -1, MCP_WRITER_INITIAL_CAPACITY) != 0 ||
+        mcp_event_loop_add(&net->loop, &server->listener, MCP_EVENT_READ) != 0) {
+        fprintf(stderr, "Failed to set up HTTP server\n");
+        mcp_writer_destroy(&server->scratch);
+        close(server->listener.fd);
+        free(server);
+        return -1;
+    }
+    if (mcp_http_start_heartbeat(server) != 0) {
+        fprintf(stderr, "Failed to set up HTTP server\n");
+        mcp_event_loop_remove(&net->loop, &server->listener);
+        mcp_writer_destroy(&server->scratch);
+        close(server->listener.fd);
+        free(server);
+        return -1;
+    }
+    server->next_server = g_http_servers;
+    g_http_servers = server;
+    mcp_net_add(net, &server->transport);
+    fprintf(stderr, "mcp server listening on http://%s:%d%s\n", host, port, MCP_HTTP_PATH);
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !__linux__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_http_listen(mcp_net* net, const char* host, int port) {
+    (void)net;
+    (void)host;
+    (void)port;
+    fprintf(stderr, "The HTTP transport needs epoll and is only available on Linux\n");
+    return -1;
+}
+
+int mcp_http_notify(const char* session_id, cJSON* message) {
+    (void)session_id;
+    cJSON_Delete(message);
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,54 @@
+#ifndef MCP_HTTP_H
+#define MCP_HTTP_H
+
+#include "cJSON.h"
+#include "mcp_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single MCP endpoint: POST requests, GET an SSE stream, DELETE a session
+#define MCP_HTTP_PATH "/mcp"
+#define MCP_HTTP_DEFAULT_HOST "127.0.0.1"
+// Per-connection buffers start small and grow, so idle connections stay cheap
+#define MCP_HTTP_BUFFER_SIZE 4096
+#define MCP_HTTP_MAX_HEADER (64 * 1024)
+#define MCP_HTTP_MAX_BODY (16 * 1024 * 1024)
+// Comment lines sent on idle SSE streams so proxies keep them open
+#define MCP_HTTP_HEARTBEAT_SECONDS 15
+#define MCP_HTTP_SESSION_ID_LENGTH 32
+// Sessions without a request or an open stream for this long are ended
+#define MCP_HTTP_SESSION_IDLE_SECONDS (30 * 60)
+// Sessions a server keeps at once; the longest idle one makes room for a new one
+#define MCP_HTTP_MAX_SESSIONS 4096
+// Sessions idle for less than this are never ended to make room
+#define MCP_HTTP_SESSION_EVICT_SECONDS 60
+
+/**
+ * @brief Starts serving MCP over streamable HTTP on host:port (NULL host is
+ * loopback) as a transport of `net`.
+ *
+ * Connections are keep-alive and run on the net's loop thread; requests go
+ * through bridge() on its worker pool. Linux only.
+ *
+ * @return 0 once listening, -1 if the socket could not be set up.
+ */
+int mcp_http_listen(mcp_net* net, const char* host, int port);
+
+/**
+ * @brief Pushes a server-initiated JSON-RPC message as an SSE event to the
+ * GET streams of `session_id`, or of every session when it is NULL.
+ * Safe to call from any thread, including handlers. Takes ownership of
+ * `message`, which must be heap allocated (no arena current).
+ *
+ * @return 0 if queued, -1 if no HTTP server is running.
+ * Only call it while the net runs (from handlers, or threads they start).
+ */
+int mcp_http_notify(const char* session_id, cJSON* message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_HTTP_H */
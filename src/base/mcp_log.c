@@ -0,0 +1,328 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mcp_log.h"
+#include "mcp_thread.h"
+#include "mcp_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_LOG_RING_MASK (MCP_LOG_RING_SIZE - 1)
+
+// Background thread states
+#define MCP_LOG_FLUSHER_IDLE 0     // Not started yet, the first record starts it
+#define MCP_LOG_FLUSHER_RUNNING 1
+#define MCP_LOG_FLUSHER_OFF 2      // Could not start or shut down: records are written as they come
+
+typedef struct mcp_log_record {
+    struct timespec time;
+    int level;
+    unsigned length;
+    char message[MCP_LOG_MESSAGE_SIZE];
+} mcp_log_record;
+
+// One thread's records. The thread is the only producer and publishes
+// `head` after the record it covers; the flusher, under g_drain_lock, is the
+// only consumer and publishes `tail` once the records before it are written.
+// A thread that exits publishes `orphaned` after its last record, and the
+// flusher frees the ring once it has written that out
+typedef struct mcp_log_ring {
+    struct mcp_log_ring* next;
+    unsigned tid;
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    volatile uint64_t orphaned;
+    volatile uint64_t dropped;  // Records lost to a full ring, counted by the owner
+    uint64_t reported;          // Drops already noted in the output, under g_drain_lock
+    mcp_log_record records[MCP_LOG_RING_SIZE];
+} mcp_log_ring;
+
+volatile long mcp_log_threshold = MCP_LOG_INFO;
+
+static const char* const g_level_names[] = { "trace", "debug", "info", "warn", "error", "off" };
+static const char* const g_level_labels[] = { "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR" };
+
+static mcp_mutex_t g_rings_lock = MCP_MUTEX_INITIALIZER;
+static mcp_log_ring* volatile g_rings = NULL;
+static unsigned g_ring_count = 0;
+static MCP_THREAD_LOCAL mcp_log_ring* t_ring = NULL;
+static volatile long g_lost = 0;  // Records of threads that could not get a ring
+static bool g_exit_keyed = false;  // g_ring_key exists, under g_rings_lock
+#ifdef _WIN32
+static DWORD g_ring_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_ring_key;
+#endif
+
+static mcp_mutex_t g_drain_lock = MCP_MUTEX_INITIALIZER;
+static FILE* g_output = NULL;     // NULL writes to stderr
+static volatile uint64_t g_written = 0;
+static volatile uint64_t g_retired_dropped = 0;  // Drops of freed rings
+
+static volatile long g_flusher_state = MCP_LOG_FLUSHER_IDLE;
+static volatile long g_flusher_stopping = 0;
+static volatile long g_exit_hooked = 0;
+static mcp_thread_t g_flusher;
+
+#ifdef _MSC_VER
+#define mcp_log_publish(field, value) ((field) = (value))
+#define mcp_log_acquire(field) (field)
+#else
+#define mcp_log_publish(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define mcp_log_acquire(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#endif
+
+// Runs as a thread that logged exits: its ring goes to the flusher
+#ifdef _WIN32
+static void WINAPI mcp_log_thread_exit(void* value) {
+#else
+static void mcp_log_thread_exit(void* value) {
+#endif
+    mcp_log_ring* ring = (mcp_log_ring*)value;
+    if (ring == NULL) {
+        return;
+    }
+    t_ring = NULL;
+    mcp_log_publish(ring->orphaned, 1);
+}
+
+static mcp_log_ring* mcp_log_ring_get(void) {
+    mcp_log_ring* ring = t_ring;
+    if (ring != NULL) {
+        return ring;
+    }
+    ring = (mcp_log_ring*)calloc(1, sizeof(mcp_log_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    mcp_mutex_lock(&g_rings_lock);
+    if (!g_exit_keyed) {
+#ifdef _WIN32
+        g_ring_key = FlsAlloc(mcp_log_thread_exit);
+        g_exit_keyed = g_ring_key != FLS_OUT_OF_INDEXES;
+#else
+        g_exit_keyed = pthread_key_create(&g_ring_key, mcp_log_thread_exit) == 0;
+#endif
+    }
+    ring->tid = ++g_ring_count;
+    ring->next = g_rings;
+    mcp_atomic_store_ptr((void* volatile*)&g_rings, ring);
+    mcp_mutex_unlock(&g_rings_lock);
+    // Without the key the ring outlives its thread, as it did before
+    if (g_exit_keyed) {
+#ifdef _WIN32
+        FlsSetValue(g_ring_key, ring);
+#else
+        pthread_setspecific(g_ring_key, ring);
+#endif
+    }
+    t_ring = ring;
+    return ring;
+}
+
+// Unlinks and frees the drained ring of an exited thread; caller holds g_drain_lock
+static void mcp_log_ring_free(mcp_log_ring* ring) {
+    mcp_mutex_lock(&g_rings_lock);
+    mcp_log_ring* volatile* link = &g_rings;
+    while (*link != ring) {
+        link = (mcp_log_ring* volatile*)&(*link)->next;
+    }
+    mcp_atomic_store_ptr((void* volatile*)link, ring->next);
+    mcp_mutex_unlock(&g_rings_lock);
+    mcp_counter_add(&g_retired_dropped, mcp_counter_load(&ring->dropped));
+    free(ring);
+}
+
+// Caller holds g_drain_lock
+static void mcp_log_print(FILE* out, const mcp_log_record* record, unsigned tid) {
+    struct tm utc;
+    time_t seconds = record->time.tv_sec;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    fprintf(out, "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ %s [%u] %.*s\n",
+            utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+            (long)(record->time.tv_nsec / 1000), g_level_labels[record->level], tid,
+            (int)record->length, record->message);
+}
+
+void mcp_log_flush(void) {
+    mcp_mutex_lock(&g_drain_lock);
+    FILE* out = g_output != NULL ? g_output : stderr;
+    uint64_t written = 0;
+    mcp_log_ring* next;
+    for (mcp_log_ring* ring = (mcp_log_ring*)mcp_atomic_load_ptr((void* volatile*)&g_rings);
+         ring != NULL; ring = next) {
+        next = ring->next;
+        // Read first: everything its thread logged is published before it
+        bool orphaned = mcp_log_acquire(ring->orphaned) != 0;
+        uint64_t first = ring->tail;
+        uint64_t head = mcp_log_acquire(ring->head);
+        for (uint64_t tail = first; tail < head; ++tail) {
+            mcp_log_print(out, &ring->records[tail & MCP_LOG_RING_MASK], ring->tid);
+        }
+        // The owner may reuse the slots once they are written out
+        mcp_log_publish(ring->tail, head);
+        written += head - first;
+        uint64_t dropped = mcp_counter_load(&ring->dropped);
+        if (dropped != ring->reported) {
+            fprintf(out, "mcpc log: %llu records dropped on thread %u, its ring was full\n",
+                    (unsigned long long)(dropped - ring->reported), ring->tid);
+            ring->reported = dropped;
+        }
+        if (orphaned) {
+            mcp_log_ring_free(ring);
+        }
+    }
+    fflush(out);
+    mcp_counter_add(&g_written, written);
+    mcp_mutex_unlock(&g_drain_lock);
+}
+
+static void* mcp_log_flusher_main(void* arg) {
+    (void)arg;
+    mcp_trace_name_thread("log flusher");
+    while (mcp_atomic_load(&g_flusher_stopping) == 0) {
+        mcp_sleep_ms(MCP_LOG_FLUSH_MS);
+        mcp_log_flush();
+    }
+    return NULL;
+}
+
+static void mcp_log_at_exit(void) {
+    // Records of a process that exits without mcp_log_shutdown()
+    mcp_log_flush();
+}
+
+// Called by the first record: leaves the flusher running, or OFF if it could not start
+static void mcp_log_start_flusher(void) {
+    if (!mcp_atomic_cas(&g_flusher_state, MCP_LOG_FLUSHER_IDLE, MCP_LOG_FLUSHER_RUNNING)) {
+        return;
+    }
+    if (mcp_atomic_cas(&g_exit_hooked, 0, 1)) {
+        atexit(mcp_log_at_exit);
+    }
+    mcp_atomic_store(&g_flusher_stopping, 0);
+    if (mcp_thread_create(&g_flusher, mcp_log_flusher_main, NULL) != 0) {
+        mcp_atomic_store(&g_flusher_state, MCP_LOG_FLUSHER_OFF);
+    }
+}
+
+void mcp_log_write(int level, const char* format, ...) {
+    if (level < MCP_LOG_TRACE || level >= MCP_LOG_OFF) {
+        return;
+    }
+    mcp_log_ring* ring = mcp_log_ring_get();
+    if (ring == NULL) {
+        mcp_atomic_add(&g_lost, 1);
+        return;
+    }
+    uint64_t head = ring->head;
+    if (head - mcp_log_acquire(ring->tail) >= MCP_LOG_RING_SIZE) {
+        // Never wait for the flusher: the caller is on a request's path
+        mcp_counter_add(&ring->dropped, 1);
+        return;
+    }
+    mcp_log_record* record = &ring->records[head & MCP_LOG_RING_MASK];
+    timespec_get(&record->time, TIME_UTC);
+    record->level = level;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(record->message, sizeof(record->message), format, args);
+    va_end(args);
+    if (length < 0) {
+        length = 0;
+    }
+    record->length = length < (int)sizeof(record->message) ? (unsigned)length : (unsigned)sizeof(record->message) - 1;
+    mcp_log_publish(ring->head, head + 1);
+
+    long state = mcp_atomic_load(&g_flusher_state);
+    if (state == MCP_LOG_FLUSHER_IDLE) {
+        mcp_log_start_flusher();
+        state = mcp_atomic_load(&g_flusher_state);
+    }
+    if (state == MCP_LOG_FLUSHER_OFF) {
+        mcp_log_flush();
+    }
+}
+
+void mcp_log_set_level(int level) {
+    if (level < MCP_LOG_TRACE) {
+        level = MCP_LOG_TRACE;
+    } else if (level > MCP_LOG_OFF) {
+        level = MCP_LOG_OFF;
+    }
+    mcp_atomic_store(&mcp_log_threshold, level);
+}
+
+void mcp_log_init(void) {
+    const char* level = getenv(MCP_LOG_LEVEL_ENV);
+    if (level != NULL && *level != '\0') {
+        int found = -1;
+        for (int i = MCP_LOG_TRACE; i <= MCP_LOG_OFF && found < 0; ++i) {
+            if (strcmp(level, g_level_names[i]) == 0) {
+                found = i;
+            }
+        }
+        if (found < 0 && strcmp(level, "warning") == 0) {
+            found = MCP_LOG_WARN;
+        }
+        if (found < 0) {
+            fprintf(stderr, "Ignoring unknown %s: %s\n", MCP_LOG_LEVEL_ENV, level);
+        } else {
+            mcp_log_set_level(found);
+        }
+    }
+
+    const char* path = getenv(MCP_LOG_FILE_ENV);
+    mcp_mutex_lock(&g_drain_lock);
+    if (path != NULL && *path != '\0' && g_output == NULL) {
+        g_output = fopen(path, "a");
+        if (g_output == NULL) {
+            fprintf(stderr, "Failed to open log file %s, logging to stderr\n", path);
+        }
+    }
+    mcp_mutex_unlock(&g_drain_lock);
+    // A server started again after mcp_log_shutdown() buffers its records again
+    mcp_atomic_cas(&g_flusher_state, MCP_LOG_FLUSHER_OFF, MCP_LOG_FLUSHER_IDLE);
+}
+
+void mcp_log_shutdown(void) {
+    // From here on records are written synchronously, the flusher is gone
+    long state = mcp_atomic_load(&g_flusher_state);
+    while (!mcp_atomic_cas(&g_flusher_state, state, MCP_LOG_FLUSHER_OFF)) {
+        state = mcp_atomic_load(&g_flusher_state);
+    }
+    if (state == MCP_LOG_FLUSHER_RUNNING) {
+        mcp_atomic_store(&g_flusher_stopping, 1);
+        mcp_thread_join(g_flusher);
+    }
+    mcp_log_flush();
+}
+
+cJSON* mcp_log_report(void) {
+    uint64_t dropped = (uint64_t)mcp_atomic_load(&g_lost);
+    // Rings are freed under g_drain_lock
+    mcp_mutex_lock(&g_drain_lock);
+    dropped += mcp_counter_load(&g_retired_dropped);
+    for (mcp_log_ring* ring = (mcp_log_ring*)mcp_atomic_load_ptr((void* volatile*)&g_rings);
+         ring != NULL; ring = ring->next) {
+        dropped += mcp_counter_load(&ring->dropped);
+    }
+    mcp_mutex_unlock(&g_drain_lock);
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddStringToObject(report, "level", g_level_names[mcp_atomic_load(&mcp_log_threshold)]);
+    cJSON_AddNumberToObject(report, "written", (double)mcp_counter_load(&g_written));
+    cJSON_AddNumberToObject(report, "dropped", (double)dropped);
+    return report;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,121 @@
+#ifndef MCP_LOG_H
+#define MCP_LOG_H
+
+#include <stdbool.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Lowest level written at runtime: trace, debug, info, warn, error or off
+#define MCP_LOG_LEVEL_ENV "MCPC_LOG_LEVEL"
+// Appends the log to this file instead of stderr
+#define MCP_LOG_FILE_ENV "MCPC_LOG_FILE"
+
+#define MCP_LOG_TRACE 0
+#define MCP_LOG_DEBUG 1
+#define MCP_LOG_INFO 2
+#define MCP_LOG_WARN 3
+#define MCP_LOG_ERROR 4
+#define MCP_LOG_OFF 5
+
+// Calls below this level are compiled out, arguments included:
+// -DMCP_LOG_COMPILE_LEVEL=MCP_LOG_WARN leaves warnings and errors only
+#ifndef MCP_LOG_COMPILE_LEVEL
+#define MCP_LOG_COMPILE_LEVEL MCP_LOG_DEBUG
+#endif
+
+// Records buffered per thread; once full, further records are dropped and counted
+#define MCP_LOG_RING_SIZE 1024
+// Bytes of one formatted message; longer ones are cut
+#define MCP_LOG_MESSAGE_SIZE 240
+// How often the background thread writes the buffered records out
+#define MCP_LOG_FLUSH_MS 20
+
+// Read by every log call, see mcp_log_enabled()
+extern volatile long mcp_log_threshold;
+
+/**
+ * @brief Whether records of `level` are written. Costs one load.
+ */
+static inline bool mcp_log_enabled(int level) {
+#ifdef _MSC_VER
+    return level >= mcp_log_threshold;
+#else
+    return level >= __atomic_load_n(&mcp_log_threshold, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * @brief Formats a message into the calling thread's ring and returns; a
+ * background thread adds the time, level and thread and writes it out, so
+ * callers never block on stderr. No trailing newline is needed. Use the
+ * mcp_log_<level>() macros, which skip disabled levels before formatting.
+ */
+void mcp_log_write(int level, const char* format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+#define MCP_LOG(level, ...) \
+    do { \
+        if (mcp_log_enabled(level)) { \
+            mcp_log_write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if MCP_LOG_COMPILE_LEVEL <= MCP_LOG_TRACE
+#define mcp_log_trace(...) MCP_LOG(MCP_LOG_TRACE, __VA_ARGS__)
+#else
+#define mcp_log_trace(...) ((void)0)
+#endif
+#if MCP_LOG_COMPILE_LEVEL <= MCP_LOG_DEBUG
+#define mcp_log_debug(...) MCP_LOG(MCP_LOG_DEBUG, __VA_ARGS__)
+#else
+#define mcp_log_debug(...) ((void)0)
+#endif
+#if MCP_LOG_COMPILE_LEVEL <= MCP_LOG_INFO
+#define mcp_log_info(...) MCP_LOG(MCP_LOG_INFO, __VA_ARGS__)
+#else
+#define mcp_log_info(...) ((void)0)
+#endif
+#if MCP_LOG_COMPILE_LEVEL <= MCP_LOG_WARN
+#define mcp_log_warn(...) MCP_LOG(MCP_LOG_WARN, __VA_ARGS__)
+#else
+#define mcp_log_warn(...) ((void)0)
+#endif
+#if MCP_LOG_COMPILE_LEVEL <= MCP_LOG_ERROR
+#define mcp_log_error(...) MCP_LOG(MCP_LOG_ERROR, __VA_ARGS__)
+#else
+#define mcp_log_error(...) ((void)0)
+#endif
+
+/**
+ * @brief Changes the runtime threshold; MCP_LOG_OFF silences everything.
+ */
+void mcp_log_set_level(int level);
+
+/**
+ * @brief Writes every buffered record out before returning.
+ */
+void mcp_log_flush(void);
+
+/**
+ * @brief Applies $MCPC_LOG_LEVEL and $MCPC_LOG_FILE when a server starts;
+ * mcp_log_shutdown() stops the background thread and writes what is left.
+ */
+void mcp_log_init(void);
+void mcp_log_shutdown(void);
+
+/**
+ * @brief The threshold and the counts of records written and dropped.
+ */
+cJSON* mcp_log_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_LOG_H */
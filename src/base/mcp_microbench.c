@@ -0,0 +1,159 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_arena.h"
+#include "mcp_microbench.h"
+#include "mcp_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcp_microbench_result {
+    uint64_t iterations;
+    uint64_t ns;
+    uint64_t allocations;
+    uint64_t bytes;
+} mcp_microbench_result;
+
+// Keeps the result of every call observable, so the calls are not optimized out
+static const void* volatile g_sink;
+
+uint32_t mcp_microbench_random(uint32_t* seed) {
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+cJSON* mcp_microbench_string(uint32_t* seed) {
+    char text[25];
+    size_t length = 1 + mcp_microbench_random(seed) % (sizeof(text) - 1);
+    for (size_t i = 0; i < length; ++i) {
+        text[i] = (char)('a' + mcp_microbench_random(seed) % 26);
+    }
+    text[length] = '\0';
+    return cJSON_CreateString(text);
+}
+
+static int mcp_microbench_run(const mcp_microbench_case* bench_case, uint32_t seed, uint64_t min_ns,
+                              mcp_microbench_result* result) {
+    cJSON* fixtures[MCP_MICROBENCH_FIXTURES];
+    for (size_t i = 0; i < MCP_MICROBENCH_FIXTURES; ++i) {
+        fixtures[i] = bench_case->fixture(&seed);
+    }
+    mcp_arena* arena = mcp_arena_acquire();
+    if (arena == NULL) {
+        for (size_t i = 0; i < MCP_MICROBENCH_FIXTURES; ++i) {
+            cJSON_Delete(fixtures[i]);
+        }
+        return -1;
+    }
+
+    memset(result, 0, sizeof(*result));
+    // One untimed batch warms the caches and the arena
+    bool warm = false;
+    size_t next = 0;
+    while (!warm || result->ns < min_ns) {
+        size_t allocations_before, bytes_before, allocations_after, bytes_after;
+        mcp_arena_set_current(arena);
+        mcp_arena_counters(&allocations_before, &bytes_before);
+        uint64_t start = mcp_stats_now_ns();
+        for (size_t i = 0; i < MCP_MICROBENCH_BATCH; ++i) {
+            g_sink = bench_case->run(fixtures[next]);
+            next = (next + 1) % MCP_MICROBENCH_FIXTURES;
+        }
+        uint64_t elapsed = mcp_stats_now_ns() - start;
+        mcp_arena_counters(&allocations_after, &bytes_after);
+        mcp_arena_set_current(NULL);
+        mcp_arena_release(arena);
+        arena = mcp_arena_acquire();
+        if (arena == NULL) {
+            break;
+        }
+        if (warm) {
+            result->iterations += MCP_MICROBENCH_BATCH;
+            result->ns += elapsed;
+            result->allocations += allocations_after - allocations_before;
+            result->bytes += bytes_after - bytes_before;
+        }
+        warm = true;
+    }
+    mcp_arena_release(arena);
+    for (size_t i = 0; i < MCP_MICROBENCH_FIXTURES; ++i) {
+        cJSON_Delete(fixtures[i]);
+    }
+    return arena != NULL ? 0 : -1;
+}
+
+int mcp_microbench_main(int argc, char** argv, const mcp_microbench_case* cases, size_t count) {
+    long min_ms = MCP_MICROBENCH_DEFAULT_MIN_MS;
+    uint32_t seed = 1;
+    const char* filter = NULL;
+    const char* output = NULL;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--min-ms") == 0) {
+            min_ms = atol(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = argv[i + 1];
+        } else {
+            argc = -1;
+            break;
+        }
+    }
+    if (argc < 0 || argc % 2 == 0 || min_ms <= 0 || seed == 0) {
+        fprintf(stderr, "usage: %s [--min-ms n] [--seed n] [--filter text] [--output file]\n", argv[0]);
+        return 2;
+    }
+
+    // Generated code allocates through mcp_malloc(), cJSON included, as in the server
+    mcp_arena_install_hooks();
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "seed", seed);
+    cJSON* results = cJSON_AddArrayToObject(report, "benchmarks");
+    int ret = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (filter != NULL && strstr(cases[i].name, filter) == NULL) {
+            continue;
+        }
+        mcp_microbench_result result;
+        if (mcp_microbench_run(&cases[i], seed, (uint64_t)min_ms * 1000000ull, &result) != 0) {
+            fprintf(stderr, "Failed to run %s: out of memory\n", cases[i].name);
+            ret = 1;
+            continue;
+        }
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "name", cases[i].name);
+        cJSON_AddNumberToObject(entry, "iterations", (double)result.iterations);
+        cJSON_AddNumberToObject(entry, "ns_per_op", (double)result.ns / (double)result.iterations);
+        cJSON_AddNumberToObject(entry, "allocs_per_op", (double)result.allocations / (double)result.iterations);
+        cJSON_AddNumberToObject(entry, "bytes_per_op", (double)result.bytes / (double)result.iterations);
+        cJSON_AddItemToArray(results, entry);
+    }
+
+    char* text = cJSON_Print(report);
+    cJSON_Delete(report);
+    FILE* file = output != NULL ? fopen(output, "w") : stdout;
+    if (text == NULL || file == NULL) {
+        fprintf(stderr, "Failed to write the report to %s\n", output != NULL ? output : "stdout");
+        ret = 1;
+    } else {
+        fprintf(file, "%s\n", text);
+        if (file != stdout) {
+            fclose(file);
+        }
+    }
+    cJSON_free(text);
+    return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+#ifndef MCP_MICROBENCH_H
+#define MCP_MICROBENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Distinct randomized inputs built per case, cycled through while timing
+#define MCP_MICROBENCH_FIXTURES 64
+// Calls timed together; the arena is reset between batches, outside the timing
+#define MCP_MICROBENCH_BATCH 256
+#define MCP_MICROBENCH_DEFAULT_MIN_MS 200
+
+/**
+ * @brief One function under test, as emitted by the export tool (-m):
+ * a parse_<struct> or a handle_<function> with a builder of valid inputs
+ * generated from the same schema.
+ */
+typedef struct mcp_microbench_case {
+    const char* name;
+    cJSON* (*fixture)(uint32_t* seed);    // A randomized valid input, heap allocated
+    const void* (*run)(cJSON* input);     // Calls the function on it
+} mcp_microbench_case;
+
+/**
+ * @brief Random numbers for the fixture builders (xorshift32; never returns
+ * 0 for a nonzero seed, so the sequence repeats for a given --seed).
+ */
+uint32_t mcp_microbench_random(uint32_t* seed);
+
+/**
+ * @brief A random lowercase string of 1 to 24 characters.
+ */
+cJSON* mcp_microbench_string(uint32_t* seed);
+
+/**
+ * @brief Runs every case (or those whose name contains --filter) for at
+ * least --min-ms each, with the request arena set as a worker would, and
+ * prints a JSON report: iterations, ns/op, allocations/op and bytes/op,
+ * where allocations are the mcp_malloc() calls the function made (cJSON
+ * nodes included). Options: --min-ms n, --seed n, --filter text,
+ * --output file. Returns the process exit code.
+ */
+int mcp_microbench_main(int argc, char** argv, const mcp_microbench_case* cases, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_MICROBENCH_H */
@@ -0,0 +1,373 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_module.h"
+#include "mcp_arena.h"
+#include "mcp_log.h"
+#include "mcp_thread.h"
+
+#ifndef _WIN32
+#include <dlfcn.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcp_module {
+    char* path;                   // Resolved against the manifest's directory
+    void* handle;                 // Set by the first call of one of its tools
+    mcp_module_lookup_fn lookup;
+    bool failed;                  // Could not be loaded; its tools stay unknown
+    const cJSON* tools;           // Manifest entries, for tools/list
+    const cJSON* defs;
+} mcp_module;
+
+typedef struct mcp_module_tool {
+    const char* name;             // Points into the manifest
+    mcp_module* module;
+    mcp_module_handler handler;   // Valid once `ready`
+    volatile long ready;
+} mcp_module_tool;
+
+static mcp_mutex_t g_modules_lock = MCP_MUTEX_INITIALIZER;
+static volatile long g_modules_indexed = 0;
+static cJSON* g_manifest = NULL;
+static mcp_module* g_modules = NULL;
+static size_t g_module_count = 0;
+static mcp_module_tool* g_tools = NULL;  // Sorted by name
+static size_t g_tool_count = 0;
+static size_t g_loaded_count = 0;
+
+static char* mcp_module_read_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    char* text = NULL;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size >= 0 && fseek(file, 0, SEEK_SET) == 0 && (text = (char*)malloc((size_t)size + 1)) != NULL) {
+        if (fread(text, 1, (size_t)size, file) != (size_t)size) {
+            free(text);
+            text = NULL;
+        } else {
+            text[size] = '\0';
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+static int mcp_module_compare_tools(const void* a, const void* b) {
+    return strcmp(((const mcp_module_tool*)a)->name, ((const mcp_module_tool*)b)->name);
+}
+
+static int mcp_module_compare_name(const void* name, const void* tool) {
+    return strcmp((const char*)name, ((const mcp_module_tool*)tool)->name);
+}
+
+static void mcp_module_forget(void) {
+    for (size_t i = 0; i < g_module_count; ++i) {
+        free(g_modules[i].path);
+    }
+    free(g_modules);
+    free(g_tools);
+    cJSON_Delete(g_manifest);
+    g_modules = NULL;
+    g_tools = NULL;
+    g_manifest = NULL;
+    g_module_count = 0;
+    g_tool_count = 0;
+}
+
+// Caller holds g_modules_lock; returns -1 on a malformed manifest
+static int mcp_module_index(const char* manifest_path) {
+    char* text = mcp_module_read_file(manifest_path);
+    if (text == NULL) {
+        fprintf(stderr, "Cannot read module manifest %s\n", manifest_path);
+        return -1;
+    }
+    g_manifest = cJSON_Parse(text);
+    free(text);
+    const cJSON* modules = cJSON_GetObjectItemCaseSensitive(g_manifest, "modules");
+    if (!cJSON_IsArray(modules)) {
+        fprintf(stderr, "Module manifest %s has no \"modules\" array\n", manifest_path);
+        return -1;
+    }
+
+    size_t module_count = (size_t)cJSON_GetArraySize(modules);
+    size_t tool_count = 0;
+    const cJSON* module;
+    cJSON_ArrayForEach(module, modules) {
+        tool_count += (size_t)cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(module, "tools"));
+    }
+    g_modules = (mcp_module*)calloc(module_count + 1, sizeof(mcp_module));
+    g_tools = (mcp_module_tool*)calloc(tool_count + 1, sizeof(mcp_module_tool));
+    if (g_modules == NULL || g_tools == NULL) {
+        fprintf(stderr, "Out of memory for module manifest %s\n", manifest_path);
+        return -1;
+    }
+
+    // Relative module paths are relative to the manifest
+    const char* slash = strrchr(manifest_path, '/');
+    size_t directory_length = slash != NULL ? (size_t)(slash - manifest_path) + 1 : 0;
+    cJSON_ArrayForEach(module, modules) {
+        const cJSON* path = cJSON_GetObjectItemCaseSensitive(module, "path");
+        if (!cJSON_IsString(path) || path->valuestring[0] == '\0') {
+            fprintf(stderr, "Module manifest %s has a module without a \"path\"\n", manifest_path);
+            return -1;
+        }
+        mcp_module* entry = &g_modules[g_module_count++];
+        size_t prefix = path->valuestring[0] == '/' ? 0 : directory_length;
+        size_t length = strlen(path->valuestring);
+        entry->path = (char*)malloc(prefix + length + 1);
+        if (entry->path == NULL) {
+            fprintf(stderr, "Out of memory for module manifest %s\n", manifest_path);
+            return -1;
+        }
+        memcpy(entry->path, manifest_path, prefix);
+        memcpy(entry->path + prefix, path->valuestring, length + 1);
+        entry->tools = cJSON_GetObjectItemCaseSensitive(module, "tools");
+        entry->defs = cJSON_GetObjectItemCaseSensitive(module, "$defs");
+
+        const cJSON* tool;
+        cJSON_ArrayForEach(tool, entry->tools) {
+            const cJSON* name = cJSON_GetObjectItemCaseSensitive(tool, "name");
+            if (cJSON_IsString(name)) {
+                g_tools[g_tool_count].name = name->valuestring;
+                g_tools[g_tool_count].module = entry;
+                g_tool_count++;
+            }
+        }
+    }
+    qsort(g_tools, g_tool_count, sizeof(mcp_module_tool), mcp_module_compare_tools);
+    for (size_t i = 1; i < g_tool_count; ++i) {
+        if (strcmp(g_tools[i - 1].name, g_tools[i].name) == 0) {
+            fprintf(stderr, "Tool %s is in modules %s and %s, calls go to either\n",
+                    g_tools[i].name, g_tools[i - 1].module->path, g_tools[i].module->path);
+        }
+    }
+    return 0;
+}
+
+void mcp_module_init(void) {
+    if (mcp_atomic_load(&g_modules_indexed)) {
+        return;
+    }
+    mcp_mutex_lock(&g_modules_lock);
+    if (!g_modules_indexed) {
+        const char* path = getenv(MCP_MODULES_ENV);
+        if (path != NULL && *path != '\0') {
+            // The manifest lives as long as the process, never in a request's arena
+            mcp_arena* previous = mcp_arena_set_current(NULL);
+            if (mcp_module_index(path) != 0) {
+                mcp_module_forget();
+            } else {
+                fprintf(stderr, "Indexed %zu tools in %zu modules from %s\n", g_tool_count, g_module_count, path);
+            }
+            mcp_arena_set_current(previous);
+        }
+        mcp_atomic_store(&g_modules_indexed, 1);
+    }
+    mcp_mutex_unlock(&g_modules_lock);
+}
+
+// Caller holds g_modules_lock
+static void mcp_module_open(mcp_module* module) {
+    module->handle = dlopen(module->path, RTLD_NOW | RTLD_LOCAL);
+    if (module->handle != NULL) {
+        // Function pointers cannot be converted from void* directly in ISO C
+        *(void**)&module->lookup = dlsym(module->handle, MCP_MODULE_HANDLER_SYMBOL);
+    }
+    if (module->lookup == NULL) {
+        mcp_log_error("Failed to load module %s: %s", module->path, dlerror());
+        if (module->handle != NULL) {
+            dlclose(module->handle);
+            module->handle = NULL;
+        }
+        module->failed = true;
+        return;
+    }
+    g_loaded_count++;
+    mcp_log_info("Loaded module %s", module->path);
+}
+
+mcp_module_handler mcp_module_lookup(const char* name) {
+    mcp_module_init();
+    if (g_tool_count == 0) {
+        return NULL;
+    }
+    mcp_module_tool* tool = (mcp_module_tool*)bsearch(name, g_tools, g_tool_count, sizeof(mcp_module_tool),
+                                                      mcp_module_compare_name);
+    if (tool == NULL) {
+        return NULL;
+    }
+    if (mcp_atomic_load(&tool->ready)) {
+        return tool->handler;
+    }
+    mcp_mutex_lock(&g_modules_lock);
+    if (!tool->ready) {
+        mcp_module* module = tool->module;
+        if (module->handle == NULL && !module->failed) {
+            mcp_module_open(module);
+        }
+        tool->handler = module->lookup != NULL ? module->lookup(tool->name) : NULL;
+        if (module->lookup != NULL && tool->handler == NULL) {
+            mcp_log_error("Module %s does not export %s, rebuild its manifest", module->path, tool->name);
+        }
+        mcp_atomic_store(&tool->ready, 1);
+    }
+    mcp_mutex_unlock(&g_modules_lock);
+    return tool->handler;
+}
+
+size_t mcp_module_count(void) {
+    mcp_module_init();
+    return g_module_count;
+}
+
+void mcp_module_add_signatures(cJSON* signatures) {
+    mcp_module_init();
+    if (g_module_count == 0 || !cJSON_IsObject(signatures)) {
+        return;
+    }
+    cJSON* tools = cJSON_GetObjectItemCaseSensitive(signatures, "tools");
+    cJSON* defs = cJSON_GetObjectItemCaseSensitive(signatures, "$defs");
+    if (tools == NULL) {
+        tools = cJSON_AddArrayToObject(signatures, "tools");
+    }
+    if (defs == NULL) {
+        defs = cJSON_AddObjectToObject(signatures, "$defs");
+    }
+    for (size_t i = 0; i < g_module_count; ++i) {
+        const cJSON* item;
+        cJSON_ArrayForEach(item, g_modules[i].defs) {
+            // Structs shared by several modules are listed once
+            if (!cJSON_HasObjectItem(defs, item->string)) {
+                cJSON_AddItemToObject(defs, item->string, cJSON_Duplicate(item, 1));
+            }
+        }
+        cJSON_ArrayForEach(item, g_modules[i].tools) {
+            cJSON_AddItemToArray(tools, cJSON_Duplicate(item, 1));
+        }
+    }
+}
+
+int mcp_module_write_index(const char* manifest, char** paths, int count) {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* modules = cJSON_AddArrayToObject(root, "modules");
+    int ret = modules != NULL ? 0 : -1;
+    int tool_count = 0;
+    for (int i = 0; i < count && ret == 0; ++i) {
+        void* handle = dlopen(paths[i], RTLD_NOW | RTLD_LOCAL);
+        mcp_module_signatures_fn signatures = NULL;
+        mcp_module_lookup_fn lookup = NULL;
+        if (handle != NULL) {
+            *(void**)&signatures = dlsym(handle, MCP_MODULE_SIGNATURES_SYMBOL);
+            *(void**)&lookup = dlsym(handle, MCP_MODULE_HANDLER_SYMBOL);
+        }
+        if (signatures == NULL || lookup == NULL) {
+            fprintf(stderr, "%s is not a tool module: %s\n", paths[i], dlerror());
+            ret = -1;
+        } else {
+            cJSON* fragment = signatures();
+            cJSON* tools = cJSON_DetachItemFromObjectCaseSensitive(fragment, "tools");
+            cJSON* defs = cJSON_DetachItemFromObjectCaseSensitive(fragment, "$defs");
+            // Absolute, so the manifest can be read from anywhere; hand-written entries may be relative
+            char* absolute = realpath(paths[i], NULL);
+            cJSON* entry = cJSON_CreateObject();
+            cJSON_AddStringToObject(entry, "path", absolute != NULL ? absolute : paths[i]);
+            free(absolute);
+            cJSON_AddItemToObject(entry, "tools", tools != NULL ? tools : cJSON_CreateArray());
+            cJSON_AddItemToObject(entry, "$defs", defs != NULL ? defs : cJSON_CreateObject());
+            cJSON_AddItemToArray(modules, entry);
+            tool_count += cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(entry, "tools"));
+            cJSON_Delete(fragment);
+        }
+        if (handle != NULL) {
+            dlclose(handle);
+        }
+    }
+
+    char* text = ret == 0 ? cJSON_Print(root) : NULL;
+    cJSON_Delete(root);
+    FILE* file = text != NULL ? fopen(manifest, "w") : NULL;
+    if (text != NULL && (file == NULL || fputs(text, file) == EOF || fputc('\n', file) == EOF)) {
+        ret = -1;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        ret = -1;
+    }
+    if (text != NULL && ret != 0) {
+        fprintf(stderr, "Failed to write module manifest %s\n", manifest);
+    }
+    cJSON_free(text);
+    if (ret == 0) {
+        fprintf(stderr, "Indexed %d tools of %d modules into %s\n", tool_count, count, manifest);
+    }
+    return ret;
+}
+
+cJSON* mcp_module_report(void) {
+    mcp_module_init();
+    mcp_mutex_lock(&g_modules_lock);
+    size_t loaded = g_loaded_count;
+    mcp_mutex_unlock(&g_modules_lock);
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "modules", (double)g_module_count);
+    cJSON_AddNumberToObject(report, "tools", (double)g_tool_count);
+    cJSON_AddNumberToObject(report, "loaded", (double)loaded);
+    return report;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* _WIN32 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mcp_module_init(void) {
+    const char* path = getenv(MCP_MODULES_ENV);
+    if (path != NULL && *path != '\0') {
+        fprintf(stderr, "Loadable tool modules are not supported on Windows, ignoring %s\n", path);
+    }
+}
+
+mcp_module_handler mcp_module_lookup(const char* name) {
+    (void)name;
+    return NULL;
+}
+
+size_t mcp_module_count(void) {
+    return 0;
+}
+
+void mcp_module_add_signatures(cJSON* signatures) {
+    (void)signatures;
+}
+
+int mcp_module_write_index(const char* manifest, char** paths, int count) {
+    (void)manifest;
+    (void)paths;
+    (void)count;
+    fprintf(stderr, "Loadable tool modules are not supported on Windows\n");
+    return -1;
+}
+
+cJSON* mcp_module_report(void) {
+    cJSON* report = cJSON_CreateObject();
+    cJSON_AddNumberToObject(report, "modules", 0);
+    cJSON_AddNumberToObject(report, "tools", 0);
+    cJSON_AddNumberToObject(report, "loaded", 0);
+    return report;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_WIN32 */
@@ -0,0 +1,76 @@
+#ifndef MCP_MODULE_H
+#define MCP_MODULE_H
+
+#include <stddef.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Manifest of the tool modules to serve, written by `mcpc --index-modules`
+#define MCP_MODULES_ENV "MCPC_MODULES"
+
+// Entry points every module exports (generated into <base>_module.c by export --module <base>)
+#define MCP_MODULE_SIGNATURES_SYMBOL "mcpc_module_signatures"
+#define MCP_MODULE_HANDLER_SYMBOL "mcpc_module_handler"
+
+#if defined(_WIN32)
+#define MCP_MODULE_EXPORT __declspec(dllexport)
+#elif defined(__GNUC__) || defined(__clang__)
+#define MCP_MODULE_EXPORT __attribute__((visibility("default")))
+#else
+#define MCP_MODULE_EXPORT
+#endif
+
+// A generated handle_<function>, as bridge() calls it
+typedef cJSON* (*mcp_module_handler)(cJSON* params);
+// mcpc_module_signatures: {"$defs": {...}, "tools": [...]} of the module's tools
+typedef cJSON* (*mcp_module_signatures_fn)(void);
+// mcpc_module_handler: the handler of one of the module's tools, NULL for others
+typedef mcp_module_handler (*mcp_module_lookup_fn)(const char* name);
+
+/**
+ * @brief Reads the manifest named by $MCPC_MODULES, once; later calls do
+ * nothing. No module is loaded here: the manifest already holds their tool
+ * names and schemas. Called when a server starts, and by the functions
+ * below otherwise.
+ */
+void mcp_module_init(void);
+
+/**
+ * @brief The handler of `name` if a module in the manifest exports it,
+ * loading that module with its first call. NULL when no module has the tool
+ * or the module failed to load (logged once).
+ */
+mcp_module_handler mcp_module_lookup(const char* name);
+
+/**
+ * @brief Modules in the manifest, 0 when none are served.
+ */
+size_t mcp_module_count(void);
+
+/**
+ * @brief Appends the modules' tools to the "tools" array of a tools/list
+ * result and their definitions to its "$defs", from the manifest.
+ */
+void mcp_module_add_signatures(cJSON* signatures);
+
+/**
+ * @brief Loads each module in `paths` once, collects its signatures and
+ * writes the manifest to `manifest`, with absolute module paths. When
+ * serving, relative paths in a manifest are taken from its directory.
+ * @return 0 on success, -1 if a module or the file failed (reported on stderr).
+ */
+int mcp_module_write_index(const char* manifest, char** paths, int count);
+
+/**
+ * @brief Counts of modules and their tools in the manifest, and of modules loaded so far.
+ */
+cJSON* mcp_module_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_MODULE_H */
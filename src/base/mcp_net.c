@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include "mcp_net.h"
+
+#ifdef __linux__
+
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_log.h"
+#include "mcp_module.h"
+#include "mcp_resource.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static mcp_net* volatile g_net = NULL;
+
+static void mcp_net_on_signal(int signo) {
+    (void)signo;
+    mcp_net* net = g_net;
+    if (net != NULL) {
+        mcp_event_loop_stop(&net->loop);
+    }
+}
+
+// A worker armed the first deadline: tick every MCP_TIMER_TICK_MS until the wheel is empty
+static void mcp_net_deadlines_armed(void* arg) {
+    mcp_net* net = (mcp_net*)arg;
+    struct itimerspec tick;
+    memset(&tick, 0, sizeof(tick));
+    tick.it_value.tv_nsec = MCP_TIMER_TICK_MS * 1000000L;
+    tick.it_interval.tv_nsec = MCP_TIMER_TICK_MS * 1000000L;
+    timerfd_settime(net->deadlines.fd, 0, &tick, NULL);
+}
+
+static void mcp_net_on_deadlines(mcp_event_handler* handler, unsigned events) {
+    mcp_net* net = (mcp_net*)((char*)handler - offsetof(mcp_net, deadlines));
+    mcp_timer_wheel* wheel = mcp_dispatch_deadlines();
+    uint64_t expirations;
+    (void)events;
+    if (read(handler->fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    if (mcp_timer_wheel_advance(wheel) == 0) {
+        struct itimerspec off;
+        memset(&off, 0, sizeof(off));
+        timerfd_settime(handler->fd, 0, &off, NULL);
+        // A deadline added since the advance may have armed the timer just before we stopped it
+        if (mcp_timer_wheel_count(wheel) != 0) {
+            mcp_net_deadlines_armed(net);
+        }
+    }
+}
+
+static int mcp_net_start_deadlines(mcp_net* net) {
+    net->deadlines.on_event = mcp_net_on_deadlines;
+    net->deadlines.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (net->deadlines.fd < 0) {
+        return -1;
+    }
+    if (mcp_event_loop_add(&net->loop, &net->deadlines, MCP_EVENT_READ) != 0) {
+        close(net->deadlines.fd);
+        return -1;
+    }
+    mcp_timer_wheel_set_driver(mcp_dispatch_deadlines(), mcp_net_deadlines_armed, net);
+    return 0;
+}
+
+int mcp_net_init(mcp_net* net) {
+    mcp_log_init();
+    mcp_arena_install_hooks();
+    // Peers that hang up must not kill the process on write
+    signal(SIGPIPE, SIG_IGN);
+    net->transports = NULL;
+    if (mcp_event_loop_init(&net->loop) != 0) {
+        fprintf(stderr, "Failed to create event loop\n");
+        return -1;
+    }
+    if (mcp_pool_init(&net->pool, 0) != 0) {
+        fprintf(stderr, "Failed to start worker pool\n");
+        mcp_event_loop_destroy(&net->loop);
+        return -1;
+    }
+    if (mcp_net_start_deadlines(net) != 0) {
+        fprintf(stderr, "Failed to create deadline timer\n");
+        mcp_pool_shutdown(&net->pool);
+        mcp_event_loop_destroy(&net->loop);
+        return -1;
+    }
+    if (mcp_stats_start_dumper() != 0) {
+        fprintf(stderr, "Failed to start statistics dumper, SIGUSR1 is ignored\n");
+    }
+    mcp_trace_init();
+    mcp_module_init();
+    mcp_resource_init();
+    return 0;
+}
+
+void mcp_net_add(mcp_net* net, mcp_transport* transport) {
+    transport->next = net->transports;
+    net->transports = transport;
+}
+
+void mcp_net_shutdown(mcp_net* net) {
+    for (mcp_transport* transport = net->transports; transport != NULL; transport = transport->next) {
+        transport->stop(transport);
+    }
+    // Workers finish what is queued; their replies are posted to the loop and delivered here
+    mcp_pool_shutdown(&net->pool);
+    // Async calls still out reply through connections the transports are about to free
+    mcp_dispatch_drain_calls(true);
+    mcp_timer_wheel_set_driver(mcp_dispatch_deadlines(), NULL, NULL);
+    mcp_event_loop_remove(&net->loop, &net->deadlines);
+    close(net->deadlines.fd);
+    mcp_event_loop_drain(&net->loop);
+    while (net->transports != NULL) {
+        mcp_transport* next = net->transports->next;
+        net->transports->destroy(net->transports);
+        net->transports = next;
+    }
+    mcp_event_loop_destroy(&net->loop);
+    mcp_stats_stop_dumper();
+    mcp_trace_shutdown();
+    mcp_log_shutdown();
+}
+
+int mcp_net_run(mcp_net* net) {
+    struct sigaction action;
+    struct sigaction old_int;
+    struct sigaction old_term;
+
+    g_net = net;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = mcp_net_on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &old_int);
+    sigaction(SIGTERM, &action, &old_term);
+
+    mcp_trace_name_thread("event loop");
+    int ret = mcp_event_loop_run(&net->loop);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    g_net = NULL;
+    mcp_net_shutdown(net);
+    return ret;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !__linux__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_net_init(mcp_net* net) {
+    (void)net;
+    fprintf(stderr, "Socket transports need epoll and are only available on Linux\n");
+    return -1;
+}
+
+void mcp_net_add(mcp_net* net, mcp_transport* transport) {
+    transport->next = net->transports;
+    net->transports = transport;
+}
+
+int mcp_net_run(mcp_net* net) {
+    (void)net;
+    return -1;
+}
+
+void mcp_net_shutdown(mcp_net* net) {
+    (void)net;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,60 @@
+#ifndef MCP_NET_H
+#define MCP_NET_H
+
+#include "mcp_event_loop.h"
+#include "mcp_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A listening transport (HTTP, Unix socket, ...) attached to an
+ * mcp_net. Embed it in the transport's state.
+ */
+typedef struct mcp_transport {
+    // Stops accepting connections; called once the loop has stopped
+    void (*stop)(struct mcp_transport* transport);
+    // Closes every connection and frees the transport, once the workers are idle
+    void (*destroy)(struct mcp_transport* transport);
+    struct mcp_transport* next;
+} mcp_transport;
+
+/**
+ * @brief Socket server runtime: one event loop thread for all connections of
+ * all transports, and one worker pool shared by every client.
+ */
+typedef struct mcp_net {
+    mcp_event_loop loop;
+    mcp_pool pool;
+    mcp_transport* transports;
+    mcp_event_handler deadlines;  // timerfd ticking the deadline wheel while requests have one
+} mcp_net;
+
+/**
+ * @brief Creates the loop and the worker pool. Returns 0 or -1.
+ */
+int mcp_net_init(mcp_net* net);
+
+/**
+ * @brief Registers a transport; it is stopped and destroyed by the net.
+ */
+void mcp_net_add(mcp_net* net, mcp_transport* transport);
+
+/**
+ * @brief Serves until SIGINT/SIGTERM, then shuts down (see mcp_net_shutdown).
+ * Returns 0 after a clean shutdown, -1 on a loop error.
+ */
+int mcp_net_run(mcp_net* net);
+
+/**
+ * @brief Stops every transport, lets in-flight requests finish and deliver
+ * their replies, then closes all connections and frees everything.
+ */
+void mcp_net_shutdown(mcp_net* net);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_NET_H */
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mcp_pool.h"
+#include "mcp_trace.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t mcp_pool_default_threads(void) {
+    const char* env = getenv(MCP_WORKERS_ENV);
+    if (env != NULL && atoi(env) > 0) {
+        return (size_t)atoi(env);
+    }
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+#endif
+}
+
+static size_t mcp_pool_limit(const char* name, size_t fallback) {
+    const char* env = getenv(name);
+    if (env != NULL && *env != '\0') {
+        long long value = atoll(env);
+        return value > 0 ? (size_t)value : 0;
+    }
+    return fallback;
+}
+
+static bool mcp_pool_full(mcp_pool* pool) {
+    return (pool->max_depth != 0 && pool->depth >= pool->max_depth) ||
+           (pool->max_bytes != 0 && pool->bytes >= pool->max_bytes);
+}
+
+static void* mcp_pool_worker_main(void* arg) {
+    mcp_pool* pool = (mcp_pool*)arg;
+    mcp_task* task = NULL;
+    mcp_trace_name_thread("worker");
+    while ((task = (mcp_task*)mcp_queue_pop(&pool->tasks)) != NULL) {
+        // Running tasks no longer count against the limits
+        mcp_mutex_lock(&pool->lock);
+        bool was_full = mcp_pool_full(pool);
+        pool->depth--;
+        pool->bytes -= task->bytes;
+        if (was_full && !mcp_pool_full(pool)) {
+            mcp_cond_broadcast(&pool->room);
+        }
+        mcp_mutex_unlock(&pool->lock);
+        task->run(task);
+    }
+    return NULL;
+}
+
+int mcp_pool_init(mcp_pool* pool, size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = mcp_pool_default_threads();
+    }
+    if (mcp_queue_init(&pool->tasks, 64) != 0) {
+        return -1;
+    }
+    pool->threads = (mcp_thread_t*)calloc(thread_count, sizeof(mcp_thread_t));
+    if (!pool->threads) {
+        mcp_queue_destroy(&pool->tasks);
+        return -1;
+    }
+    pool->max_depth = mcp_pool_limit(MCP_QUEUE_DEPTH_ENV, MCP_QUEUE_DEFAULT_DEPTH);
+    pool->max_bytes = mcp_pool_limit(MCP_QUEUE_BYTES_ENV, MCP_QUEUE_DEFAULT_BYTES);
+    pool->depth = 0;
+    pool->bytes = 0;
+    pool->held = 0;
+    pool->held_bytes = 0;
+    mcp_mutex_init(&pool->lock);
+    mcp_cond_init(&pool->room);
+    pool->thread_count = 0;
+    for (size_t i = 0; i < thread_count; ++i) {
+        if (mcp_thread_create(&pool->threads[i], mcp_pool_worker_main, pool) != 0) {
+            fprintf(stderr, "Failed to start worker thread %zu\n", i);
+            break;
+        }
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0) {
+        free(pool->threads);
+        mcp_cond_destroy(&pool->room);
+        mcp_mutex_destroy(&pool->lock);
+        mcp_queue_destroy(&pool->tasks);
+        return -1;
+    }
+    return 0;
+}
+
+int mcp_pool_submit(mcp_pool* pool, mcp_task* task) {
+    // Charged before the push so a worker never settles a task that was not counted
+    mcp_mutex_lock(&pool->lock);
+    pool->depth++;
+    pool->bytes += task->bytes;
+    mcp_mutex_unlock(&pool->lock);
+    if (mcp_queue_push(&pool->tasks, task) != 0) {
+        mcp_mutex_lock(&pool->lock);
+        pool->depth--;
+        pool->bytes -= task->bytes;
+        mcp_cond_broadcast(&pool->room);
+        mcp_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    return 0;
+}
+
+bool mcp_pool_admits(mcp_pool* pool, size_t count, size_t bytes) {
+    size_t held = (size_t)mcp_atomic_load(&pool->held);
+    size_t held_bytes = (size_t)mcp_atomic_load(&pool->held_bytes);
+    mcp_mutex_lock(&pool->lock);
+    size_t depth = pool->depth + held;
+    size_t total = pool->bytes + held_bytes;
+    bool admits = depth == 0 ||
+                  ((pool->max_depth == 0 || depth + count <= pool->max_depth) &&
+                   (pool->max_bytes == 0 || total + bytes <= pool->max_bytes));
+    mcp_mutex_unlock(&pool->lock);
+    return admits;
+}
+
+void mcp_pool_hold(mcp_pool* pool, size_t bytes) {
+    mcp_atomic_add(&pool->held, 1);
+    mcp_atomic_add(&pool->held_bytes, (long)bytes);
+}
+
+void mcp_pool_settle(mcp_pool* pool, size_t bytes) {
+    mcp_atomic_add(&pool->held_bytes, -(long)bytes);
+    mcp_atomic_add(&pool->held, -1);
+}
+
+void mcp_pool_wait_room(mcp_pool* pool) {
+    mcp_mutex_lock(&pool->lock);
+    while (mcp_pool_full(pool)) {
+        mcp_cond_wait(&pool->room, &pool->lock);
+    }
+    mcp_mutex_unlock(&pool->lock);
+}
+
+void mcp_pool_shutdown(mcp_pool* pool) {
+    mcp_queue_close(&pool->tasks);
+    for (size_t i = 0; i < pool->thread_count; ++i) {
+        mcp_thread_join(pool->threads[i]);
+    }
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+    mcp_cond_destroy(&pool->room);
+    mcp_mutex_destroy(&pool->lock);
+    mcp_queue_destroy(&pool->tasks);
+}
+
+#ifdef __cplusplus
+}
+#endif
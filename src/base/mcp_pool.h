@@ -0,0 +1,98 @@
+#ifndef MCP_POOL_H
+#define MCP_POOL_H
+
+#include <stddef.h>
+#include "mcp_queue.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Overrides the worker count, defaults to the number of online CPUs
+#define MCP_WORKERS_ENV "MCPC_WORKERS"
+// Admission limits on tasks waiting for a worker; 0 lifts a limit
+#define MCP_QUEUE_DEPTH_ENV "MCPC_QUEUE_DEPTH"
+#define MCP_QUEUE_BYTES_ENV "MCPC_QUEUE_BYTES"
+#define MCP_QUEUE_DEFAULT_DEPTH 1024
+#define MCP_QUEUE_DEFAULT_BYTES (64 * 1024 * 1024)
+
+/**
+ * @brief Unit of work for the pool. Embed it in a larger struct and recover
+ * the container in `run`; the pool never allocates or frees tasks.
+ */
+typedef struct mcp_task {
+    void (*run)(struct mcp_task* task);
+    size_t bytes;  // Charged against the byte limit while the task is queued
+} mcp_task;
+
+/**
+ * @brief Fixed set of worker threads pulling tasks from one shared queue.
+ *
+ * The queue itself never refuses work; callers ask mcp_pool_admits() first
+ * and shed or hold back what does not fit, which keeps latency and memory
+ * bounded under bursts.
+ */
+typedef struct mcp_pool {
+    mcp_queue tasks;
+    mcp_thread_t* threads;
+    size_t thread_count;
+    size_t max_depth;
+    size_t max_bytes;
+    mcp_mutex_t lock;       // Guards `depth` and `bytes`
+    mcp_cond_t room;
+    size_t depth;           // Tasks queued and not running yet
+    size_t bytes;
+    volatile long held;     // Requests unanswered off the workers, see mcp_pool_hold()
+    volatile long held_bytes;
+} mcp_pool;
+
+/**
+ * @brief Starts `thread_count` workers (0 picks the default).
+ */
+int mcp_pool_init(mcp_pool* pool, size_t thread_count);
+
+/**
+ * @brief Queues a task. Returns -1 once the pool is shutting down.
+ */
+int mcp_pool_submit(mcp_pool* pool, mcp_task* task);
+
+/**
+ * @brief Whether `count` more tasks carrying `bytes` fit under the limits
+ * ($MCPC_QUEUE_DEPTH tasks, $MCPC_QUEUE_BYTES bytes). An idle queue admits
+ * anything, so a single oversized message is still served.
+ */
+bool mcp_pool_admits(mcp_pool* pool, size_t count, size_t bytes);
+
+/**
+ * @brief A request that leaves its worker unanswered (an asynchronous or
+ * streamed call, or one parked behind an identical call) keeps counting
+ * toward the limits of mcp_pool_admits() until mcp_pool_settle(). Safe after
+ * mcp_pool_shutdown(), which such calls may outlive.
+ */
+void mcp_pool_hold(mcp_pool* pool, size_t bytes);
+void mcp_pool_settle(mcp_pool* pool, size_t bytes);
+
+/**
+ * @brief Blocks while the queue is at one of its limits, for readers that
+ * can push back on their input instead of shedding it. Held requests do not
+ * count here: the reader must stay free to take the cancellations that end them.
+ */
+void mcp_pool_wait_room(mcp_pool* pool);
+
+/**
+ * @brief Stops accepting tasks, runs everything already queued and joins
+ * the workers.
+ */
+void mcp_pool_shutdown(mcp_pool* pool);
+
+/**
+ * @brief Default worker count: $MCPC_WORKERS, else the number of online CPUs.
+ */
+size_t mcp_pool_default_threads(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_POOL_H */
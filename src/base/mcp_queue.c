@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include "mcp_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_queue_init(mcp_queue* queue, size_t initial_capacity) {
+    if (initial_capacity == 0) {
+        initial_capacity = 16;
+    }
+    queue->items = (void**)malloc(initial_capacity * sizeof(void*));
+    if (!queue->items) {
+        return -1;
+    }
+    queue->capacity = initial_capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    mcp_mutex_init(&queue->lock);
+    mcp_cond_init(&queue->not_empty);
+    return 0;
+}
+
+void mcp_queue_destroy(mcp_queue* queue) {
+    free(queue->items);
+    queue->items = NULL;
+    queue->capacity = 0;
+    queue->count = 0;
+    mcp_cond_destroy(&queue->not_empty);
+    mcp_mutex_destroy(&queue->lock);
+}
+
+// 容量翻倍, 同时把环形数据展开到新数组开头
+static int mcp_queue_grow(mcp_queue* queue) {
+    size_t new_capacity = queue->capacity * 2;
+    void** items = (void**)malloc(new_capacity * sizeof(void*));
+    if (!items) {
+        return -1;
+    }
+    for (size_t i = 0; i < queue->count; ++i) {
+        items[i] = queue->items[(queue->head + i) % queue->capacity];
+    }
+    free(queue->items);
+    queue->items = items;
+    queue->capacity = new_capacity;
+    queue->head = 0;
+    return 0;
+}
+
+int mcp_queue_push(mcp_queue* queue, void* item) {
+    mcp_mutex_lock(&queue->lock);
+    if (queue->closed) {
+        mcp_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    if (queue->count == queue->capacity && mcp_queue_grow(queue) != 0) {
+        mcp_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    mcp_cond_signal(&queue->not_empty);
+    mcp_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+void* mcp_queue_pop(mcp_queue* queue) {
+    void* item = NULL;
+    mcp_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        mcp_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    mcp_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void* mcp_queue_try_pop(mcp_queue* queue) {
+    void* item = NULL;
+    mcp_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+    }
+    mcp_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void mcp_queue_close(mcp_queue* queue) {
+    mcp_mutex_lock(&queue->lock);
+    queue->closed = true;
+    mcp_cond_broadcast(&queue->not_empty);
+    mcp_mutex_unlock(&queue->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
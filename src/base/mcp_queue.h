@@ -0,0 +1,56 @@
+#ifndef MCP_QUEUE_H
+#define MCP_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Thread-safe blocking FIFO backed by a growable ring array.
+ * The reader thread uses it to hand parsed messages to the dispatcher.
+ */
+typedef struct mcp_queue {
+    void** items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closed;
+    mcp_mutex_t lock;
+    mcp_cond_t not_empty;
+} mcp_queue;
+
+int mcp_queue_init(mcp_queue* queue, size_t initial_capacity);
+void mcp_queue_destroy(mcp_queue* queue);
+
+/**
+ * @brief Appends an item. Returns 0 on success, -1 if the queue is closed or
+ * out of memory (the caller keeps ownership of the item in that case).
+ */
+int mcp_queue_push(mcp_queue* queue, void* item);
+
+/**
+ * @brief Removes the oldest item, blocking while the queue is empty.
+ * Returns NULL once the queue is closed and drained.
+ */
+void* mcp_queue_pop(mcp_queue* queue);
+
+/**
+ * @brief Non-blocking pop. Returns NULL when the queue is currently empty.
+ */
+void* mcp_queue_try_pop(mcp_queue* queue);
+
+/**
+ * @brief Closes the queue and wakes every waiter. Items already queued can
+ * still be popped.
+ */
+void mcp_queue_close(mcp_queue* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_QUEUE_H */
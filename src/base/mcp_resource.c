@@ -0,0 +1,483 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_resource.h"
+#include "mcp_dispatch.h"
+#include "mcp_log.h"
+#include "mcp_thread.h"
+
+#ifndef _WIN32
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_RESOURCE_SCHEME "file://"
+
+typedef struct mcp_resource_type {
+    const char* extension;
+    const char* mime_type;
+    bool text;
+} mcp_resource_type;
+
+static const mcp_resource_type g_types[] = {
+    { "c", "text/x-c", true },
+    { "cc", "text/x-c++", true },
+    { "cpp", "text/x-c++", true },
+    { "css", "text/css", true },
+    { "csv", "text/csv", true },
+    { "gif", "image/gif", false },
+    { "h", "text/x-c", true },
+    { "hpp", "text/x-c++", true },
+    { "htm", "text/html", true },
+    { "html", "text/html", true },
+    { "jpeg", "image/jpeg", false },
+    { "jpg", "image/jpeg", false },
+    { "js", "text/javascript", true },
+    { "json", "application/json", true },
+    { "md", "text/markdown", true },
+    { "pdf", "application/pdf", false },
+    { "png", "image/png", false },
+    { "py", "text/x-python", true },
+    { "sh", "text/x-shellscript", true },
+    { "svg", "image/svg+xml", true },
+    { "toml", "application/toml", true },
+    { "txt", "text/plain", true },
+    { "xml", "application/xml", true },
+    { "yaml", "application/yaml", true },
+    { "yml", "application/yaml", true },
+    { "zip", "application/zip", false },
+};
+
+// The mapping the running thread reads, and where a fault in it lands
+typedef struct mcp_resource_guard {
+    const unsigned char* start;
+    size_t size;
+    sigjmp_buf fault;
+} mcp_resource_guard;
+
+static MCP_THREAD_LOCAL mcp_resource_guard* t_guard = NULL;
+static struct sigaction g_previous_bus;
+
+// A file truncated under its mapping faults past its new end: the read
+// fails instead of the process
+static void mcp_resource_on_bus(int signo, siginfo_t* info, void* context) {
+    mcp_resource_guard* guard = t_guard;
+    const unsigned char* address = (const unsigned char*)info->si_addr;
+    if (guard != NULL && address >= guard->start && address < guard->start + guard->size) {
+        siglongjmp(guard->fault, 1);
+    }
+    // Not a resource: the handler installed before takes it, while this one
+    // stays in place for the reads that come after
+    if (g_previous_bus.sa_flags & SA_SIGINFO) {
+        g_previous_bus.sa_sigaction(signo, info, context);
+    } else if (g_previous_bus.sa_handler == SIG_DFL) {
+        // Ends the process once the handler returns, as it would have without it
+        signal(SIGBUS, SIG_DFL);
+        raise(SIGBUS);
+    } else if (g_previous_bus.sa_handler != SIG_IGN) {
+        g_previous_bus.sa_handler(signo);
+    }
+}
+
+static mcp_mutex_t g_resource_lock = MCP_MUTEX_INITIALIZER;
+static volatile long g_resource_ready = 0;
+static char* g_root = NULL;        // Resolved, without a trailing slash except for "/"
+static size_t g_root_length = 0;
+
+void mcp_resource_init(void) {
+    if (mcp_atomic_load(&g_resource_ready)) {
+        return;
+    }
+    mcp_mutex_lock(&g_resource_lock);
+    if (!g_resource_ready) {
+        const char* path = getenv(MCP_RESOURCE_ROOT_ENV);
+        if (path != NULL && *path != '\0') {
+            struct stat info;
+            g_root = realpath(path, NULL);
+            if (g_root == NULL || stat(g_root, &info) != 0 || !S_ISDIR(info.st_mode)) {
+                fprintf(stderr, "Ignoring %s, not a directory: %s\n", MCP_RESOURCE_ROOT_ENV, path);
+                free(g_root);
+                g_root = NULL;
+            } else {
+                struct sigaction action;
+                memset(&action, 0, sizeof(action));
+                action.sa_sigaction = mcp_resource_on_bus;
+                action.sa_flags = SA_SIGINFO;
+                sigemptyset(&action.sa_mask);
+                sigaction(SIGBUS, &action, &g_previous_bus);
+                g_root_length = strlen(g_root);
+                fprintf(stderr, "Serving resources from %s\n", g_root);
+            }
+        }
+        mcp_atomic_store(&g_resource_ready, 1);
+    }
+    mcp_mutex_unlock(&g_resource_lock);
+}
+
+bool mcp_resource_enabled(void) {
+    mcp_resource_init();
+    return g_root != NULL;
+}
+
+static const mcp_resource_type* mcp_resource_type_of(const char* path) {
+    const char* name = strrchr(path, '/');
+    const char* dot = strrchr(name != NULL ? name : path, '.');
+    if (dot == NULL || dot[1] == '\0') {
+        return NULL;
+    }
+    char extension[8];
+    size_t length = strlen(dot + 1);
+    if (length >= sizeof(extension)) {
+        return NULL;
+    }
+    for (size_t i = 0; i <= length; ++i) {
+        char c = dot[1 + i];
+        extension[i] = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+    for (size_t i = 0; i < sizeof(g_types) / sizeof(g_types[0]); ++i) {
+        if (strcmp(extension, g_types[i].extension) == 0) {
+            return &g_types[i];
+        }
+    }
+    return NULL;
+}
+
+// Whether a file reads as UTF-8 text throughout: no NUL, no malformed,
+// overlong or surrogate sequence, nothing past U+10FFFF, none cut at the end
+static bool mcp_resource_is_text(const unsigned char* data, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = data[i];
+        if (c >= 0x01 && c < 0x80) {
+            i++;
+            continue;
+        }
+        size_t follow;
+        unsigned char low = 0x80;
+        unsigned char high = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf) {
+            follow = 1;
+        } else if (c >= 0xe0 && c <= 0xef) {
+            follow = 2;
+            low = c == 0xe0 ? 0xa0 : 0x80;
+            high = c == 0xed ? 0x9f : 0xbf;
+        } else if (c >= 0xf0 && c <= 0xf4) {
+            follow = 3;
+            low = c == 0xf0 ? 0x90 : 0x80;
+            high = c == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            return false;
+        }
+        if (length - i <= follow || data[i + 1] < low || data[i + 1] > high) {
+            return false;
+        }
+        for (size_t k = 2; k <= follow; ++k) {
+            if ((data[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += follow + 1;
+    }
+    return true;
+}
+
+// Characters a file URI carries as they are
+static bool mcp_resource_unreserved(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '.' || c == '_' || c == '~' || c == '/';
+}
+
+static char* mcp_resource_uri(const char* path) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t length = strlen(path);
+    char* uri = (char*)malloc(sizeof(MCP_RESOURCE_SCHEME) + length * 3);
+    if (uri == NULL) {
+        return NULL;
+    }
+    char* out = uri + sizeof(MCP_RESOURCE_SCHEME) - 1;
+    memcpy(uri, MCP_RESOURCE_SCHEME, sizeof(MCP_RESOURCE_SCHEME) - 1);
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)path[i];
+        if (mcp_resource_unreserved(c)) {
+            *out++ = (char)c;
+        } else {
+            *out++ = '%';
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 0xf];
+        }
+    }
+    *out = '\0';
+    return uri;
+}
+
+static int mcp_resource_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// The path a file:// URI names, decoded into `path`; false for anything else
+static bool mcp_resource_path(const char* uri, char* path, size_t size) {
+    size_t scheme = sizeof(MCP_RESOURCE_SCHEME) - 1;
+    if (uri == NULL || strncmp(uri, MCP_RESOURCE_SCHEME, scheme) != 0 || uri[scheme] != '/') {
+        return false;
+    }
+    size_t length = 0;
+    for (const char* in = uri + scheme; *in != '\0'; ++in) {
+        char c = *in;
+        if (c == '%') {
+            int high = mcp_resource_hex(in[1]);
+            int low = high >= 0 ? mcp_resource_hex(in[2]) : -1;
+            if (low < 0) {
+                return false;
+            }
+            c = (char)(high << 4 | low);
+            in += 2;
+        }
+        if (c == '\0' || length + 1 >= size) {
+            return false;
+        }
+        path[length++] = c;
+    }
+    path[length] = '\0';
+    return true;
+}
+
+// Whether a resolved path lies below the root, without a hidden component on the way
+static bool mcp_resource_allowed(const char* path) {
+    if (strncmp(path, g_root, g_root_length) != 0) {
+        return false;
+    }
+    const char* rest = path + g_root_length;
+    if (g_root_length > 1) {
+        if (*rest != '/') {
+            return false;
+        }
+        rest++;
+    }
+    for (const char* component = rest; component != NULL && *component != '\0';) {
+        if (*component == '.') {
+            return false;
+        }
+        component = strchr(component, '/');
+        if (component != NULL) {
+            component++;
+        }
+    }
+    return *rest != '\0';
+}
+
+static void mcp_resource_add(cJSON* resources, const char* path, const struct stat* info) {
+    char* uri = mcp_resource_uri(path);
+    if (uri == NULL) {
+        return;
+    }
+    const mcp_resource_type* type = mcp_resource_type_of(path);
+    const char* name = path + g_root_length + (g_root_length > 1 ? 1 : 0);
+    cJSON* resource = cJSON_CreateObject();
+    cJSON_AddStringToObject(resource, "uri", uri);
+    cJSON_AddStringToObject(resource, "name", name);
+    if (type != NULL) {
+        cJSON_AddStringToObject(resource, "mimeType", type->mime_type);
+    }
+    cJSON_AddNumberToObject(resource, "size", (double)info->st_size);
+    cJSON_AddItemToArray(resources, resource);
+    free(uri);
+}
+
+// Adds the files below `path` (a buffer of PATH_MAX holding `length` bytes)
+// while there is room in the list; false once it is full
+static bool mcp_resource_walk(cJSON* resources, char* path, size_t length, int depth, int* count) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return true;
+    }
+    bool room = true;
+    struct dirent* entry;
+    while (room && (entry = readdir(dir)) != NULL) {
+        size_t name_length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length + 1 + name_length >= PATH_MAX) {
+            continue;
+        }
+        size_t end = length;
+        if (end > 1) {
+            path[end++] = '/';
+        }
+        memcpy(path + end, entry->d_name, name_length + 1);
+        struct stat info;
+        // Links are not followed, so the listing never leaves the root
+        if (lstat(path, &info) == 0) {
+            if (S_ISREG(info.st_mode)) {
+                if (*count == MCP_RESOURCE_LIST_LIMIT) {
+                    mcp_log_warn("Listing only the first %d resources of %s", MCP_RESOURCE_LIST_LIMIT, g_root);
+                    room = false;
+                } else {
+                    mcp_resource_add(resources, path, &info);
+                    (*count)++;
+                }
+            } else if (S_ISDIR(info.st_mode) && depth < MCP_RESOURCE_MAX_DEPTH) {
+                room = mcp_resource_walk(resources, path, end + name_length, depth + 1, count);
+            }
+        }
+        path[length] = '\0';
+    }
+    closedir(dir);
+    return room;
+}
+
+cJSON* mcp_resource_list(void) {
+    mcp_resource_init();
+    cJSON* result = cJSON_CreateObject();
+    cJSON* resources = cJSON_AddArrayToObject(result, "resources");
+    if (g_root != NULL && resources != NULL) {
+        char path[PATH_MAX];
+        int count = 0;
+        memcpy(path, g_root, g_root_length + 1);
+        mcp_resource_walk(resources, path, g_root_length, 0, &count);
+    }
+    return result;
+}
+
+void mcp_resource_read(mcp_stream* out, const char* uri) {
+    mcp_resource_init();
+    char requested[PATH_MAX];
+    char resolved[PATH_MAX];
+    if (g_root == NULL || !mcp_resource_path(uri, requested, sizeof(requested)) ||
+        realpath(requested, resolved) == NULL || !mcp_resource_allowed(resolved)) {
+        mcp_stream_fail(out, MCP_ERROR_RESOURCE_NOT_FOUND, "Resource not found");
+        return;
+    }
+    int fd = open(resolved, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        mcp_stream_fail(out, MCP_ERROR_RESOURCE_NOT_FOUND, "Resource not found");
+        return;
+    }
+    if ((uint64_t)info.st_size > SIZE_MAX) {
+        close(fd);
+        mcp_stream_fail(out, MCP_ERROR_INTERNAL, "Resource too large");
+        return;
+    }
+    size_t size = (size_t)info.st_size;
+    // An empty file has no mapping but is still an empty string
+    const unsigned char* data = (const unsigned char*)"";
+    if (size > 0) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            mcp_log_error("Failed to map %s", resolved);
+            mcp_stream_fail(out, MCP_ERROR_INTERNAL, "Failed to read the resource");
+            return;
+        }
+        // Read once front to back: let the kernel read ahead and drop pages behind
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = (const unsigned char*)map;
+    }
+    close(fd);
+
+    mcp_resource_guard guard;
+    guard.start = data;
+    guard.size = size;
+    if (sigsetjmp(guard.fault, 1) != 0) {
+        t_guard = NULL;
+        munmap((void*)data, size);
+        mcp_log_error("%s was truncated while it was read", resolved);
+        mcp_stream_fail(out, MCP_ERROR_INTERNAL, "The resource changed while it was read");
+        return;
+    }
+    t_guard = &guard;
+
+    // The whole file is checked before any of it is sent: text that turns
+    // out not to be UTF-8 halfway could no longer become a blob
+    const mcp_resource_type* type = mcp_resource_type_of(resolved);
+    bool text = (type == NULL || type->text) && mcp_resource_is_text(data, size);
+    const char* mime_type;
+    if (type != NULL) {
+        mime_type = type->mime_type;
+    } else {
+        mime_type = text ? "text/plain" : "application/octet-stream";
+    }
+
+    mcp_stream_begin_object(out);
+    mcp_stream_key(out, "contents");
+    mcp_stream_begin_array(out);
+    mcp_stream_begin_object(out);
+    mcp_stream_key(out, "uri");
+    mcp_stream_string(out, uri);
+    mcp_stream_key(out, "mimeType");
+    mcp_stream_string(out, mime_type);
+    if (text) {
+        mcp_stream_key(out, "text");
+        mcp_stream_string_length(out, (const char*)data, size);
+    } else {
+        mcp_stream_key(out, "blob");
+        mcp_stream_base64(out, data, size);
+    }
+    mcp_stream_end_object(out);
+    mcp_stream_end_array(out);
+    mcp_stream_end_object(out);
+    t_guard = NULL;
+    if (size > 0) {
+        munmap((void*)data, size);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* _WIN32 */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mcp_resource_init(void) {
+    const char* path = getenv(MCP_RESOURCE_ROOT_ENV);
+    if (path != NULL && *path != '\0') {
+        fprintf(stderr, "Resources are not supported on Windows, ignoring %s\n", path);
+    }
+}
+
+bool mcp_resource_enabled(void) {
+    return false;
+}
+
+cJSON* mcp_resource_list(void) {
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddArrayToObject(result, "resources");
+    return result;
+}
+
+void mcp_resource_read(mcp_stream* out, const char* uri) {
+    (void)uri;
+    mcp_stream_fail(out, MCP_ERROR_RESOURCE_NOT_FOUND, "Resource not found");
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_WIN32 */
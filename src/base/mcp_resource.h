@@ -0,0 +1,54 @@
+#ifndef MCP_RESOURCE_H
+#define MCP_RESOURCE_H
+
+#include <stdbool.h>
+#include "cJSON.h"
+#include "mcp_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Directory whose files are served as resources; none are without it
+#define MCP_RESOURCE_ROOT_ENV "MCPC_RESOURCE_ROOT"
+// Entries resources/list returns at most
+#define MCP_RESOURCE_LIST_LIMIT 1024
+// Directory levels below the root resources/list descends
+#define MCP_RESOURCE_MAX_DEPTH 16
+
+/**
+ * @brief Resolves $MCPC_RESOURCE_ROOT, once; later calls do nothing. Called
+ * when a server starts, and by the functions below otherwise.
+ */
+void mcp_resource_init(void);
+
+/**
+ * @brief Whether a resource root is configured.
+ */
+bool mcp_resource_enabled(void);
+
+/**
+ * @brief The resources/list result: the regular files below the root as
+ * {"resources": [{"uri", "name", "mimeType", "size"}]}, with file:// URIs.
+ * Hidden entries and symbolic links are left out.
+ */
+cJSON* mcp_resource_list(void);
+
+/**
+ * @brief Writes the resources/read result of `uri` to `out`. The file is
+ * mapped read-only and its text escaped (or its bytes base64 encoded)
+ * straight from the mapping into the stream's chunks, so a large file is
+ * never copied whole. A file goes out as text only if all of it is valid
+ * UTF-8, as a blob otherwise. URIs outside the root, of hidden files or of
+ * anything but a regular file answer MCP_ERROR_RESOURCE_NOT_FOUND.
+ *
+ * A file truncated by another process while it is being sent fails the read
+ * (cut short if part of it is out already) rather than raising SIGBUS.
+ */
+void mcp_resource_read(mcp_stream* out, const char* uri);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_RESOURCE_H */
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "mcp_session.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static MCP_THREAD_LOCAL mcp_session* t_current_session = NULL;
+
+mcp_session* mcp_session_create(void) {
+    mcp_session* session = (mcp_session*)calloc(1, sizeof(mcp_session));
+    if (!session) {
+        return NULL;
+    }
+    mcp_mutex_init(&session->lock);
+    session->refs = 1;
+    return session;
+}
+
+void mcp_session_retain(mcp_session* session) {
+    if (session != NULL) {
+        mcp_atomic_add(&session->refs, 1);
+    }
+}
+
+void mcp_session_release(mcp_session* session) {
+    if (session != NULL && mcp_atomic_add(&session->refs, -1) == 0) {
+        mcp_mutex_destroy(&session->lock);
+        free(session);
+    }
+}
+
+mcp_session* mcp_session_current(void) {
+    return t_current_session;
+}
+
+mcp_session* mcp_session_set_current(mcp_session* session) {
+    mcp_session* previous = t_current_session;
+    t_current_session = session;
+    return previous;
+}
+
+void mcp_session_set_client(mcp_session* session, const char* protocol_version, const char* client_name,
+                            const char* client_version, bool roots_list_changed, int sampling_max_tokens) {
+    if (session == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    snprintf(session->protocol_version, sizeof(session->protocol_version), "%s", protocol_version ? protocol_version : "");
+    snprintf(session->client_name, sizeof(session->client_name), "%s", client_name ? client_name : "");
+    snprintf(session->client_version, sizeof(session->client_version), "%s", client_version ? client_version : "");
+    session->roots_list_changed = roots_list_changed;
+    session->sampling_max_tokens = sampling_max_tokens;
+    mcp_mutex_unlock(&session->lock);
+}
+
+void mcp_session_set_initialized(mcp_session* session) {
+    if (session == NULL) {
+        return;
+    }
+    mcp_mutex_lock(&session->lock);
+    session->initialized = true;
+    mcp_mutex_unlock(&session->lock);
+}
+
+bool mcp_session_is_initialized(mcp_session* session) {
+    if (session == NULL) {
+        return false;
+    }
+    mcp_mutex_lock(&session->lock);
+    bool initialized = session->initialized;
+    mcp_mutex_unlock(&session->lock);
+    return initialized;
+}
+
+bool mcp_session_busy(mcp_session* session) {
+    if (session == NULL) {
+        return false;
+    }
+    mcp_mutex_lock(&session->lock);
+    bool busy = session->requests != NULL;
+    mcp_mutex_unlock(&session->lock);
+    return busy;
+}
+
+#ifdef __cplusplus
+}
+#endif
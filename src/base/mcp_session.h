@@ -0,0 +1,67 @@
+#ifndef MCP_SESSION_H
+#define MCP_SESSION_H
+
+#include <stdbool.h>
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Per-client state negotiated by the initialize handshake.
+ *
+ * Every transport connection (or HTTP session) owns one; all clients share
+ * the same tool registry and worker pool. Requests keep a reference while
+ * they run, so a session outlives the connection that is closed under it.
+ * Handlers of one session may run in parallel, so fields are read and
+ * written through the accessors below.
+ */
+struct mcp_request;
+
+typedef struct mcp_session {
+    volatile long refs;
+    mcp_mutex_t lock;
+    struct mcp_request* requests; // In flight with an id, for notifications/cancelled
+    bool initialized;             // notifications/initialized received
+    char protocol_version[32];
+    char client_name[128];
+    char client_version[64];
+    bool roots_list_changed;
+    int sampling_max_tokens;
+} mcp_session;
+
+/**
+ * @brief Creates a session holding one reference.
+ */
+mcp_session* mcp_session_create(void);
+void mcp_session_retain(mcp_session* session);
+void mcp_session_release(mcp_session* session);
+
+/**
+ * @brief The session of the request running on the calling thread, or NULL
+ * outside of a request. Set by the dispatcher around bridge().
+ */
+mcp_session* mcp_session_current(void);
+mcp_session* mcp_session_set_current(mcp_session* session);
+
+/**
+ * @brief Records what the client sent with initialize. Strings may be NULL
+ * and are truncated to the field sizes.
+ */
+void mcp_session_set_client(mcp_session* session, const char* protocol_version, const char* client_name,
+                            const char* client_version, bool roots_list_changed, int sampling_max_tokens);
+void mcp_session_set_initialized(mcp_session* session);
+bool mcp_session_is_initialized(mcp_session* session);
+
+/**
+ * @brief Whether requests of the session are still queued or running
+ * (asynchronous ones until they complete).
+ */
+bool mcp_session_busy(mcp_session* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_SESSION_H */
@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_shm.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_log.h"
+#include "mcp_session.h"
+#include "mcp_shm_ring.h"
+#include "mcp_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcp_shm_server mcp_shm_server;
+
+/**
+ * @brief One client, its rings and its session. Only the loop thread
+ * touches it; the memory stays until no request of it is with the workers.
+ */
+typedef struct mcp_shm_conn {
+    mcp_event_handler wake;     // server_wake: requests arrived, or the client took replies
+    mcp_event_handler control;  // The client's socket, readable once it hangs up
+    mcp_shm_server* server;
+    mcp_shm_channel channel;
+    mcp_session* session;
+    mcp_writer backlog;         // Replies the ring had no room for, one per line
+    size_t backlog_start;       // The first of them not fully in the ring
+    size_t backlog_sent;        // Its bytes already in the ring
+    mcp_writer partial;         // Private copy of the request being read, whole or in pieces
+    struct mcp_shm_conn* prev;
+    struct mcp_shm_conn* next;
+    mcp_task poll;              // Resumes reading a client that sent more than a batch
+    mcp_task flush;             // Wakes the client once for the replies of one loop round
+    mcp_task release;
+    size_t inflight;            // Messages with the workers
+    bool poll_posted;
+    bool flush_posted;
+    bool release_posted;
+    bool closed;
+} mcp_shm_conn;
+
+/**
+ * @brief One submitted message; carries its reply back to the loop thread.
+ */
+typedef struct mcp_shm_call {
+    mcp_task task;
+    mcp_sink sink;
+    mcp_shm_conn* conn;
+    cJSON* response;
+    mcp_arena* arena;
+    int tool;  // For the byte count, see mcp_stats_bytes_out()
+} mcp_shm_call;
+
+struct mcp_shm_server {
+    mcp_transport transport;
+    mcp_net* net;
+    mcp_event_handler listener;
+    mcp_shm_conn* conns;
+    uint64_t ring_size;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+};
+
+static void mcp_shm_release_run(mcp_task* task) {
+    mcp_shm_conn* conn = (mcp_shm_conn*)((char*)task - offsetof(mcp_shm_conn, release));
+    mcp_session_release(conn->session);
+    mcp_writer_destroy(&conn->backlog);
+    mcp_writer_destroy(&conn->partial);
+    free(conn);
+}
+
+// Frees a closed connection after the current round, once nothing refers to it
+static void mcp_shm_maybe_free(mcp_shm_conn* conn) {
+    if (conn->closed && conn->inflight == 0 && !conn->poll_posted && !conn->flush_posted && !conn->release_posted) {
+        conn->release_posted = true;
+        conn->release.run = mcp_shm_release_run;
+        mcp_event_loop_post(&conn->server->net->loop, &conn->release);
+    }
+}
+
+static void mcp_shm_conn_close(mcp_shm_conn* conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = true;
+    // Nobody is left to read the replies of what this client still has running
+    mcp_dispatch_cancel_session(conn->session);
+    mcp_shm_server* server = conn->server;
+    mcp_event_loop_remove(&server->net->loop, &conn->wake);
+    mcp_event_loop_remove(&server->net->loop, &conn->control);
+    mcp_shm_channel_close(&conn->channel);
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        server->conns = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    mcp_shm_maybe_free(conn);
+}
+
+// Moves queued replies into the ring, oldest first, as far as there is room
+static void mcp_shm_flush_backlog(mcp_shm_conn* conn) {
+    mcp_shm_channel* channel = &conn->channel;
+    mcp_shm_ring* ring = &channel->header->replies;
+    while (conn->backlog_start < conn->backlog.length) {
+        char* message = conn->backlog.data + conn->backlog_start;
+        size_t length = (size_t)((char*)memchr(message, '\n', conn->backlog.length - conn->backlog_start) - message);
+        if (!mcp_shm_ring_send(ring, channel->replies, channel->ring_size, message, length, &conn->backlog_sent)) {
+            // Full: the client wakes us once it took some, unless it did so meanwhile
+            mcp_shm_sleep_on(&ring->producer_waiting);
+            if (!mcp_shm_ring_send(ring, channel->replies, channel->ring_size, message, length, &conn->backlog_sent)) {
+                return;
+            }
+        }
+        conn->backlog_start += length + 1;
+        conn->backlog_sent = 0;
+    }
+    conn->backlog.length = 0;
+    conn->backlog_start = 0;
+}
+
+static void mcp_shm_flush_run(mcp_task* task) {
+    mcp_shm_conn* conn = (mcp_shm_conn*)((char*)task - offsetof(mcp_shm_conn, flush));
+    conn->flush_posted = false;
+    if (conn->closed) {
+        mcp_shm_maybe_free(conn);
+        return;
+    }
+    mcp_shm_flush_backlog(conn);
+    mcp_shm_wake(&conn->channel.header->replies.consumer_waiting, conn->channel.client_wake);
+}
+
+static void mcp_shm_schedule_flush(mcp_shm_conn* conn) {
+    if (conn->flush_posted) {
+        return;
+    }
+    // Runs after the completions already queued, so they share one wake-up
+    conn->flush.run = mcp_shm_flush_run;
+    if (mcp_event_loop_post(&conn->server->net->loop, &conn->flush) == 0) {
+        conn->flush_posted = true;
+    } else {
+        mcp_shm_flush_backlog(conn);
+        mcp_shm_wake(&conn->channel.header->replies.consumer_waiting, conn->channel.client_wake);
+    }
+}
+
+// Queues a reply for the ring. cJSON reads back what it printed, which the
+// client could change under it in shared memory, so replies are encoded in
+// the backlog and copied into the ring by the flush
+static long mcp_shm_encode(mcp_shm_conn* conn, cJSON* response) {
+    size_t length = conn->backlog.length;
+    if (mcp_writer_append_json(&conn->backlog, response) != 0) {
+        return -1;
+    }
+    return (long)(conn->backlog.length - length - 1);
+}
+
+// Worker thread: hand the reply back to the loop thread that owns the connection
+static void mcp_shm_call_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    mcp_shm_call* call = (mcp_shm_call*)((char*)sink - offsetof(mcp_shm_call, sink));
+    call->response = response;
+    call->arena = arena;
+    call->tool = mcp_stats_current();
+    if (mcp_event_loop_post(&call->conn->server->net->loop, &call->task) != 0) {
+        mcp_log_error("Failed to hand reply back to the event loop");
+    }
+}
+
+static void mcp_shm_call_complete(mcp_task* task) {
+    mcp_shm_call* call = (mcp_shm_call*)task;
+    mcp_shm_conn* conn = call->conn;
+    conn->inflight--;
+    if (!conn->closed && call->response != NULL) {
+        uint64_t trace = mcp_trace_begin();
+        long length = mcp_shm_encode(conn, call->response);
+        if (length < 0) {
+            mcp_log_error("Failed to encode response");
+        } else {
+            mcp_stats_bytes_out(call->tool, (size_t)length);
+        }
+        mcp_trace_end("encode", trace);
+    }
+    mcp_response_release(call->response, call->arena);
+    free(call);
+    if (conn->closed) {
+        mcp_shm_maybe_free(conn);
+        return;
+    }
+    mcp_shm_schedule_flush(conn);
+}
+
+// `message` is private memory: cJSON reads strings twice, and bytes the client
+// changed in between would let it write past what it sized
+static void mcp_shm_submit(mcp_shm_conn* conn, const char* message, size_t length) {
+    // Parse into the arena that will also hold the reply
+    mcp_arena* arena = mcp_arena_acquire();
+    mcp_arena* previous = mcp_arena_set_current(arena);
+    uint64_t trace = mcp_trace_begin();
+    cJSON* json = cJSON_ParseWithLength(message, length);
+    mcp_trace_end("cJSON_Parse", trace);
+    mcp_arena_set_current(previous);
+    if (json == NULL) {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL) {
+            mcp_log_warn("JSON parsing error: %.64s", error_ptr);
+        }
+        mcp_arena_release(arena);
+        return;
+    }
+
+    mcp_shm_call* call = (mcp_shm_call*)calloc(1, sizeof(mcp_shm_call));
+    if (!call) {
+        mcp_response_release(json, arena);
+        return;
+    }
+    call->task.run = mcp_shm_call_complete;
+    call->sink.send = mcp_shm_call_send;
+    call->conn = conn;
+    if (mcp_dispatch_submit(&conn->server->net->pool, json, length, arena, &call->sink, conn->session) != 0) {
+        mcp_response_release(json, arena);
+        free(call);
+        return;
+    }
+    conn->inflight++;
+}
+
+static void mcp_shm_poll_run(mcp_task* task);
+
+// Takes up to MCP_SHM_BATCH requests off the ring, then goes to sleep when it is empty
+static void mcp_shm_read(mcp_shm_conn* conn) {
+    mcp_shm_channel* channel = &conn->channel;
+    mcp_shm_ring* ring = &channel->header->requests;
+    for (unsigned count = 0;;) {
+        const char* bytes;
+        size_t length;
+        uint32_t kind;
+        size_t consumed;
+        int ret = mcp_shm_ring_peek(ring, channel->requests, channel->ring_size, &bytes, &length, &kind, &consumed);
+        if (ret < 0) {
+            mcp_log_warn("Shared-memory client wrote a corrupt record, closing it");
+            mcp_shm_conn_close(conn);
+            return;
+        }
+        if (ret == 0) {
+            // Idle: the client wakes us with its next request, unless it sent one meanwhile
+            mcp_shm_sleep_on(&ring->consumer_waiting);
+            if (mcp_shm_ring_empty(ring)) {
+                break;
+            }
+            __atomic_store_n(&ring->consumer_waiting, 0, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        if (count == MCP_SHM_BATCH) {
+            // Let the other clients have a turn; the ring is not empty, so nothing wakes us
+            conn->poll.run = mcp_shm_poll_run;
+            if (mcp_event_loop_post(&conn->server->net->loop, &conn->poll) == 0) {
+                conn->poll_posted = true;
+                break;
+            }
+        }
+        // Copied out before the slot is released, and before cJSON sees it
+        if (mcp_writer_append(&conn->partial, bytes, length) != 0) {
+            mcp_log_error("Out of memory for a %zu byte request", conn->partial.length + length);
+            mcp_shm_conn_close(conn);
+            return;
+        }
+        if (kind != MCP_SHM_RECORD_PART) {
+            if (conn->partial.length > 0) {
+                mcp_shm_submit(conn, conn->partial.data, conn->partial.length);
+            }
+            conn->partial.length = 0;
+        }
+        mcp_shm_ring_release(ring, consumed);
+        mcp_shm_wake(&ring->producer_waiting, channel->client_wake);
+        count++;
+    }
+    // Replies may have been waiting for the client to make room
+    if (conn->backlog.length > 0) {
+        mcp_shm_schedule_flush(conn);
+    }
+}
+
+static void mcp_shm_poll_run(mcp_task* task) {
+    mcp_shm_conn* conn = (mcp_shm_conn*)((char*)task - offsetof(mcp_shm_conn, poll));
+    conn->poll_posted = false;
+    if (conn->closed) {
+        mcp_shm_maybe_free(conn);
+        return;
+    }
+    mcp_shm_read(conn);
+}
+
+static void mcp_shm_on_wake(mcp_event_handler* handler, unsigned events) {
+    mcp_shm_conn* conn = (mcp_shm_conn*)handler;
+    uint64_t count;
+    (void)events;
+    if (conn->closed || read(handler->fd, &count, sizeof(count)) < 0) {
+        return;
+    }
+    if (!conn->poll_posted) {
+        mcp_shm_read(conn);
+    }
+}
+
+static void mcp_shm_on_control(mcp_event_handler* handler, unsigned events) {
+    mcp_shm_conn* conn = (mcp_shm_conn*)((char*)handler - offsetof(mcp_shm_conn, control));
+    char buffer[64];
+    if (conn->closed) {
+        return;
+    }
+    // Nothing is expected on the socket after the handshake: end of file or an error ends the session
+    ssize_t n = (events & MCP_EVENT_ERROR) ? 0 : recv(handler->fd, buffer, sizeof(buffer), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        mcp_shm_conn_close(conn);
+    }
+}
+
+// Creates the shared rings and their eventfds and hands them to the client
+static int mcp_shm_handshake(mcp_shm_conn* conn, int fd, uint64_t ring_size) {
+    size_t size = mcp_shm_map_size(ring_size);
+    int memory_fd = memfd_create("mcpc-shm", MFD_CLOEXEC);
+    if (memory_fd < 0 || ftruncate(memory_fd, (off_t)size) != 0) {
+        if (memory_fd >= 0) close(memory_fd);
+        return -1;
+    }
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (memory == MAP_FAILED) {
+        close(memory_fd);
+        return -1;
+    }
+    mcp_shm_header* header = (mcp_shm_header*)memory;
+    header->magic = MCP_SHM_MAGIC;
+    header->ring_size = ring_size;
+    // The server starts out asleep: the first request wakes it
+    header->requests.consumer_waiting = 1;
+    mcp_shm_channel_map(&conn->channel, memory, size);
+    conn->channel.control = fd;
+    conn->channel.server_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    conn->channel.client_wake = eventfd(0, EFD_CLOEXEC);
+
+    int fds[3] = { memory_fd, conn->channel.server_wake, conn->channel.client_wake };
+    char byte = 0;
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    int ret = conn->channel.server_wake >= 0 && conn->channel.client_wake >= 0 &&
+              sendmsg(fd, &message, MSG_NOSIGNAL) == 1 ? 0 : -1;
+    // The mapping outlives the descriptor
+    close(memory_fd);
+    return ret;
+}
+
+static void mcp_shm_accept(mcp_event_handler* handler, unsigned events) {
+    mcp_shm_server* server = (mcp_shm_server*)((char*)handler - offsetof(mcp_shm_server, listener));
+    (void)events;
+    for (;;) {
+        int fd = accept4(handler->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        mcp_shm_conn* conn = (mcp_shm_conn*)calloc(1, sizeof(mcp_shm_conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->channel.control = conn->channel.server_wake = conn->channel.client_wake = -1;
+        conn->session = mcp_session_create();
+        if (conn->session == NULL || mcp_writer_init(&conn->backlog, -1, MCP_WRITER_INITIAL_CAPACITY) != 0) {
+            mcp_session_release(conn->session);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        if (mcp_writer_init(&conn->partial, -1, MCP_WRITER_INITIAL_CAPACITY) != 0) {
+            mcp_writer_destroy(&conn->backlog);
+            mcp_session_release(conn->session);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->wake.on_event = mcp_shm_on_wake;
+        conn->control.on_event = mcp_shm_on_control;
+        conn->control.fd = fd;
+        bool ok = mcp_shm_handshake(conn, fd, server->ring_size) == 0;
+        conn->wake.fd = conn->channel.server_wake;
+        if (!ok || mcp_event_loop_add(&server->net->loop, &conn->wake, MCP_EVENT_READ) != 0) {
+            mcp_log_error("Failed to set up a shared-memory client: %s", strerror(errno));
+            mcp_shm_channel_close(&conn->channel);
+            mcp_writer_destroy(&conn->partial);
+            mcp_writer_destroy(&conn->backlog);
+            mcp_session_release(conn->session);
+            free(conn);
+            continue;
+        }
+        if (mcp_event_loop_add(&server->net->loop, &conn->control, MCP_EVENT_READ) != 0) {
+            mcp_event_loop_remove(&server->net->loop, &conn->wake);
+            mcp_shm_channel_close(&conn->channel);
+            mcp_writer_destroy(&conn->partial);
+            mcp_writer_destroy(&conn->backlog);
+            mcp_session_release(conn->session);
+            free(conn);
+            continue;
+        }
+        conn->next = server->conns;
+        if (server->conns != NULL) {
+            server->conns->prev = conn;
+        }
+        server->conns = conn;
+    }
+}
+
+static void mcp_shm_stop(mcp_transport* transport) {
+    mcp_shm_server* server = (mcp_shm_server*)transport;
+    mcp_event_loop_remove(&server->net->loop, &server->listener);
+    close(server->listener.fd);
+    unlink(server->path);
+}
+
+static void mcp_shm_destroy(mcp_transport* transport) {
+    mcp_shm_server* server = (mcp_shm_server*)transport;
+    while (server->conns != NULL) {
+        mcp_shm_conn_close(server->conns);
+    }
+    // Run the deferred frees before the server goes away
+    mcp_event_loop_drain(&server->net->loop);
+    free(server);
+}
+
+// $MCPC_SHM_RING_BYTES rounded up to a power of two
+static uint64_t mcp_shm_ring_size(void) {
+    const char* env = getenv(MCP_SHM_RING_ENV);
+    uint64_t wanted = env != NULL && *env != '\0' ? strtoull(env, NULL, 10) : MCP_SHM_DEFAULT_RING_SIZE;
+    uint64_t size = MCP_SHM_MIN_RING_SIZE;
+    while (size < wanted && size < (1ull << 40)) {
+        size *= 2;
+    }
+    return size;
+}
+
+int mcp_shm_listen(mcp_net* net, const char* path) {
+    struct sockaddr_un address;
+    struct stat info;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    mcp_shm_server* server = (mcp_shm_server*)calloc(1, sizeof(mcp_shm_server));
+    if (!server) {
+        return -1;
+    }
+    server->net = net;
+    server->transport.stop = mcp_shm_stop;
+    server->transport.destroy = mcp_shm_destroy;
+    server->listener.on_event = mcp_shm_accept;
+    server->ring_size = mcp_shm_ring_size();
+    snprintf(server->path, sizeof(server->path), "%s", path);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    // Replace the socket file a previous run left behind, never a regular file
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    server->listener.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listener.fd < 0 ||
+        bind(server->listener.fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listener.fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        if (server->listener.fd >= 0) close(server->listener.fd);
+        free(server);
+        return -1;
+    }
+    if (mcp_event_loop_add(&net->loop, &server->listener, MCP_EVENT_READ) != 0) {
+        fprintf(stderr, "Failed to set up shared-memory server\n");
+        close(server->listener.fd);
+        unlink(path);
+        free(server);
+        return -1;
+    }
+    mcp_net_add(net, &server->transport);
+    fprintf(stderr, "mcp server listening on shm:%s (%llu byte rings)\n", path, (unsigned long long)server->ring_size);
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !__linux__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_shm_listen(mcp_net* net, const char* path) {
+    (void)net;
+    (void)path;
+    fprintf(stderr, "The shared-memory transport is only available on Linux\n");
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
@@ -0,0 +1,42 @@
+#ifndef MCP_SHM_H
+#define MCP_SHM_H
+
+#include "mcp_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes of each ring of a client, rounded up to a power of two
+#define MCP_SHM_RING_ENV "MCPC_SHM_RING_BYTES"
+#define MCP_SHM_DEFAULT_RING_SIZE (1024 * 1024)
+#define MCP_SHM_MIN_RING_SIZE 4096
+// Requests taken from one client before the loop turns to the others
+#define MCP_SHM_BATCH 64
+
+/**
+ * @brief Starts serving clients on the same machine through shared memory,
+ * as a transport of `net`.
+ *
+ * A client connects to the Unix socket at `path` and gets, as SCM_RIGHTS,
+ * a memfd holding a pair of single-producer single-consumer rings (requests
+ * and replies) and two eventfds, one each side sleeps on; the socket itself
+ * carries nothing more and closing it ends the session. Messages are the
+ * same JSON-RPC frames as on the other transports; each is copied once
+ * between its ring and private memory, which the client cannot change
+ * while the server parses or prints it, and a side only makes a system
+ * call to wake the other when it went to sleep. The wire
+ * format is in mcp_shm_ring.h, which is all a client needs.
+ *
+ * Like the Unix socket transport, each client has its own mcp_session and
+ * its requests run concurrently, answered in completion order.
+ *
+ * @return 0 once listening, -1 if the socket could not be set up.
+ */
+int mcp_shm_listen(mcp_net* net, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_SHM_H */
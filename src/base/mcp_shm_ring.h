@@ -0,0 +1,347 @@
+#ifndef MCP_SHM_RING_H
+#define MCP_SHM_RING_H
+
+// Wire format of the shared-memory transport (see mcp_shm.h), shared by the
+// server and its clients. Header-only so a client needs nothing else of mcpc.
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_SHM_MAGIC 0x314d48534350434dull  // "MCPCSHM1"
+
+// Kinds of records in a ring
+#define MCP_SHM_RECORD_MESSAGE 0u  // A whole message, or the last piece of one
+#define MCP_SHM_RECORD_PART 1u     // A piece of a message continued by the next record
+#define MCP_SHM_RECORD_WRAP 2u     // Filler up to the end of the ring, skipped
+
+/**
+ * @brief One direction of the channel: a single-producer single-consumer
+ * byte ring of 8-byte aligned records. `head` and `tail` only grow; their
+ * difference is what the consumer has yet to release. Each side sets its
+ * `waiting` flag before it sleeps on its eventfd and the other side wakes
+ * it after publishing (consumer) or releasing (producer), so neither makes
+ * a system call while the other is busy.
+ */
+typedef struct mcp_shm_ring {
+    volatile uint64_t head;              // Bytes published, written by the producer
+    volatile uint32_t consumer_waiting;  // The consumer sleeps until head moves
+    uint32_t reserved0;
+    char pad0[48];
+    volatile uint64_t tail;              // Bytes released, written by the consumer
+    volatile uint32_t producer_waiting;  // The producer sleeps until tail moves
+    uint32_t reserved1;
+    char pad1[48];
+} mcp_shm_ring;
+
+/**
+ * @brief Start of the shared memory; the request data, then the reply data
+ * (`ring_size` bytes each) follow it.
+ */
+typedef struct mcp_shm_header {
+    uint64_t magic;
+    uint64_t ring_size;    // A power of two
+    char pad[48];
+    mcp_shm_ring requests; // Client to server
+    mcp_shm_ring replies;  // Server to client
+} mcp_shm_header;
+
+typedef struct mcp_shm_record {
+    uint32_t length;  // Payload bytes
+    uint32_t kind;
+} mcp_shm_record;
+
+/**
+ * @brief Either end of a connected channel. The server sleeps on
+ * `server_wake`, the client on `client_wake`; the control socket carries
+ * nothing after the handshake, closing it ends the session.
+ */
+typedef struct mcp_shm_channel {
+    mcp_shm_header* header;
+    size_t map_size;
+    uint64_t ring_size;  // Copied at setup: the peer can write the header
+    char* requests;   // Data of header->requests
+    char* replies;    // Data of header->replies
+    int control;
+    int server_wake;
+    int client_wake;
+} mcp_shm_channel;
+
+static inline size_t mcp_shm_record_size(size_t length) {
+    return (sizeof(mcp_shm_record) + length + 7) & ~(size_t)7;
+}
+
+// Largest piece of a message in one record; longer messages are split
+static inline size_t mcp_shm_max_piece(uint64_t size) {
+    return (size_t)size / 2 - sizeof(mcp_shm_record);
+}
+
+static inline void mcp_shm_channel_map(mcp_shm_channel* channel, void* memory, size_t size) {
+    channel->header = (mcp_shm_header*)memory;
+    channel->map_size = size;
+    channel->ring_size = (size - sizeof(mcp_shm_header)) / 2;
+    channel->requests = (char*)memory + sizeof(mcp_shm_header);
+    channel->replies = channel->requests + channel->ring_size;
+}
+
+static inline size_t mcp_shm_map_size(uint64_t ring_size) {
+    return sizeof(mcp_shm_header) + 2 * (size_t)ring_size;
+}
+
+/**
+ * @brief Producer: contiguous free bytes for the payload of the next record
+ * at the current head, for encoding in place before mcp_shm_ring_commit().
+ */
+static inline char* mcp_shm_ring_reserve(mcp_shm_ring* ring, char* data, uint64_t size, size_t* room) {
+    uint64_t head = ring->head;
+    uint64_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t offset = (size_t)(head & (size - 1));
+    size_t contiguous = (size_t)(size - offset);
+    size_t available = (size_t)(size - used) < contiguous ? (size_t)(size - used) : contiguous;
+    *room = available > sizeof(mcp_shm_record) ? (available - sizeof(mcp_shm_record)) & ~(size_t)7 : 0;
+    return data + offset + sizeof(mcp_shm_record);
+}
+
+// Producer: publishes the record of `length` bytes written at `head`, wrap filler before it included
+static inline void mcp_shm_ring_publish(mcp_shm_ring* ring, char* data, uint64_t size, uint64_t head, size_t length,
+                                        uint32_t kind) {
+    mcp_shm_record* record = (mcp_shm_record*)(data + (head & (size - 1)));
+    record->length = (uint32_t)length;
+    record->kind = kind;
+    // Sequentially consistent, so the consumer's waiting flag is read after it
+    __atomic_store_n(&ring->head, head + mcp_shm_record_size(length), __ATOMIC_SEQ_CST);
+}
+
+// Producer: publishes `length` bytes encoded at the position mcp_shm_ring_reserve() gave
+static inline void mcp_shm_ring_commit(mcp_shm_ring* ring, char* data, uint64_t size, size_t length, uint32_t kind) {
+    mcp_shm_ring_publish(ring, data, size, ring->head, length, kind);
+}
+
+/**
+ * @brief Producer: copies one record in, wrapping to the start when it does
+ * not fit before the end. Returns false when the ring has no room yet.
+ */
+static inline bool mcp_shm_ring_write(mcp_shm_ring* ring, char* data, uint64_t size, const char* bytes,
+                                      size_t length, uint32_t kind) {
+    uint64_t head = ring->head;
+    uint64_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    size_t need = mcp_shm_record_size(length);
+    size_t offset = (size_t)(head & (size - 1));
+    size_t filler = (size_t)(size - offset) < need ? (size_t)(size - offset) : 0;
+    if (size - used < filler + need) {
+        return false;
+    }
+    if (filler != 0) {
+        mcp_shm_record* wrap = (mcp_shm_record*)(data + offset);
+        wrap->length = (uint32_t)(filler - sizeof(mcp_shm_record));
+        wrap->kind = MCP_SHM_RECORD_WRAP;
+        head += filler;
+    }
+    memcpy(data + (head & (size - 1)) + sizeof(mcp_shm_record), bytes, length);
+    mcp_shm_ring_publish(ring, data, size, head, length, kind);
+    return true;
+}
+
+/**
+ * @brief Producer: writes as much of a message as fits, in pieces of at
+ * most mcp_shm_max_piece(); `*sent` carries the progress between calls.
+ * Returns true once the whole message is in the ring.
+ */
+static inline bool mcp_shm_ring_send(mcp_shm_ring* ring, char* data, uint64_t size, const char* message,
+                                     size_t length, size_t* sent) {
+    size_t max_piece = mcp_shm_max_piece(size);
+    while (*sent < length) {
+        size_t piece = length - *sent < max_piece ? length - *sent : max_piece;
+        uint32_t kind = *sent + piece < length ? MCP_SHM_RECORD_PART : MCP_SHM_RECORD_MESSAGE;
+        if (!mcp_shm_ring_write(ring, data, size, message + *sent, piece, kind)) {
+            return false;
+        }
+        *sent += piece;
+    }
+    return true;
+}
+
+/**
+ * @brief Consumer: the next record, in place. `*consumed` is what
+ * mcp_shm_ring_release() must be given once the payload was used, wrap
+ * filler before it included. Returns 1 for a record, 0 when the ring is
+ * empty and -1 when the producer wrote a record that overruns the ring.
+ */
+static inline int mcp_shm_ring_peek(mcp_shm_ring* ring, const char* data, uint64_t size, const char** bytes,
+                                    size_t* length, uint32_t* kind, size_t* consumed) {
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t skipped = 0;
+    for (;;) {
+        if (head == tail) {
+            return 0;
+        }
+        const mcp_shm_record* record = (const mcp_shm_record*)(data + (tail & (size - 1)));
+        uint32_t record_length = record->length;
+        uint32_t record_kind = record->kind;
+        size_t record_size = mcp_shm_record_size(record_length);
+        // The producer is another process: never trust a length past what it published
+        if (head - tail > size || record_size > head - tail || record_size > size - (tail & (size - 1))) {
+            return -1;
+        }
+        if (record_kind == MCP_SHM_RECORD_WRAP) {
+            skipped += record_size;
+            tail += record_size;
+            continue;
+        }
+        *bytes = (const char*)(record + 1);
+        *length = record_length;
+        *kind = record_kind;
+        *consumed = skipped + record_size;
+        return 1;
+    }
+}
+
+static inline void mcp_shm_ring_release(mcp_shm_ring* ring, size_t consumed) {
+    // Sequentially consistent, so the producer's waiting flag is read after it
+    __atomic_store_n(&ring->tail, ring->tail + consumed, __ATOMIC_SEQ_CST);
+}
+
+static inline bool mcp_shm_ring_empty(mcp_shm_ring* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail;
+}
+
+/**
+ * @brief Announces that the caller is about to sleep on its eventfd. The
+ * caller must check its ring again afterwards and only sleep if nothing
+ * changed, since a wake-up may have been skipped just before the flag was
+ * set.
+ */
+static inline void mcp_shm_sleep_on(volatile uint32_t* waiting) {
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+// Wakes the other side through `eventfd` if it announced it is asleep
+static inline void mcp_shm_wake(volatile uint32_t* waiting, int eventfd) {
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) != 0 && __atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST) != 0) {
+        uint64_t one = 1;
+        ssize_t ret = write(eventfd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+/**
+ * @brief Client side: connects to the server's socket at `path` and maps
+ * the channel it hands over. Returns 0, or -1 with errno set.
+ */
+static inline int mcp_shm_connect(const char* path, mcp_shm_channel* channel) {
+    struct sockaddr_un address;
+    memset(channel, 0, sizeof(*channel));
+    channel->control = channel->server_wake = channel->client_wake = -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        int error = errno;
+        if (fd >= 0) close(fd);
+        errno = error;
+        return -1;
+    }
+
+    // One byte, with the memfd and the two eventfds attached
+    char byte;
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t n;
+    while ((n = recvmsg(fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    struct cmsghdr* header = n == 1 ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    int fds[3];
+    memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    struct stat info;
+    void* memory = fstat(fds[0], &info) == 0 && (size_t)info.st_size >= sizeof(mcp_shm_header)
+        ? mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0)
+        : MAP_FAILED;
+    close(fds[0]);
+    uint64_t ring_size = memory != MAP_FAILED ? ((mcp_shm_header*)memory)->ring_size : 0;
+    if (memory == MAP_FAILED || ((mcp_shm_header*)memory)->magic != MCP_SHM_MAGIC || ring_size < 64 ||
+        (ring_size & (ring_size - 1)) != 0 || mcp_shm_map_size(ring_size) != (size_t)info.st_size) {
+        if (memory != MAP_FAILED) munmap(memory, (size_t)info.st_size);
+        close(fds[1]);
+        close(fds[2]);
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    mcp_shm_channel_map(channel, memory, (size_t)info.st_size);
+    channel->control = fd;
+    channel->server_wake = fds[1];
+    channel->client_wake = fds[2];
+    return 0;
+}
+
+/**
+ * @brief Client side: sleeps on client_wake until the server signals or
+ * `timeout_ms` passes (-1 waits forever). Returns 1 when woken, 0 on a
+ * timeout, -1 when the server went away.
+ */
+static inline int mcp_shm_wait(mcp_shm_channel* channel, int timeout_ms) {
+    struct pollfd fds[2] = { { channel->client_wake, POLLIN, 0 }, { channel->control, POLLIN, 0 } };
+    int n = poll(fds, 2, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR ? 1 : -1;
+    }
+    if (fds[1].revents != 0) {
+        return -1;
+    }
+    if (fds[0].revents & POLLIN) {
+        uint64_t count;
+        ssize_t ret = read(channel->client_wake, &count, sizeof(count));
+        (void)ret;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void mcp_shm_channel_close(mcp_shm_channel* channel) {
+    if (channel->header != NULL) munmap(channel->header, channel->map_size);
+    if (channel->control >= 0) close(channel->control);
+    if (channel->server_wake >= 0) close(channel->server_wake);
+    if (channel->client_wake >= 0) close(channel->client_wake);
+    memset(channel, 0, sizeof(*channel));
+    channel->control = channel->server_wake = channel->client_wake = -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
+
+#endif /* MCP_SHM_RING_H */
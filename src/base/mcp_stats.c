@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+#include "mcp_cache.h"
+#include "mcp_flight.h"
+#include "mcp_log.h"
+#include "mcp_module.h"
+#include "mcp_stats.h"
+#include "mcp_thread.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_STATS_SUB_COUNT (1u << MCP_STATS_SUB_BITS)
+
+static const char* const g_phase_names[MCP_STATS_PHASES] = { "parse", "handler", "serialize", "total" };
+
+// Everything one thread recorded for one tool; only that thread writes it
+typedef struct mcp_tool_stats {
+    volatile uint64_t calls;
+    volatile uint64_t errors;
+    volatile uint64_t bytes_in;
+    volatile uint64_t bytes_out;
+    volatile uint64_t sum_ns[MCP_STATS_PHASES];
+    volatile uint64_t max_ns[MCP_STATS_PHASES];
+    volatile uint64_t buckets[MCP_STATS_PHASES][MCP_STATS_BUCKETS];
+} mcp_tool_stats;
+
+// A thread's statistics, kept after the thread exits so its counts are not lost
+typedef struct mcp_stats_shard {
+    struct mcp_stats_shard* next;
+    mcp_tool_stats* volatile tools[];  // bridge_tool_count slots, filled on first use
+} mcp_stats_shard;
+
+static mcp_mutex_t g_shards_lock = MCP_MUTEX_INITIALIZER;
+static mcp_stats_shard* volatile g_shards = NULL;
+static MCP_THREAD_LOCAL mcp_stats_shard* t_shard = NULL;
+static MCP_THREAD_LOCAL int t_tool = -1;
+
+uint64_t mcp_stats_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000000ull +
+           (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000000ull / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static unsigned mcp_stats_bucket(uint64_t ns) {
+    if (ns < MCP_STATS_SUB_COUNT) {
+        return (unsigned)ns;
+    }
+    unsigned exponent = 0;
+    for (uint64_t rest = ns; rest > 1; rest >>= 1) {
+        exponent++;
+    }
+    if (exponent >= MCP_STATS_MAX_BITS) {
+        return MCP_STATS_BUCKETS - 1;
+    }
+    return ((exponent - MCP_STATS_SUB_BITS + 1) << MCP_STATS_SUB_BITS) +
+           (unsigned)((ns >> (exponent - MCP_STATS_SUB_BITS)) & (MCP_STATS_SUB_COUNT - 1));
+}
+
+// Highest value that lands in `bucket`
+static uint64_t mcp_stats_bucket_limit(unsigned bucket) {
+    if (bucket < MCP_STATS_SUB_COUNT) {
+        return bucket;
+    }
+    unsigned shift = (bucket >> MCP_STATS_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)(MCP_STATS_SUB_COUNT + (bucket & (MCP_STATS_SUB_COUNT - 1))) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+// The calling thread's slot for `tool`, created on first use; NULL for unknown tools
+static mcp_tool_stats* mcp_stats_slot(int tool) {
+    if (tool < 0 || (unsigned)tool >= bridge_tool_count) {
+        return NULL;
+    }
+    mcp_stats_shard* shard = t_shard;
+    if (shard == NULL) {
+        shard = (mcp_stats_shard*)calloc(1, sizeof(mcp_stats_shard) + bridge_tool_count * sizeof(shard->tools[0]));
+        if (shard == NULL) {
+            return NULL;
+        }
+        mcp_mutex_lock(&g_shards_lock);
+        shard->next = g_shards;
+        mcp_atomic_store_ptr((void* volatile*)&g_shards, shard);
+        mcp_mutex_unlock(&g_shards_lock);
+        t_shard = shard;
+    }
+    mcp_tool_stats* stats = shard->tools[tool];
+    if (stats == NULL) {
+        stats = (mcp_tool_stats*)calloc(1, sizeof(mcp_tool_stats));
+        if (stats == NULL) {
+            return NULL;
+        }
+        mcp_atomic_store_ptr((void* volatile*)&shard->tools[tool], stats);
+    }
+    return stats;
+}
+
+static void mcp_stats_record(mcp_tool_stats* stats, mcp_stats_phase phase, uint64_t ns) {
+    mcp_counter_add(&stats->buckets[phase][mcp_stats_bucket(ns)], 1);
+    mcp_counter_add(&stats->sum_ns[phase], ns);
+    if (ns > mcp_counter_load(&stats->max_ns[phase])) {
+        mcp_counter_store(&stats->max_ns[phase], ns);
+    }
+}
+
+uint64_t mcp_stats_begin(unsigned tool) {
+    t_tool = (int)tool;
+    return mcp_stats_now_ns();
+}
+
+void mcp_stats_lap(unsigned tool, mcp_stats_phase phase, uint64_t* mark) {
+    uint64_t now = mcp_stats_now_ns();
+    mcp_tool_stats* stats = mcp_stats_slot((int)tool);
+    if (stats != NULL) {
+        mcp_stats_record(stats, phase, now - *mark);
+    }
+    *mark = now;
+}
+
+int mcp_stats_current(void) {
+    return t_tool;
+}
+
+void mcp_stats_set_current(int tool) {
+    t_tool = tool;
+}
+
+void mcp_stats_call(int tool, bool error, uint64_t total_ns, size_t bytes_in) {
+    mcp_tool_stats* stats = mcp_stats_slot(tool);
+    if (stats == NULL) {
+        return;
+    }
+    mcp_counter_add(&stats->calls, 1);
+    if (error) {
+        mcp_counter_add(&stats->errors, 1);
+    }
+    mcp_counter_add(&stats->bytes_in, bytes_in);
+    mcp_stats_record(stats, MCP_STATS_TOTAL, total_ns);
+}
+
+void mcp_stats_bytes_out(int tool, size_t bytes) {
+    mcp_tool_stats* stats = mcp_stats_slot(tool);
+    if (stats != NULL) {
+        mcp_counter_add(&stats->bytes_out, bytes);
+    }
+}
+
+// Adds every thread's slot for `tool` into `sum`; returns false when no thread recorded any
+static bool mcp_stats_collect(unsigned tool, mcp_tool_stats* sum) {
+    bool seen = false;
+    memset(sum, 0, sizeof(*sum));
+    for (mcp_stats_shard* shard = (mcp_stats_shard*)mcp_atomic_load_ptr((void* volatile*)&g_shards);
+         shard != NULL; shard = shard->next) {
+        mcp_tool_stats* stats = (mcp_tool_stats*)mcp_atomic_load_ptr((void* volatile*)&shard->tools[tool]);
+        if (stats == NULL) {
+            continue;
+        }
+        seen = true;
+        sum->calls += mcp_counter_load(&stats->calls);
+        sum->errors += mcp_counter_load(&stats->errors);
+        sum->bytes_in += mcp_counter_load(&stats->bytes_in);
+        sum->bytes_out += mcp_counter_load(&stats->bytes_out);
+        for (unsigned phase = 0; phase < MCP_STATS_PHASES; ++phase) {
+            sum->sum_ns[phase] += mcp_counter_load(&stats->sum_ns[phase]);
+            uint64_t max = mcp_counter_load(&stats->max_ns[phase]);
+            if (max > sum->max_ns[phase]) {
+                sum->max_ns[phase] = max;
+            }
+            for (unsigned bucket = 0; bucket < MCP_STATS_BUCKETS; ++bucket) {
+                sum->buckets[phase][bucket] += mcp_counter_load(&stats->buckets[phase][bucket]);
+            }
+        }
+    }
+    return seen;
+}
+
+static cJSON* mcp_stats_phase_json(const mcp_tool_stats* sum, unsigned phase) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char* const names[] = { "p50", "p90", "p99", "p999" };
+    uint64_t count = 0;
+    for (unsigned bucket = 0; bucket < MCP_STATS_BUCKETS; ++bucket) {
+        count += sum->buckets[phase][bucket];
+    }
+    cJSON* json = cJSON_CreateObject();
+    if (json == NULL) {
+        return NULL;
+    }
+    cJSON_AddNumberToObject(json, "count", (double)count);
+    if (count == 0) {
+        return json;
+    }
+    cJSON_AddNumberToObject(json, "mean", (double)(sum->sum_ns[phase] / count));
+    unsigned bucket = 0;
+    uint64_t seen = 0;
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+        uint64_t rank = (uint64_t)(quantiles[q] * (double)count + 0.999999);
+        while (bucket < MCP_STATS_BUCKETS - 1 && seen + sum->buckets[phase][bucket] < rank) {
+            seen += sum->buckets[phase][bucket];
+            bucket++;
+        }
+        uint64_t limit = mcp_stats_bucket_limit(bucket);
+        cJSON_AddNumberToObject(json, names[q], (double)(limit < sum->max_ns[phase] ? limit : sum->max_ns[phase]));
+    }
+    cJSON_AddNumberToObject(json, "max", (double)sum->max_ns[phase]);
+    return json;
+}
+
+cJSON* mcp_stats_report(void) {
+    cJSON* report = cJSON_CreateObject();
+    cJSON* tools = cJSON_AddArrayToObject(report, "tools");
+    mcp_tool_stats* sum = (mcp_tool_stats*)malloc(sizeof(mcp_tool_stats));
+    if (tools == NULL || sum == NULL) {
+        free(sum);
+        cJSON_Delete(report);
+        return NULL;
+    }
+    for (unsigned tool = 0; tool < bridge_tool_count; ++tool) {
+        if (!mcp_stats_collect(tool, sum)) {
+            continue;
+        }
+        cJSON* entry = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry, "name", bridge_tool_names[tool]);
+        cJSON_AddNumberToObject(entry, "calls", (double)sum->calls);
+        cJSON_AddNumberToObject(entry, "errors", (double)sum->errors);
+        cJSON_AddNumberToObject(entry, "bytes_in", (double)sum->bytes_in);
+        cJSON_AddNumberToObject(entry, "bytes_out", (double)sum->bytes_out);
+        cJSON* latency = cJSON_AddObjectToObject(entry, "latency_ns");
+        for (unsigned phase = 0; phase < MCP_STATS_PHASES; ++phase) {
+            cJSON_AddItemToObject(latency, g_phase_names[phase], mcp_stats_phase_json(sum, phase));
+        }
+        cJSON_AddItemToArray(tools, entry);
+    }
+    free(sum);
+    cJSON_AddItemToObject(report, "cache", mcp_cache_report());
+    cJSON_AddItemToObject(report, "single_flight", mcp_flight_report());
+    cJSON_AddItemToObject(report, "log", mcp_log_report());
+    cJSON_AddItemToObject(report, "modules", mcp_module_report());
+    return report;
+}
+
+int mcp_stats_dump(const char* path) {
+    cJSON* report = mcp_stats_report();
+    char* text = report != NULL ? cJSON_Print(report) : NULL;
+    cJSON_Delete(report);
+    if (text == NULL) {
+        return -1;
+    }
+    char temporary[4096];
+    int ret = -1;
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) < (int)sizeof(temporary)) {
+        FILE* file = fopen(temporary, "w");
+        if (file != NULL) {
+            int written = fputs(text, file) >= 0 && fputc('\n', file) != EOF;
+            if (fclose(file) == 0 && written && rename(temporary, path) == 0) {
+                ret = 0;
+            } else {
+                remove(temporary);
+            }
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Failed to write statistics to %s\n", path);
+    }
+    cJSON_free(text);
+    return ret;
+}
+
+#ifndef _WIN32
+static sem_t g_dump_requested;
+static mcp_thread_t g_dump_thread;
+static const char* g_dump_path = NULL;
+static volatile long g_dump_stopping = 0;
+
+static void mcp_stats_on_signal(int signo) {
+    (void)signo;
+    sem_post(&g_dump_requested);  // Async-signal-safe, the dump itself runs on the dumper thread
+}
+
+static void* mcp_stats_dumper_main(void* arg) {
+    (void)arg;
+    for (;;) {
+        if (sem_wait(&g_dump_requested) != 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+        if (mcp_atomic_load(&g_dump_stopping)) {
+            return NULL;
+        }
+        mcp_stats_dump(g_dump_path);
+    }
+}
+
+int mcp_stats_start_dumper(void) {
+    g_dump_path = getenv(MCP_STATS_FILE_ENV);
+    if (g_dump_path == NULL || *g_dump_path == '\0') {
+        g_dump_path = NULL;
+        return 0;
+    }
+    if (sem_init(&g_dump_requested, 0, 0) != 0) {
+        g_dump_path = NULL;
+        return -1;
+    }
+    mcp_atomic_store(&g_dump_stopping, 0);
+    if (mcp_thread_create(&g_dump_thread, mcp_stats_dumper_main, NULL) != 0) {
+        sem_destroy(&g_dump_requested);
+        g_dump_path = NULL;
+        return -1;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = mcp_stats_on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    return 0;
+}
+
+void mcp_stats_stop_dumper(void) {
+    if (g_dump_path == NULL) {
+        return;
+    }
+    signal(SIGUSR1, SIG_IGN);
+    mcp_atomic_store(&g_dump_stopping, 1);
+    sem_post(&g_dump_requested);
+    mcp_thread_join(g_dump_thread);
+    sem_destroy(&g_dump_requested);
+    g_dump_path = NULL;
+}
+#else
+int mcp_stats_start_dumper(void) {
+    return 0;
+}
+
+void mcp_stats_stop_dumper(void) {
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
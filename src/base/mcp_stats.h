@@ -0,0 +1,103 @@
+#ifndef MCP_STATS_H
+#define MCP_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reserved JSON-RPC method answering with the statistics of every tool
+#define MCP_STATS_METHOD "mcpc/stats"
+// When set, SIGUSR1 writes the same report to this file
+#define MCP_STATS_FILE_ENV "MCPC_STATS_FILE"
+
+// Histogram buckets: 2^3 linear sub-buckets per power of two keep every
+// bucket within 12.5% of its values; latencies are in nanoseconds and
+// saturate at 2^40 ns (about 18 minutes)
+#define MCP_STATS_SUB_BITS 3
+#define MCP_STATS_MAX_BITS 40
+#define MCP_STATS_BUCKETS ((MCP_STATS_MAX_BITS - MCP_STATS_SUB_BITS + 1) << MCP_STATS_SUB_BITS)
+
+typedef enum mcp_stats_phase {
+    MCP_STATS_PARSE,      // Parameters decoded into C values (generated handler)
+    MCP_STATS_HANDLER,    // The exported function itself
+    MCP_STATS_SERIALIZE,  // Return value converted back to JSON (generated handler)
+    MCP_STATS_TOTAL,      // Worker pickup to reply, including async completion
+    MCP_STATS_PHASES
+} mcp_stats_phase;
+
+// Names of the exported tools, indexed by the ids the generated handlers
+// record under (emitted with bridge())
+extern const char* const bridge_tool_names[];
+extern const unsigned bridge_tool_count;
+
+uint64_t mcp_stats_now_ns(void);
+
+/**
+ * @brief Marks the calling thread as running tool `tool` and returns the
+ * start of its first phase. Called first thing by a generated handler.
+ */
+uint64_t mcp_stats_begin(unsigned tool);
+
+/**
+ * @brief Records the time since `*mark` under `phase` and moves the mark to now.
+ */
+void mcp_stats_lap(unsigned tool, mcp_stats_phase phase, uint64_t* mark);
+
+/**
+ * @brief Tool that the request running on this thread has called, or -1.
+ * Set by mcp_stats_begin(), cleared with mcp_stats_set_current(-1).
+ */
+int mcp_stats_current(void);
+void mcp_stats_set_current(int tool);
+
+/**
+ * @brief Records one finished call of `tool`.
+ *
+ * @param total_ns Time from worker pickup to the reply.
+ * @param bytes_in Size of the request as received, 0 when unknown.
+ */
+void mcp_stats_call(int tool, bool error, uint64_t total_ns, size_t bytes_in);
+
+/**
+ * @brief Records the encoded size of a reply to `tool`. Transports call it
+ * once they have written the reply out, with the tool their sink's send()
+ * saw in mcp_stats_current() (-1 for replies no tool produced).
+ */
+void mcp_stats_bytes_out(int tool, size_t bytes);
+
+/**
+ * @brief Report of every tool that has been called: counters and, per
+ * phase, the count, mean, max and p50/p90/p99/p99.9 in nanoseconds, and
+ * the counters of the result cache of PURE tools (see mcp_cache_report())
+ * and of coalesced calls (see mcp_flight_report()).
+ * Allocated with the current arena, like any reply.
+ *
+ * Recording is lock-free: each thread owns its histograms and only the
+ * reader walks all of them, so a report is a consistent-enough snapshot
+ * rather than an atomic one.
+ */
+cJSON* mcp_stats_report(void);
+
+/**
+ * @brief Writes the report to `path` (through a temporary file and a
+ * rename). Returns 0 or -1.
+ */
+int mcp_stats_dump(const char* path);
+
+/**
+ * @brief Dumps the report to $MCPC_STATS_FILE whenever the process gets
+ * SIGUSR1. Does nothing when the variable is unset or on Windows.
+ */
+int mcp_stats_start_dumper(void);
+void mcp_stats_stop_dumper(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_STATS_H */
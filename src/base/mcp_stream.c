@@ -0,0 +1,560 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_stream.h"
+#include "mcp_dispatch.h"
+#include "mcp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_STREAM_OBJECT 1
+#define MCP_STREAM_ARRAY 2
+
+// A buffered reply starts this small and grows as needed
+#define MCP_STREAM_BUFFERED_SIZE 4096
+
+// A streamed reply is the envelope mcp_result_response() builds, written around the result
+static const char g_reply_head[] = "{\"result\":";
+static const char g_reply_id[] = ",\"id\":";
+static const char g_reply_tail[] = ",\"jsonrpc\":\"2.0\"}";
+
+struct mcp_stream {
+    mcp_call* call;
+    mcp_sink* sink;        // Takes the chunks; NULL when the result is buffered whole
+    char* data;
+    size_t length;
+    size_t capacity;
+    size_t start;          // Where the result begins in `data`, until a piece went out
+    bool claimed;          // The reply is this stream's, the deadline no longer answers
+    bool sent;             // The transport took the first piece and expects the last one
+    bool failed;           // Output is dropped from here on
+    bool done;             // The result value is complete
+    bool key_pending;      // A member name was written, its value is due
+    int error;             // mcp_stream_fail() replaced the result with this error
+    char* error_message;
+    int depth;
+    unsigned char kinds[MCP_STREAM_MAX_DEPTH];
+    size_t counts[MCP_STREAM_MAX_DEPTH];
+};
+
+// Hands the chunk to the transport and starts the next one; nothing goes out
+// before the call is claimed, and nothing once the stream failed
+static void mcp_stream_flush(mcp_stream* stream, bool last) {
+    if (!stream->claimed) {
+        if (!stream->failed && !mcp_cancel_requested(mcp_call_cancel_token(stream->call)) &&
+            mcp_call_claim(stream->call)) {
+            stream->claimed = true;
+        } else {
+            // Cancelled or timed out before the first byte: the client gets no result from here
+            stream->failed = true;
+        }
+    }
+    if (stream->failed && !(last && stream->sent)) {
+        stream->length = stream->start;
+        return;
+    }
+    // The last piece of a failed stream still goes, so the transport lets go of the connection
+    char* chunk = stream->data;
+    size_t length = stream->length;
+    bool first = !stream->sent;
+    char* next = NULL;
+    if (!last) {
+        next = (char*)malloc(MCP_STREAM_CHUNK_SIZE);
+        if (next == NULL) {
+            mcp_log_error("Out of memory streaming a result, the rest is dropped");
+            stream->failed = true;
+            stream->length = 0;
+            return;
+        }
+    }
+    stream->data = next;
+    stream->length = 0;
+    stream->start = 0;
+    stream->capacity = next != NULL ? MCP_STREAM_CHUNK_SIZE : 0;
+    if (stream->sink->send_chunk(stream->sink, chunk, length, first, last) != 0) {
+        stream->failed = true;
+    } else if (first) {
+        stream->sent = true;
+    }
+}
+
+// Room for `extra` more bytes: a full chunk goes out first, a buffered result grows
+static bool mcp_stream_reserve(mcp_stream* stream, size_t extra) {
+    if (stream->length + extra <= stream->capacity) {
+        return true;
+    }
+    if (stream->failed && !stream->sent) {
+        // None of it is sent: start over instead of growing
+        stream->length = stream->start;
+        return stream->length + extra <= stream->capacity;
+    }
+    if (stream->sink != NULL && extra <= MCP_STREAM_CHUNK_SIZE) {
+        mcp_stream_flush(stream, false);
+        if (stream->length + extra <= stream->capacity) {
+            return true;
+        }
+        if (stream->failed) {
+            return false;
+        }
+    }
+    size_t capacity = stream->capacity > 0 ? stream->capacity : MCP_STREAM_BUFFERED_SIZE;
+    while (capacity < stream->length + extra) {
+        capacity *= 2;
+    }
+    char* data = (char*)realloc(stream->data, capacity);
+    if (data == NULL) {
+        mcp_log_error("Out of memory streaming a result, the rest is dropped");
+        stream->failed = true;
+        stream->length = stream->start;
+        return false;
+    }
+    stream->data = data;
+    stream->capacity = capacity;
+    return true;
+}
+
+// Copies `length` bytes in, a chunk at a time
+static void mcp_stream_put(mcp_stream* stream, const char* bytes, size_t length) {
+    while (length > 0) {
+        size_t room = stream->capacity - stream->length;
+        if (room == 0) {
+            if (!mcp_stream_reserve(stream, length < MCP_STREAM_CHUNK_SIZE ? length : MCP_STREAM_CHUNK_SIZE)) {
+                return;
+            }
+            room = stream->capacity - stream->length;
+        }
+        size_t n = length < room ? length : room;
+        memcpy(stream->data + stream->length, bytes, n);
+        stream->length += n;
+        bytes += n;
+        length -= n;
+    }
+}
+
+// A JSON string, escaped the way cJSON prints it, straight into the chunk
+static void mcp_stream_escape(mcp_stream* stream, const char* value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+    size_t i = 0;
+    mcp_stream_put(stream, "\"", 1);
+    while (i < length) {
+        // The longest escape is \u00XX
+        if (!mcp_stream_reserve(stream, 6)) {
+            return;
+        }
+        if (i > 0 && mcp_stream_failed(stream)) {
+            // Nobody reads the rest: end the string at this chunk
+            break;
+        }
+        char* out = stream->data + stream->length;
+        size_t room = stream->capacity - stream->length;
+        size_t n = 0;
+        while (i < length && n + 6 <= room) {
+            unsigned char c = (unsigned char)value[i++];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                out[n++] = (char)c;
+                continue;
+            }
+            out[n++] = '\\';
+            switch (c) {
+            case '"': out[n++] = '"'; break;
+            case '\\': out[n++] = '\\'; break;
+            case '\b': out[n++] = 'b'; break;
+            case '\f': out[n++] = 'f'; break;
+            case '\n': out[n++] = 'n'; break;
+            case '\r': out[n++] = 'r'; break;
+            case '\t': out[n++] = 't'; break;
+            default:
+                out[n++] = 'u';
+                out[n++] = '0';
+                out[n++] = '0';
+                out[n++] = hex[c >> 4];
+                out[n++] = hex[c & 0xf];
+                break;
+            }
+        }
+        stream->length += n;
+    }
+    mcp_stream_put(stream, "\"", 1);
+}
+
+static void mcp_stream_put_number(mcp_stream* stream, double value) {
+    char text[32];
+    int length;
+    if (!isfinite(value)) {
+        length = snprintf(text, sizeof(text), "null");
+    } else {
+        // Shortest of the two that reads back as the same double
+        length = snprintf(text, sizeof(text), "%1.15g", value);
+        if (strtod(text, NULL) != value) {
+            length = snprintf(text, sizeof(text), "%1.17g", value);
+        }
+    }
+    mcp_stream_put(stream, text, (size_t)length);
+}
+
+static void mcp_stream_misuse(const char* message) {
+    mcp_log_error("Ignoring streamed %s", message);
+}
+
+// Separator and bookkeeping ahead of a value; false when no value may go here
+static bool mcp_stream_value(mcp_stream* stream) {
+    if (stream->depth == 0) {
+        if (stream->done) {
+            mcp_stream_misuse("value after the result");
+            return false;
+        }
+        return true;
+    }
+    int top = stream->depth - 1;
+    if (stream->kinds[top] == MCP_STREAM_OBJECT) {
+        if (!stream->key_pending) {
+            mcp_stream_misuse("object member without a key");
+            return false;
+        }
+        stream->key_pending = false;
+        return true;
+    }
+    if (stream->counts[top]++ > 0) {
+        mcp_stream_put(stream, ",", 1);
+    }
+    return true;
+}
+
+// A value at the top level is the whole result
+static void mcp_stream_value_done(mcp_stream* stream) {
+    if (stream->depth == 0) {
+        stream->done = true;
+    }
+}
+
+mcp_stream* mcp_stream_open(void) {
+    mcp_call* call = mcp_call_detach();
+    if (call == NULL) {
+        return NULL;
+    }
+    mcp_stream* stream = (mcp_stream*)calloc(1, sizeof(mcp_stream));
+    // A batch is answered as one array and a notification not at all, so only
+    // a lone request goes out in pieces, if its transport takes them
+    bool pieces = call->sink->send_chunk != NULL && call->batch == NULL && call->id != NULL;
+    if (stream != NULL) {
+        stream->call = call;
+        stream->capacity = pieces ? MCP_STREAM_CHUNK_SIZE : MCP_STREAM_BUFFERED_SIZE;
+        stream->data = (char*)malloc(stream->capacity);
+    }
+    if (stream == NULL || stream->data == NULL) {
+        free(stream);
+        mcp_call_fail(call, MCP_ERROR_INTERNAL, "Out of memory");
+        return NULL;
+    }
+    if (pieces) {
+        stream->sink = call->sink;
+        memcpy(stream->data, g_reply_head, sizeof(g_reply_head) - 1);
+        stream->length = stream->start = sizeof(g_reply_head) - 1;
+    }
+    return stream;
+}
+
+void mcp_stream_close(mcp_stream* stream) {
+    if (stream == NULL) {
+        return;
+    }
+    mcp_call* call = stream->call;
+    if (stream->error != 0) {
+        int code = stream->error;
+        char* message = stream->error_message;
+        free(stream->data);
+        free(stream);
+        mcp_call_fail(call, code, message != NULL ? message : "Failed to stream the result");
+        free(message);
+        return;
+    }
+    if (stream->key_pending) {
+        mcp_stream_put(stream, "null", 4);
+        stream->key_pending = false;
+    }
+    if (stream->depth > 0) {
+        // Closing the outermost container completes the result
+        stream->done = true;
+    }
+    while (stream->depth > 0) {
+        stream->depth--;
+        mcp_stream_put(stream, stream->kinds[stream->depth] == MCP_STREAM_OBJECT ? "}" : "]", 1);
+    }
+    if (!stream->done) {
+        mcp_stream_put(stream, "null", 4);
+    }
+
+    if (stream->sink != NULL && (stream->claimed || stream->failed)) {
+        if (stream->sent) {
+            mcp_stream_put(stream, g_reply_id, sizeof(g_reply_id) - 1);
+            if (cJSON_IsString(call->id)) {
+                mcp_stream_escape(stream, call->id->valuestring, strlen(call->id->valuestring));
+            } else {
+                mcp_stream_put_number(stream, call->id->valuedouble);
+            }
+            mcp_stream_put(stream, g_reply_tail, sizeof(g_reply_tail) - 1);
+            mcp_stream_flush(stream, true);
+        }
+        free(stream->data);
+        free(stream);
+        // The reply went out in pieces, or is dropped
+        mcp_call_sent(call);
+        return;
+    }
+
+    // Everything fit into one chunk, or the transport takes whole replies only
+    cJSON* result = NULL;
+    if (!stream->failed && mcp_stream_reserve(stream, 1)) {
+        stream->data[stream->length] = '\0';
+        result = cJSON_CreateRaw(stream->data + stream->start);
+    }
+    free(stream->data);
+    free(stream);
+    if (result != NULL) {
+        mcp_call_complete(call, result);
+    } else {
+        mcp_call_fail(call, MCP_ERROR_INTERNAL, "Failed to stream the result");
+    }
+}
+
+void mcp_stream_begin_object(mcp_stream* stream) {
+    if (stream->depth == MCP_STREAM_MAX_DEPTH) {
+        mcp_stream_misuse("object nested too deeply");
+        return;
+    }
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    mcp_stream_put(stream, "{", 1);
+    stream->kinds[stream->depth] = MCP_STREAM_OBJECT;
+    stream->counts[stream->depth] = 0;
+    stream->depth++;
+}
+
+void mcp_stream_end_object(mcp_stream* stream) {
+    if (stream->depth == 0 || stream->kinds[stream->depth - 1] != MCP_STREAM_OBJECT || stream->key_pending) {
+        mcp_stream_misuse("end of an object that is not open or misses a value");
+        return;
+    }
+    mcp_stream_put(stream, "}", 1);
+    stream->depth--;
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_begin_array(mcp_stream* stream) {
+    if (stream->depth == MCP_STREAM_MAX_DEPTH) {
+        mcp_stream_misuse("array nested too deeply");
+        return;
+    }
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    mcp_stream_put(stream, "[", 1);
+    stream->kinds[stream->depth] = MCP_STREAM_ARRAY;
+    stream->counts[stream->depth] = 0;
+    stream->depth++;
+}
+
+void mcp_stream_end_array(mcp_stream* stream) {
+    if (stream->depth == 0 || stream->kinds[stream->depth - 1] != MCP_STREAM_ARRAY) {
+        mcp_stream_misuse("end of an array that is not open");
+        return;
+    }
+    mcp_stream_put(stream, "]", 1);
+    stream->depth--;
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_key(mcp_stream* stream, const char* key) {
+    if (stream->depth == 0 || stream->kinds[stream->depth - 1] != MCP_STREAM_OBJECT || stream->key_pending ||
+        key == NULL) {
+        mcp_stream_misuse("key outside of an object");
+        return;
+    }
+    if (stream->counts[stream->depth - 1]++ > 0) {
+        mcp_stream_put(stream, ",", 1);
+    }
+    mcp_stream_escape(stream, key, strlen(key));
+    mcp_stream_put(stream, ":", 1);
+    stream->key_pending = true;
+}
+
+void mcp_stream_string(mcp_stream* stream, const char* value) {
+    mcp_stream_string_length(stream, value, value != NULL ? strlen(value) : 0);
+}
+
+void mcp_stream_string_length(mcp_stream* stream, const char* value, size_t length) {
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    if (value != NULL) {
+        mcp_stream_escape(stream, value, length);
+    } else {
+        mcp_stream_put(stream, "null", 4);
+    }
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_number(mcp_stream* stream, double value) {
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    mcp_stream_put_number(stream, value);
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_bool(mcp_stream* stream, bool value) {
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    mcp_stream_put(stream, value ? "true" : "false", value ? 4 : 5);
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_null(mcp_stream* stream) {
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    mcp_stream_put(stream, "null", 4);
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_base64(mcp_stream* stream, const void* data, size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    const unsigned char* bytes = (const unsigned char*)data;
+    mcp_stream_put(stream, "\"", 1);
+    while (length > 0) {
+        if (!mcp_stream_reserve(stream, 4)) {
+            return;
+        }
+        if (bytes != data && mcp_stream_failed(stream)) {
+            break;
+        }
+        char* out = stream->data + stream->length;
+        size_t room = stream->capacity - stream->length;
+        size_t n = 0;
+        // Whole groups of three while they fit, then the padded rest
+        while (length >= 3 && n + 4 <= room) {
+            unsigned group = (unsigned)bytes[0] << 16 | (unsigned)bytes[1] << 8 | bytes[2];
+            out[n++] = alphabet[group >> 18];
+            out[n++] = alphabet[(group >> 12) & 0x3f];
+            out[n++] = alphabet[(group >> 6) & 0x3f];
+            out[n++] = alphabet[group & 0x3f];
+            bytes += 3;
+            length -= 3;
+        }
+        if (length > 0 && length < 3 && n + 4 <= room) {
+            unsigned group = (unsigned)bytes[0] << 16 | (length > 1 ? (unsigned)bytes[1] << 8 : 0u);
+            out[n++] = alphabet[group >> 18];
+            out[n++] = alphabet[(group >> 12) & 0x3f];
+            out[n++] = length > 1 ? alphabet[(group >> 6) & 0x3f] : '=';
+            out[n++] = '=';
+            length = 0;
+        }
+        stream->length += n;
+    }
+    mcp_stream_put(stream, "\"", 1);
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_json(mcp_stream* stream, const cJSON* item) {
+    if (!mcp_stream_value(stream)) {
+        return;
+    }
+    char* text = item != NULL ? cJSON_PrintUnformatted(item) : NULL;
+    if (text != NULL) {
+        mcp_stream_put(stream, text, strlen(text));
+        cJSON_free(text);
+    } else {
+        mcp_stream_put(stream, "null", 4);
+    }
+    mcp_stream_value_done(stream);
+}
+
+void mcp_stream_fail(mcp_stream* stream, int code, const char* message) {
+    if (stream->error != 0) {
+        return;
+    }
+    if (stream->claimed) {
+        // Part of the result may be out already; the client gets it cut short
+        mcp_log_error("Streamed result failed after it started: %s", message != NULL ? message : "");
+        stream->failed = true;
+        return;
+    }
+    stream->error = code;
+    if (message != NULL) {
+        size_t length = strlen(message) + 1;
+        stream->error_message = (char*)malloc(length);
+        if (stream->error_message != NULL) {
+            memcpy(stream->error_message, message, length);
+        }
+    }
+    stream->failed = true;
+    stream->length = stream->start;
+}
+
+bool mcp_stream_failed(mcp_stream* stream) {
+    return stream == NULL || stream->failed || mcp_cancel_requested(mcp_call_cancel_token(stream->call));
+}
+
+void mcp_stream_gate_init(mcp_stream_gate* gate) {
+    memset(gate, 0, sizeof(*gate));
+    mcp_mutex_init(&gate->lock);
+    mcp_cond_init(&gate->changed);
+}
+
+void mcp_stream_gate_destroy(mcp_stream_gate* gate) {
+    mcp_cond_destroy(&gate->changed);
+    mcp_mutex_destroy(&gate->lock);
+}
+
+int mcp_stream_gate_enter(mcp_stream_gate* gate, size_t length, bool first) {
+    mcp_mutex_lock(&gate->lock);
+    while (first && gate->busy && !gate->closed) {
+        mcp_cond_wait(&gate->changed, &gate->lock);
+    }
+    if (first && !gate->closed) {
+        gate->busy = true;
+    }
+    // A piece larger than the window still goes once the earlier ones are written
+    while (!gate->closed && gate->queued > 0 && gate->queued + length > MCP_STREAM_WINDOW) {
+        mcp_cond_wait(&gate->changed, &gate->lock);
+    }
+    int ret = gate->closed ? -1 : 0;
+    if (ret == 0) {
+        gate->queued += length;
+    }
+    mcp_mutex_unlock(&gate->lock);
+    return ret;
+}
+
+void mcp_stream_gate_leave(mcp_stream_gate* gate) {
+    mcp_mutex_lock(&gate->lock);
+    gate->busy = false;
+    mcp_cond_broadcast(&gate->changed);
+    mcp_mutex_unlock(&gate->lock);
+}
+
+void mcp_stream_gate_written(mcp_stream_gate* gate, size_t length) {
+    mcp_mutex_lock(&gate->lock);
+    gate->queued = length < gate->queued ? gate->queued - length : 0;
+    mcp_cond_broadcast(&gate->changed);
+    mcp_mutex_unlock(&gate->lock);
+}
+
+void mcp_stream_gate_close(mcp_stream_gate* gate) {
+    mcp_mutex_lock(&gate->lock);
+    gate->closed = true;
+    mcp_cond_broadcast(&gate->changed);
+    mcp_mutex_unlock(&gate->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef MCP_STREAM_H
+#define MCP_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "cJSON.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bytes of a streamed reply handed to the transport at a time
+#define MCP_STREAM_CHUNK_SIZE (64 * 1024)
+// Bytes a transport may hold unwritten before the handler waits for the client
+#define MCP_STREAM_WINDOW (4 * MCP_STREAM_CHUNK_SIZE)
+// Objects and arrays open at once
+#define MCP_STREAM_MAX_DEPTH 64
+
+/**
+ * @brief Writer of a streamed result (EXPORT_STREAM_AS). The handler emits
+ * exactly one value, the tool's result, and the stream encodes it as compact
+ * JSON into fixed-size chunks that go to the transport while the handler is
+ * still running, so neither a cJSON tree nor the whole text is ever held.
+ *
+ * Transports that cannot stream, and requests inside a batch, get the text
+ * buffered and sent as one reply instead; handlers do not see a difference.
+ * Misuse (a value where a key is due, unbalanced ends) is logged and the
+ * offending call ignored.
+ */
+typedef struct mcp_stream mcp_stream;
+
+/**
+ * @brief Takes the running request off the synchronous path, like
+ * mcp_call_detach(), and opens its result stream. Called by generated
+ * EXPORT_STREAM_AS handlers before the user function; NULL outside of a
+ * request or out of memory.
+ */
+mcp_stream* mcp_stream_open(void);
+
+/**
+ * @brief Ends the reply and frees the stream. Containers left open are
+ * closed and a missing result is written as null, so the client always gets
+ * valid JSON, cut short if the handler stopped early.
+ */
+void mcp_stream_close(mcp_stream* stream);
+
+void mcp_stream_begin_object(mcp_stream* stream);
+void mcp_stream_end_object(mcp_stream* stream);
+void mcp_stream_begin_array(mcp_stream* stream);
+void mcp_stream_end_array(mcp_stream* stream);
+
+/**
+ * @brief Names the next member of the innermost object.
+ */
+void mcp_stream_key(mcp_stream* stream, const char* key);
+
+/**
+ * @brief Writes a string value, escaped on the way into the chunk; `length`
+ * bytes of `value` need no terminator and may be any size. NULL writes null.
+ * A long string ends early, still terminated, once mcp_stream_failed().
+ */
+void mcp_stream_string(mcp_stream* stream, const char* value);
+void mcp_stream_string_length(mcp_stream* stream, const char* value, size_t length);
+
+void mcp_stream_number(mcp_stream* stream, double value);
+void mcp_stream_bool(mcp_stream* stream, bool value);
+void mcp_stream_null(mcp_stream* stream);
+
+/**
+ * @brief Writes `length` bytes of binary data as a base64 string, encoded
+ * straight into the chunk.
+ */
+void mcp_stream_base64(mcp_stream* stream, const void* data, size_t length);
+
+/**
+ * @brief Writes a small prebuilt tree as one value. The caller keeps `item`.
+ */
+void mcp_stream_json(mcp_stream* stream, const cJSON* item);
+
+/**
+ * @brief Answers with a JSON-RPC error instead of a result. Only before the
+ * first chunk went out, which a handler can count on while it has written
+ * less than MCP_STREAM_CHUNK_SIZE; later the reply is cut short instead.
+ * Nothing written afterwards is sent.
+ */
+void mcp_stream_fail(mcp_stream* stream, int code, const char* message);
+
+/**
+ * @brief Whether the handler may stop: the client cancelled or went away,
+ * or the deadline answered first. Further values are cut at the next chunk.
+ */
+bool mcp_stream_failed(mcp_stream* stream);
+
+/**
+ * @brief Per-connection state a streaming transport shares with the workers
+ * writing into it: one streamed reply at a time, and no more than
+ * MCP_STREAM_WINDOW bytes of it waiting to be written.
+ */
+typedef struct mcp_stream_gate {
+    mcp_mutex_t lock;
+    mcp_cond_t changed;
+    bool busy;       // A stream holds the connection between its first and last piece
+    bool closed;     // The client is gone, every stream stops
+    size_t queued;   // Bytes handed over and not written yet
+} mcp_stream_gate;
+
+void mcp_stream_gate_init(mcp_stream_gate* gate);
+void mcp_stream_gate_destroy(mcp_stream_gate* gate);
+
+/**
+ * @brief Worker side, in mcp_sink.send_chunk: the first piece of a reply
+ * waits until no other stream holds the connection, every piece waits for
+ * room in the window. Returns -1 once the gate is closed; the first piece
+ * then holds nothing, later ones still end with mcp_stream_gate_leave().
+ */
+int mcp_stream_gate_enter(mcp_stream_gate* gate, size_t length, bool first);
+void mcp_stream_gate_leave(mcp_stream_gate* gate);
+
+/**
+ * @brief Transport side: `length` streamed bytes left the process.
+ */
+void mcp_stream_gate_written(mcp_stream_gate* gate, size_t length);
+
+/**
+ * @brief Transport side: the client is gone; wakes and fails every waiter.
+ */
+void mcp_stream_gate_close(mcp_stream_gate* gate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_STREAM_H */
@@ -0,0 +1,180 @@
+#ifndef MCP_THREAD_H
+#define MCP_THREAD_H
+
+// Minimal portable thread / mutex / condition variable wrappers (pthread or Win32)
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* (*mcp_thread_fn)(void* arg);
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef HANDLE mcp_thread_t;
+typedef SRWLOCK mcp_mutex_t;
+typedef CONDITION_VARIABLE mcp_cond_t;
+#define MCP_MUTEX_INITIALIZER SRWLOCK_INIT
+#define MCP_COND_INITIALIZER CONDITION_VARIABLE_INIT
+
+typedef struct mcp_thread_start {
+    mcp_thread_fn fn;
+    void* arg;
+} mcp_thread_start;
+
+static DWORD WINAPI mcp_thread_trampoline(LPVOID param) {
+    mcp_thread_start start = *(mcp_thread_start*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+static inline int mcp_thread_create(mcp_thread_t* thread, mcp_thread_fn fn, void* arg) {
+    mcp_thread_start* start = (mcp_thread_start*)malloc(sizeof(mcp_thread_start));
+    if (!start) return -1;
+    start->fn = fn;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, mcp_thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+static inline int mcp_thread_join(mcp_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+    return 0;
+}
+
+static inline void mcp_sleep_ms(unsigned ms) { Sleep(ms); }
+
+static inline void mcp_mutex_init(mcp_mutex_t* mutex) { InitializeSRWLock(mutex); }
+static inline void mcp_mutex_destroy(mcp_mutex_t* mutex) { (void)mutex; }
+static inline void mcp_mutex_lock(mcp_mutex_t* mutex) { AcquireSRWLockExclusive(mutex); }
+static inline void mcp_mutex_unlock(mcp_mutex_t* mutex) { ReleaseSRWLockExclusive(mutex); }
+
+static inline void mcp_cond_init(mcp_cond_t* cond) { InitializeConditionVariable(cond); }
+static inline void mcp_cond_destroy(mcp_cond_t* cond) { (void)cond; }
+static inline void mcp_cond_wait(mcp_cond_t* cond, mcp_mutex_t* mutex) {
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+static inline void mcp_cond_signal(mcp_cond_t* cond) { WakeConditionVariable(cond); }
+static inline void mcp_cond_broadcast(mcp_cond_t* cond) { WakeAllConditionVariable(cond); }
+
+#else
+#include <pthread.h>
+#include <time.h>
+
+typedef pthread_t mcp_thread_t;
+typedef pthread_mutex_t mcp_mutex_t;
+typedef pthread_cond_t mcp_cond_t;
+#define MCP_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define MCP_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+static inline int mcp_thread_create(mcp_thread_t* thread, mcp_thread_fn fn, void* arg) {
+    return pthread_create(thread, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+static inline int mcp_thread_join(mcp_thread_t thread) {
+    return pthread_join(thread, NULL) == 0 ? 0 : -1;
+}
+
+static inline void mcp_sleep_ms(unsigned ms) {
+    struct timespec delay = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+static inline void mcp_mutex_init(mcp_mutex_t* mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mcp_mutex_destroy(mcp_mutex_t* mutex) { pthread_mutex_destroy(mutex); }
+static inline void mcp_mutex_lock(mcp_mutex_t* mutex) { pthread_mutex_lock(mutex); }
+static inline void mcp_mutex_unlock(mcp_mutex_t* mutex) { pthread_mutex_unlock(mutex); }
+
+static inline void mcp_cond_init(mcp_cond_t* cond) { pthread_cond_init(cond, NULL); }
+static inline void mcp_cond_destroy(mcp_cond_t* cond) { pthread_cond_destroy(cond); }
+static inline void mcp_cond_wait(mcp_cond_t* cond, mcp_mutex_t* mutex) { pthread_cond_wait(cond, mutex); }
+static inline void mcp_cond_signal(mcp_cond_t* cond) { pthread_cond_signal(cond); }
+static inline void mcp_cond_broadcast(mcp_cond_t* cond) { pthread_cond_broadcast(cond); }
+
+#endif
+
+// Sequentially consistent atomics on a long
+#ifdef _MSC_VER
+static inline long mcp_atomic_add(volatile long* value, long delta) {
+    return InterlockedExchangeAdd(value, delta) + delta;
+}
+static inline long mcp_atomic_load(volatile long* value) {
+    return InterlockedCompareExchange(value, 0, 0);
+}
+static inline void mcp_atomic_store(volatile long* value, long desired) {
+    InterlockedExchange(value, desired);
+}
+static inline int mcp_atomic_cas(volatile long* value, long expected, long desired) {
+    return InterlockedCompareExchange(value, desired, expected) == expected;
+}
+static inline void* mcp_atomic_load_ptr(void* volatile* value) {
+    return InterlockedCompareExchangePointer(value, NULL, NULL);
+}
+static inline void mcp_atomic_store_ptr(void* volatile* value, void* desired) {
+    InterlockedExchangePointer(value, desired);
+}
+#else
+static inline long mcp_atomic_add(volatile long* value, long delta) {
+    return __atomic_add_fetch(value, delta, __ATOMIC_SEQ_CST);
+}
+static inline long mcp_atomic_load(volatile long* value) {
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+static inline void mcp_atomic_store(volatile long* value, long desired) {
+    __atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+}
+static inline int mcp_atomic_cas(volatile long* value, long expected, long desired) {
+    return __atomic_compare_exchange_n(value, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+static inline void* mcp_atomic_load_ptr(void* volatile* value) {
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+static inline void mcp_atomic_store_ptr(void* volatile* value, void* desired) {
+    __atomic_store_n(value, desired, __ATOMIC_SEQ_CST);
+}
+#endif
+
+// Statistics counters: written by one thread only, read by any without tearing
+#ifdef _MSC_VER
+static inline void mcp_counter_add(volatile uint64_t* counter, uint64_t delta) {
+    *counter += delta;  // Aligned 64-bit accesses are single-copy atomic on x64 and ARM64
+}
+static inline void mcp_counter_store(volatile uint64_t* counter, uint64_t value) {
+    *counter = value;
+}
+static inline uint64_t mcp_counter_load(volatile uint64_t* counter) {
+    return *counter;
+}
+#else
+static inline void mcp_counter_add(volatile uint64_t* counter, uint64_t delta) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + delta, __ATOMIC_RELAXED);
+}
+static inline void mcp_counter_store(volatile uint64_t* counter, uint64_t value) {
+    __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+static inline uint64_t mcp_counter_load(volatile uint64_t* counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+#endif
+
+#ifdef _MSC_VER
+#define MCP_THREAD_LOCAL __declspec(thread)
+#else
+#define MCP_THREAD_LOCAL __thread
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_THREAD_H */
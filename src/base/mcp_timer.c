@@ -0,0 +1,164 @@
+#include "mcp_timer.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_TIMER_WHEEL_MASK (MCP_TIMER_WHEEL_SLOTS - 1)
+
+uint64_t mcp_timer_now_ms(void) {
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
+}
+
+void mcp_timer_wheel_set_driver(mcp_timer_wheel* wheel, void (*on_armed)(void* arg), void* arg) {
+    mcp_mutex_lock(&wheel->lock);
+    wheel->on_armed = on_armed;
+    wheel->armed_arg = arg;
+    mcp_mutex_unlock(&wheel->lock);
+}
+
+// Links the timer into the slot its distance from `now` selects. Caller holds the lock
+static void mcp_timer_link(mcp_timer_wheel* wheel, mcp_timer* timer) {
+    uint64_t delta = timer->expires - wheel->now;
+    unsigned level = 0;
+    while (level + 1 < MCP_TIMER_WHEEL_LEVELS && delta >= ((uint64_t)1 << (MCP_TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    if (level + 1 == MCP_TIMER_WHEEL_LEVELS) {
+        // Beyond the top level's span, fire at its far end instead
+        uint64_t span = ((uint64_t)1 << (MCP_TIMER_WHEEL_BITS * MCP_TIMER_WHEEL_LEVELS)) - 1;
+        if (delta > span) {
+            timer->expires = wheel->now + span;
+        }
+    }
+    mcp_timer** head = &wheel->slots[level][(timer->expires >> (MCP_TIMER_WHEEL_BITS * level)) & MCP_TIMER_WHEEL_MASK];
+    timer->next = *head;
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void mcp_timer_unlink(mcp_timer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+void mcp_timer_add(mcp_timer_wheel* wheel, mcp_timer* timer, unsigned delay_ms) {
+    uint64_t now_ms = mcp_timer_now_ms();
+    mcp_mutex_lock(&wheel->lock);
+    if (!wheel->started) {
+        wheel->started = true;
+        wheel->origin = now_ms;
+        wheel->now = 0;
+    }
+    // Round up, so a timer never fires early
+    uint64_t ticks = (now_ms - wheel->origin + delay_ms + MCP_TIMER_TICK_MS - 1) / MCP_TIMER_TICK_MS;
+    timer->expires = ticks > wheel->now ? ticks : wheel->now + 1;
+    mcp_timer_link(wheel, timer);
+    bool armed = wheel->count++ == 0;
+    void (*on_armed)(void*) = wheel->on_armed;
+    void* arg = wheel->armed_arg;
+    mcp_mutex_unlock(&wheel->lock);
+    if (armed && on_armed != NULL) {
+        on_armed(arg);
+    }
+}
+
+bool mcp_timer_cancel(mcp_timer_wheel* wheel, mcp_timer* timer) {
+    bool removed = false;
+    mcp_mutex_lock(&wheel->lock);
+    if (timer->pprev != NULL) {
+        mcp_timer_unlink(timer);
+        wheel->count--;
+        removed = true;
+    }
+    mcp_mutex_unlock(&wheel->lock);
+    return removed;
+}
+
+// Re-files the slot of `level` that the current tick has reached, one level down
+static void mcp_timer_cascade(mcp_timer_wheel* wheel, unsigned level) {
+    unsigned index = (unsigned)(wheel->now >> (MCP_TIMER_WHEEL_BITS * level)) & MCP_TIMER_WHEEL_MASK;
+    if (index == 0 && level + 1 < MCP_TIMER_WHEEL_LEVELS) {
+        mcp_timer_cascade(wheel, level + 1);
+    }
+    mcp_timer* timer = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+    while (timer != NULL) {
+        mcp_timer* next = timer->next;
+        mcp_timer_link(wheel, timer);
+        timer = next;
+    }
+}
+
+size_t mcp_timer_wheel_advance(mcp_timer_wheel* wheel) {
+    uint64_t now_ms = mcp_timer_now_ms();
+    mcp_timer* expired = NULL;
+
+    mcp_mutex_lock(&wheel->lock);
+    if (!wheel->started) {
+        mcp_mutex_unlock(&wheel->lock);
+        return 0;
+    }
+    uint64_t target = (now_ms - wheel->origin) / MCP_TIMER_TICK_MS;
+    while (wheel->now < target) {
+        if (wheel->count == 0) {
+            // Nothing to cascade or fire on the way
+            wheel->now = target;
+            break;
+        }
+        wheel->now++;
+        unsigned index = (unsigned)wheel->now & MCP_TIMER_WHEEL_MASK;
+        if (index == 0) {
+            mcp_timer_cascade(wheel, 1);
+        }
+        // Detach the due slot; `pprev` is cleared so a concurrent cancel sees it as fired
+        mcp_timer* timer = wheel->slots[0][index];
+        wheel->slots[0][index] = NULL;
+        while (timer != NULL) {
+            mcp_timer* next = timer->next;
+            timer->pprev = NULL;
+            timer->next = expired;
+            expired = timer;
+            wheel->count--;
+            timer = next;
+        }
+    }
+    size_t pending = wheel->count;
+    mcp_mutex_unlock(&wheel->lock);
+
+    while (expired != NULL) {
+        mcp_timer* next = expired->next;  // `fire` may free the timer
+        expired->next = NULL;
+        expired->fire(expired);
+        expired = next;
+    }
+    return pending;
+}
+
+size_t mcp_timer_wheel_count(mcp_timer_wheel* wheel) {
+    mcp_mutex_lock(&wheel->lock);
+    size_t count = wheel->count;
+    mcp_mutex_unlock(&wheel->lock);
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
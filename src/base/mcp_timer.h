@@ -0,0 +1,86 @@
+#ifndef MCP_TIMER_H
+#define MCP_TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Resolution of the wheel; deadlines fire up to one tick late
+#define MCP_TIMER_TICK_MS 10
+#define MCP_TIMER_WHEEL_BITS 6
+#define MCP_TIMER_WHEEL_SLOTS (1u << MCP_TIMER_WHEEL_BITS)
+// 64^4 ticks of 10 ms reach past a day; longer delays are clamped
+#define MCP_TIMER_WHEEL_LEVELS 4
+
+/**
+ * @brief A one-shot timer. Embed it in the object it times out and recover
+ * the container in `fire`.
+ */
+typedef struct mcp_timer {
+    struct mcp_timer* next;
+    struct mcp_timer** pprev;  // NULL while the timer is not in a wheel
+    uint64_t expires;          // In ticks
+    void (*fire)(struct mcp_timer* timer);
+} mcp_timer;
+
+/**
+ * @brief Hierarchical timer wheel: O(1) add, cancel and per-tick expiry
+ * however many timers are pending.
+ *
+ * Level 0 holds the next 64 ticks one slot per tick; each level above
+ * covers 64 times the span of the one below, and its slots are cascaded
+ * down when the level below wraps. Timers may be added and cancelled from
+ * any thread; one driver thread calls mcp_timer_wheel_advance(), and
+ * `fire` runs there without the wheel locked.
+ */
+typedef struct mcp_timer_wheel {
+    mcp_mutex_t lock;
+    bool started;
+    uint64_t origin;  // mcp_timer_now_ms() at tick 0
+    uint64_t now;     // Last tick processed
+    size_t count;
+    mcp_timer* slots[MCP_TIMER_WHEEL_LEVELS][MCP_TIMER_WHEEL_SLOTS];
+    // Called when the first timer lands in an empty wheel, so an idle driver can wake up
+    void (*on_armed)(void* arg);
+    void* armed_arg;
+} mcp_timer_wheel;
+
+#define MCP_TIMER_WHEEL_INITIALIZER { MCP_MUTEX_INITIALIZER, false, 0, 0, 0, { { NULL } }, NULL, NULL }
+
+/**
+ * @brief Milliseconds of a monotonic clock.
+ */
+uint64_t mcp_timer_now_ms(void);
+
+void mcp_timer_wheel_set_driver(mcp_timer_wheel* wheel, void (*on_armed)(void* arg), void* arg);
+
+/**
+ * @brief Arms `timer` (with `fire` set) to fire `delay_ms` from now.
+ */
+void mcp_timer_add(mcp_timer_wheel* wheel, mcp_timer* timer, unsigned delay_ms);
+
+/**
+ * @brief Disarms `timer`. Returns false when it was not pending: it has
+ * fired, is firing right now, or was never added.
+ */
+bool mcp_timer_cancel(mcp_timer_wheel* wheel, mcp_timer* timer);
+
+/**
+ * @brief Fires every timer that is due by now. Called by the driver about
+ * every MCP_TIMER_TICK_MS.
+ *
+ * @return The number of timers still pending.
+ */
+size_t mcp_timer_wheel_advance(mcp_timer_wheel* wheel);
+size_t mcp_timer_wheel_count(mcp_timer_wheel* wheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_TIMER_H */
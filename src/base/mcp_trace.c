@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_trace.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_TRACE_RING_MASK (MCP_TRACE_RING_SIZE - 1)
+
+typedef struct mcp_trace_event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+} mcp_trace_event;
+
+// One thread's spans. The thread is the only writer; `head` counts the
+// spans ever written and is published after the span it covers
+typedef struct mcp_trace_ring {
+    struct mcp_trace_ring* next;
+    unsigned tid;
+    const char* volatile name;
+    volatile uint64_t head;
+    mcp_trace_event events[MCP_TRACE_RING_SIZE];
+} mcp_trace_ring;
+
+volatile long mcp_trace_active = 0;
+
+static mcp_mutex_t g_rings_lock = MCP_MUTEX_INITIALIZER;
+static mcp_trace_ring* volatile g_rings = NULL;
+static unsigned g_ring_count = 0;
+static MCP_THREAD_LOCAL mcp_trace_ring* t_ring = NULL;
+static MCP_THREAD_LOCAL const char* t_thread_name = NULL;
+
+#ifdef _MSC_VER
+#define mcp_trace_store(field, value) ((field) = (value))
+#define mcp_trace_load(field) (field)
+#define mcp_trace_publish(field, value) ((field) = (value))
+#define mcp_trace_acquire(field) (field)
+#else
+#define mcp_trace_store(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define mcp_trace_load(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define mcp_trace_publish(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define mcp_trace_acquire(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#endif
+
+static mcp_trace_ring* mcp_trace_ring_get(void) {
+    mcp_trace_ring* ring = t_ring;
+    if (ring != NULL) {
+        return ring;
+    }
+    ring = (mcp_trace_ring*)calloc(1, sizeof(mcp_trace_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->name = t_thread_name;
+    mcp_mutex_lock(&g_rings_lock);
+    ring->tid = ++g_ring_count;
+    ring->next = g_rings;
+    mcp_atomic_store_ptr((void* volatile*)&g_rings, ring);
+    mcp_mutex_unlock(&g_rings_lock);
+    t_ring = ring;
+    return ring;
+}
+
+void mcp_trace_end(const char* name, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t now = mcp_stats_now_ns();
+    mcp_trace_ring* ring = mcp_trace_ring_get();
+    if (ring == NULL) {
+        return;
+    }
+    uint64_t head = ring->head;
+    mcp_trace_event* event = &ring->events[head & MCP_TRACE_RING_MASK];
+    mcp_trace_store(event->name, name);
+    mcp_trace_store(event->start, start);
+    mcp_trace_store(event->duration, now - start);
+    mcp_trace_publish(ring->head, head + 1);
+}
+
+void mcp_trace_name_thread(const char* name) {
+    t_thread_name = name;
+    if (t_ring != NULL) {
+        mcp_atomic_store_ptr((void* volatile*)&t_ring->name, (void*)name);
+    }
+}
+
+void mcp_trace_enable(bool enabled) {
+    mcp_atomic_store(&mcp_trace_active, enabled ? 1 : 0);
+}
+
+bool mcp_trace_enabled(void) {
+    return mcp_atomic_load(&mcp_trace_active) != 0;
+}
+
+// Copies the spans of `ring` that survive the copy into `out`; returns how many
+static size_t mcp_trace_snapshot(mcp_trace_ring* ring, mcp_trace_event* out) {
+    uint64_t head = mcp_trace_acquire(ring->head);
+    uint64_t first = head > MCP_TRACE_RING_SIZE ? head - MCP_TRACE_RING_SIZE : 0;
+    for (uint64_t i = first; i < head; ++i) {
+        mcp_trace_event* event = &ring->events[i & MCP_TRACE_RING_MASK];
+        out[i - first].name = mcp_trace_load(event->name);
+        out[i - first].start = mcp_trace_load(event->start);
+        out[i - first].duration = mcp_trace_load(event->duration);
+    }
+    // The owner may have lapped the copy: drop every slot it could have rewritten,
+    // including the one it may be filling right now
+    uint64_t now = mcp_trace_acquire(ring->head);
+    uint64_t valid = now + 1 > MCP_TRACE_RING_SIZE ? now + 1 - MCP_TRACE_RING_SIZE : 0;
+    if (valid <= first) {
+        return (size_t)(head - first);
+    }
+    if (valid >= head) {
+        return 0;
+    }
+    memmove(out, out + (valid - first), (size_t)(head - valid) * sizeof(*out));
+    return (size_t)(head - valid);
+}
+
+long mcp_trace_export(const char* path) {
+    mcp_trace_event* events = (mcp_trace_event*)malloc(MCP_TRACE_RING_SIZE * sizeof(mcp_trace_event));
+    char temporary[4096];
+    FILE* file = NULL;
+    if (events == NULL || snprintf(temporary, sizeof(temporary), "%s.tmp", path) >= (int)sizeof(temporary) ||
+        (file = fopen(temporary, "w")) == NULL) {
+        fprintf(stderr, "Failed to write trace to %s\n", path);
+        free(events);
+        return -1;
+    }
+
+    long written = 0;
+    bool first = true;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    for (mcp_trace_ring* ring = (mcp_trace_ring*)mcp_atomic_load_ptr((void* volatile*)&g_rings);
+         ring != NULL; ring = ring->next) {
+        const char* name = (const char*)mcp_atomic_load_ptr((void* volatile*)&ring->name);
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                first ? "" : ",\n", ring->tid, name != NULL ? name : "thread", ring->tid);
+        first = false;
+        size_t count = mcp_trace_snapshot(ring, events);
+        for (size_t i = 0; i < count; ++i) {
+            // Complete events, timestamps in microseconds
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u}",
+                    events[i].name, ring->tid,
+                    (unsigned long long)(events[i].start / 1000), (unsigned)(events[i].start % 1000),
+                    (unsigned long long)(events[i].duration / 1000), (unsigned)(events[i].duration % 1000));
+        }
+        written += (long)count;
+    }
+    fputs("\n]}\n", file);
+    free(events);
+    if (fclose(file) != 0 || rename(temporary, path) != 0) {
+        remove(temporary);
+        fprintf(stderr, "Failed to write trace to %s\n", path);
+        return -1;
+    }
+    return written;
+}
+
+cJSON* mcp_trace_control(const cJSON* params) {
+    const cJSON* enabled = cJSON_IsObject(params) ? cJSON_GetObjectItemCaseSensitive(params, "enabled") : NULL;
+    const cJSON* dump = cJSON_IsObject(params) ? cJSON_GetObjectItemCaseSensitive(params, "dump") : NULL;
+    const char* path = getenv(MCP_TRACE_FILE_ENV);
+    if (cJSON_IsBool(enabled)) {
+        mcp_trace_enable(cJSON_IsTrue(enabled));
+    }
+
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddBoolToObject(result, "enabled", mcp_trace_enabled());
+    if (path != NULL && *path != '\0') {
+        cJSON_AddStringToObject(result, "file", path);
+    } else {
+        cJSON_AddNullToObject(result, "file");
+    }
+    // Clients may only trigger a write to the file the operator chose
+    if (cJSON_IsTrue(dump) && path != NULL && *path != '\0') {
+        cJSON_AddNumberToObject(result, "spans", (double)mcp_trace_export(path));
+    }
+    return result;
+}
+
+void mcp_trace_init(void) {
+    const char* env = getenv(MCP_TRACE_ENV);
+    if (env != NULL && atoi(env) > 0) {
+        mcp_trace_enable(true);
+    }
+}
+
+void mcp_trace_shutdown(void) {
+    const char* path = getenv(MCP_TRACE_FILE_ENV);
+    if (mcp_trace_enabled() && path != NULL && *path != '\0') {
+        mcp_trace_export(path);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
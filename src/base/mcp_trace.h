@@ -0,0 +1,83 @@
+#ifndef MCP_TRACE_H
+#define MCP_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+#include "mcp_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// "1" starts the process with tracing on
+#define MCP_TRACE_ENV "MCPC_TRACE"
+// Where traces are written: on request through mcp_trace_export() or the
+// reserved method, and at shutdown while tracing is on
+#define MCP_TRACE_FILE_ENV "MCPC_TRACE_FILE"
+// Reserved JSON-RPC method: params {"enabled": bool} switches tracing,
+// {"dump": true} writes the trace to $MCPC_TRACE_FILE
+#define MCP_TRACE_METHOD "mcpc/trace"
+// Spans kept per thread; older ones are overwritten
+#define MCP_TRACE_RING_SIZE 16384
+
+// Read by every span, see mcp_trace_begin()
+extern volatile long mcp_trace_active;
+
+/**
+ * @brief Starts a span: the current time while tracing is on, 0 otherwise.
+ * Pass the result to mcp_trace_end(). Costs one load when tracing is off.
+ */
+static inline uint64_t mcp_trace_begin(void) {
+#ifdef _MSC_VER
+    return mcp_trace_active ? mcp_stats_now_ns() : 0;
+#else
+    return __atomic_load_n(&mcp_trace_active, __ATOMIC_RELAXED) ? mcp_stats_now_ns() : 0;
+#endif
+}
+
+/**
+ * @brief Records the span `name` from `start` until now into the calling
+ * thread's ring. `name` must be a string literal (only the pointer is kept).
+ * Does nothing when `start` is 0.
+ */
+void mcp_trace_end(const char* name, uint64_t start);
+
+/**
+ * @brief Names the calling thread in exported traces. `name` must stay
+ * valid for the life of the process, like a string literal.
+ */
+void mcp_trace_name_thread(const char* name);
+
+/**
+ * @brief Switches tracing on or off at any time.
+ */
+void mcp_trace_enable(bool enabled);
+bool mcp_trace_enabled(void);
+
+/**
+ * @brief Writes the spans still in the rings to `path` in the Chrome
+ * trace-event JSON format (chrome://tracing, ui.perfetto.dev), one track
+ * per thread. Recording goes on meanwhile; spans overwritten during the
+ * export are left out. Returns the number of spans written, -1 on error.
+ */
+long mcp_trace_export(const char* path);
+
+/**
+ * @brief Handles MCP_TRACE_METHOD; returns its result object.
+ */
+cJSON* mcp_trace_control(const cJSON* params);
+
+/**
+ * @brief Applies $MCPC_TRACE when a server starts; mcp_trace_shutdown()
+ * writes the trace to $MCPC_TRACE_FILE when it stops with tracing on.
+ */
+void mcp_trace_init(void);
+void mcp_trace_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_TRACE_H */
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_unix.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_framer.h"
+#include "mcp_log.h"
+#include "mcp_session.h"
+#include "mcp_stream.h"
+#include "mcp_writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcp_unix_server mcp_unix_server;
+typedef struct mcp_unix_call mcp_unix_call;
+
+/**
+ * @brief One agent connection and its session. Only the loop thread touches
+ * it; the memory stays until no request of it is with the workers.
+ */
+typedef struct mcp_unix_conn {
+    mcp_event_handler handler;
+    mcp_unix_server* server;
+    mcp_framer in;
+    mcp_writer out;
+    mcp_session* session;
+    struct mcp_unix_conn* prev;
+    struct mcp_unix_conn* next;
+    mcp_task flush;       // Writes the replies completed in one loop round at once
+    mcp_task release;
+    size_t inflight;      // Messages with the workers
+    mcp_stream_gate gate; // Shared with the workers streaming replies into `out`
+    size_t streamed;      // Streamed bytes in `out`, returned to the gate once written
+    mcp_unix_call* held;  // Replies completed while a streamed one is half written
+    mcp_unix_call** held_tail;
+    bool streaming;
+    unsigned events;
+    bool flush_posted;
+    bool release_posted;
+    bool eof;             // Client finished sending; close once everything is answered
+    bool closed;
+} mcp_unix_conn;
+
+/**
+ * @brief One submitted message; carries its reply back to the loop thread.
+ */
+struct mcp_unix_call {
+    mcp_task task;
+    mcp_sink sink;
+    mcp_unix_conn* conn;
+    cJSON* response;
+    mcp_arena* arena;
+    int tool;  // For the byte count, see mcp_stats_bytes_out()
+    mcp_unix_call* next;
+};
+
+/**
+ * @brief One piece of a streamed reply on its way to the loop thread.
+ */
+typedef struct mcp_unix_chunk {
+    mcp_task task;
+    mcp_unix_conn* conn;
+    char* data;
+    size_t length;
+    bool last;
+    int tool;
+} mcp_unix_chunk;
+
+struct mcp_unix_server {
+    mcp_transport transport;
+    mcp_net* net;
+    mcp_event_handler listener;
+    mcp_unix_conn* conns;
+    char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+};
+
+static void mcp_unix_release_run(mcp_task* task) {
+    mcp_unix_conn* conn = (mcp_unix_conn*)((char*)task - offsetof(mcp_unix_conn, release));
+    mcp_session_release(conn->session);
+    mcp_framer_destroy(&conn->in);
+    mcp_writer_destroy(&conn->out);
+    mcp_stream_gate_destroy(&conn->gate);
+    free(conn);
+}
+
+// Frees a closed connection after the current round, once nothing refers to it
+static void mcp_unix_maybe_free(mcp_unix_conn* conn) {
+    if (conn->closed && conn->inflight == 0 && !conn->flush_posted && !conn->release_posted) {
+        conn->release_posted = true;
+        conn->release.run = mcp_unix_release_run;
+        mcp_event_loop_post(&conn->server->net->loop, &conn->release);
+    }
+}
+
+static void mcp_unix_call_complete(mcp_task* task);
+
+// Completes the replies held back behind a streamed one
+static void mcp_unix_release_held(mcp_unix_conn* conn) {
+    while (conn->held != NULL && (!conn->streaming || conn->closed)) {
+        mcp_unix_call* call = conn->held;
+        conn->held = call->next;
+        mcp_unix_call_complete(&call->task);
+    }
+    if (conn->held == NULL) {
+        conn->held_tail = &conn->held;
+    }
+}
+
+static void mcp_unix_close(mcp_unix_conn* conn) {
+    if (conn->closed) {
+        return;
+    }
+    conn->closed = true;
+    // Nobody is left to read the replies of what this client still has running
+    mcp_dispatch_cancel_session(conn->session);
+    mcp_stream_gate_close(&conn->gate);
+    mcp_unix_release_held(conn);
+    mcp_unix_server* server = conn->server;
+    mcp_event_loop_close(&server->net->loop, &conn->handler);
+    if (conn->prev != NULL) {
+        conn->prev->next = conn->next;
+    } else {
+        server->conns = conn->next;
+    }
+    if (conn->next != NULL) {
+        conn->next->prev = conn->prev;
+    }
+    mcp_unix_maybe_free(conn);
+}
+
+static void mcp_unix_update_interest(mcp_unix_conn* conn) {
+    unsigned events = conn->eof ? 0 : MCP_EVENT_READ;
+    if (conn->out.length > 0) {
+        events |= MCP_EVENT_WRITE;
+    }
+    if (events != conn->events && mcp_event_loop_modify(&conn->server->net->loop, &conn->handler, events) == 0) {
+        conn->events = events;
+    }
+}
+
+static void mcp_unix_write(mcp_unix_conn* conn) {
+    while (conn->out.length > 0) {
+        if (mcp_event_loop_write(&conn->server->net->loop, &conn->handler, &conn->out) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            mcp_unix_close(conn);
+            return;
+        }
+    }
+    if (conn->out.length == 0 && conn->streamed > 0) {
+        // The client took it all: let the stream add more
+        mcp_stream_gate_written(&conn->gate, conn->streamed);
+        conn->streamed = 0;
+    }
+    if (conn->eof && conn->inflight == 0 && conn->out.length == 0) {
+        mcp_unix_close(conn);
+        return;
+    }
+    mcp_unix_update_interest(conn);
+}
+
+static void mcp_unix_flush_run(mcp_task* task) {
+    mcp_unix_conn* conn = (mcp_unix_conn*)((char*)task - offsetof(mcp_unix_conn, flush));
+    conn->flush_posted = false;
+    if (conn->closed) {
+        mcp_unix_maybe_free(conn);
+        return;
+    }
+    mcp_unix_write(conn);
+}
+
+static void mcp_unix_schedule_flush(mcp_unix_conn* conn) {
+    if (conn->flush_posted) {
+        return;
+    }
+    // Runs after the completions already queued, so they share one write()
+    conn->flush.run = mcp_unix_flush_run;
+    if (mcp_event_loop_post(&conn->server->net->loop, &conn->flush) == 0) {
+        conn->flush_posted = true;
+    } else {
+        mcp_unix_write(conn);
+    }
+}
+
+// Worker thread: hand the reply back to the loop thread that owns the connection
+static void mcp_unix_call_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    mcp_unix_call* call = (mcp_unix_call*)((char*)sink - offsetof(mcp_unix_call, sink));
+    call->response = response;
+    call->arena = arena;
+    call->tool = mcp_stats_current();
+    if (mcp_event_loop_post(&call->conn->server->net->loop, &call->task) != 0) {
+        mcp_log_error("Failed to hand reply back to the event loop");
+    }
+}
+
+static void mcp_unix_chunk_run(mcp_task* task) {
+    mcp_unix_chunk* piece = (mcp_unix_chunk*)task;
+    mcp_unix_conn* conn = piece->conn;
+    if (!conn->closed) {
+        size_t length = conn->out.length;
+        if (mcp_writer_append(&conn->out, piece->data, piece->length) != 0 ||
+            (piece->last && mcp_writer_append(&conn->out, "\n", 1) != 0)) {
+            mcp_log_error("Failed to buffer a streamed response");
+        }
+        mcp_stats_bytes_out(piece->tool, conn->out.length - length);
+        conn->streamed += piece->length;
+    } else {
+        mcp_stream_gate_written(&conn->gate, piece->length);
+    }
+    conn->streaming = !piece->last;
+    free(piece->data);
+    free(piece);
+    mcp_unix_release_held(conn);
+    if (!conn->closed) {
+        mcp_unix_schedule_flush(conn);
+    }
+}
+
+// Worker thread: hands a piece of a streamed reply to the loop thread, waiting while the client lags behind
+static int mcp_unix_call_send_chunk(mcp_sink* sink, char* chunk, size_t length, bool first, bool last) {
+    mcp_unix_call* call = (mcp_unix_call*)((char*)sink - offsetof(mcp_unix_call, sink));
+    mcp_unix_conn* conn = call->conn;
+    bool queued = false;
+    if (mcp_stream_gate_enter(&conn->gate, length, first) == 0) {
+        mcp_unix_chunk* piece = (mcp_unix_chunk*)malloc(sizeof(mcp_unix_chunk));
+        if (piece != NULL) {
+            piece->task.run = mcp_unix_chunk_run;
+            piece->conn = conn;
+            piece->data = chunk;
+            piece->length = length;
+            piece->last = last;
+            piece->tool = mcp_stats_current();
+            queued = mcp_event_loop_post(&conn->server->net->loop, &piece->task) == 0;
+            if (!queued) {
+                free(piece);
+            }
+        }
+        if (!queued) {
+            mcp_stream_gate_written(&conn->gate, length);
+        }
+    }
+    if (!queued) {
+        free(chunk);
+    }
+    // The stream holds the connection from its first accepted piece up to its last one
+    if (last || (first && !queued)) {
+        mcp_stream_gate_leave(&conn->gate);
+    }
+    return queued ? 0 : -1;
+}
+
+static void mcp_unix_call_complete(mcp_task* task) {
+    mcp_unix_call* call = (mcp_unix_call*)task;
+    mcp_unix_conn* conn = call->conn;
+    if (conn->streaming && !conn->closed && call->response != NULL) {
+        // Written after the last piece of the streamed reply
+        call->next = NULL;
+        *conn->held_tail = call;
+        conn->held_tail = &call->next;
+        return;
+    }
+    conn->inflight--;
+    if (!conn->closed && call->response != NULL) {
+        size_t length = conn->out.length;
+        uint64_t trace = mcp_trace_begin();
+        if (mcp_writer_append_json(&conn->out, call->response) != 0) {
+            mcp_log_error("Failed to encode response");
+        } else {
+            mcp_stats_bytes_out(call->tool, conn->out.length - length);
+        }
+        mcp_trace_end("encode", trace);
+    }
+    mcp_response_release(call->response, call->arena);
+    free(call);
+    if (conn->closed) {
+        mcp_unix_maybe_free(conn);
+        return;
+    }
+    mcp_unix_schedule_flush(conn);
+}
+
+static void mcp_unix_submit(mcp_unix_conn* conn, const char* message, size_t length) {
+    // Parse straight into the arena that will also hold the reply
+    mcp_arena* arena = mcp_arena_acquire();
+    mcp_arena* previous = mcp_arena_set_current(arena);
+    uint64_t trace = mcp_trace_begin();
+    cJSON* json = cJSON_ParseWithLength(message, length);
+    mcp_trace_end("cJSON_Parse", trace);
+    mcp_arena_set_current(previous);
+    if (json == NULL) {
+        const char *error_ptr = cJSON_GetErrorPtr();
+        if (error_ptr != NULL) {
+            mcp_log_warn("JSON parsing error: %.64s", error_ptr);
+        }
+        mcp_arena_release(arena);
+        return;
+    }
+
+    mcp_unix_call* call = (mcp_unix_call*)calloc(1, sizeof(mcp_unix_call));
+    if (!call) {
+        mcp_response_release(json, arena);
+        return;
+    }
+    call->task.run = mcp_unix_call_complete;
+    call->sink.send = mcp_unix_call_send;
+    call->sink.send_chunk = mcp_unix_call_send_chunk;
+    call->conn = conn;
+    if (mcp_dispatch_submit(&conn->server->net->pool, json, length, arena, &call->sink, conn->session) != 0) {
+        mcp_response_release(json, arena);
+        free(call);
+        return;
+    }
+    conn->inflight++;
+}
+
+static void mcp_unix_conn_on_event(mcp_event_handler* handler, unsigned events) {
+    mcp_unix_conn* conn = (mcp_unix_conn*)handler;
+    char* message = NULL;
+    size_t length = 0;
+
+    if (conn->closed) {
+        return;
+    }
+    if (events & MCP_EVENT_ERROR) {
+        // The peer is gone in both directions, nobody is left to answer
+        mcp_unix_close(conn);
+        return;
+    }
+    if (events & MCP_EVENT_WRITE) {
+        mcp_unix_write(conn);
+        if (conn->closed) {
+            return;
+        }
+    }
+    if ((events & MCP_EVENT_READ) && !conn->eof) {
+        long n = mcp_event_loop_read(&conn->server->net->loop, &conn->handler, &conn->in);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            mcp_unix_close(conn);
+            return;
+        }
+        while (mcp_framer_pop(&conn->in, &message, &length)) {
+            if (length > 0) {
+                mcp_unix_submit(conn, message, length);
+            }
+        }
+        if (n == 0) {
+            // A last message without a trailing newline still counts
+            if (conn->in.end > conn->in.start) {
+                mcp_unix_submit(conn, conn->in.data + conn->in.start, conn->in.end - conn->in.start);
+                mcp_framer_consume(&conn->in, conn->in.end - conn->in.start);
+            }
+            conn->eof = true;
+            mcp_unix_write(conn);
+            return;
+        }
+    }
+    mcp_unix_update_interest(conn);
+}
+
+static void mcp_unix_accept(mcp_event_handler* handler, unsigned events) {
+    mcp_unix_server* server = (mcp_unix_server*)((char*)handler - offsetof(mcp_unix_server, listener));
+    (void)events;
+    for (;;) {
+        int fd = accept4(handler->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+        mcp_unix_conn* conn = (mcp_unix_conn*)calloc(1, sizeof(mcp_unix_conn));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->session = mcp_session_create();
+        if (conn->session == NULL || mcp_framer_init(&conn->in, fd, MCP_UNIX_BUFFER_SIZE) != 0) {
+            mcp_session_release(conn->session);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        if (mcp_writer_init(&conn->out, fd, MCP_UNIX_BUFFER_SIZE) != 0) {
+            mcp_framer_destroy(&conn->in);
+            mcp_session_release(conn->session);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        mcp_stream_gate_init(&conn->gate);
+        conn->held_tail = &conn->held;
+        conn->handler.fd = fd;
+        conn->handler.on_event = mcp_unix_conn_on_event;
+        conn->server = server;
+        conn->events = MCP_EVENT_READ;
+        if (mcp_event_loop_add(&server->net->loop, &conn->handler, MCP_EVENT_READ | MCP_EVENT_STREAM) != 0) {
+            mcp_stream_gate_destroy(&conn->gate);
+            mcp_writer_destroy(&conn->out);
+            mcp_framer_destroy(&conn->in);
+            mcp_session_release(conn->session);
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->next = server->conns;
+        if (server->conns != NULL) {
+            server->conns->prev = conn;
+        }
+        server->conns = conn;
+    }
+}
+
+static void mcp_unix_stop(mcp_transport* transport) {
+    mcp_unix_server* server = (mcp_unix_server*)transport;
+    mcp_event_loop_remove(&server->net->loop, &server->listener);
+    close(server->listener.fd);
+    unlink(server->path);
+    // The loop no longer writes: workers streaming into a connection would
+    // wait for room forever, and the pool shutdown with them
+    for (mcp_unix_conn* conn = server->conns; conn != NULL; conn = conn->next) {
+        mcp_stream_gate_close(&conn->gate);
+    }
+}
+
+static void mcp_unix_destroy(mcp_transport* transport) {
+    mcp_unix_server* server = (mcp_unix_server*)transport;
+    while (server->conns != NULL) {
+        mcp_unix_close(server->conns);
+    }
+    // Run the deferred frees before the server goes away
+    mcp_event_loop_drain(&server->net->loop);
+    free(server);
+}
+
+int mcp_unix_listen(mcp_net* net, const char* path) {
+    struct sockaddr_un address;
+    struct stat info;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    mcp_unix_server* server = (mcp_unix_server*)calloc(1, sizeof(mcp_unix_server));
+    if (!server) {
+        return -1;
+    }
+    server->net = net;
+    server->transport.stop = mcp_unix_stop;
+    server->transport.destroy = mcp_unix_destroy;
+    server->listener.on_event = mcp_unix_accept;
+    snprintf(server->path, sizeof(server->path), "%s", path);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    // Replace the socket file a previous run left behind, never a regular file
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+    server->listener.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listener.fd < 0 ||
+        bind(server->listener.fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(server->listener.fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+        if (server->listener.fd >= 0) close(server->listener.fd);
+        free(server);
+        return -1;
+    }
+    if (mcp_event_loop_add(&net->loop, &server->listener, MCP_EVENT_READ) != 0) {
+        fprintf(stderr, "Failed to set up Unix socket server\n");
+        close(server->listener.fd);
+        unlink(path);
+        free(server);
+        return -1;
+    }
+    mcp_net_add(net, &server->transport);
+    fprintf(stderr, "mcp server listening on unix:%s\n", path);
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !__linux__ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_unix_listen(mcp_net* net, const char* path) {
+    (void)net;
+    (void)path;
+    fprintf(stderr, "The Unix socket transport is only available on Linux\n");
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __linux__ */
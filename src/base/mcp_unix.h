@@ -0,0 +1,31 @@
+#ifndef MCP_UNIX_H
+#define MCP_UNIX_H
+
+#include "mcp_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-connection buffers start small and grow, so idle agents stay cheap
+#define MCP_UNIX_BUFFER_SIZE 4096
+
+/**
+ * @brief Starts serving newline-delimited JSON-RPC (the stdio framing) on a
+ * Unix domain socket at `path`, as a transport of `net`.
+ *
+ * Every connection is one client with its own mcp_session, so each agent
+ * runs its own initialize handshake, while all of them share the tool
+ * registry and the net's worker pool. Requests of one connection run
+ * concurrently and are answered in completion order. A stale socket file
+ * left by a previous run is replaced; the file is removed on shutdown.
+ *
+ * @return 0 once listening, -1 if the socket could not be set up.
+ */
+int mcp_unix_listen(mcp_net* net, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_UNIX_H */
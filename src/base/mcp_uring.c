@@ -0,0 +1,910 @@
+#include <stdlib.h>
+#include "mcp_uring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#if defined(__linux__) && defined(IORING_RECV_MULTISHOT)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Operation in the low byte of user_data, the slot index above it
+enum {
+    MCP_URING_IGNORE = 0,  // Cancellations and updates, nothing to do on completion
+    MCP_URING_WAKE,
+    MCP_URING_POLL,
+    MCP_URING_RECV,
+    MCP_URING_SEND
+};
+
+/**
+ * @brief Loop-side state of one handler. Completions name the slot, not the
+ * handler, so a handler can go away while the kernel still owes completions;
+ * the slot is recycled once `pending` drops to zero.
+ */
+typedef struct mcp_uring_slot {
+    mcp_event_handler* handler;  // NULL once removed
+    int fd;
+    int next_free;
+    int error;                   // errno of a failed receive or send
+    unsigned events;
+    unsigned pending;            // Operations still owing their final completion
+    bool used;
+    bool stream;
+    bool recv_armed;
+    bool eof;
+    bool hangup_seen;            // mcp_uring_read() already reported eof or error
+    bool ready;                  // Queued to be reported after this round's completions
+    bool close_fd;               // Close the descriptor once the send in flight is done
+    const char* received;        // Provided buffer of the completion being handled
+    size_t received_length;
+    char* backlog;               // Received bytes the handler has not read yet
+    size_t backlog_length;
+    size_t backlog_capacity;
+    char* sending;               // Owned by the kernel while send_length > 0
+    size_t sending_capacity;
+    size_t send_offset;
+    size_t send_length;
+} mcp_uring_slot;
+
+struct mcp_uring {
+    mcp_event_loop* loop;
+    int fd;
+    void* ring;
+    size_t ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;      // SQEs filled so far, published on submit
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    struct io_uring_buf_ring* buffers;
+    size_t buffers_size;
+    char* buffer_memory;
+    uint64_t wake_value;
+    bool wake_armed;
+    bool closing;
+    mcp_uring_slot* slots;
+    int slot_count;
+    int free_slot;
+    int* ready;
+    int ready_count;
+    int ready_capacity;
+};
+
+static uint64_t mcp_uring_data(int index, int kind) {
+    return ((uint64_t)index << 8) | (uint64_t)kind;
+}
+
+static int mcp_uring_enter(mcp_uring* uring, unsigned to_submit, unsigned min_complete) {
+    return (int)syscall(__NR_io_uring_enter, uring->fd, to_submit, min_complete,
+                        min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Publishes the queued SQEs and, with `min_complete`, waits for completions in the same syscall
+static int mcp_uring_submit(mcp_uring* uring, unsigned min_complete) {
+    __atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = uring->sq_local_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && min_complete == 0) {
+        return 0;
+    }
+    return mcp_uring_enter(uring, to_submit, min_complete);
+}
+
+static struct io_uring_sqe* mcp_uring_sqe(mcp_uring* uring, uint64_t user_data) {
+    if (uring->sq_local_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+        // Ring full: hand what is queued to the kernel without waiting
+        while (mcp_uring_submit(uring, 0) < 0 && errno == EINTR) {
+        }
+        if (uring->sq_local_tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) == uring->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &uring->sqes[uring->sq_local_tail & uring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    uring->sq_local_tail++;
+    return sqe;
+}
+
+static unsigned mcp_uring_poll_mask(unsigned events) {
+    unsigned mask = 0;
+    if (events & MCP_EVENT_READ) mask |= POLLIN | POLLRDHUP;
+    if (events & MCP_EVENT_WRITE) mask |= POLLOUT;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    return mask;
+}
+
+// --- Provided buffers ---
+
+static void mcp_uring_recycle(mcp_uring* uring, unsigned bid) {
+    // Only this thread moves the tail, the kernel moves the head
+    unsigned short tail = uring->buffers->tail;
+    struct io_uring_buf* buf = &uring->buffers->bufs[tail & (MCP_URING_BUFFER_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(uring->buffer_memory + (size_t)bid * MCP_URING_BUFFER_SIZE);
+    buf->len = MCP_URING_BUFFER_SIZE;
+    buf->bid = (unsigned short)bid;
+    __atomic_store_n(&uring->buffers->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+// --- Operations ---
+
+static int mcp_uring_arm_wake(mcp_uring* uring) {
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(0, MCP_URING_WAKE));
+    if (!sqe) {
+        return -1;
+    }
+    // Reading the eventfd here replaces the read() of the epoll wake handler
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = uring->loop->wake.fd;
+    sqe->addr = (uint64_t)(uintptr_t)&uring->wake_value;
+    sqe->len = sizeof(uring->wake_value);
+    sqe->off = (uint64_t)-1;
+    uring->wake_armed = true;
+    return 0;
+}
+
+static int mcp_uring_arm_poll(mcp_uring* uring, int index) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(index, MCP_URING_POLL));
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = slot->fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = mcp_uring_poll_mask(slot->events);
+    slot->pending++;
+    return 0;
+}
+
+static int mcp_uring_arm_recv(mcp_uring* uring, int index) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(index, MCP_URING_RECV));
+    if (!sqe) {
+        return -1;
+    }
+    // One request keeps receiving, each chunk in a buffer the kernel picks from the ring
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = slot->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    slot->recv_armed = true;
+    slot->pending++;
+    return 0;
+}
+
+static int mcp_uring_arm_send(mcp_uring* uring, int index) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(index, MCP_URING_SEND));
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->sending + slot->send_offset);
+    sqe->len = (unsigned)(slot->send_length - slot->send_offset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    slot->pending++;
+    return 0;
+}
+
+static void mcp_uring_cancel(mcp_uring* uring, int index, int kind) {
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(0, MCP_URING_IGNORE));
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = mcp_uring_data(index, kind);
+    }
+}
+
+// --- Slots ---
+
+static int mcp_uring_slot_alloc(mcp_uring* uring) {
+    if (uring->free_slot < 0) {
+        int count = uring->slot_count > 0 ? uring->slot_count * 2 : 64;
+        mcp_uring_slot* slots = (mcp_uring_slot*)realloc(uring->slots, (size_t)count * sizeof(mcp_uring_slot));
+        if (!slots) {
+            return -1;
+        }
+        memset(slots + uring->slot_count, 0, (size_t)(count - uring->slot_count) * sizeof(mcp_uring_slot));
+        for (int i = uring->slot_count; i < count; ++i) {
+            slots[i].next_free = i + 1 < count ? i + 1 : -1;
+        }
+        uring->free_slot = uring->slot_count;
+        uring->slots = slots;
+        uring->slot_count = count;
+    }
+    int index = uring->free_slot;
+    uring->free_slot = uring->slots[index].next_free;
+    uring->slots[index].used = true;
+    return index;
+}
+
+static void mcp_uring_slot_maybe_free(mcp_uring* uring, int index) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    if (!slot->used || slot->handler != NULL || slot->pending > 0 || slot->ready) {
+        return;
+    }
+    if (slot->close_fd) {
+        close(slot->fd);
+    }
+    free(slot->backlog);
+    free(slot->sending);
+    memset(slot, 0, sizeof(*slot));
+    slot->next_free = uring->free_slot;
+    uring->free_slot = index;
+}
+
+static void mcp_uring_mark_ready(mcp_uring* uring, int index) {
+    if (uring->slots[index].ready) {
+        return;
+    }
+    if (uring->ready_count == uring->ready_capacity) {
+        int capacity = uring->ready_capacity > 0 ? uring->ready_capacity * 2 : 64;
+        int* ready = (int*)realloc(uring->ready, (size_t)capacity * sizeof(int));
+        if (!ready) {
+            return;
+        }
+        uring->ready = ready;
+        uring->ready_capacity = capacity;
+    }
+    uring->ready[uring->ready_count++] = index;
+    uring->slots[index].ready = true;
+}
+
+static bool mcp_uring_wants_recv(mcp_uring* uring, mcp_uring_slot* slot) {
+    return !uring->closing && slot->handler != NULL && slot->stream && (slot->events & MCP_EVENT_READ) &&
+           !slot->recv_armed && !slot->eof && slot->error == 0;
+}
+
+/**
+ * @brief Reports what a stream handler can do now, level-triggered like
+ * epoll: READ while received bytes or a hang-up wait, WRITE while no send is
+ * in flight, ERROR once a receive or send failed.
+ */
+static void mcp_uring_deliver(mcp_uring* uring, int index) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    mcp_event_handler* handler = slot->handler;
+    unsigned events = 0;
+    if (handler == NULL || uring->closing) {
+        return;
+    }
+    if ((slot->events & MCP_EVENT_READ) &&
+        (slot->received != NULL || slot->backlog_length > 0 || slot->eof)) {
+        events |= MCP_EVENT_READ;
+    }
+    if (slot->error != 0) {
+        events |= MCP_EVENT_READ | MCP_EVENT_ERROR;
+    }
+    if ((slot->events & MCP_EVENT_WRITE) && slot->send_length == 0) {
+        events |= MCP_EVENT_WRITE;
+    }
+    if (events == 0) {
+        return;
+    }
+    handler->on_event(handler, events);
+
+    // The handler may have added slots (moving the array) or removed itself
+    slot = &uring->slots[index];
+    if (slot->handler != NULL &&
+        (((slot->events & MCP_EVENT_READ) && slot->backlog_length > 0) ||
+         ((slot->eof || slot->error != 0) && !slot->hangup_seen))) {
+        mcp_uring_mark_ready(uring, index);
+    }
+}
+
+static int mcp_uring_stash(mcp_uring_slot* slot, const char* data, size_t length) {
+    if (slot->backlog_capacity - slot->backlog_length < length) {
+        size_t capacity = slot->backlog_capacity > 0 ? slot->backlog_capacity : MCP_URING_BUFFER_SIZE;
+        while (capacity - slot->backlog_length < length) {
+            capacity *= 2;
+        }
+        char* backlog = (char*)realloc(slot->backlog, capacity);
+        if (!backlog) {
+            return -1;
+        }
+        slot->backlog = backlog;
+        slot->backlog_capacity = capacity;
+    }
+    memcpy(slot->backlog + slot->backlog_length, data, length);
+    slot->backlog_length += length;
+    return 0;
+}
+
+// --- Completions ---
+
+static void mcp_uring_on_poll(mcp_uring* uring, int index, int res, bool more) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    if (slot->handler == NULL || uring->closing || res == -ECANCELED) {
+        return;
+    }
+    if (res >= 0) {
+        unsigned ready = 0;
+        if (res & (POLLIN | POLLRDHUP)) ready |= MCP_EVENT_READ;
+        if (res & POLLOUT) ready |= MCP_EVENT_WRITE;
+        if (res & (POLLERR | POLLHUP)) ready |= MCP_EVENT_ERROR;
+        slot->handler->on_event(slot->handler, ready);
+        slot = &uring->slots[index];
+    }
+    // The kernel ends a multishot poll on overflow; keep watching
+    if (!more && res >= 0 && slot->handler != NULL) {
+        mcp_uring_arm_poll(uring, index);
+    }
+}
+
+static void mcp_uring_on_recv(mcp_uring* uring, int index, int res, unsigned flags) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    if (!(flags & IORING_CQE_F_MORE)) {
+        slot->recv_armed = false;
+    }
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (slot->handler != NULL && !uring->closing) {
+            slot->received = uring->buffer_memory + (size_t)bid * MCP_URING_BUFFER_SIZE;
+            slot->received_length = (size_t)res;
+            mcp_uring_deliver(uring, index);
+            slot = &uring->slots[index];
+            // Bytes the handler left behind must not stay in the shared buffer
+            if (slot->received != NULL && slot->handler != NULL &&
+                mcp_uring_stash(slot, slot->received, slot->received_length) != 0) {
+                slot->error = ENOMEM;
+                mcp_uring_mark_ready(uring, index);
+            }
+            slot->received = NULL;
+        }
+        mcp_uring_recycle(uring, bid);
+    } else if (res == 0) {
+        slot->eof = true;
+        mcp_uring_deliver(uring, index);
+    } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+        // ENOBUFS: every buffer was taken, those of this round are back by now
+        slot->error = -res;
+        mcp_uring_deliver(uring, index);
+    }
+    slot = &uring->slots[index];
+    if (mcp_uring_wants_recv(uring, slot)) {
+        mcp_uring_arm_recv(uring, index);
+    }
+}
+
+static void mcp_uring_on_send(mcp_uring* uring, int index, int res) {
+    mcp_uring_slot* slot = &uring->slots[index];
+    if (res > 0 && slot->send_offset + (size_t)res < slot->send_length) {
+        // Short send: the rest goes out before anything newer
+        slot->send_offset += (size_t)res;
+        if (!uring->closing && (slot->handler != NULL || slot->close_fd) && mcp_uring_arm_send(uring, index) == 0) {
+            return;
+        }
+        if (!uring->closing && slot->handler != NULL) {
+            // No room to send the rest: a reply cut short must end the connection
+            slot->error = EBUSY;
+        }
+    } else if (res <= 0 && slot->handler != NULL) {
+        slot->error = res < 0 ? -res : EPIPE;
+    }
+    slot->send_offset = 0;
+    slot->send_length = 0;
+    if (slot->sending_capacity > MCP_WRITER_RETAIN_CAPACITY) {
+        free(slot->sending);
+        slot->sending = NULL;
+        slot->sending_capacity = 0;
+    }
+    if (slot->close_fd && slot->handler == NULL) {
+        close(slot->fd);
+        slot->close_fd = false;
+    }
+    mcp_uring_deliver(uring, index);
+}
+
+static void mcp_uring_complete(mcp_uring* uring, uint64_t user_data, int res, unsigned flags) {
+    int kind = (int)(user_data & 0xff);
+    int index = (int)(user_data >> 8);
+
+    if (kind == MCP_URING_IGNORE) {
+        return;
+    }
+    if (kind == MCP_URING_WAKE) {
+        uring->wake_armed = false;
+        if (!uring->closing) {
+            mcp_uring_arm_wake(uring);
+        }
+        return;
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+        uring->slots[index].pending--;
+    }
+    switch (kind) {
+    case MCP_URING_POLL:
+        mcp_uring_on_poll(uring, index, res, (flags & IORING_CQE_F_MORE) != 0);
+        break;
+    case MCP_URING_RECV:
+        mcp_uring_on_recv(uring, index, res, flags);
+        break;
+    case MCP_URING_SEND:
+        mcp_uring_on_send(uring, index, res);
+        break;
+    default:
+        break;
+    }
+    mcp_uring_slot_maybe_free(uring, index);
+}
+
+static void mcp_uring_reap(mcp_uring* uring) {
+    unsigned head = *uring->cq_head;
+    while (head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        // Hand the entry back before the handler runs, it may submit more work
+        __atomic_store_n(uring->cq_head, ++head, __ATOMIC_RELEASE);
+        mcp_uring_complete(uring, user_data, res, flags);
+    }
+}
+
+static void mcp_uring_process_ready(mcp_uring* uring) {
+    // Slots queued while these are reported wait for the next round
+    int count = uring->ready_count;
+    if (count == 0) {
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        int index = uring->ready[i];
+        uring->slots[index].ready = false;
+        mcp_uring_deliver(uring, index);
+        mcp_uring_slot_maybe_free(uring, index);
+    }
+    memmove(uring->ready, uring->ready + count, (size_t)(uring->ready_count - count) * sizeof(int));
+    uring->ready_count -= count;
+}
+
+// --- Setup ---
+
+// Multishot receive (Linux 6.0) has no feature bit: try it once on a socketpair
+static bool mcp_uring_probe(mcp_uring* uring) {
+    int pair[2];
+    bool supported = false;
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        return false;
+    }
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(0, MCP_URING_IGNORE));
+    if (sqe != NULL && write(pair[1], "x", 1) == 1) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        bool armed = false;
+        // First the byte, then (after the peer closes) the final completion
+        for (int round = 0; round < 2; ++round) {
+            if (mcp_uring_submit(uring, 1) < 0) {
+                break;
+            }
+            unsigned head = *uring->cq_head;
+            if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            struct io_uring_cqe* cqe = &uring->cqes[head & uring->cq_mask];
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                mcp_uring_recycle(uring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            armed = (cqe->flags & IORING_CQE_F_MORE) != 0;
+            if (round == 0) {
+                supported = cqe->res == 1 && armed;
+            }
+            __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+            if (!armed) {
+                break;
+            }
+            close(pair[1]);
+            pair[1] = -1;
+        }
+    }
+    if (pair[1] >= 0) close(pair[1]);
+    close(pair[0]);
+    return supported;
+}
+
+static void mcp_uring_free(mcp_uring* uring) {
+    if (uring->buffers != NULL) munmap(uring->buffers, uring->buffers_size);
+    if (uring->sqes != NULL) munmap(uring->sqes, uring->sqes_size);
+    if (uring->ring != NULL) munmap(uring->ring, uring->ring_size);
+    if (uring->fd >= 0) close(uring->fd);
+    free(uring->buffer_memory);
+    free(uring->slots);
+    free(uring->ready);
+    free(uring);
+}
+
+mcp_uring* mcp_uring_create(mcp_event_loop* loop) {
+    const char* env = getenv(MCP_IO_ENV);
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+
+    if (env != NULL && strcmp(env, "epoll") == 0) {
+        return NULL;
+    }
+    mcp_uring* uring = (mcp_uring*)calloc(1, sizeof(mcp_uring));
+    if (!uring) {
+        return NULL;
+    }
+    uring->loop = loop;
+    uring->free_slot = -1;
+    memset(&params, 0, sizeof(params));
+    // Multishot receives produce many completions per request, leave them room
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = MCP_URING_ENTRIES * 4;
+    uring->fd = (int)syscall(__NR_io_uring_setup, MCP_URING_ENTRIES, &params);
+    // Blocked (seccomp, io_uring_disabled) or too old: the caller falls back to epoll
+    if (uring->fd < 0 || (params.features & required) != required) {
+        mcp_uring_free(uring);
+        return NULL;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    uring->ring = mmap(NULL, uring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       uring->fd, IORING_OFF_SQ_RING);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = (struct io_uring_sqe*)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+        if (uring->ring == MAP_FAILED) uring->ring = NULL;
+        if (uring->sqes == MAP_FAILED) uring->sqes = NULL;
+        mcp_uring_free(uring);
+        return NULL;
+    }
+    char* ring = (char*)uring->ring;
+    uring->sq_head = (unsigned*)(ring + params.sq_off.head);
+    uring->sq_tail = (unsigned*)(ring + params.sq_off.tail);
+    uring->sq_mask = *(unsigned*)(ring + params.sq_off.ring_mask);
+    uring->sq_entries = params.sq_entries;
+    uring->sq_local_tail = *uring->sq_tail;
+    uring->cq_head = (unsigned*)(ring + params.cq_off.head);
+    uring->cq_tail = (unsigned*)(ring + params.cq_off.tail);
+    uring->cq_mask = *(unsigned*)(ring + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+    // SQE slot i is always submitted from array entry i
+    unsigned* array = (unsigned*)(ring + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; ++i) {
+        array[i] = i;
+    }
+
+    // Register the receive buffers once, instead of passing one per read
+    uring->buffers_size = MCP_URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    uring->buffers = (struct io_uring_buf_ring*)mmap(NULL, uring->buffers_size, PROT_READ | PROT_WRITE,
+                                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    uring->buffer_memory = (char*)malloc((size_t)MCP_URING_BUFFER_COUNT * MCP_URING_BUFFER_SIZE);
+    if (uring->buffers == MAP_FAILED) {
+        uring->buffers = NULL;
+    }
+    if (uring->buffers == NULL || uring->buffer_memory == NULL) {
+        mcp_uring_free(uring);
+        return NULL;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)uring->buffers;
+    reg.ring_entries = MCP_URING_BUFFER_COUNT;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, uring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        mcp_uring_free(uring);
+        return NULL;
+    }
+    for (unsigned bid = 0; bid < MCP_URING_BUFFER_COUNT; ++bid) {
+        mcp_uring_recycle(uring, bid);
+    }
+    if (!mcp_uring_probe(uring)) {
+        mcp_uring_free(uring);
+        return NULL;
+    }
+    // io_uring fails reads of O_NONBLOCK files with EAGAIN instead of waiting
+    int wake_flags = fcntl(loop->wake.fd, F_GETFL);
+    if (wake_flags < 0 || fcntl(loop->wake.fd, F_SETFL, wake_flags & ~O_NONBLOCK) != 0 ||
+        mcp_uring_arm_wake(uring) != 0) {
+        mcp_uring_free(uring);
+        return NULL;
+    }
+    return uring;
+}
+
+void mcp_uring_destroy(mcp_uring* uring) {
+    uring->closing = true;
+    // Cancel everything and collect the completions, so no operation still
+    // points at slot or buffer memory when it is freed
+    struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(0, MCP_URING_IGNORE));
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    }
+    for (;;) {
+        bool outstanding = uring->wake_armed;
+        for (int i = 0; i < uring->slot_count && !outstanding; ++i) {
+            outstanding = uring->slots[i].pending > 0;
+        }
+        if (!outstanding) {
+            break;
+        }
+        if (mcp_uring_submit(uring, 1) < 0 && errno != EINTR && errno != EBUSY) {
+            break;
+        }
+        mcp_uring_reap(uring);
+    }
+    for (int i = 0; i < uring->slot_count; ++i) {
+        mcp_uring_slot* slot = &uring->slots[i];
+        if (slot->used && slot->close_fd) {
+            close(slot->fd);
+        }
+        free(slot->backlog);
+        free(slot->sending);
+    }
+    mcp_uring_free(uring);
+}
+
+// --- Handlers ---
+
+int mcp_uring_add(mcp_uring* uring, mcp_event_handler* handler, unsigned events) {
+    int index = mcp_uring_slot_alloc(uring);
+    if (index < 0) {
+        return -1;
+    }
+    mcp_uring_slot* slot = &uring->slots[index];
+    slot->handler = handler;
+    slot->fd = handler->fd;
+    slot->stream = (events & MCP_EVENT_STREAM) != 0;
+    slot->events = events & (MCP_EVENT_READ | MCP_EVENT_WRITE);
+    handler->slot = index;
+    int ret = 0;
+    if (!slot->stream) {
+        ret = mcp_uring_arm_poll(uring, index);
+    } else if (mcp_uring_wants_recv(uring, slot)) {
+        ret = mcp_uring_arm_recv(uring, index);
+    }
+    if (ret != 0) {
+        slot->handler = NULL;
+        mcp_uring_slot_maybe_free(uring, index);
+        errno = EBUSY;
+        return -1;
+    }
+    return 0;
+}
+
+int mcp_uring_modify(mcp_uring* uring, mcp_event_handler* handler, unsigned events) {
+    int index = handler->slot;
+    mcp_uring_slot* slot = &uring->slots[index];
+    events &= MCP_EVENT_READ | MCP_EVENT_WRITE;
+    if (events == slot->events) {
+        return 0;
+    }
+    slot->events = events;
+    if (!slot->stream) {
+        struct io_uring_sqe* sqe = mcp_uring_sqe(uring, mcp_uring_data(0, MCP_URING_IGNORE));
+        if (!sqe) {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = mcp_uring_data(index, MCP_URING_POLL);
+        sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = mcp_uring_poll_mask(events);
+        return 0;
+    }
+    if (events & MCP_EVENT_READ) {
+        if (mcp_uring_wants_recv(uring, slot) && mcp_uring_arm_recv(uring, index) != 0) {
+            return -1;
+        }
+    } else if (slot->recv_armed) {
+        // Stop pulling bytes while the handler is busy; a late chunk goes to the backlog
+        mcp_uring_cancel(uring, index, MCP_URING_RECV);
+    }
+    if (((events & MCP_EVENT_READ) && (slot->backlog_length > 0 || (slot->eof && !slot->hangup_seen))) ||
+        ((events & MCP_EVENT_WRITE) && slot->send_length == 0)) {
+        mcp_uring_mark_ready(uring, index);
+    }
+    return 0;
+}
+
+void mcp_uring_remove(mcp_uring* uring, mcp_event_handler* handler, bool close_fd) {
+    int index = handler->slot;
+    mcp_uring_slot* slot = &uring->slots[index];
+    slot->handler = NULL;
+    if (!slot->stream) {
+        mcp_uring_cancel(uring, index, MCP_URING_POLL);
+    } else if (slot->recv_armed) {
+        mcp_uring_cancel(uring, index, MCP_URING_RECV);
+    }
+    if (close_fd) {
+        // In-flight operations hold their own reference to the socket, only a
+        // short send still needs the descriptor for its rest
+        if (slot->send_length > 0) {
+            slot->close_fd = true;
+        } else {
+            close(slot->fd);
+        }
+    }
+    // Recycled after this round, the caller may still be inside a completion of it
+    mcp_uring_mark_ready(uring, index);
+}
+
+long mcp_uring_read(mcp_uring* uring, mcp_event_handler* handler, mcp_framer* framer) {
+    mcp_uring_slot* slot = &uring->slots[handler->slot];
+    size_t total = 0;
+    if (slot->backlog_length > 0) {
+        if (mcp_framer_append(framer, slot->backlog, slot->backlog_length) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+        total += slot->backlog_length;
+        slot->backlog_length = 0;
+    }
+    if (slot->received != NULL) {
+        if (mcp_framer_append(framer, slot->received, slot->received_length) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+        total += slot->received_length;
+        slot->received = NULL;
+    }
+    if (total > 0) {
+        return (long)total;
+    }
+    if (slot->error != 0) {
+        slot->hangup_seen = true;
+        errno = slot->error;
+        return -1;
+    }
+    if (slot->eof) {
+        slot->hangup_seen = true;
+        framer->eof = true;
+        return 0;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+long mcp_uring_write(mcp_uring* uring, mcp_event_handler* handler, mcp_writer* writer) {
+    int index = handler->slot;
+    mcp_uring_slot* slot = &uring->slots[index];
+    if (writer->length == 0) {
+        return 0;
+    }
+    if (slot->error != 0) {
+        errno = slot->error;
+        return -1;
+    }
+    if (slot->send_length > 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    // Swap buffers: the kernel sends the filled one, the writer keeps appending to the idle one
+    char* idle = slot->sending;
+    size_t idle_capacity = slot->sending_capacity;
+    if (idle == NULL) {
+        idle_capacity = writer->capacity;
+        idle = (char*)malloc(idle_capacity);
+        if (!idle) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    long length = (long)writer->length;
+    slot->sending = writer->data;
+    slot->sending_capacity = writer->capacity;
+    slot->send_offset = 0;
+    slot->send_length = writer->length;
+    writer->data = idle;
+    writer->capacity = idle_capacity;
+    writer->length = 0;
+    if (mcp_uring_arm_send(uring, index) != 0) {
+        slot->send_length = 0;
+        errno = EBUSY;
+        return -1;
+    }
+    return length;
+}
+
+int mcp_uring_run(mcp_uring* uring) {
+    mcp_event_loop* loop = uring->loop;
+    while (!mcp_atomic_load(&loop->stopping)) {
+        // One syscall submits the whole round's work and waits for the next completions
+        if (mcp_uring_submit(uring, uring->ready_count > 0 ? 0 : 1) < 0 &&
+            errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            perror("io_uring_enter");
+            return -1;
+        }
+        mcp_uring_reap(uring);
+        mcp_uring_process_ready(uring);
+        // Completions posted by workers are handled after the I/O of this round
+        mcp_event_loop_drain(loop);
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#elif defined(__linux__)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernel headers without multishot receive: the loop always runs on epoll
+mcp_uring* mcp_uring_create(mcp_event_loop* loop) {
+    (void)loop;
+    return NULL;
+}
+
+void mcp_uring_destroy(mcp_uring* uring) {
+    (void)uring;
+}
+
+int mcp_uring_add(mcp_uring* uring, mcp_event_handler* handler, unsigned events) {
+    (void)uring;
+    (void)handler;
+    (void)events;
+    return -1;
+}
+
+int mcp_uring_modify(mcp_uring* uring, mcp_event_handler* handler, unsigned events) {
+    (void)uring;
+    (void)handler;
+    (void)events;
+    return -1;
+}
+
+void mcp_uring_remove(mcp_uring* uring, mcp_event_handler* handler, bool close_fd) {
+    (void)uring;
+    (void)handler;
+    (void)close_fd;
+}
+
+long mcp_uring_read(mcp_uring* uring, mcp_event_handler* handler, mcp_framer* framer) {
+    (void)uring;
+    (void)handler;
+    (void)framer;
+    return -1;
+}
+
+long mcp_uring_write(mcp_uring* uring, mcp_event_handler* handler, mcp_writer* writer) {
+    (void)uring;
+    (void)handler;
+    (void)writer;
+    return -1;
+}
+
+int mcp_uring_run(mcp_uring* uring) {
+    (void)uring;
+    return -1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MCP_URING_H
+#define MCP_URING_H
+
+#include <stdbool.h>
+#include "mcp_event_loop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set to "epoll" to keep the socket transports off io_uring
+#define MCP_IO_ENV "MCPC_IO"
+#define MCP_URING_ENTRIES 256
+// Provided buffers that multishot receives land in, shared by all connections
+#define MCP_URING_BUFFER_SIZE (16 * 1024)
+#define MCP_URING_BUFFER_COUNT 128
+
+typedef struct mcp_uring mcp_uring;
+
+/**
+ * @brief io_uring backend of mcp_event_loop, built on raw syscalls.
+ *
+ * Listeners and timers are watched with multishot polls. Stream handlers
+ * get a multishot receive into a registered ring of provided buffers, and
+ * their output is handed to the kernel as one send per flush. Everything a
+ * loop round queues is submitted together with the wait for the next
+ * completions, so a busy connection costs no read, write or epoll syscalls.
+ *
+ * @return NULL when the kernel lacks multishot receive (before 6.0), when
+ * io_uring is blocked, or when MCPC_IO=epoll; the loop then uses epoll.
+ */
+mcp_uring* mcp_uring_create(mcp_event_loop* loop);
+
+/**
+ * @brief Cancels what is still in flight, closes descriptors whose close was
+ * deferred and frees the ring. Handlers are not called any more.
+ */
+void mcp_uring_destroy(mcp_uring* uring);
+
+int mcp_uring_add(mcp_uring* uring, mcp_event_handler* handler, unsigned events);
+int mcp_uring_modify(mcp_uring* uring, mcp_event_handler* handler, unsigned events);
+void mcp_uring_remove(mcp_uring* uring, mcp_event_handler* handler, bool close_fd);
+long mcp_uring_read(mcp_uring* uring, mcp_event_handler* handler, mcp_framer* framer);
+long mcp_uring_write(mcp_uring* uring, mcp_event_handler* handler, mcp_writer* writer);
+int mcp_uring_run(mcp_uring* uring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_URING_H */
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp_writer.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define mcp_write(fd, buf, n) _write((fd), (buf), (unsigned int)(n))
+#else
+#include <unistd.h>
+#define mcp_write(fd, buf, n) write((fd), (buf), (n))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mcp_writer_init(mcp_writer* writer, int fd, size_t initial_capacity) {
+    if (initial_capacity == 0) {
+        initial_capacity = MCP_WRITER_INITIAL_CAPACITY;
+    }
+    writer->data = (char*)malloc(initial_capacity);
+    if (!writer->data) {
+        return -1;
+    }
+    writer->capacity = initial_capacity;
+    writer->start = 0;
+    writer->length = 0;
+    writer->fd = fd;
+    return 0;
+}
+
+void mcp_writer_destroy(mcp_writer* writer) {
+    free(writer->data);
+    writer->data = NULL;
+    writer->capacity = 0;
+    writer->start = 0;
+    writer->length = 0;
+}
+
+// Moves the unsent tail to the front of the buffer
+static void mcp_writer_compact(mcp_writer* writer) {
+    writer->length -= writer->start;
+    memmove(writer->data, writer->data + writer->start, writer->length);
+    writer->start = 0;
+}
+
+int mcp_writer_reserve(mcp_writer* writer, size_t extra) {
+    if (writer->capacity - writer->length >= extra) {
+        return 0;
+    }
+    if (writer->start > 0) {
+        // Reclaim the sent front before growing
+        mcp_writer_compact(writer);
+        if (writer->capacity - writer->length >= extra) {
+            return 0;
+        }
+    }
+    size_t new_capacity = writer->capacity;
+    while (new_capacity - writer->length < extra) {
+        new_capacity *= 2;
+    }
+    char* data = (char*)realloc(writer->data, new_capacity);
+    if (!data) {
+        return -1;
+    }
+    writer->data = data;
+    writer->capacity = new_capacity;
+    return 0;
+}
+
+int mcp_writer_append(mcp_writer* writer, const char* data, size_t length) {
+    if (mcp_writer_reserve(writer, length) != 0) {
+        return -1;
+    }
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+    return 0;
+}
+
+int mcp_writer_append_json(mcp_writer* writer, cJSON* item) {
+    // cJSON needs a few spare bytes beyond the printed text; grow and retry on failure
+    size_t extra = 256;
+    for (;;) {
+        if (mcp_writer_reserve(writer, extra) != 0) {
+            return -1;
+        }
+        size_t available = writer->capacity - writer->length;
+        if (available > INT_MAX) {
+            available = INT_MAX;
+        }
+        char* out = writer->data + writer->length;
+        if (cJSON_PrintPreallocated(item, out, (int)available, 0)) {
+            writer->length += strlen(out);
+            return mcp_writer_append(writer, "\n", 1);
+        }
+        if (available == INT_MAX) {
+            return -1;
+        }
+        extra = available * 2;
+    }
+}
+
+// 单个超大响应之后释放多余内存, 避免 RSS 长期停留在峰值
+static void mcp_writer_shrink(mcp_writer* writer) {
+    if (writer->capacity > MCP_WRITER_RETAIN_CAPACITY) {
+        char* data = (char*)realloc(writer->data, MCP_WRITER_INITIAL_CAPACITY);
+        if (data) {
+            writer->data = data;
+            writer->capacity = MCP_WRITER_INITIAL_CAPACITY;
+        }
+    }
+}
+
+int mcp_writer_flush(mcp_writer* writer) {
+    size_t offset = writer->start;
+    int ret = 0;
+    while (offset < writer->length) {
+        long n = (long)mcp_write(writer->fd, writer->data + offset, writer->length - offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = -1;
+            break;
+        }
+        offset += (size_t)n;
+    }
+    writer->start = 0;
+    writer->length = 0;
+    mcp_writer_shrink(writer);
+    return ret;
+}
+
+long mcp_writer_write_some(mcp_writer* writer) {
+    if (writer->length == 0) {
+        return 0;
+    }
+    long n;
+    do {
+        n = (long)mcp_write(writer->fd, writer->data + writer->start, writer->length - writer->start);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return n;
+    }
+    // Moving the tail after every partial write would copy a large reply
+    // over and over while a slow reader takes it piece by piece
+    writer->start += (size_t)n;
+    if (writer->start == writer->length) {
+        writer->start = 0;
+        writer->length = 0;
+        mcp_writer_shrink(writer);
+    } else if (writer->start > writer->capacity / 2) {
+        mcp_writer_compact(writer);
+    }
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,70 @@
+#ifndef MCP_WRITER_H
+#define MCP_WRITER_H
+
+#include <stddef.h>
+#include "cJSON.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_WRITER_INITIAL_CAPACITY (16 * 1024)
+// Buffers grown past this by one large reply are shrunk back after a flush
+#define MCP_WRITER_RETAIN_CAPACITY (1024 * 1024)
+
+/**
+ * @brief Per-connection output buffer for JSON-RPC replies.
+ *
+ * Replies are encoded as compact JSON straight into a buffer that is reused
+ * across requests, then sent with a single write() per flush. Several
+ * replies can be appended before one flush to batch them.
+ */
+typedef struct mcp_writer {
+    char* data;
+    size_t capacity;
+    size_t start;   // Bytes at the front mcp_writer_write_some() already sent
+    size_t length;  // End of the encoded bytes; those past `start` wait for the next flush
+    int fd;
+} mcp_writer;
+
+int mcp_writer_init(mcp_writer* writer, int fd, size_t initial_capacity);
+void mcp_writer_destroy(mcp_writer* writer);
+
+/**
+ * @brief Ensures at least `extra` free bytes after the pending data.
+ */
+int mcp_writer_reserve(mcp_writer* writer, size_t extra);
+
+/**
+ * @brief Appends raw bytes to the pending output.
+ */
+int mcp_writer_append(mcp_writer* writer, const char* data, size_t length);
+
+/**
+ * @brief Encodes `item` as compact JSON followed by '\n' into the buffer.
+ * Returns 0 on success, -1 if the buffer cannot grow large enough.
+ */
+int mcp_writer_append_json(mcp_writer* writer, cJSON* item);
+
+/**
+ * @brief Writes every pending byte to the descriptor and empties the buffer.
+ * Returns 0 on success, -1 on a write error.
+ */
+int mcp_writer_flush(mcp_writer* writer);
+
+/**
+ * @brief Non-blocking variant of flush for sockets: performs one write() and
+ * skips the bytes it sent. The unsent tail moves to the front only once the
+ * sent part passes half the buffer, and both reset when nothing is left, so
+ * `length` is 0 exactly when nothing is pending.
+ *
+ * @return Bytes written (0 when nothing is pending), -1 on error with errno
+ * kept, so EAGAIN can be told apart.
+ */
+long mcp_writer_write_some(mcp_writer* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCP_WRITER_H */
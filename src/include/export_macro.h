@@ -21,8 +21,13 @@
         #define _EXPORT_AS5(x, y, z, w, v) #x "/" #y "/" #z "/" #w "/" #v
         #define _GET_EXPORT_AS_MACRO(_1,_2,_3,_4,_5,NAME,...) NAME
         #define EXPORT_AS(...) __declspec(dllexport) /* EXPORT_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
+        #define EXPORT_ASYNC_AS(...) __declspec(dllexport) /* EXPORT_ASYNC_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
+        #define EXPORT_STREAM_AS(...) __declspec(dllexport) /* EXPORT_STREAM_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
         
         #define DES(x) __declspec(dllexport)
+        #define TIMEOUT_MS(ms) /* TIMEOUT_MS=ms */
+        #define PURE /* PURE=1 */
+        #define SINGLE_FLIGHT /* SINGLE_FLIGHT=1 */
     #else
         #define EXPORT 
         // 空定义版本
@@ -33,8 +38,13 @@
         #define _EXPORT_AS5(x, y, z, w, v) #x "/" #y "/" #z "/" #w "/" #v
         #define _GET_EXPORT_AS_MACRO(_1,_2,_3,_4,_5,NAME,...) NAME
         #define EXPORT_AS(...) /* EXPORT_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
+        #define EXPORT_ASYNC_AS(...) /* EXPORT_ASYNC_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
+        #define EXPORT_STREAM_AS(...) /* EXPORT_STREAM_AS=_GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__) */
         
         #define DES(x) 
+        #define TIMEOUT_MS(ms) /* TIMEOUT_MS=ms */
+        #define PURE /* PURE=1 */
+        #define SINGLE_FLIGHT /* SINGLE_FLIGHT=1 */
     #endif
 #else
     // Clang 编译器
@@ -47,8 +57,21 @@
     #define _EXPORT_AS5(x, y, z, w, v) #x "/" #y "/" #z "/" #w "/" #v
     #define _GET_EXPORT_AS_MACRO(_1,_2,_3,_4,_5,NAME,...) NAME
     #define EXPORT_AS(...) __attribute__((annotate("EXPORT_AS=" _GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__))))
+    // 异步版本：函数形如 void fn(mcp_call* call, mcp_cancel_token* cancel, ...)，
+    // 通过 mcp_call_complete()/mcp_call_fail() 回复，并轮询 mcp_cancel_requested(cancel)；
+    // 参数在回复之前一直有效（可交给其他线程使用），回复时才被释放
+    #define EXPORT_ASYNC_AS(...) __attribute__((annotate("EXPORT_ASYNC_AS=" _GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__))))
+    // 流式版本：函数形如 void fn(mcp_stream* out, ...)，用 mcp_stream_* 逐个写出结果，
+    // 大结果按块发送而不必在内存中构建完整的 cJSON 树，可用 mcp_stream_failed(out) 提前停止
+    #define EXPORT_STREAM_AS(...) __attribute__((annotate("EXPORT_STREAM_AS=" _GET_EXPORT_AS_MACRO(__VA_ARGS__, _EXPORT_AS5, _EXPORT_AS4, _EXPORT_AS3, _EXPORT_AS2, _EXPORT_AS1)(__VA_ARGS__))))
     
     #define DES(x) __attribute__((annotate("DESCRIPTION=" #x)))
+    // 超时（毫秒）：到期后回复超时错误并触发取消令牌，可用 MCPC_TIMEOUTS 在运行时覆盖
+    #define TIMEOUT_MS(ms) __attribute__((annotate("TIMEOUT_MS=" #ms)))
+    // 纯函数：结果只取决于参数，按工具名和规范化后的参数缓存序列化结果（MCPC_CACHE_BYTES、MCPC_CACHE_TTL_MS）
+    #define PURE __attribute__((annotate("PURE=1")))
+    // 合并并发的相同调用：同一时刻工具名和参数都相同的请求只运行一次处理函数，结果分发给所有等待者（PURE 已包含此行为）
+    #define SINGLE_FLIGHT __attribute__((annotate("SINGLE_FLIGHT=1")))
 #endif
 
 #endif // EXPORT_MACRO_H
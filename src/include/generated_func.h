@@ -1,6 +1,8 @@
 #ifndef GENERATED_FUNCTION_SIGNATURES_H
 #define GENERATED_FUNCTION_SIGNATURES_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "cJSON.h"
 
 #ifdef __cplusplus
@@ -9,8 +11,26 @@ extern "C" {
 
 cJSON* get_all_function_signatures_json();
 
+// The signatures as export serialized them, unformatted; get_all_function_signatures_json() parses this text
+extern const char function_signatures_json_text[];
+extern const size_t function_signatures_json_length;
+
 cJSON* bridge(cJSON* input_json);
 
+// One exported tool with what its annotations say about it
+typedef struct bridge_tool_info {
+    cJSON* (*handler)(cJSON* params);  // NULL for the tools of loadable modules
+    unsigned timeout_ms;               // Deadline from the TIMEOUT_MS annotation, 0 when it has none
+    bool pure;                         // PURE: its results may be served from the cache
+    bool single_flight;                // PURE or SINGLE_FLIGHT: identical concurrent calls share one run
+} bridge_tool_info;
+
+// Indexed as bridge_tool_names
+extern const bridge_tool_info bridge_tools[];
+
+// The entry of the tool called `name`, NULL when no tool is; one lookup answers every flag
+const bridge_tool_info* bridge_tool(const char* name);
+
 #ifdef __cplusplus
 }
 #endif
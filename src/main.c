@@ -1,18 +1,93 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "base/mcp.h"
+#include "base/mcp_http.h"
+#include "base/mcp_module.h"
+#include "base/mcp_net.h"
+#include "base/mcp_shm.h"
+#include "base/mcp_unix.h"
 // #include "base\mcp.h" // 暂时不需要 mcp.h
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int main() {
-    printf("mcp server is running...\n");
-    mcp_serve();
-    return 0;
+static int usage(const char* program) {
+    fprintf(stderr, "usage: %s                                        serve stdio\n", program);
+    fprintf(stderr, "       %s [--http [host:]port] [--unix path] [--shm path]...\n", program);
+    fprintf(stderr, "              serve sockets and shared memory, one process for all clients\n");
+    fprintf(stderr, "       %s --index-modules manifest module...\n", program);
+    fprintf(stderr, "              write the manifest of loadable tool modules, served with MCPC_MODULES=manifest\n");
+    return 2;
+}
+
+// Listens for streamable HTTP on "[host:]port", host defaults to loopback
+static int listen_http(mcp_net* net, const char* address) {
+    char host[256];
+    const char* colon = strrchr(address, ':');
+    const char* port_text = colon != NULL ? colon + 1 : address;
+    size_t host_length = colon != NULL ? (size_t)(colon - address) : 0;
+    int port = atoi(port_text);
+    if (port <= 0 || port > 65535 || host_length >= sizeof(host)) {
+        fprintf(stderr, "Invalid HTTP address: %s\n", address);
+        return -1;
+    }
+    if (host_length == 0) {
+        snprintf(host, sizeof(host), "%s", MCP_HTTP_DEFAULT_HOST);
+    } else if (address[0] == '[' && host_length >= 2 && address[host_length - 1] == ']') {
+        snprintf(host, sizeof(host), "%.*s", (int)(host_length - 2), address + 1); // [::1]:8080
+    } else {
+        snprintf(host, sizeof(host), "%.*s", (int)host_length, address);
+    }
+    return mcp_http_listen(net, host, port);
+}
+
+int main(int argc, char** argv) {
+    if (argc == 1) {
+        // stdout carries the protocol stream, status goes to stderr
+        fprintf(stderr, "mcp server is running...\n");
+        // Serves requests until stdin is closed
+        return mcp_serve() == 0 ? 0 : 1;
+    }
+    if (strcmp(argv[1], "--index-modules") == 0) {
+        if (argc < 4) {
+            return usage(argv[0]);
+        }
+        return mcp_module_write_index(argv[2], argv + 3, argc - 3) == 0 ? 0 : 1;
+    }
+    if (argc % 2 == 0) {
+        return usage(argv[0]);
+    }
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--http") != 0 && strcmp(argv[i], "--unix") != 0 && strcmp(argv[i], "--shm") != 0) {
+            return usage(argv[0]);
+        }
+    }
+
+    // Every listener shares one event loop and one worker pool
+    mcp_net net;
+    if (mcp_net_init(&net) != 0) {
+        return 1;
+    }
+    for (int i = 1; i < argc; i += 2) {
+        int ret;
+        if (strcmp(argv[i], "--http") == 0) {
+            ret = listen_http(&net, argv[i + 1]);
+        } else if (strcmp(argv[i], "--shm") == 0) {
+            ret = mcp_shm_listen(&net, argv[i + 1]);
+        } else {
+            ret = mcp_unix_listen(&net, argv[i + 1]);
+        }
+        if (ret != 0) {
+            mcp_net_shutdown(&net);
+            return 1;
+        }
+    }
+    // Serves until SIGINT/SIGTERM
+    return mcp_net_run(&net) == 0 ? 0 : 1;
 }
 
 #ifdef __cplusplus
 }
 #endif
-
@@ -5,16 +5,17 @@
 #include "cJSON.h"  // Make sure to include the cJSON header
 #include "export_macro.h"
 #include "file.h"
+#include "mcp_log.h"
 
 EXPORT_AS(get_person_info)
 cJSON* get_person_info(person* p) {
     cJSON* result = cJSON_CreateObject();
     cJSON_AddStringToObject(result, "message", "Hello, World!");
-    printf("p->name: %s\n", p->name);
-    printf("p->age: %d\n", p->age);
-    printf("p->isMale: %d\n", p->isMale);
-    printf("p->wearing_cloths.color: %d\n", p->wearing_cloths.color);
-    printf("p->wearing_cloths.size: %d\n", p->wearing_cloths.size);
+    mcp_log_debug("p->name: %s", p->name);
+    mcp_log_debug("p->age: %d", p->age);
+    mcp_log_debug("p->isMale: %d", p->isMale);
+    mcp_log_debug("p->wearing_cloths.color: %d", p->wearing_cloths.color);
+    mcp_log_debug("p->wearing_cloths.size: %d", p->wearing_cloths.size);
     return result;
 }
 
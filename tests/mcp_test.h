@@ -0,0 +1,34 @@
+#ifndef MCP_TEST_H
+#define MCP_TEST_H
+
+// Checks shared by the runtime unit tests: a failed check is reported and
+// counted, and the test goes on, so one run lists every failure
+
+#include <stdio.h>
+#include <string.h>
+
+static int mcp_test_failures = 0;
+
+#define MCP_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            mcp_test_failures++; \
+        } \
+    } while (0)
+
+#define MCP_CHECK_STRING(actual, expected) \
+    do { \
+        const char* mcp_actual_ = (actual); \
+        const char* mcp_expected_ = (expected); \
+        if (mcp_actual_ == NULL || strcmp(mcp_actual_, mcp_expected_) != 0) { \
+            fprintf(stderr, "%s:%d: expected %s\n    got %s\n", __FILE__, __LINE__, mcp_expected_, \
+                    mcp_actual_ != NULL ? mcp_actual_ : "(null)"); \
+            mcp_test_failures++; \
+        } \
+    } while (0)
+
+// The exit status of a test's main()
+#define MCP_TEST_RESULT() (mcp_test_failures == 0 ? 0 : 1)
+
+#endif /* MCP_TEST_H */
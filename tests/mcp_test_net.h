@@ -0,0 +1,69 @@
+#ifndef MCP_TEST_NET_H
+#define MCP_TEST_NET_H
+
+// Runs an mcp_net on a thread of its own while a test talks to its
+// transports as a client, through sockets that give up after a few seconds
+// rather than hang the test
+
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "mcp_net.h"
+#include "mcp_thread.h"
+
+// Exit status ctest counts as skipped: the transport is not available here
+#define MCP_TEST_SKIPPED 77
+
+// How long a test waits for the server before it fails
+#define MCP_TEST_TIMEOUT_SECONDS 5
+
+typedef struct mcp_test_net {
+    mcp_net net;
+    mcp_thread_t thread;
+    int result;
+} mcp_test_net;
+
+static inline void* mcp_test_net_run(void* arg) {
+    mcp_test_net* server = (mcp_test_net*)arg;
+    server->result = mcp_net_run(&server->net);
+    return NULL;
+}
+
+// Serves the transports added to `server->net` since mcp_net_init()
+static inline int mcp_test_net_start(mcp_test_net* server) {
+    server->result = -1;
+    return mcp_thread_create(&server->thread, mcp_test_net_run, server);
+}
+
+// Shuts the net down with the SIGTERM mcp_net_run() handles, delivered to
+// its own thread, and returns what mcp_net_run() did
+static inline int mcp_test_net_stop(mcp_test_net* server) {
+    pthread_kill(server->thread, SIGTERM);
+    mcp_thread_join(server->thread);
+    return server->result;
+}
+
+static inline void mcp_test_socket_timeout(int fd) {
+    struct timeval timeout;
+    memset(&timeout, 0, sizeof(timeout));
+    timeout.tv_sec = MCP_TEST_TIMEOUT_SECONDS;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// Writes all of `text`, false when the peer is gone
+static inline bool mcp_test_send_all(int fd, const char* text, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, text, length, 0);  // mcp_net_init() ignores SIGPIPE
+        if (n <= 0) {
+            return false;
+        }
+        text += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+#endif /* MCP_TEST_NET_H */
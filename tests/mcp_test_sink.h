@@ -0,0 +1,88 @@
+#ifndef MCP_TEST_SINK_H
+#define MCP_TEST_SINK_H
+
+// A sink that keeps every reply mcp_dispatch_submit() delivers to it, for
+// tests that drive the dispatcher without a transport
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_thread.h"
+#include "mcp_timer.h"
+
+#define MCP_TEST_MAX_SENDS 16
+
+typedef struct mcp_test_sink {
+    mcp_sink sink;
+    mcp_mutex_t lock;
+    size_t sent;
+    char* replies[MCP_TEST_MAX_SENDS];  // In the order sent, NULL for messages that got no reply
+} mcp_test_sink;
+
+static inline void mcp_test_sink_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    mcp_test_sink* test = (mcp_test_sink*)sink;
+    char* reply = response != NULL ? cJSON_PrintUnformatted(response) : NULL;
+    mcp_response_release(response, arena);
+    mcp_mutex_lock(&test->lock);
+    if (test->sent < MCP_TEST_MAX_SENDS) {
+        test->replies[test->sent] = reply;
+    } else {
+        free(reply);
+    }
+    test->sent++;
+    mcp_mutex_unlock(&test->lock);
+}
+
+static inline void mcp_test_sink_init(mcp_test_sink* test) {
+    memset(test, 0, sizeof(*test));
+    test->sink.send = mcp_test_sink_send;
+    mcp_mutex_init(&test->lock);
+}
+
+// Forgets the replies so far
+static inline void mcp_test_sink_reset(mcp_test_sink* test) {
+    mcp_mutex_lock(&test->lock);
+    for (size_t i = 0; i < test->sent && i < MCP_TEST_MAX_SENDS; ++i) {
+        free(test->replies[i]);
+        test->replies[i] = NULL;
+    }
+    test->sent = 0;
+    mcp_mutex_unlock(&test->lock);
+}
+
+static inline void mcp_test_sink_destroy(mcp_test_sink* test) {
+    mcp_test_sink_reset(test);
+    mcp_mutex_destroy(&test->lock);
+}
+
+// Waits for `count` sends in all, advancing the deadline wheel meanwhile as
+// the event loop would; false after `limit_ms` or on a send beyond `count`
+static inline bool mcp_test_sink_wait(mcp_test_sink* test, size_t count, unsigned limit_ms) {
+    uint64_t limit = mcp_timer_now_ms() + limit_ms;
+    for (;;) {
+        mcp_mutex_lock(&test->lock);
+        size_t sent = test->sent;
+        mcp_mutex_unlock(&test->lock);
+        if (sent >= count) {
+            return sent == count;
+        }
+        if (mcp_timer_now_ms() > limit) {
+            return false;
+        }
+        mcp_timer_wheel_advance(mcp_dispatch_deadlines());
+        mcp_sleep_ms(MCP_TIMER_TICK_MS);
+    }
+}
+
+// Reply `index`, "(no reply)" for a message that got none
+static inline const char* mcp_test_sink_reply(mcp_test_sink* test, size_t index) {
+    mcp_mutex_lock(&test->lock);
+    const char* reply = index < test->sent && index < MCP_TEST_MAX_SENDS && test->replies[index] != NULL ?
+                        test->replies[index] : "(no reply)";
+    mcp_mutex_unlock(&test->lock);
+    return reply;
+}
+
+#endif /* MCP_TEST_SINK_H */
@@ -0,0 +1,132 @@
+// Admission to the worker queue ($MCPC_QUEUE_DEPTH, $MCPC_QUEUE_BYTES):
+// requests that do not fit are answered with a busy error right away,
+// notifications are queued regardless, a batch sheds its requests only, calls
+// held off the workers still count, and an idle queue admits any size
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_pool.h"
+#include "mcp_session.h"
+#include "mcp_thread.h"
+#include "mcp_test.h"
+#include "mcp_test_sink.h"
+
+static mcp_test_sink g_sink;
+
+static void test_submit(mcp_pool* pool, const char* message, size_t bytes, mcp_session* session) {
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(pool, json, bytes, NULL, &g_sink.sink, session) == 0);
+}
+
+// Waits until the one worker has taken everything queued
+static void test_wait_idle_queue(mcp_pool* pool) {
+    for (int i = 0; i < 200; ++i) {
+        mcp_mutex_lock(&pool->lock);
+        size_t depth = pool->depth;
+        mcp_mutex_unlock(&pool->lock);
+        if (depth == 0) {
+            return;
+        }
+        mcp_sleep_ms(5);
+    }
+    MCP_CHECK(!"the queue never emptied");
+}
+
+static void test_depth(void) {
+    mcp_pool pool;
+    setenv(MCP_QUEUE_DEPTH_ENV, "2", 1);
+    setenv(MCP_QUEUE_BYTES_ENV, "0", 1);
+    MCP_CHECK(mcp_pool_init(&pool, 1) == 0);
+    mcp_test_sink_reset(&g_sink);
+    // One running, two waiting: the queue is full
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"sleep\",\"params\":{\"ms\":100}}", 64, NULL);
+    test_wait_idle_queue(&pool);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    MCP_CHECK(!mcp_pool_admits(&pool, 1, 64));
+
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 50));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 0),
+                     "{\"error\":{\"code\":-32000,\"message\":\"Server busy\"},\"id\":4,\"jsonrpc\":\"2.0\"}");
+    // Queued in spite of the limit, and answered with nothing
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    test_submit(&pool, "[{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"echo\"},{\"jsonrpc\":\"2.0\",\"method\":\"echo\"}]", 128,
+                NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 2, 50));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 1),
+                     "[{\"error\":{\"code\":-32000,\"message\":\"Server busy\"},\"id\":5,\"jsonrpc\":\"2.0\"}]");
+
+    // The queued ones run once the worker is free: ids 1 to 3 and the notification
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 6, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 2), "{\"result\":{\"ms\":100},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 3), "{\"result\":{},\"id\":2,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 4), "{\"result\":{},\"id\":3,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 5), "(no reply)");
+    MCP_CHECK(mcp_pool_admits(&pool, 2, 64));
+    mcp_pool_shutdown(&pool);
+}
+
+// Asynchronous calls left running off the workers keep their places
+static void test_held(void) {
+    mcp_pool pool;
+    mcp_session* session = mcp_session_create();
+    setenv(MCP_QUEUE_DEPTH_ENV, "2", 1);
+    setenv(MCP_QUEUE_BYTES_ENV, "0", 1);
+    MCP_CHECK(mcp_pool_init(&pool, 1) == 0);
+    mcp_test_sink_reset(&g_sink);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"async\",\"params\":{\"ms\":5000}}", 64, session);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"async\",\"params\":{\"ms\":5000}}", 64, session);
+    for (int i = 0; i < 200 && mcp_atomic_load(&pool.held) < 2; ++i) {
+        mcp_sleep_ms(5);
+    }
+    MCP_CHECK(mcp_atomic_load(&pool.held) == 2);
+
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 50));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 0),
+                     "{\"error\":{\"code\":-32000,\"message\":\"Server busy\"},\"id\":3,\"jsonrpc\":\"2.0\"}");
+
+    // Settled once they finish, here by being cancelled
+    mcp_dispatch_cancel_session(session);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 3, 2000));
+    mcp_dispatch_drain_calls(false);
+    MCP_CHECK(mcp_atomic_load(&pool.held) == 0 && mcp_atomic_load(&pool.held_bytes) == 0);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"echo\",\"params\":{}}", 64, NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 4, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 3), "{\"result\":{},\"id\":4,\"jsonrpc\":\"2.0\"}");
+    mcp_pool_shutdown(&pool);
+    mcp_session_release(session);
+}
+
+static void test_bytes(void) {
+    mcp_pool pool;
+    setenv(MCP_QUEUE_DEPTH_ENV, "0", 1);
+    setenv(MCP_QUEUE_BYTES_ENV, "100", 1);
+    MCP_CHECK(mcp_pool_init(&pool, 1) == 0);
+    mcp_test_sink_reset(&g_sink);
+    // Larger than the limit, but nothing else is waiting
+    MCP_CHECK(mcp_pool_admits(&pool, 1, 1000));
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"sleep\",\"params\":{\"ms\":100}}", 1000, NULL);
+    test_wait_idle_queue(&pool);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}", 60, NULL);
+    test_submit(&pool, "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"echo\",\"params\":{}}", 60, NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 50));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 0),
+                     "{\"error\":{\"code\":-32000,\"message\":\"Server busy\"},\"id\":3,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK(mcp_pool_admits(&pool, 1, 40));
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 3, 2000));
+    mcp_pool_shutdown(&pool);
+}
+
+int main(void) {
+    mcp_test_sink_init(&g_sink);
+    test_depth();
+    test_held();
+    test_bytes();
+    mcp_test_sink_destroy(&g_sink);
+    return MCP_TEST_RESULT();
+}
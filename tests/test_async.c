@@ -0,0 +1,98 @@
+// Asynchronous handlers (EXPORT_ASYNC_AS): a detached call answered from
+// another thread with the parameters it kept, and the ways it is cancelled,
+// each taking its reply away: notifications/cancelled, the tool's deadline,
+// the client going away, and the shutdown drain
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_pool.h"
+#include "mcp_session.h"
+#include "mcp_thread.h"
+#include "mcp_timer.h"
+#include "mcp_test.h"
+#include "mcp_test_sink.h"
+
+static mcp_pool g_pool;
+static mcp_test_sink g_sink;
+
+static void test_submit(const char* message, mcp_session* session) {
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, &g_sink.sink, session) == 0);
+}
+
+// Answered from the handler's thread, with the string parameter it kept
+static void test_complete(void) {
+    mcp_test_sink_reset(&g_sink);
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"async\",\"params\":{\"ms\":20,\"note\":\"kept\"}}", NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 0), "{\"result\":{\"ms\":20,\"note\":\"kept\"},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    mcp_dispatch_drain_calls(false);
+}
+
+static void test_client_cancel(void) {
+    mcp_session* session = mcp_session_create();
+    mcp_test_sink_reset(&g_sink);
+    uint64_t start = mcp_timer_now_ms();
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"async\",\"params\":{\"ms\":5000}}", session);
+    mcp_sleep_ms(30);
+    test_submit("{\"jsonrpc\":\"2.0\",\"method\":\"notifications/cancelled\",\"params\":{\"requestId\":2}}", session);
+    // Neither the notification nor the cancelled request is answered
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 2, 2000));
+    MCP_CHECK(g_sink.replies[0] == NULL && g_sink.replies[1] == NULL);
+    mcp_dispatch_drain_calls(false);
+    MCP_CHECK(mcp_timer_now_ms() - start < 2000);
+    mcp_session_release(session);
+}
+
+// The deadline answers with a timeout error and cancels the handler, whose own answer is dropped
+static void test_deadline(void) {
+    mcp_test_sink_reset(&g_sink);
+    mcp_dispatch_set_timeout("async", 50);
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"async\",\"params\":{\"ms\":5000}}", NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink, 0), "{\"error\":{\"code\":-32001,\"message\":\"Request timed out\"},\"id\":3,\"jsonrpc\":\"2.0\"}");
+    mcp_dispatch_drain_calls(false);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 100));
+    mcp_dispatch_set_timeout("async", 0);
+}
+
+// A transport whose client went away cancels every call of its session
+static void test_session_gone(void) {
+    mcp_session* session = mcp_session_create();
+    mcp_test_sink_reset(&g_sink);
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"async\",\"params\":{\"ms\":5000}}", session);
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"async\",\"params\":{\"ms\":5000}}", session);
+    mcp_sleep_ms(30);
+    mcp_dispatch_cancel_session(session);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 2, 2000));
+    MCP_CHECK(g_sink.replies[0] == NULL && g_sink.replies[1] == NULL);
+    mcp_dispatch_drain_calls(false);
+    mcp_session_release(session);
+}
+
+// Shutting down waits for calls still out, which see their tokens cancelled
+static void test_drain(void) {
+    mcp_test_sink_reset(&g_sink);
+    uint64_t start = mcp_timer_now_ms();
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":6,\"method\":\"async\",\"params\":{\"ms\":5000}}", NULL);
+    mcp_pool_shutdown(&g_pool);
+    mcp_dispatch_drain_calls(true);
+    MCP_CHECK(mcp_timer_now_ms() - start < 2000);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 100));
+    MCP_CHECK(g_sink.replies[0] == NULL);
+}
+
+int main(void) {
+    mcp_test_sink_init(&g_sink);
+    if (mcp_pool_init(&g_pool, 4) != 0) {
+        return 1;
+    }
+    test_complete();
+    test_client_cancel();
+    test_deadline();
+    test_session_gone();
+    test_drain();
+    mcp_test_sink_destroy(&g_sink);
+    return MCP_TEST_RESULT();
+}
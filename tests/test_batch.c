@@ -0,0 +1,100 @@
+// Batch replies of mcp_dispatch_submit: one array in the order of the
+// batch, whatever order its elements finish in, without entries for
+// notifications, and no reply at all for a batch of notifications
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_pool.h"
+#include "mcp_thread.h"
+#include "mcp_test.h"
+
+// Keeps the printed reply of the one message submitted at a time
+typedef struct test_sink {
+    mcp_sink sink;
+    mcp_mutex_t lock;
+    mcp_cond_t done;
+    bool sent;
+    char* reply;  // NULL when the message got no reply
+} test_sink;
+
+static void test_sink_send(mcp_sink* sink, cJSON* response, mcp_arena* arena) {
+    test_sink* test = (test_sink*)sink;
+    char* reply = response != NULL ? cJSON_PrintUnformatted(response) : NULL;
+    mcp_response_release(response, arena);
+    mcp_mutex_lock(&test->lock);
+    test->reply = reply;
+    test->sent = true;
+    mcp_cond_signal(&test->done);
+    mcp_mutex_unlock(&test->lock);
+}
+
+static mcp_pool g_pool;
+static test_sink g_sink;
+
+// Submits `message` and checks its reply is `expected`, or that it gets none when that is NULL
+static void test_submit(const char* message, const char* expected) {
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL);
+    if (json == NULL) {
+        return;
+    }
+    g_sink.sent = false;
+    g_sink.reply = NULL;
+    MCP_CHECK(mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, &g_sink.sink, NULL) == 0);
+    mcp_mutex_lock(&g_sink.lock);
+    while (!g_sink.sent) {
+        mcp_cond_wait(&g_sink.done, &g_sink.lock);
+    }
+    char* reply = g_sink.reply;
+    mcp_mutex_unlock(&g_sink.lock);
+    if (expected == NULL) {
+        MCP_CHECK(reply == NULL);
+    } else {
+        MCP_CHECK_STRING(reply, expected);
+    }
+    free(reply);
+}
+
+static void test_order(void) {
+    // The first element finishes last, the last one first
+    test_submit("[{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"sleep\",\"params\":{\"ms\":60}},"
+                "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"sleep\",\"params\":{\"ms\":30}},"
+                "{\"jsonrpc\":\"2.0\",\"id\":\"three\",\"method\":\"echo\",\"params\":{\"v\":3}}]",
+                "[{\"result\":{\"ms\":60},\"id\":1,\"jsonrpc\":\"2.0\"},"
+                "{\"result\":{\"ms\":30},\"id\":2,\"jsonrpc\":\"2.0\"},"
+                "{\"result\":{\"v\":3},\"id\":\"three\",\"jsonrpc\":\"2.0\"}]");
+}
+
+static void test_notifications(void) {
+    test_submit("[{\"jsonrpc\":\"2.0\",\"method\":\"echo\"},"
+                "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"echo\",\"params\":{\"v\":7}},"
+                "{\"jsonrpc\":\"2.0\",\"method\":\"sleep\",\"params\":{\"ms\":10}}]",
+                "[{\"result\":{\"v\":7},\"id\":7,\"jsonrpc\":\"2.0\"}]");
+    test_submit("[{\"jsonrpc\":\"2.0\",\"method\":\"echo\"},{\"jsonrpc\":\"2.0\",\"method\":\"echo\"}]", NULL);
+}
+
+static void test_invalid(void) {
+    test_submit("[]", "{\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null,\"jsonrpc\":\"2.0\"}");
+    test_submit("[1,{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}]",
+                "[{\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null,\"jsonrpc\":\"2.0\"},"
+                "{\"result\":{},\"id\":2,\"jsonrpc\":\"2.0\"}]");
+}
+
+int main(void) {
+    g_sink.sink.send = test_sink_send;
+    g_sink.sink.send_chunk = NULL;
+    mcp_mutex_init(&g_sink.lock);
+    mcp_cond_init(&g_sink.done);
+    if (mcp_pool_init(&g_pool, 4) != 0) {
+        return 1;
+    }
+    test_order();
+    test_notifications();
+    test_invalid();
+    mcp_pool_shutdown(&g_pool);
+    mcp_cond_destroy(&g_sink.done);
+    mcp_mutex_destroy(&g_sink.lock);
+    return MCP_TEST_RESULT();
+}
@@ -0,0 +1,178 @@
+// Stands in for the generated bridge, so the runtime links without export:
+// "echo" answers its params, "sleep" answers them after params.ms,
+// "initialized" marks the session initialized, answering whether it was,
+// "async" detaches and answers {ms, note} from a thread of its own after
+// params.ms, or fails as soon as it is cancelled, "shared", a SINGLE_FLIGHT
+// tool, answers {run} after params.ms, numbering its runs, and "stream"
+// streams {parts: [params.parts strings of 1 KiB]}, stopping early once the
+// stream fails, or fails it up front with params.refuse. "resources/list" and
+// "resources/read" are served as src/base/base_func.c serves them.
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "generated_func.h"
+#include "mcp_arena.h"
+#include "mcp_dispatch.h"
+#include "mcp_resource.h"
+#include "mcp_session.h"
+#include "mcp_stream.h"
+#include "mcp_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static cJSON* test_echo(cJSON* params) {
+    return params != NULL ? cJSON_Duplicate(params, 1) : cJSON_CreateObject();
+}
+
+static cJSON* test_sleep(cJSON* params) {
+    const cJSON* ms = cJSON_GetObjectItemCaseSensitive(params, "ms");
+    mcp_sleep_ms(cJSON_IsNumber(ms) ? (unsigned)ms->valueint : 0);
+    return cJSON_Duplicate(params, 1);
+}
+
+static cJSON* test_initialized(cJSON* params) {
+    (void)params;
+    mcp_session* session = mcp_session_current();
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddBoolToObject(result, "was", session != NULL && mcp_session_is_initialized(session));
+    if (session != NULL) {
+        mcp_session_set_initialized(session);
+    }
+    return result;
+}
+
+// What a generated asynchronous handler hands its thread: the call and the kept parameters
+typedef struct test_async_call {
+    mcp_call* call;
+    unsigned ms;
+    char* note;  // mcp_malloc()ed like a parsed string parameter, kept by the call
+} test_async_call;
+
+static void* test_async_run(void* arg) {
+    test_async_call* async = (test_async_call*)arg;
+    mcp_cancel_token* cancel = mcp_call_cancel_token(async->call);
+    for (unsigned waited = 0; waited < async->ms && !mcp_cancel_requested(cancel); waited += 5) {
+        mcp_sleep_ms(5);
+    }
+    if (mcp_cancel_requested(cancel)) {
+        mcp_call_fail(async->call, MCP_ERROR_INTERNAL, "Cancelled");
+    } else {
+        cJSON* result = cJSON_CreateObject();
+        cJSON_AddNumberToObject(result, "ms", async->ms);
+        cJSON_AddStringToObject(result, "note", async->note);
+        mcp_call_complete(async->call, result);
+    }
+    free(async);
+    return NULL;
+}
+
+static cJSON* test_async(cJSON* params) {
+    const cJSON* ms = cJSON_GetObjectItemCaseSensitive(params, "ms");
+    const cJSON* note = cJSON_GetObjectItemCaseSensitive(params, "note");
+    test_async_call* async = (test_async_call*)calloc(1, sizeof(test_async_call));
+    async->call = mcp_call_detach();
+    async->ms = cJSON_IsNumber(ms) ? (unsigned)ms->valueint : 0;
+    async->note = mcp_strdup(cJSON_IsString(note) ? note->valuestring : "");
+    void* kept[] = { async->note };
+    mcp_call_keep(async->call, kept, 1);
+    mcp_thread_t thread;
+    mcp_thread_create(&thread, test_async_run, async);
+    pthread_detach(thread);
+    return NULL;
+}
+
+static volatile long g_shared_runs = 0;
+
+static cJSON* test_shared(cJSON* params) {
+    const cJSON* ms = cJSON_GetObjectItemCaseSensitive(params, "ms");
+    long run = mcp_atomic_add(&g_shared_runs, 1);
+    unsigned limit = cJSON_IsNumber(ms) ? (unsigned)ms->valueint : 0;
+    for (unsigned waited = 0; waited < limit && !mcp_cancel_requested(mcp_cancel_current()); waited += 5) {
+        mcp_sleep_ms(5);
+    }
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddNumberToObject(result, "run", (double)run);
+    return result;
+}
+
+#define TEST_STREAM_PART_SIZE 1024
+
+static cJSON* test_stream(cJSON* params) {
+    char part[TEST_STREAM_PART_SIZE];
+    const cJSON* parts = cJSON_GetObjectItemCaseSensitive(params, "parts");
+    mcp_stream* stream = mcp_stream_open();
+    if (stream == NULL) {
+        return NULL;
+    }
+    if (cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(params, "refuse"))) {
+        mcp_stream_fail(stream, MCP_ERROR_INVALID_PARAMS, "Refused");
+        mcp_stream_close(stream);
+        return NULL;
+    }
+    memset(part, 'x', sizeof(part));
+    mcp_stream_begin_object(stream);
+    mcp_stream_key(stream, "parts");
+    mcp_stream_begin_array(stream);
+    for (int i = 0; cJSON_IsNumber(parts) && i < parts->valueint && !mcp_stream_failed(stream); ++i) {
+        mcp_stream_string_length(stream, part, sizeof(part));
+    }
+    mcp_stream_end_array(stream);
+    mcp_stream_end_object(stream);
+    mcp_stream_close(stream);
+    return NULL;
+}
+
+static cJSON* test_resources_list(cJSON* params) {
+    (void)params;
+    return mcp_resource_list();
+}
+
+static cJSON* test_resources_read(cJSON* params) {
+    const cJSON* uri = cJSON_GetObjectItemCaseSensitive(params, "uri");
+    mcp_stream* stream = mcp_stream_open();
+    if (stream == NULL) {
+        return NULL;
+    }
+    mcp_resource_read(stream, cJSON_IsString(uri) ? uri->valuestring : NULL);
+    mcp_stream_close(stream);
+    return NULL;
+}
+
+const char* const bridge_tool_names[] = {
+    "echo", "sleep", "initialized", "async", "shared", "stream", "resources/list", "resources/read", NULL,
+};
+const unsigned bridge_tool_count = 8;
+
+const bridge_tool_info bridge_tools[] = {
+    { test_echo, 0, false, false },
+    { test_sleep, 0, false, false },
+    { test_initialized, 0, false, false },
+    { test_async, 0, false, false },
+    { test_shared, 0, false, true },
+    { test_stream, 0, false, false },
+    { test_resources_list, 0, false, false },
+    { test_resources_read, 0, false, false },
+    { NULL, 0, false, false },
+};
+
+const bridge_tool_info* bridge_tool(const char* name) {
+    for (unsigned tool = 0; tool < bridge_tool_count; ++tool) {
+        if (strcmp(bridge_tool_names[tool], name) == 0) {
+            return &bridge_tools[tool];
+        }
+    }
+    return NULL;
+}
+
+cJSON* bridge(cJSON* input_json) {
+    const cJSON* method = cJSON_GetObjectItemCaseSensitive(input_json, "method");
+    cJSON* params = cJSON_GetObjectItemCaseSensitive(input_json, "params");
+    const bridge_tool_info* tool = cJSON_IsString(method) ? bridge_tool(method->valuestring) : NULL;
+    return tool != NULL ? tool->handler(params) : NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
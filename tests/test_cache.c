@@ -0,0 +1,123 @@
+// Canonical keys of mcp_cache: params that are the same value in another
+// order, spacing or spelling share a key, and different values never do
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_cache.h"
+#include "mcp_test.h"
+
+// Whether calling `tool_a` with `params_a` and `tool_b` with `params_b` share
+// a key; NULL params stand for none, anything else is parsed as JSON
+static bool test_same_key(const char* tool_a, const char* params_a, const char* tool_b, const char* params_b) {
+    cJSON* json_a = params_a != NULL ? cJSON_Parse(params_a) : NULL;
+    cJSON* json_b = params_b != NULL ? cJSON_Parse(params_b) : NULL;
+    MCP_CHECK(params_a == NULL || json_a != NULL);
+    MCP_CHECK(params_b == NULL || json_b != NULL);
+    mcp_cache_key a;
+    mcp_cache_key b;
+    MCP_CHECK(mcp_cache_key_init(&a, tool_a, json_a) == 0);
+    MCP_CHECK(mcp_cache_key_init(&b, tool_b, json_b) == 0);
+    bool same = a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+    // Equal keys must hash alike, or they would land in different shards
+    MCP_CHECK(!same || a.hash == b.hash);
+    mcp_cache_key_free(&a);
+    mcp_cache_key_free(&b);
+    cJSON_Delete(json_a);
+    cJSON_Delete(json_b);
+    return same;
+}
+
+static const char* test_text(const char* params) {
+    return params != NULL ? params : "(no params)";
+}
+
+#define CHECK_SAME(a, b) \
+    do { \
+        if (!test_same_key("tool", (a), "tool", (b))) { \
+            fprintf(stderr, "%s:%d: different keys for %s and %s\n", __FILE__, __LINE__, test_text(a), \
+                    test_text(b)); \
+            mcp_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_DIFFERENT(a, b) \
+    do { \
+        if (test_same_key("tool", (a), "tool", (b))) { \
+            fprintf(stderr, "%s:%d: one key for %s and %s\n", __FILE__, __LINE__, test_text(a), test_text(b)); \
+            mcp_test_failures++; \
+        } \
+    } while (0)
+
+static void test_equal_params(void) {
+    CHECK_SAME("{\"a\":1,\"b\":2}", "{\"b\":2,\"a\":1}");
+    CHECK_SAME("{\"a\":1,\"b\":[1,2]}", " { \"b\" : [ 1 , 2 ] ,\n\t\"a\" : 1 } ");
+    CHECK_SAME("{\"x\":{\"b\":true,\"a\":null}}", "{\"x\":{\"a\":null,\"b\":true}}");
+    CHECK_SAME("{\"n\":1}", "{\"n\":1.0}");
+    CHECK_SAME("{\"n\":1}", "{\"n\":1e0}");
+    CHECK_SAME("{\"n\":-0}", "{\"n\":0}");
+    CHECK_SAME("{\"s\":\"\\u0041\"}", "{\"s\":\"A\"}");
+    // Missing params are called with an empty object
+    CHECK_SAME(NULL, "{}");
+}
+
+static void test_different_params(void) {
+    MCP_CHECK(!test_same_key("tool", "{}", "other", "{}"));
+    MCP_CHECK(!test_same_key("ab", "{}", "a", "{}"));
+    CHECK_DIFFERENT("{\"a\":\"1\"}", "{\"a\":1}");
+    CHECK_DIFFERENT("[\"ab\"]", "[\"a\",\"b\"]");
+    CHECK_DIFFERENT("{\"ab\":\"c\"}", "{\"a\":\"bc\"}");
+    CHECK_DIFFERENT("{\"a\":null}", "{}");
+    CHECK_DIFFERENT("null", NULL);
+    CHECK_DIFFERENT("{\"a\":true}", "{\"a\":1}");
+    CHECK_DIFFERENT("{\"a\":false}", "{\"a\":0}");
+    CHECK_DIFFERENT("{\"a\":[]}", "{\"a\":{}}");
+    CHECK_DIFFERENT("[[1],2]", "[[1,2]]");
+    CHECK_DIFFERENT("[1,2]", "[2,1]");
+    CHECK_DIFFERENT("{\"n\":0.1}", "{\"n\":0.10000000000000002}");
+}
+
+// Past the inline buffer of a key, and past the inline member table of an object
+static void test_large_params(void) {
+    enum { MEMBERS = 40 };
+    cJSON* forward = cJSON_CreateObject();
+    cJSON* backward = cJSON_CreateObject();
+    cJSON* changed = cJSON_CreateObject();
+    char name[32];
+    for (int i = 0; i < MEMBERS; ++i) {
+        snprintf(name, sizeof(name), "member_%02d", i);
+        cJSON_AddNumberToObject(forward, name, i);
+        snprintf(name, sizeof(name), "member_%02d", MEMBERS - 1 - i);
+        cJSON_AddNumberToObject(backward, name, MEMBERS - 1 - i);
+        // One member's value differs from `forward`
+        cJSON_AddNumberToObject(changed, name, i == 0 ? -1 : MEMBERS - 1 - i);
+    }
+    char* text_forward = cJSON_PrintUnformatted(forward);
+    char* text_backward = cJSON_PrintUnformatted(backward);
+    MCP_CHECK(strlen(text_forward) > MCP_CACHE_KEY_INLINE);
+    CHECK_SAME(text_forward, text_backward);
+
+    char* text_changed = cJSON_PrintUnformatted(changed);
+    CHECK_DIFFERENT(text_forward, text_changed);
+
+    mcp_cache_key key;
+    MCP_CHECK(mcp_cache_key_init(&key, "tool", forward) == 0);
+    MCP_CHECK(key.length > MCP_CACHE_KEY_INLINE);
+    MCP_CHECK(key.data != key.inline_data);
+    mcp_cache_key_free(&key);
+
+    free(text_forward);
+    free(text_backward);
+    free(text_changed);
+    cJSON_Delete(forward);
+    cJSON_Delete(backward);
+    cJSON_Delete(changed);
+}
+
+int main(void) {
+    test_equal_params();
+    test_different_params();
+    test_large_params();
+    return MCP_TEST_RESULT();
+}
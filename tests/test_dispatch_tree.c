@@ -0,0 +1,84 @@
+// The method lookup export generates: every exported name finds its own
+// entry of bridge_tools, and names one character away from one, shorter or
+// longer, find nothing unless they are exported themselves. Links the
+// generated bridge of this tree, not the stub the other tests use.
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "generated_func.h"
+#include "mcp_stats.h"
+#include "mcp_test.h"
+
+// The entry `name` should find: the tool of that name, or none
+static const bridge_tool_info* test_expected(const char* name) {
+    for (unsigned tool = 0; tool < bridge_tool_count; ++tool) {
+        if (strcmp(bridge_tool_names[tool], name) == 0) {
+            return &bridge_tools[tool];
+        }
+    }
+    return NULL;
+}
+
+static void test_check_lookup(const char* name) {
+    if (bridge_tool(name) != test_expected(name)) {
+        fprintf(stderr, "%s:%d: wrong entry for \"%s\"\n", __FILE__, __LINE__, name);
+        mcp_test_failures++;
+    }
+}
+
+static void test_exported_names(void) {
+    MCP_CHECK(bridge_tool_count > 0);
+    MCP_CHECK(bridge_tool_names[bridge_tool_count] == NULL);
+    for (unsigned tool = 0; tool < bridge_tool_count; ++tool) {
+        MCP_CHECK(bridge_tool(bridge_tool_names[tool]) == &bridge_tools[tool]);
+    }
+}
+
+// Every name with one character replaced, cut short, or one character longer
+static void test_near_names(void) {
+    static const char replacements[] = { 'a', 'z', '_', '/', '0', '\x7f', '\xc3' };
+    char buffer[256];
+    for (unsigned tool = 0; tool < bridge_tool_count; ++tool) {
+        size_t length = strlen(bridge_tool_names[tool]);
+        if (length + 2 > sizeof(buffer)) {
+            continue;
+        }
+        memcpy(buffer, bridge_tool_names[tool], length + 1);
+        for (size_t pos = 0; pos < length; ++pos) {
+            char original = buffer[pos];
+            for (size_t i = 0; i < sizeof(replacements); ++i) {
+                buffer[pos] = replacements[i];
+                test_check_lookup(buffer);
+            }
+            buffer[pos] = original;
+        }
+        for (size_t cut = 0; cut < length; ++cut) {
+            buffer[cut] = '\0';
+            test_check_lookup(buffer);
+            buffer[cut] = bridge_tool_names[tool][cut];
+        }
+        for (size_t i = 0; i < sizeof(replacements); ++i) {
+            buffer[length] = replacements[i];
+            buffer[length + 1] = '\0';
+            test_check_lookup(buffer);
+        }
+    }
+}
+
+// bridge() answers no tool for a method the lookup does not find
+static void test_unknown_method(void) {
+    cJSON* request = cJSON_Parse("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"no such tool\",\"params\":{}}");
+    MCP_CHECK(request != NULL);
+    MCP_CHECK(bridge_tool("no such tool") == NULL);
+    cJSON* result = bridge(request);
+    MCP_CHECK(result == NULL);
+    cJSON_Delete(result);
+    cJSON_Delete(request);
+}
+
+int main(void) {
+    test_exported_names();
+    test_near_names();
+    test_unknown_method();
+    return MCP_TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+// Single-flight calls (SINGLE_FLIGHT): identical calls that arrive while one
+// runs wait for it and share its result, calls with other params or arriving
+// later run on their own, and when the run leading a flight is cancelled a
+// waiter gets a run of its own instead of the cut-short result
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_flight.h"
+#include "mcp_pool.h"
+#include "mcp_session.h"
+#include "mcp_thread.h"
+#include "mcp_test.h"
+#include "mcp_test_sink.h"
+
+static mcp_pool g_pool;
+static mcp_test_sink g_sink;
+
+static void test_submit(const char* message, mcp_session* session) {
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, &g_sink.sink, session) == 0);
+}
+
+static void test_submit_shared(int id, const char* params, mcp_session* session) {
+    char message[256];
+    snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"shared\",\"params\":%s}", id, params);
+    test_submit(message, session);
+}
+
+// The run that answered request `id`, -1 when it got no result
+static long test_run_of(int id) {
+    long run = -1;
+    for (size_t i = 0; i < g_sink.sent && i < MCP_TEST_MAX_SENDS; ++i) {
+        cJSON* reply = g_sink.replies[i] != NULL ? cJSON_Parse(g_sink.replies[i]) : NULL;
+        const cJSON* reply_id = cJSON_GetObjectItemCaseSensitive(reply, "id");
+        const cJSON* result = cJSON_GetObjectItemCaseSensitive(reply, "result");
+        const cJSON* value = cJSON_GetObjectItemCaseSensitive(result, "run");
+        if (cJSON_IsNumber(reply_id) && reply_id->valueint == id && cJSON_IsNumber(value)) {
+            run = (long)value->valuedouble;
+        }
+        cJSON_Delete(reply);
+    }
+    return run;
+}
+
+static double test_flight_counter(const char* name) {
+    cJSON* report = mcp_flight_report();
+    const cJSON* value = cJSON_GetObjectItemCaseSensitive(report, name);
+    double counter = cJSON_IsNumber(value) ? value->valuedouble : -1;
+    cJSON_Delete(report);
+    return counter;
+}
+
+static void test_coalesced(void) {
+    mcp_test_sink_reset(&g_sink);
+    double joined = test_flight_counter("joined");
+    test_submit_shared(1, "{\"ms\":100}", NULL);
+    mcp_sleep_ms(20);
+    test_submit_shared(2, "{\"ms\":100}", NULL);
+    test_submit_shared(3, "{\"ms\":100}", NULL);
+    // Other params are another call
+    test_submit_shared(4, "{\"ms\":100,\"other\":true}", NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 4, 2000));
+    long run = test_run_of(1);
+    MCP_CHECK(run > 0);
+    MCP_CHECK(test_run_of(2) == run && test_run_of(3) == run);
+    MCP_CHECK(test_run_of(4) > 0 && test_run_of(4) != run);
+    MCP_CHECK(test_flight_counter("joined") == joined + 2);
+    MCP_CHECK(test_flight_counter("in_flight") == 0);
+
+    // Landed: the same call runs again
+    test_submit_shared(5, "{\"ms\":100}", NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 5, 2000));
+    MCP_CHECK(test_run_of(5) > 0 && test_run_of(5) != run);
+}
+
+// The leader's client cancels it: the one waiting gets an answer of its own
+static void test_leader_cancelled(void) {
+    mcp_session* leader = mcp_session_create();
+    mcp_session* waiter = mcp_session_create();
+    mcp_test_sink_reset(&g_sink);
+    test_submit_shared(1, "{\"ms\":200}", leader);
+    mcp_sleep_ms(20);
+    test_submit_shared(2, "{\"ms\":200}", waiter);
+    mcp_sleep_ms(20);
+    double started = test_flight_counter("runs");
+    test_submit("{\"jsonrpc\":\"2.0\",\"method\":\"notifications/cancelled\",\"params\":{\"requestId\":1}}", leader);
+    // The notification, the cancelled leader and the waiter
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 3, 2000));
+    MCP_CHECK(test_run_of(1) == -1);
+    long run = test_run_of(2);
+    MCP_CHECK(run > 0);
+    // Run again for the waiter, which counts as a run rather than a join
+    MCP_CHECK(test_flight_counter("runs") == started + 1);
+    MCP_CHECK(test_flight_counter("in_flight") == 0);
+    mcp_test_sink_reset(&g_sink);
+    test_submit_shared(3, "{\"ms\":0}", NULL);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 2000));
+    MCP_CHECK(test_run_of(3) == run + 1);
+    mcp_session_release(leader);
+    mcp_session_release(waiter);
+}
+
+int main(void) {
+    mcp_test_sink_init(&g_sink);
+    // Concurrent requests need workers to run on, however few CPUs there are
+    if (mcp_pool_init(&g_pool, 4) != 0) {
+        return 1;
+    }
+    test_coalesced();
+    test_leader_cancelled();
+    mcp_pool_shutdown(&g_pool);
+    mcp_dispatch_drain_calls(false);
+    mcp_test_sink_destroy(&g_sink);
+    return MCP_TEST_RESULT();
+}
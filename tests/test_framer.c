@@ -0,0 +1,210 @@
+// Message boundaries of mcp_framer: messages split across reads, several in
+// one read, CRLF endings, a last line without a newline, growth past the
+// initial capacity, and the SSE2 newline search around its 16-byte blocks
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mcp_framer.h"
+#include "mcp_test.h"
+
+// A framer reading the other end of a pipe the test writes into
+typedef struct test_pipe {
+    mcp_framer framer;
+    int writer;
+} test_pipe;
+
+static void test_pipe_open(test_pipe* channel, size_t capacity) {
+    int fds[2];
+    MCP_CHECK(pipe(fds) == 0);
+    MCP_CHECK(mcp_framer_init(&channel->framer, fds[0], capacity) == 0);
+    channel->writer = fds[1];
+}
+
+static void test_pipe_close(test_pipe* channel) {
+    if (channel->writer >= 0) {
+        close(channel->writer);
+    }
+    close(channel->framer.fd);
+    mcp_framer_destroy(&channel->framer);
+}
+
+// Writes `text` and has the framer read all of it, in as many fills as its room takes
+static void test_pipe_feed(test_pipe* channel, const char* text) {
+    size_t length = strlen(text);
+    MCP_CHECK(write(channel->writer, text, length) == (ssize_t)length);
+    for (size_t taken = 0; taken < length;) {
+        long n = mcp_framer_fill(&channel->framer);
+        MCP_CHECK(n > 0);
+        if (n <= 0) {
+            break;
+        }
+        taken += (size_t)n;
+    }
+}
+
+static void test_pipe_end(test_pipe* channel) {
+    close(channel->writer);
+    channel->writer = -1;
+}
+
+// Pops the next message, expecting `expected`, or none when it is NULL
+static void test_pop(test_pipe* channel, const char* expected) {
+    char* message = NULL;
+    size_t length = 0;
+    bool popped = mcp_framer_pop(&channel->framer, &message, &length);
+    if (expected == NULL) {
+        MCP_CHECK(!popped);
+        return;
+    }
+    MCP_CHECK(popped);
+    if (popped) {
+        MCP_CHECK(length == strlen(expected));
+        MCP_CHECK_STRING(message, expected);
+    }
+}
+
+static void test_split_across_reads(void) {
+    test_pipe channel;
+    test_pipe_open(&channel, 64);
+    test_pipe_feed(&channel, "{\"jsonrpc\":");
+    test_pop(&channel, NULL);
+    test_pipe_feed(&channel, "\"2.0\",\"id\"");
+    test_pop(&channel, NULL);
+    test_pipe_feed(&channel, ":1}\n");
+    test_pop(&channel, "{\"jsonrpc\":\"2.0\",\"id\":1}");
+    test_pop(&channel, NULL);
+    test_pipe_close(&channel);
+}
+
+static void test_several_in_one_read(void) {
+    test_pipe channel;
+    test_pipe_open(&channel, 64);
+    test_pipe_feed(&channel, "first\nsecond\n\nthi");
+    test_pop(&channel, "first");
+    test_pop(&channel, "second");
+    test_pop(&channel, "");
+    test_pop(&channel, NULL);
+    test_pipe_feed(&channel, "rd\n");
+    test_pop(&channel, "third");
+    test_pop(&channel, NULL);
+    test_pipe_close(&channel);
+}
+
+static void test_crlf(void) {
+    test_pipe channel;
+    test_pipe_open(&channel, 64);
+    test_pipe_feed(&channel, "one\r\ntwo\r");
+    test_pop(&channel, "one");
+    test_pop(&channel, NULL);
+    // The '\r' arrived a read before its '\n'
+    test_pipe_feed(&channel, "\nthree\n\r\n");
+    test_pop(&channel, "two");
+    test_pop(&channel, "three");
+    test_pop(&channel, "");
+    test_pipe_close(&channel);
+}
+
+static void test_unterminated_last_line(void) {
+    test_pipe channel;
+    char* message = NULL;
+    size_t length = 0;
+    test_pipe_open(&channel, 64);
+    test_pipe_feed(&channel, "whole\nlast");
+    test_pipe_end(&channel);
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 1);
+    MCP_CHECK_STRING(message, "whole");
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 1);
+    MCP_CHECK(length == 4);
+    MCP_CHECK_STRING(message, "last");
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 0);
+    test_pipe_close(&channel);
+
+    // It fills the buffer to the last byte, so the terminator needs room made first
+    test_pipe_open(&channel, 16);
+    test_pipe_feed(&channel, "0123456789abcdef");
+    test_pipe_end(&channel);
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 1);
+    MCP_CHECK(length == 16);
+    MCP_CHECK_STRING(message, "0123456789abcdef");
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 0);
+    test_pipe_close(&channel);
+
+    // A CRLF line at the end counts as terminated; a lone '\r' is stripped too
+    test_pipe_open(&channel, 64);
+    test_pipe_feed(&channel, "crlf\r\ncr\r");
+    test_pipe_end(&channel);
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 1);
+    MCP_CHECK_STRING(message, "crlf");
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 1);
+    MCP_CHECK_STRING(message, "cr");
+    MCP_CHECK(mcp_framer_next(&channel.framer, &message, &length) == 0);
+    test_pipe_close(&channel);
+}
+
+static void test_growth(void) {
+    // Ten times the initial capacity, arriving in reads of 7 bytes
+    enum { SIZE = 160 };
+    char line[SIZE + 1];
+    for (size_t i = 0; i < SIZE; ++i) {
+        line[i] = (char)('a' + i % 26);
+    }
+    line[SIZE] = '\0';
+    test_pipe channel;
+    test_pipe_open(&channel, 16);
+    test_pipe_feed(&channel, "x\n");
+    for (size_t i = 0; i < SIZE; i += 7) {
+        char piece[8] = { 0 };
+        memcpy(piece, line + i, SIZE - i < 7 ? SIZE - i : 7);
+        test_pipe_feed(&channel, piece);
+    }
+    test_pipe_feed(&channel, "\ny\n");
+    test_pop(&channel, "x");
+    test_pop(&channel, line);
+    test_pop(&channel, "y");
+    test_pop(&channel, NULL);
+    test_pipe_close(&channel);
+}
+
+static void test_append(void) {
+    mcp_framer framer;
+    char* message = NULL;
+    size_t length = 0;
+    MCP_CHECK(mcp_framer_init(&framer, -1, 8) == 0);
+    MCP_CHECK(mcp_framer_append(&framer, "abc", 3) == 0);
+    MCP_CHECK(!mcp_framer_pop(&framer, &message, &length));
+    MCP_CHECK(mcp_framer_append(&framer, "defghijkl\r\nmn\n", 14) == 0);
+    MCP_CHECK(mcp_framer_pop(&framer, &message, &length));
+    MCP_CHECK_STRING(message, "abcdefghijkl");
+    MCP_CHECK(mcp_framer_pop(&framer, &message, &length));
+    MCP_CHECK_STRING(message, "mn");
+    MCP_CHECK(!mcp_framer_pop(&framer, &message, &length));
+    mcp_framer_destroy(&framer);
+}
+
+static void test_find_newline(void) {
+    char data[96];
+    for (size_t start = 0; start < 17; ++start) {
+        for (size_t at = 0; at < 48; ++at) {
+            memset(data, 'x', sizeof(data));
+            data[start + at] = '\n';
+            // A second newline further on must not win over the first
+            data[start + at + 20] = '\n';
+            MCP_CHECK(mcp_find_newline(data + start, 60) == data + start + at);
+            // Nor may one just past the end be found
+            MCP_CHECK(mcp_find_newline(data + start, at) == NULL);
+        }
+    }
+    MCP_CHECK(mcp_find_newline(data, 0) == NULL);
+}
+
+int main(void) {
+    test_split_across_reads();
+    test_several_in_one_read();
+    test_crlf();
+    test_unterminated_last_line();
+    test_growth();
+    test_append();
+    test_find_newline();
+    return MCP_TEST_RESULT();
+}
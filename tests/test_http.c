@@ -0,0 +1,255 @@
+// The streamable HTTP transport: a session from initialize, replies on
+// keep-alive connections and to pipelined requests, 202 for notifications,
+// the status codes of requests it refuses, SSE replies for clients that only
+// accept SSE, pushes to a GET stream, and sessions ended by DELETE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "cJSON.h"
+#include "mcp_http.h"
+#include "mcp_test.h"
+#include "mcp_test_net.h"
+
+static int g_port;
+
+static int test_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    MCP_CHECK(fd >= 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((unsigned short)g_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    MCP_CHECK(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+    mcp_test_socket_timeout(fd);
+    return fd;
+}
+
+// One response read off a connection
+typedef struct test_response {
+    int status;
+    char header[2048];
+    char body[4096];
+} test_response;
+
+// Reads the next response; keeps whatever follows it in `pending` for the next call
+static bool test_read_response(int fd, char* pending, size_t* pending_length, test_response* response) {
+    char* end = NULL;
+    while ((end = strstr(pending, "\r\n\r\n")) == NULL) {
+        ssize_t n = recv(fd, pending + *pending_length, 8191 - *pending_length, 0);
+        if (n <= 0) {
+            return false;
+        }
+        *pending_length += (size_t)n;
+        pending[*pending_length] = '\0';
+    }
+    size_t header_length = (size_t)(end - pending) + 4;
+    if (header_length >= sizeof(response->header)) {
+        return false;
+    }
+    memcpy(response->header, pending, header_length);
+    response->header[header_length] = '\0';
+    response->status = atoi(pending + strlen("HTTP/1.1 "));
+    const char* field = strstr(response->header, "Content-Length: ");
+    size_t body_length = field != NULL ? (size_t)atol(field + strlen("Content-Length: ")) : 0;
+    if (body_length >= sizeof(response->body)) {
+        return false;
+    }
+    while (*pending_length < header_length + body_length) {
+        ssize_t n = recv(fd, pending + *pending_length, 8191 - *pending_length, 0);
+        if (n <= 0) {
+            return false;
+        }
+        *pending_length += (size_t)n;
+    }
+    memcpy(response->body, pending + header_length, body_length);
+    response->body[body_length] = '\0';
+    *pending_length -= header_length + body_length;
+    memmove(pending, pending + header_length + body_length, *pending_length);
+    pending[*pending_length] = '\0';
+    return true;
+}
+
+// Sends `request` on a fresh connection and reads the one response
+static test_response test_exchange(const char* request) {
+    test_response response;
+    memset(&response, 0, sizeof(response));
+    char pending[8192] = "";
+    size_t pending_length = 0;
+    int fd = test_connect();
+    MCP_CHECK(mcp_test_send_all(fd, request, strlen(request)));
+    MCP_CHECK(test_read_response(fd, pending, &pending_length, &response));
+    close(fd);
+    return response;
+}
+
+// A POST of `body` to `path`, in the session `session_id` unless it is empty
+static void test_post_text(char* request, size_t size, const char* path, const char* session_id, const char* accept,
+                           const char* body) {
+    char session[96] = "";
+    if (session_id[0] != '\0') {
+        snprintf(session, sizeof(session), "Mcp-Session-Id: %s\r\n", session_id);
+    }
+    snprintf(request, size,
+             "POST %s HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: %s\r\nContent-Type: application/json\r\n%s"
+             "Content-Length: %zu\r\n\r\n%s",
+             path, accept, session, strlen(body), body);
+}
+
+static test_response test_post(const char* session_id, const char* body) {
+    char request[4096];
+    test_post_text(request, sizeof(request), MCP_HTTP_PATH, session_id, "application/json, text/event-stream", body);
+    return test_exchange(request);
+}
+
+// Starts a session, whose id is copied to `session_id`
+static void test_initialize(char* session_id) {
+    test_response response = test_post("", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}");
+    MCP_CHECK(response.status == 200);
+    const char* field = strstr(response.header, "Mcp-Session-Id: ");
+    MCP_CHECK(field != NULL);
+    session_id[0] = '\0';
+    if (field != NULL) {
+        field += strlen("Mcp-Session-Id: ");
+        size_t length = strcspn(field, "\r");
+        MCP_CHECK(length == MCP_HTTP_SESSION_ID_LENGTH);
+        memcpy(session_id, field, length);
+        session_id[length] = '\0';
+    }
+}
+
+static void test_requests(const char* session_id) {
+    test_response response = test_post(session_id, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{\"v\":2}}");
+    MCP_CHECK(response.status == 200);
+    MCP_CHECK(strstr(response.header, "Content-Type: application/json\r\n") != NULL);
+    MCP_CHECK_STRING(response.body, "{\"result\":{\"v\":2},\"id\":2,\"jsonrpc\":\"2.0\"}\n");
+
+    response = test_post(session_id, "{\"jsonrpc\":\"2.0\",\"method\":\"echo\"}");
+    MCP_CHECK(response.status == 202);
+    MCP_CHECK(response.body[0] == '\0');
+}
+
+// Two requests in one write on a keep-alive connection, answered in order
+static void test_pipelined(const char* session_id) {
+    char first[512];
+    char second[512];
+    char both[1024];
+    test_post_text(first, sizeof(first), MCP_HTTP_PATH, session_id, "application/json",
+                   "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"sleep\",\"params\":{\"ms\":30}}");
+    test_post_text(second, sizeof(second), MCP_HTTP_PATH, session_id, "application/json",
+                   "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"echo\",\"params\":{}}");
+    snprintf(both, sizeof(both), "%s%s", first, second);
+
+    char pending[8192] = "";
+    size_t pending_length = 0;
+    test_response response;
+    int fd = test_connect();
+    MCP_CHECK(mcp_test_send_all(fd, both, strlen(both)));
+    MCP_CHECK(test_read_response(fd, pending, &pending_length, &response));
+    MCP_CHECK_STRING(response.body, "{\"result\":{\"ms\":30},\"id\":3,\"jsonrpc\":\"2.0\"}\n");
+    MCP_CHECK(test_read_response(fd, pending, &pending_length, &response));
+    MCP_CHECK_STRING(response.body, "{\"result\":{},\"id\":4,\"jsonrpc\":\"2.0\"}\n");
+    close(fd);
+}
+
+static void test_refused(const char* session_id) {
+    char request[1024];
+    test_post_text(request, sizeof(request), "/other", session_id, "application/json", "{}");
+    MCP_CHECK(test_exchange(request).status == 404);
+
+    test_response response = test_post("0123456789abcdef0123456789abcdef",
+                                       "{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"echo\"}");
+    MCP_CHECK(response.status == 404);
+
+    MCP_CHECK(test_post(session_id, "{\"jsonrpc\":").status == 400);
+    MCP_CHECK(test_exchange("PUT /mcp HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 0\r\n\r\n").status == 405);
+    MCP_CHECK(test_exchange("GET /mcp HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: application/json\r\n\r\n").status == 406);
+    MCP_CHECK(test_exchange("POST /mcp HTTP/1.1\r\nHost: 127.0.0.1\r\nOrigin: http://example.com\r\n"
+                            "Content-Length: 2\r\n\r\n{}").status == 403);
+}
+
+// A client that only accepts SSE gets its reply as one event
+static void test_sse_reply(const char* session_id) {
+    char request[1024];
+    test_post_text(request, sizeof(request), MCP_HTTP_PATH, session_id, "text/event-stream",
+                   "{\"jsonrpc\":\"2.0\",\"id\":6,\"method\":\"echo\",\"params\":{\"v\":6}}");
+    test_response response = test_exchange(request);
+    MCP_CHECK(response.status == 200);
+    MCP_CHECK(strstr(response.header, "Content-Type: text/event-stream\r\n") != NULL);
+    MCP_CHECK_STRING(response.body, "event: message\ndata: {\"result\":{\"v\":6},\"id\":6,\"jsonrpc\":\"2.0\"}\n\n");
+}
+
+// mcp_http_notify() reaches the GET stream of the session
+static void test_push(const char* session_id) {
+    char request[512];
+    snprintf(request, sizeof(request),
+             "GET /mcp HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/event-stream\r\nMcp-Session-Id: %s\r\n\r\n", session_id);
+    int fd = test_connect();
+    MCP_CHECK(mcp_test_send_all(fd, request, strlen(request)));
+
+    char stream[4096] = "";
+    size_t length = 0;
+    while (strstr(stream, "\r\n\r\n") == NULL) {
+        ssize_t n = recv(fd, stream + length, sizeof(stream) - 1 - length, 0);
+        MCP_CHECK(n > 0);
+        if (n <= 0) {
+            close(fd);
+            return;
+        }
+        length += (size_t)n;
+        stream[length] = '\0';
+    }
+    MCP_CHECK(strncmp(stream, "HTTP/1.1 200 OK\r\n", 17) == 0);
+
+    MCP_CHECK(mcp_http_notify(session_id, cJSON_Parse("{\"jsonrpc\":\"2.0\",\"method\":\"notifications/ping\"}")) == 0);
+    const char* expected = "data: {\"jsonrpc\":\"2.0\",\"method\":\"notifications/ping\"}\n\n";
+    while (strstr(stream, expected) == NULL) {
+        ssize_t n = recv(fd, stream + length, sizeof(stream) - 1 - length, 0);
+        MCP_CHECK(n > 0);
+        if (n <= 0) {
+            break;
+        }
+        length += (size_t)n;
+        stream[length] = '\0';
+    }
+    close(fd);
+}
+
+static void test_delete(const char* session_id) {
+    char request[512];
+    snprintf(request, sizeof(request), "DELETE /mcp HTTP/1.1\r\nHost: 127.0.0.1\r\nMcp-Session-Id: %s\r\n\r\n", session_id);
+    MCP_CHECK(test_exchange(request).status == 200);
+    MCP_CHECK(test_post(session_id, "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"echo\"}").status == 404);
+}
+
+int main(void) {
+    static mcp_test_net server;
+    if (mcp_net_init(&server.net) != 0) {
+        return MCP_TEST_SKIPPED;
+    }
+    // A port of its own, so tests running side by side do not collide
+    g_port = 20000 + (int)(getpid() % 20000);
+    while (mcp_http_listen(&server.net, NULL, g_port) != 0) {
+        if (++g_port >= 65536) {
+            return 1;
+        }
+    }
+    MCP_CHECK(mcp_test_net_start(&server) == 0);
+
+    char session_id[MCP_HTTP_SESSION_ID_LENGTH + 1];
+    test_initialize(session_id);
+    test_requests(session_id);
+    test_pipelined(session_id);
+    test_refused(session_id);
+    test_sse_reply(session_id);
+    test_push(session_id);
+    test_delete(session_id);
+
+    MCP_CHECK(mcp_test_net_stop(&server) == 0);
+    return MCP_TEST_RESULT();
+}
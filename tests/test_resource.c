@@ -0,0 +1,250 @@
+// Resources ($MCPC_RESOURCE_ROOT): the listing leaves hidden files and links
+// out, reads answer text, escaped, or a base64 blob for bytes that are not
+// UTF-8, paths outside the root are not found, a file truncated while it is
+// sent cuts the reply short instead of killing the server, and a SIGBUS of
+// someone else's still reaches the handler installed before
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_pool.h"
+#include "mcp_resource.h"
+#include "mcp_stream.h"
+#include "mcp_test.h"
+#include "mcp_test_sink.h"
+
+// Larger than a stream chunk many times over
+#define TEST_LARGE_SIZE (4 * 1024 * 1024)
+
+// Truncates `path` to nothing once the first chunk of the reply is out
+typedef struct test_truncating_sink {
+    mcp_test_sink base;
+    const char* path;
+    unsigned chunks;
+    size_t length;
+    bool ended;
+} test_truncating_sink;
+
+static int test_truncating_send_chunk(mcp_sink* sink, char* chunk, size_t length, bool first, bool last) {
+    test_truncating_sink* test = (test_truncating_sink*)sink;
+    (void)first;
+    if (test->chunks++ == 0) {
+        MCP_CHECK(truncate(test->path, 0) == 0);
+    }
+    test->length += length;
+    test->ended = last;
+    free(chunk);
+    return 0;
+}
+
+static mcp_pool g_pool;
+static mcp_test_sink g_sink;
+static char g_root[256];
+static volatile sig_atomic_t g_foreign_bus = 0;
+
+static void test_on_bus(int signo, siginfo_t* info, void* context) {
+    (void)signo;
+    (void)info;
+    (void)context;
+    g_foreign_bus++;
+}
+
+static void test_write_file(const char* name, const char* data, size_t length) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", g_root, name);
+    FILE* file = fopen(path, "wb");
+    MCP_CHECK(file != NULL);
+    if (file != NULL) {
+        MCP_CHECK(fwrite(data, 1, length, file) == length);
+        fclose(file);
+    }
+}
+
+// The result of `method` with `params`, answered whole
+static cJSON* test_call(const char* method, const char* params) {
+    char message[1024];
+    snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"%s\",\"params\":%s}", method, params);
+    mcp_test_sink_reset(&g_sink);
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, &g_sink.sink, NULL) == 0);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink, 1, 5000));
+    return cJSON_Parse(mcp_test_sink_reply(&g_sink, 0));
+}
+
+static cJSON* test_read(const char* name) {
+    char params[512];
+    snprintf(params, sizeof(params), "{\"uri\":\"file://%s/%s\"}", g_root, name);
+    return test_call("resources/read", params);
+}
+
+static const char* test_string(const cJSON* object, const char* key) {
+    const cJSON* item = cJSON_GetObjectItemCaseSensitive(object, key);
+    return cJSON_IsString(item) ? item->valuestring : "(none)";
+}
+
+// The one content of a read reply
+static const cJSON* test_content(const cJSON* reply) {
+    const cJSON* result = cJSON_GetObjectItemCaseSensitive(reply, "result");
+    return cJSON_GetArrayItem(cJSON_GetObjectItemCaseSensitive(result, "contents"), 0);
+}
+
+static int test_error_code(const cJSON* reply) {
+    const cJSON* code = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(reply, "error"), "code");
+    return cJSON_IsNumber(code) ? code->valueint : 0;
+}
+
+static void test_list(void) {
+    cJSON* reply = test_call("resources/list", "{}");
+    const cJSON* resources = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(reply, "result"),
+                                                              "resources");
+    MCP_CHECK(cJSON_GetArraySize(resources) == 5);
+    bool nested = false;
+    const cJSON* resource = NULL;
+    cJSON_ArrayForEach(resource, resources) {
+        const char* name = test_string(resource, "name");
+        MCP_CHECK(strcmp(name, ".hidden") != 0 && strcmp(name, "link.txt") != 0);
+        if (strcmp(name, "sub/b.json") == 0) {
+            nested = true;
+            MCP_CHECK_STRING(test_string(resource, "mimeType"), "application/json");
+            const cJSON* size = cJSON_GetObjectItemCaseSensitive(resource, "size");
+            MCP_CHECK(cJSON_IsNumber(size) && size->valueint == 7);
+            char uri[512];
+            snprintf(uri, sizeof(uri), "file://%s/sub/b.json", g_root);
+            MCP_CHECK_STRING(test_string(resource, "uri"), uri);
+        }
+    }
+    MCP_CHECK(nested);
+    cJSON_Delete(reply);
+}
+
+static void test_reads(void) {
+    cJSON* reply = test_read("a.txt");
+    const cJSON* content = test_content(reply);
+    MCP_CHECK_STRING(test_string(content, "mimeType"), "text/plain");
+    MCP_CHECK_STRING(test_string(content, "text"), "line\n\"quoted\"\t\xc3\xa9");
+    cJSON_Delete(reply);
+
+    reply = test_read("empty.txt");
+    MCP_CHECK_STRING(test_string(test_content(reply), "text"), "");
+    cJSON_Delete(reply);
+
+    // Bytes without a known type, and a .txt file that is not UTF-8
+    reply = test_read("bin.dat");
+    content = test_content(reply);
+    MCP_CHECK_STRING(test_string(content, "mimeType"), "application/octet-stream");
+    MCP_CHECK_STRING(test_string(content, "blob"), "AAEC/w==");
+    cJSON_Delete(reply);
+    reply = test_read("bad.txt");
+    content = test_content(reply);
+    MCP_CHECK_STRING(test_string(content, "mimeType"), "text/plain");
+    MCP_CHECK_STRING(test_string(content, "blob"), "wyg=");
+    cJSON_Delete(reply);
+}
+
+static void test_not_found(void) {
+    static const char* const names[] = { ".hidden", "missing.txt", "sub", "../outside.txt", "sub/../../outside.txt" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        cJSON* reply = test_read(names[i]);
+        MCP_CHECK(test_error_code(reply) == MCP_ERROR_RESOURCE_NOT_FOUND);
+        cJSON_Delete(reply);
+    }
+    cJSON* reply = test_call("resources/read", "{\"uri\":\"http://example.com/a.txt\"}");
+    MCP_CHECK(test_error_code(reply) == MCP_ERROR_RESOURCE_NOT_FOUND);
+    cJSON_Delete(reply);
+}
+
+// The first chunk is out when the file shrinks under the mapping
+static void test_truncated(void) {
+    char path[512];
+    char message[1024];
+    char* data = (char*)malloc(TEST_LARGE_SIZE);
+    memset(data, 'a', TEST_LARGE_SIZE);
+    test_write_file("large.txt", data, TEST_LARGE_SIZE);
+    free(data);
+    snprintf(path, sizeof(path), "%s/large.txt", g_root);
+
+    test_truncating_sink sink;
+    mcp_test_sink_init(&sink.base);
+    sink.base.sink.send_chunk = test_truncating_send_chunk;
+    sink.path = path;
+    sink.chunks = 0;
+    sink.length = 0;
+    sink.ended = false;
+    snprintf(message, sizeof(message),
+             "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"resources/read\",\"params\":{\"uri\":\"file://%s\"}}", path);
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, &sink.base.sink, NULL) == 0);
+    MCP_CHECK(mcp_test_sink_wait(&sink.base, 1, 5000));
+    MCP_CHECK(sink.ended);
+    MCP_CHECK(sink.chunks >= 2 && sink.length < TEST_LARGE_SIZE);
+    mcp_test_sink_destroy(&sink.base);
+
+    // The server goes on
+    cJSON* reply = test_read("a.txt");
+    MCP_CHECK(test_content(reply) != NULL);
+    cJSON_Delete(reply);
+}
+
+int main(void) {
+    // Installed before the resources install theirs
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = test_on_bus;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, NULL);
+
+    const char* directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    char base[200];
+    snprintf(base, sizeof(base), "%s/mcpc_test_resource_%d", directory, (int)getpid());
+    snprintf(g_root, sizeof(g_root), "%s/root", base);
+    char path[512];
+    MCP_CHECK(mkdir(base, 0700) == 0 && mkdir(g_root, 0700) == 0);
+    snprintf(path, sizeof(path), "%s/sub", g_root);
+    MCP_CHECK(mkdir(path, 0700) == 0);
+    test_write_file("a.txt", "line\n\"quoted\"\t\xc3\xa9", strlen("line\n\"quoted\"\t\xc3\xa9"));
+    test_write_file("empty.txt", "", 0);
+    test_write_file("bin.dat", "\x00\x01\x02\xff", 4);
+    test_write_file("bad.txt", "\xc3\x28", 2);
+    test_write_file("sub/b.json", "{\"k\":1}", 7);
+    test_write_file(".hidden", "secret", 6);
+    snprintf(path, sizeof(path), "%s/outside.txt", base);
+    FILE* outside = fopen(path, "w");
+    MCP_CHECK(outside != NULL);
+    if (outside != NULL) {
+        fclose(outside);
+    }
+    snprintf(path, sizeof(path), "%s/link.txt", g_root);
+    MCP_CHECK(symlink("a.txt", path) == 0);
+    // Resolved without the symlink the temporary directory may sit behind
+    char* resolved = realpath(g_root, NULL);
+    MCP_CHECK(resolved != NULL);
+    setenv(MCP_RESOURCE_ROOT_ENV, resolved != NULL ? resolved : g_root, 1);
+    snprintf(g_root, sizeof(g_root), "%s", resolved != NULL ? resolved : g_root);
+    free(resolved);
+
+    mcp_test_sink_init(&g_sink);
+    if (mcp_pool_init(&g_pool, 2) != 0) {
+        return 1;
+    }
+    MCP_CHECK(mcp_resource_enabled());
+    test_list();
+    test_reads();
+    test_not_found();
+    test_truncated();
+    // Not from a resource mapping: passed on, and the process lives
+    raise(SIGBUS);
+    MCP_CHECK(g_foreign_bus == 1);
+    mcp_pool_shutdown(&g_pool);
+    mcp_test_sink_destroy(&g_sink);
+
+    char command[600];
+    snprintf(command, sizeof(command), "rm -rf '%s'", base);
+    MCP_CHECK(system(command) == 0);
+    return MCP_TEST_RESULT();
+}
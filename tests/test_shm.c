@@ -0,0 +1,193 @@
+// The shared-memory transport, with rings at their smallest: messages split
+// into pieces both ways, requests and replies many times a ring that the
+// other side has to drain meanwhile, replies in completion order, a session
+// per client, and a client dropped for a corrupt record
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mcp_shm.h"
+#include "mcp_shm_ring.h"
+#include "mcp_test.h"
+#include "mcp_test_net.h"
+
+static char g_path[108];
+
+static void test_connect(mcp_shm_channel* channel) {
+    MCP_CHECK(mcp_shm_connect(g_path, channel) == 0);
+    MCP_CHECK(channel->ring_size == MCP_SHM_MIN_RING_SIZE);
+}
+
+// Writes the whole message, waiting for the server to make room as it goes
+static bool test_send(mcp_shm_channel* channel, const char* message) {
+    mcp_shm_ring* ring = &channel->header->requests;
+    size_t sent = 0;
+    for (;;) {
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        bool done = mcp_shm_ring_send(ring, channel->requests, channel->ring_size, message, strlen(message), &sent);
+        mcp_shm_wake(&ring->consumer_waiting, channel->server_wake);
+        if (done) {
+            return true;
+        }
+        // Full: the server wakes us once it takes some, unless it did so before the flag went up
+        mcp_shm_sleep_on(&ring->producer_waiting);
+        if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail &&
+            mcp_shm_wait(channel, MCP_TEST_TIMEOUT_SECONDS * 1000) <= 0) {
+            return false;
+        }
+    }
+}
+
+// The next reply, put together from its pieces; NULL when none comes
+static char* test_read(mcp_shm_channel* channel) {
+    mcp_shm_ring* ring = &channel->header->replies;
+    char* reply = NULL;
+    size_t length = 0;
+    for (;;) {
+        const char* bytes;
+        size_t piece;
+        uint32_t kind;
+        size_t consumed;
+        int ret = mcp_shm_ring_peek(ring, channel->replies, channel->ring_size, &bytes, &piece, &kind, &consumed);
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            mcp_shm_sleep_on(&ring->consumer_waiting);
+            if (mcp_shm_ring_empty(ring) && mcp_shm_wait(channel, MCP_TEST_TIMEOUT_SECONDS * 1000) <= 0) {
+                break;
+            }
+            continue;
+        }
+        reply = (char*)realloc(reply, length + piece + 1);
+        memcpy(reply + length, bytes, piece);
+        length += piece;
+        reply[length] = '\0';
+        mcp_shm_ring_release(ring, consumed);
+        mcp_shm_wake(&ring->producer_waiting, channel->server_wake);
+        if (kind == MCP_SHM_RECORD_MESSAGE) {
+            return reply;
+        }
+    }
+    free(reply);
+    return NULL;
+}
+
+static void test_expect(mcp_shm_channel* channel, const char* expected) {
+    char* reply = test_read(channel);
+    MCP_CHECK_STRING(reply, expected);
+    free(reply);
+}
+
+// An echo request whose params carry `size` bytes of filler, or the reply it gets
+static char* test_echo_message(int id, size_t size, bool reply) {
+    char* text = (char*)malloc(size + 128);
+    int head = reply ? snprintf(text, 128, "{\"result\":{\"v\":\"") :
+                       snprintf(text, 128, "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"echo\",\"params\":{\"v\":\"", id);
+    for (size_t i = 0; i < size; ++i) {
+        text[head + i] = (char)('a' + (i + (size_t)id) % 26);
+    }
+    if (reply) {
+        snprintf(text + head + size, 128, "\"},\"id\":%d,\"jsonrpc\":\"2.0\"}", id);
+    } else {
+        snprintf(text + head + size, 128, "\"}}");
+    }
+    return text;
+}
+
+static void test_messages(void) {
+    mcp_shm_channel channel;
+    test_connect(&channel);
+    MCP_CHECK(test_send(&channel, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"v\":1}}"));
+    test_expect(&channel, "{\"result\":{\"v\":1},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    // A notification is answered with nothing
+    MCP_CHECK(test_send(&channel, "{\"jsonrpc\":\"2.0\",\"method\":\"echo\",\"params\":{}}"));
+    MCP_CHECK(test_send(&channel, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}"));
+    test_expect(&channel, "{\"result\":{},\"id\":2,\"jsonrpc\":\"2.0\"}");
+
+    // Ten rings' worth each way
+    const size_t size = 10 * MCP_SHM_MIN_RING_SIZE;
+    char* message = test_echo_message(3, size, false);
+    char* expected = test_echo_message(3, size, true);
+    MCP_CHECK(test_send(&channel, message));
+    test_expect(&channel, expected);
+    free(expected);
+    free(message);
+    mcp_shm_channel_close(&channel);
+}
+
+// Requests of one client run concurrently: the quick one is answered first
+static void test_completion_order(void) {
+    mcp_shm_channel channel;
+    test_connect(&channel);
+    MCP_CHECK(test_send(&channel, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"sleep\",\"params\":{\"ms\":100}}"));
+    MCP_CHECK(test_send(&channel, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}"));
+    test_expect(&channel, "{\"result\":{},\"id\":2,\"jsonrpc\":\"2.0\"}");
+    test_expect(&channel, "{\"result\":{\"ms\":100},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    mcp_shm_channel_close(&channel);
+}
+
+static void test_sessions(void) {
+    static const char call[] = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialized\"}";
+    mcp_shm_channel a;
+    mcp_shm_channel b;
+    test_connect(&a);
+    test_connect(&b);
+    MCP_CHECK(test_send(&a, call));
+    test_expect(&a, "{\"result\":{\"was\":false},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK(test_send(&a, call));
+    test_expect(&a, "{\"result\":{\"was\":true},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK(test_send(&b, call));
+    test_expect(&b, "{\"result\":{\"was\":false},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    mcp_shm_channel_close(&a);
+    mcp_shm_channel_close(&b);
+}
+
+// A record claiming more than was published: the server hangs up on the client, and only on it
+static void test_corrupt_record(void) {
+    mcp_shm_channel bad;
+    mcp_shm_channel good;
+    test_connect(&bad);
+    test_connect(&good);
+    mcp_shm_ring* ring = &bad.header->requests;
+    mcp_shm_record* record = (mcp_shm_record*)(bad.requests + (ring->head & (bad.ring_size - 1)));
+    record->length = (uint32_t)bad.ring_size;
+    record->kind = MCP_SHM_RECORD_MESSAGE;
+    __atomic_store_n(&ring->head, ring->head + sizeof(mcp_shm_record), __ATOMIC_SEQ_CST);
+    mcp_shm_wake(&ring->consumer_waiting, bad.server_wake);
+    int woken;
+    while ((woken = mcp_shm_wait(&bad, MCP_TEST_TIMEOUT_SECONDS * 1000)) == 1) {
+    }
+    MCP_CHECK(woken == -1);
+    mcp_shm_channel_close(&bad);
+
+    MCP_CHECK(test_send(&good, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{}}"));
+    test_expect(&good, "{\"result\":{},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    mcp_shm_channel_close(&good);
+}
+
+int main(void) {
+    static mcp_test_net server;
+    // Concurrent requests need workers to run on, however few CPUs there are
+    setenv(MCP_WORKERS_ENV, "4", 1);
+    setenv(MCP_SHM_RING_ENV, "1", 1);
+    if (mcp_net_init(&server.net) != 0) {
+        return MCP_TEST_SKIPPED;
+    }
+    const char* directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(g_path, sizeof(g_path), "%s/mcpc_test_shm_%d.sock", directory, (int)getpid());
+    if (mcp_shm_listen(&server.net, g_path) != 0) {
+        mcp_net_shutdown(&server.net);
+        return MCP_TEST_SKIPPED;
+    }
+    MCP_CHECK(mcp_test_net_start(&server) == 0);
+
+    test_messages();
+    test_completion_order();
+    test_sessions();
+    test_corrupt_record();
+
+    MCP_CHECK(mcp_test_net_stop(&server) == 0);
+    return MCP_TEST_RESULT();
+}
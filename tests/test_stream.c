@@ -0,0 +1,309 @@
+// Streamed results (EXPORT_STREAM_AS): a large reply goes to the transport
+// in chunks while a small one, a batch and a transport without chunks get it
+// whole, a stream can still fail before its first chunk, and a handler stops
+// early once the client is gone. Then the gate of a streaming connection:
+// one stream at a time, a bounded window, and closing it. Last, a streamed
+// reply and another one sharing a Unix socket connection arrive intact.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "cJSON.h"
+#include "mcp_dispatch.h"
+#include "mcp_pool.h"
+#include "mcp_stream.h"
+#include "mcp_thread.h"
+#include "mcp_unix.h"
+#include "mcp_test.h"
+#include "mcp_test_net.h"
+#include "mcp_test_sink.h"
+
+// Bytes of each string the "stream" tool of tests/test_bridge.c writes
+#define TEST_PART_SIZE 1024
+
+// Also takes chunks, and puts them together
+typedef struct test_chunk_sink {
+    mcp_test_sink base;
+    char* text;
+    size_t length;
+    unsigned chunks;
+    bool in_order;         // Only the first chunk was flagged first, only the last one last
+    bool ended;
+    unsigned accepted;     // Chunks taken before the client is gone, 0 for all of them
+} test_chunk_sink;
+
+static int test_chunk_sink_send_chunk(mcp_sink* sink, char* chunk, size_t length, bool first, bool last) {
+    test_chunk_sink* test = (test_chunk_sink*)sink;
+    mcp_mutex_lock(&test->base.lock);
+    test->in_order = test->in_order && first == (test->chunks == 0) && !test->ended;
+    test->chunks++;
+    test->ended = last;
+    test->text = (char*)realloc(test->text, test->length + length + 1);
+    memcpy(test->text + test->length, chunk, length);
+    test->length += length;
+    test->text[test->length] = '\0';
+    bool gone = test->accepted != 0 && test->chunks > test->accepted;
+    mcp_mutex_unlock(&test->base.lock);
+    free(chunk);
+    return gone ? -1 : 0;
+}
+
+static void test_chunk_sink_reset(test_chunk_sink* test, unsigned accepted) {
+    mcp_test_sink_reset(&test->base);
+    free(test->text);
+    test->text = NULL;
+    test->length = 0;
+    test->chunks = 0;
+    test->in_order = true;
+    test->ended = false;
+    test->accepted = accepted;
+}
+
+static mcp_pool g_pool;
+static test_chunk_sink g_sink;
+static mcp_test_sink g_whole_sink;
+static char g_path[108];
+
+static void test_submit(const char* message, mcp_sink* sink) {
+    cJSON* json = cJSON_Parse(message);
+    MCP_CHECK(json != NULL);
+    MCP_CHECK(json != NULL && mcp_dispatch_submit(&g_pool, json, strlen(message), NULL, sink, NULL) == 0);
+}
+
+// The reply of the "stream" tool to request `id` with `parts` parts
+static char* test_expected(int id, int parts) {
+    char* text = (char*)malloc((size_t)parts * (TEST_PART_SIZE + 3) + 128);
+    size_t length = (size_t)sprintf(text, "{\"result\":{\"parts\":[");
+    for (int i = 0; i < parts; ++i) {
+        text[length++] = i > 0 ? ',' : '"';
+        if (i > 0) {
+            text[length++] = '"';
+        }
+        memset(text + length, 'x', TEST_PART_SIZE);
+        length += TEST_PART_SIZE;
+        text[length++] = '"';
+    }
+    sprintf(text + length, "]},\"id\":%d,\"jsonrpc\":\"2.0\"}", id);
+    return text;
+}
+
+static void test_stream_call(int id, int parts, mcp_sink* sink) {
+    char message[128];
+    snprintf(message, sizeof(message), "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"stream\",\"params\":{\"parts\":%d}}", id,
+             parts);
+    test_submit(message, sink);
+}
+
+// Fits one chunk: answered like any other result
+static void test_small(void) {
+    test_chunk_sink_reset(&g_sink, 0);
+    test_stream_call(1, 2, &g_sink.base.sink);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink.base, 1, 2000));
+    char* expected = test_expected(1, 2);
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink.base, 0), expected);
+    MCP_CHECK(g_sink.chunks == 0);
+    free(expected);
+}
+
+static void test_chunked(void) {
+    test_chunk_sink_reset(&g_sink, 0);
+    test_stream_call(2, 300, &g_sink.base.sink);
+    // The call still finishes with a send, which has nothing left to reply
+    MCP_CHECK(mcp_test_sink_wait(&g_sink.base, 1, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink.base, 0), "(no reply)");
+    char* expected = test_expected(2, 300);
+    MCP_CHECK(g_sink.chunks >= 300 * TEST_PART_SIZE / MCP_STREAM_CHUNK_SIZE);
+    MCP_CHECK(g_sink.in_order && g_sink.ended);
+    MCP_CHECK(g_sink.text != NULL && strcmp(g_sink.text, expected) == 0);
+    free(expected);
+}
+
+// A transport without chunks, and a request inside a batch, get the reply whole
+static void test_buffered(void) {
+    char* expected = test_expected(3, 300);
+    mcp_test_sink_reset(&g_whole_sink);
+    test_stream_call(3, 300, &g_whole_sink.sink);
+    MCP_CHECK(mcp_test_sink_wait(&g_whole_sink, 1, 2000));
+    MCP_CHECK(strcmp(mcp_test_sink_reply(&g_whole_sink, 0), expected) == 0);
+    free(expected);
+
+    test_chunk_sink_reset(&g_sink, 0);
+    test_submit("[{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"stream\",\"params\":{\"parts\":100}}]", &g_sink.base.sink);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink.base, 1, 2000));
+    expected = test_expected(4, 100);
+    const char* reply = mcp_test_sink_reply(&g_sink.base, 0);
+    size_t length = strlen(expected);
+    MCP_CHECK(reply[0] == '[' && strncmp(reply + 1, expected, length) == 0 && strcmp(reply + 1 + length, "]") == 0);
+    MCP_CHECK(g_sink.chunks == 0);
+    free(expected);
+}
+
+static void test_refused(void) {
+    test_chunk_sink_reset(&g_sink, 0);
+    test_submit("{\"jsonrpc\":\"2.0\",\"id\":5,\"method\":\"stream\",\"params\":{\"refuse\":true}}", &g_sink.base.sink);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink.base, 1, 2000));
+    MCP_CHECK_STRING(mcp_test_sink_reply(&g_sink.base, 0),
+                     "{\"error\":{\"code\":-32602,\"message\":\"Refused\"},\"id\":5,\"jsonrpc\":\"2.0\"}");
+    MCP_CHECK(g_sink.chunks == 0);
+}
+
+// The client goes away after the first chunk: the handler stops writing, and
+// the last piece still goes so the transport lets go of the connection
+static void test_client_gone(void) {
+    test_chunk_sink_reset(&g_sink, 1);
+    test_stream_call(6, 100 * 1024, &g_sink.base.sink);
+    MCP_CHECK(mcp_test_sink_wait(&g_sink.base, 1, 5000));
+    MCP_CHECK(g_sink.in_order && g_sink.ended);
+    MCP_CHECK(g_sink.chunks <= 3);
+}
+
+typedef struct test_entrant {
+    mcp_stream_gate* gate;
+    size_t length;
+    bool first;
+    volatile long entered;  // 1 once in, -1 when refused
+} test_entrant;
+
+static void* test_enter(void* arg) {
+    test_entrant* entrant = (test_entrant*)arg;
+    int ret = mcp_stream_gate_enter(entrant->gate, entrant->length, entrant->first);
+    mcp_atomic_add(&entrant->entered, ret == 0 ? 1 : -1);
+    return NULL;
+}
+
+// Starts `entrant` on a thread of its own and tells whether it is still waiting a little later
+static bool test_waits(test_entrant* entrant, mcp_thread_t* thread) {
+    MCP_CHECK(mcp_thread_create(thread, test_enter, entrant) == 0);
+    mcp_sleep_ms(30);
+    return mcp_atomic_load(&entrant->entered) == 0;
+}
+
+static void test_gate(void) {
+    mcp_stream_gate gate;
+    mcp_thread_t thread;
+    mcp_stream_gate_init(&gate);
+
+    // A second stream waits for the first to end
+    MCP_CHECK(mcp_stream_gate_enter(&gate, 100, true) == 0);
+    test_entrant second = { &gate, 100, true, 0 };
+    MCP_CHECK(test_waits(&second, &thread));
+    MCP_CHECK(mcp_stream_gate_enter(&gate, 100, false) == 0);
+    mcp_stream_gate_leave(&gate);
+    mcp_thread_join(thread);
+    MCP_CHECK(mcp_atomic_load(&second.entered) == 1);
+    mcp_stream_gate_written(&gate, 300);
+
+    // A full window holds the next piece until the transport wrote some
+    MCP_CHECK(mcp_stream_gate_enter(&gate, MCP_STREAM_WINDOW - 100, false) == 0);
+    test_entrant piece = { &gate, 200, false, 0 };
+    MCP_CHECK(test_waits(&piece, &thread));
+    mcp_stream_gate_written(&gate, 100);
+    mcp_thread_join(thread);
+    MCP_CHECK(mcp_atomic_load(&piece.entered) == 1);
+    mcp_stream_gate_written(&gate, MCP_STREAM_WINDOW);
+    // Larger than the window, but nothing else is waiting to be written
+    MCP_CHECK(mcp_stream_gate_enter(&gate, 2 * MCP_STREAM_WINDOW, false) == 0);
+
+    // Closing fails the waiters and everyone after them
+    test_entrant third = { &gate, 100, true, 0 };
+    MCP_CHECK(test_waits(&third, &thread));
+    mcp_stream_gate_close(&gate);
+    mcp_thread_join(thread);
+    MCP_CHECK(mcp_atomic_load(&third.entered) == -1);
+    MCP_CHECK(mcp_stream_gate_enter(&gate, 1, false) == -1);
+    mcp_stream_gate_leave(&gate);
+    mcp_stream_gate_destroy(&gate);
+}
+
+// Reads the next line off the connection into `line`, which grows as needed
+static bool test_read_line(int fd, char** line, size_t* capacity, size_t* pending) {
+    char* newline;
+    while ((newline = *pending > 0 ? (char*)memchr(*line, '\n', *pending) : NULL) == NULL) {
+        if (*pending + 64 * 1024 + 1 > *capacity) {
+            *capacity = 2 * (*pending + 64 * 1024 + 1);
+            *line = (char*)realloc(*line, *capacity);
+        }
+        ssize_t n = recv(fd, *line + *pending, 64 * 1024, 0);
+        if (n <= 0) {
+            return false;
+        }
+        *pending += (size_t)n;
+    }
+    *newline = '\0';
+    return true;
+}
+
+// A streamed reply holds its connection: the other reply comes before or after it, whole
+static void test_unix(void) {
+    static const char messages[] = "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"stream\",\"params\":{\"parts\":600}}\n"
+                                   "{\"jsonrpc\":\"2.0\",\"id\":8,\"method\":\"echo\",\"params\":{}}\n";
+    static const char echo[] = "{\"result\":{},\"id\":8,\"jsonrpc\":\"2.0\"}";
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", g_path);
+    MCP_CHECK(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+    mcp_test_socket_timeout(fd);
+    MCP_CHECK(mcp_test_send_all(fd, messages, strlen(messages)));
+
+    char* expected = test_expected(7, 600);
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t pending = 0;
+    bool streamed = false;
+    bool echoed = false;
+    for (int i = 0; i < 2; ++i) {
+        MCP_CHECK(test_read_line(fd, &line, &capacity, &pending));
+        if (line == NULL || strlen(line) >= pending) {
+            break;
+        }
+        streamed = streamed || strcmp(line, expected) == 0;
+        echoed = echoed || strcmp(line, echo) == 0;
+        size_t used = strlen(line) + 1;
+        memmove(line, line + used, pending - used);
+        pending -= used;
+    }
+    MCP_CHECK(streamed && echoed);
+    free(line);
+    free(expected);
+    close(fd);
+}
+
+int main(void) {
+    static mcp_test_net server;
+    // Concurrent requests need workers to run on, however few CPUs there are
+    setenv(MCP_WORKERS_ENV, "4", 1);
+    mcp_test_sink_init(&g_sink.base);
+    g_sink.base.sink.send_chunk = test_chunk_sink_send_chunk;
+    mcp_test_sink_init(&g_whole_sink);
+    if (mcp_pool_init(&g_pool, 4) != 0) {
+        return 1;
+    }
+    test_small();
+    test_chunked();
+    test_buffered();
+    test_refused();
+    test_client_gone();
+    mcp_pool_shutdown(&g_pool);
+    mcp_dispatch_drain_calls(false);
+    test_chunk_sink_reset(&g_sink, 0);
+    mcp_test_sink_destroy(&g_sink.base);
+    mcp_test_sink_destroy(&g_whole_sink);
+
+    test_gate();
+
+    if (mcp_net_init(&server.net) != 0) {
+        return MCP_TEST_RESULT();
+    }
+    const char* directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(g_path, sizeof(g_path), "%s/mcpc_test_stream_%d.sock", directory, (int)getpid());
+    MCP_CHECK(mcp_unix_listen(&server.net, g_path) == 0);
+    MCP_CHECK(mcp_test_net_start(&server) == 0);
+    test_unix();
+    MCP_CHECK(mcp_test_net_stop(&server) == 0);
+    return MCP_TEST_RESULT();
+}
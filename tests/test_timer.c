@@ -0,0 +1,115 @@
+// mcp_timer_wheel: timers on every level are cascaded down and fire on
+// time, never before their delay, and cancelled ones never fire. The test
+// moves the wheel's clock by shifting its origin back one tick at a time,
+// so a day of timers runs in well under a second
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mcp_timer.h"
+#include "mcp_test.h"
+
+typedef struct test_timer {
+    mcp_timer timer;
+    unsigned delay_ms;
+    uint64_t added_ms;  // Wheel time when it was armed
+    uint64_t fired_ms;  // Wheel time when it fired
+    int fired;
+} test_timer;
+
+static mcp_timer_wheel g_wheel = MCP_TIMER_WHEEL_INITIALIZER;
+
+// Milliseconds since the wheel's tick 0, as the wheel itself counts them
+static uint64_t test_wheel_time(void) {
+    return mcp_timer_now_ms() - g_wheel.origin;
+}
+
+static void test_timer_fire(mcp_timer* timer) {
+    test_timer* test = (test_timer*)((char*)timer - offsetof(test_timer, timer));
+    test->fired++;
+    test->fired_ms = test_wheel_time();
+}
+
+static void test_timer_add(test_timer* test, unsigned delay_ms) {
+    test->timer.fire = test_timer_fire;
+    test->delay_ms = delay_ms;
+    test->fired = 0;
+    mcp_timer_add(&g_wheel, &test->timer, delay_ms);
+    test->added_ms = test_wheel_time();
+}
+
+// Moves the wheel's clock one tick on and lets it catch up
+static void test_wheel_step(void) {
+    g_wheel.origin -= MCP_TIMER_TICK_MS;
+    mcp_timer_wheel_advance(&g_wheel);
+}
+
+// Fired exactly once, not before its delay and at most two ticks after it
+static void test_timer_check(const test_timer* test) {
+    MCP_CHECK(test->fired == 1);
+    if (test->fired != 1) {
+        fprintf(stderr, "    timer of %u ms fired %d times\n", test->delay_ms, test->fired);
+        return;
+    }
+    uint64_t due = test->added_ms + test->delay_ms;
+    MCP_CHECK(test->fired_ms >= due);
+    MCP_CHECK(test->fired_ms <= due + 2 * MCP_TIMER_TICK_MS);
+    if (test->fired_ms < due || test->fired_ms > due + 2 * MCP_TIMER_TICK_MS) {
+        fprintf(stderr, "    timer of %u ms armed at %llu fired at %llu\n", test->delay_ms,
+                (unsigned long long)test->added_ms, (unsigned long long)test->fired_ms);
+    }
+}
+
+int main(void) {
+    // Delays around the spans of levels 0 to 3 (64, 64^2 and 64^3 ticks)
+    static const unsigned delays[] = {
+        1, 9, 10, 11, 630, 639, 640, 641, 650, 1000,
+        40950, 40959, 40960, 40961, 41000, 100000,
+        2621430, 2621440, 2621450, 2700000,
+    };
+    enum { DELAYS = sizeof(delays) / sizeof(delays[0]), LATE = 200 };
+    static test_timer timers[DELAYS];
+    static test_timer late[LATE];
+    test_timer cancelled_low;
+    test_timer cancelled_high;
+
+    for (size_t i = 0; i < DELAYS; ++i) {
+        test_timer_add(&timers[i], delays[i]);
+    }
+    test_timer_add(&cancelled_low, 500);
+    test_timer_add(&cancelled_high, 50000);
+    MCP_CHECK(mcp_timer_wheel_count(&g_wheel) == DELAYS + 2);
+    MCP_CHECK(mcp_timer_cancel(&g_wheel, &cancelled_low.timer));
+
+    // Timers armed later start from other slot offsets, so their cascades differ
+    size_t added = 0;
+    uint64_t steps = 0;
+    while (mcp_timer_wheel_count(&g_wheel) > 0 || added < LATE) {
+        if (added < LATE && steps % 3 == 0) {
+            test_timer_add(&late[added], (unsigned)(added * 7919 % 50000 + 1));
+            added++;
+        }
+        if (steps == 4500) {
+            // Cascaded from level 2 into level 1 at tick 4096
+            MCP_CHECK(mcp_timer_cancel(&g_wheel, &cancelled_high.timer));
+            MCP_CHECK(!mcp_timer_cancel(&g_wheel, &cancelled_high.timer));
+        }
+        test_wheel_step();
+        steps++;
+        MCP_CHECK(steps < 300000);
+        if (steps >= 300000) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < DELAYS; ++i) {
+        test_timer_check(&timers[i]);
+    }
+    for (size_t i = 0; i < LATE; ++i) {
+        test_timer_check(&late[i]);
+    }
+    MCP_CHECK(cancelled_low.fired == 0);
+    MCP_CHECK(cancelled_high.fired == 0);
+    // A fired timer is no longer pending
+    MCP_CHECK(!mcp_timer_cancel(&g_wheel, &timers[0].timer));
+    return MCP_TEST_RESULT();
+}
@@ -0,0 +1,153 @@
+// The Unix socket transport: newline-delimited messages split across writes
+// or sharing one, replies in completion order, a last message without a
+// newline before the client stops writing, a session per connection, and
+// the socket file it replaces, keeps and removes
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mcp_unix.h"
+#include "mcp_test.h"
+#include "mcp_test_net.h"
+
+static char g_path[108];
+
+static int test_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    MCP_CHECK(fd >= 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", g_path);
+    MCP_CHECK(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+    mcp_test_socket_timeout(fd);
+    return fd;
+}
+
+static void test_send(int fd, const char* text) {
+    MCP_CHECK(mcp_test_send_all(fd, text, strlen(text)));
+}
+
+// Reads up to the next newline; the connection's bytes after it stay in `pending`
+static void test_expect_line(int fd, char* pending, size_t size, const char* expected) {
+    char* newline = NULL;
+    size_t length = strlen(pending);
+    while ((newline = strchr(pending, '\n')) == NULL) {
+        ssize_t n = recv(fd, pending + length, size - 1 - length, 0);
+        MCP_CHECK(n > 0);
+        if (n <= 0) {
+            return;
+        }
+        length += (size_t)n;
+        pending[length] = '\0';
+    }
+    *newline = '\0';
+    MCP_CHECK_STRING(pending, expected);
+    memmove(pending, newline + 1, strlen(newline + 1) + 1);
+}
+
+static void test_framing(void) {
+    char pending[4096] = "";
+    int fd = test_connect();
+    // Split in the middle of a message, then two in one write
+    test_send(fd, "{\"jsonrpc\":\"2.0\",\"id\":1,\"met");
+    usleep(20 * 1000);
+    test_send(fd, "hod\":\"echo\",\"params\":{\"v\":1}}\n");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{\"v\":1},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    test_send(fd, "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{\"v\":2}}\r\n"
+                  "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"echo\",\"params\":{\"v\":3}}\n");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{\"v\":2},\"id\":2,\"jsonrpc\":\"2.0\"}");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{\"v\":3},\"id\":3,\"jsonrpc\":\"2.0\"}");
+    // A line that does not parse is dropped, and the connection goes on
+    test_send(fd, "{\"jsonrpc\":\n\n{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"echo\",\"params\":{}}\n");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{},\"id\":4,\"jsonrpc\":\"2.0\"}");
+    close(fd);
+}
+
+// Requests of one connection run concurrently: the quick one is answered first
+static void test_completion_order(void) {
+    char pending[4096] = "";
+    int fd = test_connect();
+    test_send(fd, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"sleep\",\"params\":{\"ms\":100}}\n"
+                  "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"echo\",\"params\":{}}\n");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{},\"id\":2,\"jsonrpc\":\"2.0\"}");
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{\"ms\":100},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    close(fd);
+}
+
+// A client that stops writing after a message without a newline still gets its reply
+static void test_half_close(void) {
+    char pending[4096] = "";
+    int fd = test_connect();
+    test_send(fd, "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"echo\",\"params\":{\"last\":true}}");
+    MCP_CHECK(shutdown(fd, SHUT_WR) == 0);
+    test_expect_line(fd, pending, sizeof(pending), "{\"result\":{\"last\":true},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    close(fd);
+}
+
+// Each connection is a client of its own, with its own initialize handshake
+static void test_sessions(void) {
+    static const char call[] = "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialized\"}\n";
+    char pending_a[1024] = "";
+    char pending_b[1024] = "";
+    int a = test_connect();
+    int b = test_connect();
+    test_send(a, call);
+    test_expect_line(a, pending_a, sizeof(pending_a), "{\"result\":{\"was\":false},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    test_send(a, call);
+    test_expect_line(a, pending_a, sizeof(pending_a), "{\"result\":{\"was\":true},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    test_send(b, call);
+    test_expect_line(b, pending_b, sizeof(pending_b), "{\"result\":{\"was\":false},\"id\":1,\"jsonrpc\":\"2.0\"}");
+    close(a);
+    close(b);
+}
+
+// A socket file left behind is replaced, a regular file never is
+static void test_stale_files(mcp_net* net) {
+    char path[108];
+    snprintf(path, sizeof(path), "%s.file", g_path);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    MCP_CHECK(fd >= 0);
+    close(fd);
+    MCP_CHECK(mcp_unix_listen(net, path) != 0);
+    struct stat info;
+    MCP_CHECK(lstat(path, &info) == 0 && S_ISREG(info.st_mode));
+    unlink(path);
+
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", g_path);
+    MCP_CHECK(bind(stale, (struct sockaddr*)&address, sizeof(address)) == 0);
+    close(stale);
+    MCP_CHECK(mcp_unix_listen(net, g_path) == 0);
+}
+
+int main(void) {
+    static mcp_test_net server;
+    // Concurrent requests need workers to run on, however few CPUs there are
+    setenv(MCP_WORKERS_ENV, "4", 1);
+    if (mcp_net_init(&server.net) != 0) {
+        return MCP_TEST_SKIPPED;
+    }
+    const char* directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(g_path, sizeof(g_path), "%s/mcpc_test_unix_%d.sock", directory, (int)getpid());
+    test_stale_files(&server.net);
+    MCP_CHECK(mcp_test_net_start(&server) == 0);
+
+    test_framing();
+    test_completion_order();
+    test_half_close();
+    test_sessions();
+
+    MCP_CHECK(mcp_test_net_stop(&server) == 0);
+    // Removed on shutdown
+    MCP_CHECK(access(g_path, F_OK) != 0);
+    return MCP_TEST_RESULT();
+}
@@ -0,0 +1,151 @@
+// The io_uring backend of the event loop, through the Unix socket transport:
+// messages larger than one provided buffer, more of them at once than there
+// are buffers, and replies too large for one send to a client that reads
+// slowly. Skipped where the kernel or MCPC_IO=epoll keeps the loop on epoll.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mcp_unix.h"
+#include "mcp_uring.h"
+#include "mcp_test.h"
+#include "mcp_test_net.h"
+
+static char g_path[108];
+
+static int test_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    MCP_CHECK(fd >= 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", g_path);
+    MCP_CHECK(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+    mcp_test_socket_timeout(fd);
+    return fd;
+}
+
+// An echo request whose params carry `size` bytes of filler, and the reply it gets
+static char* test_echo_message(int id, size_t size, bool reply) {
+    char* text = (char*)malloc(size + 128);
+    int head = reply ? snprintf(text, 128, "{\"result\":{\"v\":\"") :
+                       snprintf(text, 128, "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"echo\",\"params\":{\"v\":\"", id);
+    for (size_t i = 0; i < size; ++i) {
+        text[head + i] = (char)('a' + (i + (size_t)id) % 26);
+    }
+    if (reply) {
+        snprintf(text + head + size, 128, "\"},\"id\":%d,\"jsonrpc\":\"2.0\"}\n", id);
+    } else {
+        snprintf(text + head + size, 128, "\"}}\n");
+    }
+    return text;
+}
+
+// Reads the one reply the connection waits for; `pause_ms` after every
+// 256 KiB makes a slow client
+static char* test_read_line(int fd, unsigned pause_ms) {
+    size_t capacity = 64 * 1024;
+    size_t length = 0;
+    size_t paused = 0;
+    char* line = (char*)malloc(capacity);
+    for (;;) {
+        if (length + 16 * 1024 + 1 > capacity) {
+            capacity *= 2;
+            line = (char*)realloc(line, capacity);
+        }
+        ssize_t n = recv(fd, line + length, 16 * 1024, 0);
+        if (n <= 0) {
+            free(line);
+            return NULL;
+        }
+        length += (size_t)n;
+        if (line[length - 1] == '\n') {
+            line[length] = '\0';
+            return line;
+        }
+        if (pause_ms != 0 && length - paused >= 256 * 1024) {
+            paused = length;
+            mcp_sleep_ms(pause_ms);
+        }
+    }
+}
+
+static void test_expect_echo(int fd, int id, size_t size, unsigned pause_ms) {
+    char* expected = test_echo_message(id, size, true);
+    char* line = test_read_line(fd, pause_ms);
+    MCP_CHECK(line != NULL);
+    MCP_CHECK(line != NULL && strcmp(line, expected) == 0);
+    free(line);
+    free(expected);
+}
+
+// Larger than a provided buffer, so a message spans several receive completions
+static void test_large_message(void) {
+    int fd = test_connect();
+    char* message = test_echo_message(1, 5 * MCP_URING_BUFFER_SIZE / 2, false);
+    MCP_CHECK(mcp_test_send_all(fd, message, strlen(message)));
+    test_expect_echo(fd, 1, 5 * MCP_URING_BUFFER_SIZE / 2, 0);
+    free(message);
+    close(fd);
+}
+
+// Together the clients send more than the provided buffers hold
+static void test_buffers_exhausted(void) {
+    enum { CLIENTS = 16 };
+    const size_t size = MCP_URING_BUFFER_COUNT * MCP_URING_BUFFER_SIZE / 8;
+    int fds[CLIENTS];
+    char* message = test_echo_message(2, size, false);
+    for (int i = 0; i < CLIENTS; ++i) {
+        fds[i] = test_connect();
+    }
+    for (int i = 0; i < CLIENTS; ++i) {
+        MCP_CHECK(mcp_test_send_all(fds[i], message, strlen(message)));
+    }
+    for (int i = 0; i < CLIENTS; ++i) {
+        test_expect_echo(fds[i], 2, size, 0);
+        close(fds[i]);
+    }
+    free(message);
+}
+
+// A reply many times the socket buffer, to a client that reads slowly: sent in pieces
+static void test_slow_reader(void) {
+    const size_t size = 1024 * 1024;
+    int fd = test_connect();
+    char* message = test_echo_message(3, size, false);
+    MCP_CHECK(mcp_test_send_all(fd, message, strlen(message)));
+    test_expect_echo(fd, 3, size, 5);
+    // The connection is still in order afterwards
+    char* small = test_echo_message(4, 10, false);
+    MCP_CHECK(mcp_test_send_all(fd, small, strlen(small)));
+    test_expect_echo(fd, 4, 10, 0);
+    free(small);
+    free(message);
+    close(fd);
+}
+
+int main(void) {
+    static mcp_test_net server;
+    if (mcp_net_init(&server.net) != 0) {
+        return MCP_TEST_SKIPPED;
+    }
+    if (server.net.loop.uring == NULL) {
+        fprintf(stderr, "io_uring is not available, the loop runs on epoll\n");
+        mcp_net_shutdown(&server.net);
+        return MCP_TEST_SKIPPED;
+    }
+    const char* directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+    snprintf(g_path, sizeof(g_path), "%s/mcpc_test_uring_%d.sock", directory, (int)getpid());
+    MCP_CHECK(mcp_unix_listen(&server.net, g_path) == 0);
+    MCP_CHECK(mcp_test_net_start(&server) == 0);
+
+    test_large_message();
+    test_buffers_exhausted();
+    test_slow_reader();
+
+    MCP_CHECK(mcp_test_net_stop(&server) == 0);
+    return MCP_TEST_RESULT();
+}